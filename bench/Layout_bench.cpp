@@ -0,0 +1,358 @@
+/* bench/Layout_bench.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include <benchmark/benchmark.h>
+#include <iterator>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include "rcmreader.h"
+#include "rcmwriter.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+// Compares array of structs (-s) with struct of arrays (-a): loading the
+// object and walking it with the access patterns of typical consumers. Every
+// benchmark takes the vertex count as range(0) and the layout as range(1),
+// 0 for array of structs and 1 for struct of arrays.
+
+#define BENCH_LAYOUT_FILE "/tmp/123456layoutbench"
+
+static const unsigned short kLayoutFlags = HAS_POSITIONS | HAS_NORMALS | HAS_UV0 |
+                                           HAS_TAN_AND_BITAN | HAS_BONES;
+static const unsigned int kLayoutBones = 32;
+
+static const std::vector<int64_t> kVertexCounts = {1 << 10, 1 << 14, 1 << 17, 1 << 20};
+static const std::vector<int64_t> kLayouts = {0, 1};
+
+// counts the last level cache misses of this thread while enabled. Reports
+// nothing if perf events are not available (other systems, containers,
+// perf_event_paranoid).
+class CacheMissCounter {
+public:
+    CacheMissCounter() : fd(-1) {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~CacheMissCounter() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    void start() {
+#ifdef __linux__
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    // adds the misses per vertex since start() to the counters of state
+    void report(benchmark::State &state, uint64_t numVertices) {
+#ifdef __linux__
+        uint64_t misses = 0;
+        if (fd < 0) {
+            return;
+        }
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &misses, sizeof(misses)) == sizeof(misses) && state.iterations() > 0) {
+            state.counters["cache_misses/vertex"] =
+                    (double) misses / (state.iterations() * numVertices);
+        }
+#endif
+    }
+
+private:
+    int fd;
+};
+
+// sets the counters shared by all benchmarks: vertices and vertex data per
+// second and the time per vertex
+static void setProcessed(benchmark::State &state, uint64_t numVertices) {
+    state.SetItemsProcessed(state.iterations() * numVertices);
+    state.SetBytesProcessed(state.iterations() * numVertices * calcVertexSize(kLayoutFlags) *
+                            sizeof(float));
+    state.counters["time/vertex"] = benchmark::Counter((double) numVertices,
+            benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+// writes an unoptimized skinned model in the given layout and returns the file
+static std::vector<char> createFile(unsigned int numVertices, bool useStructOfArrays) {
+    Mesh *mesh = new Mesh();
+    mesh->flags = kLayoutFlags;
+    mesh->vertexSize = calcVertexSize(mesh->flags);
+    mesh->numVertices = numVertices;
+    mesh->numIndices = numVertices;
+    mesh->numTexCoords = 1;
+    mesh->vertices = new float[numVertices * mesh->vertexSize];
+    mesh->indices = new unsigned short[numVertices];
+    mesh->numBones = kLayoutBones;
+    mesh->bones = new BoneData[kLayoutBones]();
+    mesh->boneIndices = new unsigned char[numVertices * kMaxBoneInfluences];
+    mesh->boneWeights = new float[numVertices * kMaxBoneInfluences];
+    const float weights[] = {0.5f, 0.25f, 0.15f, 0.1f};
+    for (unsigned int i = 0; i < numVertices; i++) {
+        float *vertex = mesh->vertices + i * mesh->vertexSize;
+        for (unsigned int k = 0; k < mesh->vertexSize; k++) {
+            vertex[k] = sinf(i * 0.01f + k);
+        }
+        mesh->indices[i] = (unsigned short) i;
+        for (unsigned int k = 0; k < kMaxBoneInfluences; k++) {
+            mesh->boneIndices[i * kMaxBoneInfluences + k] = (i + k * 7) % kLayoutBones;
+            mesh->boneWeights[i * kMaxBoneInfluences + k] = weights[k];
+        }
+    }
+    for (unsigned int b = 0; b < kLayoutBones; b++) {
+        mesh->bones[b].nameHash = b;
+        for (unsigned int k = 0; k < 16; k += 5) {
+            mesh->bones[b].inverseBindMatrix[k] = 1.0f;
+        }
+    }
+    std::vector<Mesh*> meshes(1, mesh);
+    writeFile(BENCH_LAYOUT_FILE, &meshes, false, useStructOfArrays);
+    delete mesh;
+
+    std::ifstream in(BENCH_LAYOUT_FILE, std::ios::binary);
+    std::vector<char> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    unlink(BENCH_LAYOUT_FILE);
+    return file;
+}
+
+// one vertex attribute, element i starts at data + i * stride
+struct AttributeStream {
+    const float *data;
+    size_t stride;
+};
+
+// a model loaded for the consumers, the attributes point into file
+struct LayoutModel {
+    std::vector<char> file;
+    ObjectHeader header;
+    ObjectView view;
+    AttributeStream positions;
+    AttributeStream normals;
+    AttributeStream tangents;
+    AttributeStream bitangents;
+};
+
+static AttributeStream attributeStream(const LayoutModel &model, unsigned int array,
+        int offset) {
+    AttributeStream stream;
+    if (model.header.type == STRUCT_OF_ARRAYS) {
+        stream.data = model.view.vertices[array];
+        stream.stride = vertexArrayElementSize(array);
+    } else {
+        stream.data = model.view.vertices[POSITION_ARRAY] + offset;
+        stream.stride = calcVertexSize(model.header.vertexFlags);
+    }
+    return stream;
+}
+
+static void loadModel(unsigned int numVertices, bool useStructOfArrays, LayoutModel &model) {
+    model.file = createFile(numVertices, useStructOfArrays);
+    MemoryStream in(&model.file[0], model.file.size());
+    FileHeader fileHeader;
+    readFileHeader(in, &fileHeader);
+    readObjectHeader(in, &model.header);
+    readObjectView(in, &model.header, &model.view);
+    const uint16_t flags = model.header.vertexFlags;
+    model.positions = attributeStream(model, POSITION_ARRAY, positionOffset());
+    model.normals = attributeStream(model, NORMALS_ARRAY, normalsOffset());
+    model.tangents = attributeStream(model, TANGENT_ARRAY, tanOffset(flags));
+    model.bitangents = attributeStream(model, BITANGENT_ARRAY, bitanOffset(flags));
+}
+
+static void releaseModel(LayoutModel &model) {
+    delete[] (char*) model.view.allocation;
+}
+
+static void transformPoint(const float *m, const float *p, float *out) {
+    out[0] = m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12];
+    out[1] = m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13];
+    out[2] = m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14];
+}
+
+static void transformVector(const float *m, const float *v, float *out) {
+    out[0] = m[0] * v[0] + m[4] * v[1] + m[8] * v[2];
+    out[1] = m[1] * v[0] + m[5] * v[1] + m[9] * v[2];
+    out[2] = m[2] * v[0] + m[6] * v[1] + m[10] * v[2];
+}
+
+static void createMatrix(float angle, float *m) {
+    memset(m, 0, 16 * sizeof(float));
+    m[0] = cosf(angle);
+    m[2] = -sinf(angle);
+    m[5] = 1.0f;
+    m[8] = sinf(angle);
+    m[10] = cosf(angle);
+    m[12] = angle;
+    m[15] = 1.0f;
+}
+
+// readArrayOfStructs() or readStructOfArrays() from a file stream
+static void BM_loadStream(benchmark::State &state) {
+    const std::vector<char> file = createFile(state.range(0), state.range(1) != 0);
+    std::ofstream(BENCH_LAYOUT_FILE, std::ios::binary).write(&file[0], file.size());
+    std::ifstream in(BENCH_LAYOUT_FILE, std::ios::binary);
+    CacheMissCounter misses;
+    misses.start();
+    for (auto _ : state) {
+        in.seekg(0);
+        FileHeader *fileHeader = readFileHeader(in);
+        ObjectHeader *objHeader = readObjectHeader(in);
+        Bla *bla = objHeader->type == STRUCT_OF_ARRAYS ? readStructOfArrays(in, objHeader) :
+                                                          readArrayOfStructs(in, objHeader);
+        benchmark::DoNotOptimize(bla->vertices[0]);
+        for (unsigned int i = 0; i < kNumVertexArrays; i++) {
+            if (objHeader->type == STRUCT_OF_ARRAYS || i == 0) {
+                delete[] bla->vertices[i];
+            }
+        }
+        delete[] bla->vertices;
+        delete[] bla->indices;
+        delete bla;
+        delete objHeader;
+        delete fileHeader;
+    }
+    misses.report(state, state.range(0));
+    setProcessed(state, state.range(0));
+    unlink(BENCH_LAYOUT_FILE);
+}
+BENCHMARK(BM_loadStream)->ArgsProduct({kVertexCounts, kLayouts});
+
+// the zero copy path over a file in memory, as it would be mapped
+static void BM_loadView(benchmark::State &state) {
+    const std::vector<char> file = createFile(state.range(0), state.range(1) != 0);
+    CacheMissCounter misses;
+    misses.start();
+    for (auto _ : state) {
+        MemoryStream in(&file[0], file.size());
+        FileHeader fileHeader;
+        ObjectHeader objHeader;
+        ObjectView view;
+        readFileHeader(in, &fileHeader);
+        readObjectHeader(in, &objHeader);
+        readObjectView(in, &objHeader, &view);
+        benchmark::DoNotOptimize(view.vertices[0]);
+        delete[] (char*) view.allocation;
+    }
+    misses.report(state, state.range(0));
+    setProcessed(state, state.range(0));
+}
+BENCHMARK(BM_loadView)->ArgsProduct({kVertexCounts, kLayouts});
+
+// moves every position by one matrix, e.g. for a bounding volume update
+static void BM_transformPositions(benchmark::State &state) {
+    LayoutModel model;
+    loadModel(state.range(0), state.range(1) != 0, model);
+    const unsigned int numVertices = model.header.vertexCount;
+    std::vector<float> out(numVertices * 3);
+    float m[16];
+    createMatrix(0.3f, m);
+    CacheMissCounter misses;
+    misses.start();
+    for (auto _ : state) {
+        const float *p = model.positions.data;
+        for (unsigned int i = 0; i < numVertices; i++, p += model.positions.stride) {
+            transformPoint(m, p, &out[i * 3]);
+        }
+        benchmark::ClobberMemory();
+    }
+    misses.report(state, numVertices);
+    setProcessed(state, numVertices);
+    releaseModel(model);
+}
+BENCHMARK(BM_transformPositions)->ArgsProduct({kVertexCounts, kLayouts});
+
+// linear blend skinning of positions, normals and tangent frames with four
+// influences per vertex
+static void BM_skinVertices(benchmark::State &state) {
+    LayoutModel model;
+    loadModel(state.range(0), state.range(1) != 0, model);
+    const unsigned int numVertices = model.header.vertexCount;
+    std::vector<float> palette(kLayoutBones * 16);
+    for (unsigned int b = 0; b < kLayoutBones; b++) {
+        createMatrix(b * 0.1f, &palette[b * 16]);
+    }
+    std::vector<float> out(numVertices * 12);
+    CacheMissCounter misses;
+    misses.start();
+    for (auto _ : state) {
+        for (unsigned int i = 0; i < numVertices; i++) {
+            const uint8_t *bones = model.view.boneIndices + i * kMaxBoneInfluences;
+            const uint8_t *weights = model.view.boneWeights + i * kMaxBoneInfluences;
+            float m[16] = {0};
+            for (unsigned int k = 0; k < kMaxBoneInfluences; k++) {
+                const float *bone = &palette[bones[k] * 16];
+                const float weight = weights[k] * (1.0f / 255.0f);
+                for (unsigned int j = 0; j < 16; j++) {
+                    m[j] += bone[j] * weight;
+                }
+            }
+            float *o = &out[i * 12];
+            transformPoint(m, model.positions.data + i * model.positions.stride, o);
+            transformVector(m, model.normals.data + i * model.normals.stride, o + 3);
+            transformVector(m, model.tangents.data + i * model.tangents.stride, o + 6);
+            transformVector(m, model.bitangents.data + i * model.bitangents.stride, o + 9);
+        }
+        benchmark::ClobberMemory();
+    }
+    misses.report(state, numVertices);
+    setProcessed(state, numVertices);
+    releaseModel(model);
+}
+BENCHMARK(BM_skinVertices)->ArgsProduct({kVertexCounts, kLayouts});
+
+// diffuse term of a directional light, reads nothing but the normals
+static void BM_lightNormals(benchmark::State &state) {
+    LayoutModel model;
+    loadModel(state.range(0), state.range(1) != 0, model);
+    const unsigned int numVertices = model.header.vertexCount;
+    const float light[] = {0.267f, 0.802f, 0.535f};
+    std::vector<float> out(numVertices);
+    CacheMissCounter misses;
+    misses.start();
+    for (auto _ : state) {
+        const float *n = model.normals.data;
+        for (unsigned int i = 0; i < numVertices; i++, n += model.normals.stride) {
+            const float d = n[0] * light[0] + n[1] * light[1] + n[2] * light[2];
+            out[i] = d > 0.0f ? d : 0.0f;
+        }
+        benchmark::ClobberMemory();
+    }
+    misses.report(state, numVertices);
+    setProcessed(state, numVertices);
+    releaseModel(model);
+}
+BENCHMARK(BM_lightNormals)->ArgsProduct({kVertexCounts, kLayouts});
@@ -0,0 +1,126 @@
+/* bench/Reader_bench.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include <benchmark/benchmark.h>
+#include <iterator>
+#include <math.h>
+#include <unistd.h>
+#include "rcmreader.h"
+#include "rcmwriter.h"
+
+#define BENCH_READER_FILE "/tmp/123456readerbench"
+
+// writes a file with a single unoptimized array of structs object
+static std::vector<char> createFile(unsigned int numVertices) {
+    Mesh *mesh = new Mesh();
+    mesh->flags = HAS_POSITIONS | HAS_NORMALS | HAS_UV0;
+    mesh->vertexSize = calcVertexSize(mesh->flags);
+    mesh->numVertices = numVertices;
+    mesh->numIndices = numVertices;
+    mesh->vertices = new float[numVertices * mesh->vertexSize];
+    mesh->indices = new unsigned short[numVertices];
+    for (unsigned int i = 0; i < numVertices * mesh->vertexSize; i++) {
+        mesh->vertices[i] = (float) i;
+    }
+    for (unsigned int i = 0; i < numVertices; i++) {
+        mesh->indices[i] = i;
+    }
+    std::vector<Mesh*> meshes(1, mesh);
+    writeFile(BENCH_READER_FILE, &meshes, false, false);
+    delete mesh;
+
+    std::ifstream in(BENCH_READER_FILE, std::ios::binary);
+    return std::vector<char>((std::istreambuf_iterator<char>(in)),
+                             std::istreambuf_iterator<char>());
+}
+
+static void BM_readArrayOfStructsStream(benchmark::State &state) {
+    createFile(state.range(0));
+    std::ifstream in(BENCH_READER_FILE, std::ios::binary);
+    for (auto _ : state) {
+        in.seekg(0);
+        FileHeader *fileHeader = readFileHeader(in);
+        ObjectHeader *objHeader = readObjectHeader(in);
+        Bla *bla = readArrayOfStructs(in, objHeader);
+        benchmark::DoNotOptimize(bla->vertices[0]);
+        delete[] bla->vertices[0];
+        delete[] bla->vertices;
+        delete[] bla->indices;
+        delete bla;
+        delete objHeader;
+        delete fileHeader;
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    unlink(BENCH_READER_FILE);
+}
+BENCHMARK(BM_readArrayOfStructsStream)->Range(8, 8 << 10);
+
+static void BM_readObjectViewMemory(benchmark::State &state) {
+    std::vector<char> file = createFile(state.range(0));
+    unlink(BENCH_READER_FILE);
+    for (auto _ : state) {
+        MemoryStream in(&file[0], file.size());
+        FileHeader fileHeader;
+        ObjectHeader objHeader;
+        ObjectView view;
+        readFileHeader(in, &fileHeader);
+        readObjectHeader(in, &objHeader);
+        readObjectView(in, &objHeader, &view);
+        benchmark::DoNotOptimize(view.vertices[0]);
+        delete[] (char*) view.allocation;
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_readObjectViewMemory)->Range(8, 8 << 10);
+
+// plays a clip of range(0) tracks forward frame by frame
+static void BM_sampleAnimation(benchmark::State &state) {
+    const unsigned int numTracks = state.range(0);
+    Animation animation;
+    animation.nameHash = 0;
+    animation.duration = 4.0f;
+    animation.tracks.resize(numTracks);
+    for (unsigned int t = 0; t < numTracks; t++) {
+        AnimationTrack &track = animation.tracks[t];
+        track.nameHash = t;
+        for (unsigned int i = 0; i <= 120; i++) {
+            const float time = i / 30.0f;
+            const float angle = time * (1.0f + t * 0.1f);
+            VectorKey translation = {time, {time, sinf(angle), (float) t}};
+            RotationKey rotation = {time, {0.0f, sinf(angle * 0.5f), 0.0f, cosf(angle * 0.5f)}};
+            track.translations.push_back(translation);
+            track.rotations.push_back(rotation);
+        }
+    }
+    std::vector<uint8_t> data;
+    compressAnimation(animation, data);
+    AnimationView view;
+    openAnimation(&data[0], data.size(), &view);
+    std::vector<uint32_t> cursors(numTracks * kNumAnimationChannels, 0);
+    std::vector<NodeTransform> transforms(numTracks);
+    float time = 0.0f;
+    for (auto _ : state) {
+        sampleAnimation(view, time, &cursors[0], &transforms[0]);
+        benchmark::DoNotOptimize(transforms[0].rotation[3]);
+        time += 1.0f / 60.0f;
+        if (time > animation.duration) {
+            time = 0.0f;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * numTracks);
+}
+BENCHMARK(BM_sampleAnimation)->Range(8, 256);
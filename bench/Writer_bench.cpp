@@ -0,0 +1,207 @@
+/* bench/Writer_bench.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include <benchmark/benchmark.h>
+#include <math.h>
+#include <unistd.h>
+#include "internal/rcm_internal.h"
+#include "rcmgenerator.h"
+
+#define BENCH_WRITER_FILE "/tmp/123456writerbench"
+
+// vertex layouts the benchmarks run with, selected by range(1)
+enum BenchLayout {
+    LAYOUT_POSITIONS = 0,
+    // the usual layout of a textured model
+    LAYOUT_TEXTURED,
+    // normal mapped model with lightmap uvs and vertex colors
+    LAYOUT_FULL
+};
+
+static const std::vector<int64_t> kVertexCounts = {1000, 10000, 100000, 1000000, 10000000};
+// the sizes whose distinct vertices 16 bit indices can address
+static const std::vector<int64_t> kIndexedVertexCounts = {1000, 10000, 60000};
+static const std::vector<int64_t> kLayouts = {LAYOUT_POSITIONS, LAYOUT_TEXTURED, LAYOUT_FULL};
+
+// creates a grid of about numVertices vertices in the xz plane with two
+// triangles per cell. convertAiMesh() turns grids of more than 65536 vertices
+// into lists of corners, like rcmconvert does with such models.
+static aiMesh* createGrid(unsigned int numVertices, int layout) {
+    const unsigned int width = (unsigned int) ceil(sqrt((double) numVertices));
+    const unsigned int height = numVertices / width;
+    aiMesh *aimesh = new aiMesh();
+    aimesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+    aimesh->mNumVertices = width * height;
+    aimesh->mVertices = new aiVector3D[aimesh->mNumVertices];
+    if (layout >= LAYOUT_TEXTURED) {
+        aimesh->mNormals = new aiVector3D[aimesh->mNumVertices];
+        aimesh->mTextureCoords[0] = new aiVector3D[aimesh->mNumVertices];
+        aimesh->mNumUVComponents[0] = 2;
+    }
+    if (layout >= LAYOUT_FULL) {
+        aimesh->mTextureCoords[1] = new aiVector3D[aimesh->mNumVertices];
+        aimesh->mNumUVComponents[1] = 2;
+        aimesh->mColors[0] = new aiColor4D[aimesh->mNumVertices];
+        aimesh->mTangents = new aiVector3D[aimesh->mNumVertices];
+        aimesh->mBitangents = new aiVector3D[aimesh->mNumVertices];
+    }
+    for (unsigned int z = 0, i = 0; z < height; z++) {
+        for (unsigned int x = 0; x < width; x++, i++) {
+            const float u = (float) x / width;
+            const float v = (float) z / height;
+            aimesh->mVertices[i] = aiVector3D(x, sinf(u * 7.0f) * cosf(v * 5.0f), z);
+            if (aimesh->mNormals) {
+                aimesh->mNormals[i] = aiVector3D(0.0f, 1.0f, 0.0f);
+                aimesh->mTextureCoords[0][i] = aiVector3D(u, v, 0.0f);
+            }
+            if (aimesh->mTangents) {
+                aimesh->mTextureCoords[1][i] = aiVector3D(v, u, 0.0f);
+                aimesh->mColors[0][i] = aiColor4D(u, v, 0.5f, 1.0f);
+                aimesh->mTangents[i] = aiVector3D(1.0f, 0.0f, 0.0f);
+                aimesh->mBitangents[i] = aiVector3D(0.0f, 0.0f, 1.0f);
+            }
+        }
+    }
+    aimesh->mNumFaces = height > 1 ? 2 * (width - 1) * (height - 1) : 0;
+    aimesh->mFaces = new aiFace[aimesh->mNumFaces];
+    for (unsigned int z = 0, f = 0; z + 1 < height; z++) {
+        for (unsigned int x = 0; x + 1 < width; x++) {
+            const unsigned int corner = z * width + x;
+            const unsigned int triangles[2][3] = {
+                {corner, corner + width, corner + 1},
+                {corner + 1, corner + width, corner + width + 1}
+            };
+            for (unsigned int t = 0; t < 2; t++, f++) {
+                aiFace &face = aimesh->mFaces[f];
+                face.mNumIndices = 3;
+                face.mIndices = new unsigned int[3];
+                for (unsigned int k = 0; k < 3; k++) {
+                    face.mIndices[k] = triangles[t][k];
+                }
+            }
+        }
+    }
+    return aimesh;
+}
+
+static Mesh* createMesh(unsigned int numVertices, int layout) {
+    aiMesh *aimesh = createGrid(numVertices, layout);
+    Mesh *mesh = convertAiMesh(aimesh);
+    delete aimesh;
+    return mesh;
+}
+
+// reports vertices and bytes of vertex data per second, for lists of corners
+// every corner counts
+static void setProcessed(benchmark::State &state, const Mesh *mesh) {
+    state.SetItemsProcessed(state.iterations() * mesh->numVertices);
+    state.SetBytesProcessed(state.iterations() * mesh->numVertices * mesh->vertexSize *
+                            sizeof(float));
+}
+
+static void BM_convertAiMesh(benchmark::State &state) {
+    aiMesh *aimesh = createGrid(state.range(0), state.range(1));
+    for (auto _ : state) {
+        Mesh *mesh = convertAiMesh(aimesh);
+        benchmark::DoNotOptimize(mesh->vertices);
+        delete mesh;
+    }
+    Mesh *mesh = convertAiMesh(aimesh);
+    setProcessed(state, mesh);
+    delete mesh;
+    delete aimesh;
+}
+BENCHMARK(BM_convertAiMesh)->ArgsProduct({kVertexCounts, kLayouts})
+        ->Unit(benchmark::kMillisecond);
+
+static void BM_optimizeArrayOfStructs(benchmark::State &state) {
+    Mesh *mesh = createMesh(state.range(0), state.range(1));
+    for (auto _ : state) {
+        std::vector<unsigned short> indices;
+        std::vector<Vertex<float> > vertices;
+        optimizeArrayOfStructs(mesh->vertices, mesh->vertexSize, mesh->numVertices,
+                               indices, vertices);
+        benchmark::DoNotOptimize(vertices.data());
+    }
+    setProcessed(state, mesh);
+    delete mesh;
+}
+BENCHMARK(BM_optimizeArrayOfStructs)->ArgsProduct({kIndexedVertexCounts, kLayouts})
+        ->Unit(benchmark::kMillisecond);
+
+static void BM_convertArrayOfStructsToStructOfArrays(benchmark::State &state) {
+    Mesh *mesh = createMesh(state.range(0), state.range(1));
+    std::vector<unsigned short> indices;
+    std::vector<Vertex<float> > vertices;
+    optimizeArrayOfStructs(mesh->vertices, mesh->vertexSize, mesh->numVertices,
+                           indices, vertices);
+    for (auto _ : state) {
+        ObjectData *data = convertArrayOfStructsToStructOfArrays(vertices, mesh->flags,
+                                                                 mesh->vertexSize);
+        benchmark::DoNotOptimize(data->position.data());
+        delete data;
+    }
+    setProcessed(state, mesh);
+    delete mesh;
+}
+BENCHMARK(BM_convertArrayOfStructsToStructOfArrays)->ArgsProduct({kIndexedVertexCounts,
+                                                                   kLayouts})
+        ->Unit(benchmark::kMillisecond);
+
+// range(2) selects struct of arrays, the mesh is optimized on the way as
+// rcmconvert does by default
+static void BM_writeObject(benchmark::State &state) {
+    Mesh *mesh = createMesh(state.range(0), state.range(1));
+    std::ofstream out(BENCH_WRITER_FILE, std::ios::trunc | std::ios::binary);
+    for (auto _ : state) {
+        out.seekp(0);
+        writeObject(out, mesh, true, state.range(2) != 0);
+    }
+    out.close();
+    setProcessed(state, mesh);
+    delete mesh;
+    unlink(BENCH_WRITER_FILE);
+}
+BENCHMARK(BM_writeObject)->ArgsProduct({kVertexCounts, kLayouts, {0, 1}})
+        ->Unit(benchmark::kMillisecond);
+
+static void BM_writeFile(benchmark::State &state) {
+    std::vector<Mesh*> meshes(1, createMesh(state.range(0), state.range(1)));
+    for (auto _ : state) {
+        writeFile(BENCH_WRITER_FILE, &meshes, true, false);
+    }
+    setProcessed(state, meshes[0]);
+    delete meshes[0];
+    unlink(BENCH_WRITER_FILE);
+}
+BENCHMARK(BM_writeFile)->ArgsProduct({kVertexCounts, kLayouts})
+        ->Unit(benchmark::kMillisecond);
+
+// merging the corners of scanned surfaces, up to the largest scan whose
+// distinct vertices still fit 16 bit indices
+static void BM_createOptimizedMesh(benchmark::State &state) {
+    Mesh *mesh = generateMesh(GENERATE_SCAN, state.range(0), HAS_NORMALS | HAS_UV0, 1);
+    for (auto _ : state) {
+        Mesh *optimized = createOptimizedMesh(mesh);
+        benchmark::DoNotOptimize(optimized->indices);
+        delete optimized;
+    }
+    setProcessed(state, mesh);
+    delete mesh;
+}
+BENCHMARK(BM_createOptimizedMesh)->Arg(1000)->Arg(10000)->Arg(100000)->Arg(380000)
+        ->Unit(benchmark::kMillisecond);
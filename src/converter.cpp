@@ -15,29 +15,261 @@
  * limitations under the License.
  * */
 
+#include <atomic>
 #include <iostream>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
 #include <vector>
 #include <iomanip>
 
+#include "rcmanalyze.h"
+#include "rcmedit.h"
+#include "rcmpack.h"
 #include "rcmreader.h"
+#include "rcmstats.h"
+#include "rcmtrace.h"
+#include "rcmweld.h"
 #include "rcmwriter.h"
 
 #include "command_parser.h"
 
 static const char* kArraysOption = "-a";
+static const char* kSharedBuffersOption = "-b";
+static const char* kBvhOption = "-c";
+static const char* kDropOption = "-d";
+static const char* kMaterialsOption = "-e";
 static const char* kHalfFloatOption = "-f";
+static const char* kTexturesOption = "-g";
 static const char* kHelpOption = "-h";
 static const char* kDisplayInfoOption = "-i";
+static const char* kAnimationsOption = "-k";
+static const char* kMergeOption = "-m";
 static const char* kNoOptimizationOption = "-n";
 static const char* kOutputFileOption = "-o";
+static const char* kPackOption = "-p";
+static const char* kQuantizeMorphOption = "-q";
+static const char* kInstancesOption = "-r";
 static const char* kStructsOption = "-s";
+static const char* kTranscodeOption = "-t";
+static const char* kSortOption = "-u";
 static const char* kVerboseOption = "-v";
+static const char* kWeightsOption = "-w";
+static const char* kExtractOption = "-x";
+static const char* kStatsOption = "--stats";
+static const char* kStatsJsonOption = "--stats=json";
+static const char* kTraceOption = "--trace";
+static const char* kAnalyzeOption = "--analyze";
+static const char* kWeldOption = "--weld";
 
 static const char* kDefaultFileExtension = ".rcm";
+static const char* kDefaultPackExtension = ".rcmpack";
 
 static const int kFormatWidth = 17;
 static const int kInfoFormatWidth = 13;
 static const int kInfoDataFormatWidth = 12;
+static const int kAnalyzeColumnWidth = 11;
+
+// post transform cache sizes simulated by --analyze
+static const unsigned int kAnalyzedCacheSizes[] = {8, 16, 32, 64};
+
+static const char* kObjectTypeNames[] = {
+    "unknown", "struct of arrays", "array of structs", "draw ranges", "instances",
+    "animation", "morph targets", "bvh", "texture", "materials"
+};
+
+static const char* kVertexArrayNames[kNumVertexArrays] = {
+    "positions", "normals", "uvs0", "uvs1", "uvs2", "uvs3",
+    "color0", "color1", "color2", "color3", "tangents", "bitangents"
+};
+
+// every allocation of the process, including those of assimp, is counted
+// for the statistics
+static std::atomic<uint64_t> sAllocations(0);
+
+void* operator new(size_t size) {
+    sAllocations.fetch_add(1, std::memory_order_relaxed);
+    void *memory = malloc(size > 0 ? size : 1);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    free(memory);
+}
+
+static uint64_t countAllocations() {
+    return sAllocations.load(std::memory_order_relaxed);
+}
+
+static std::string fileStem(const std::string &path) {
+    size_t slashIndex = path.find_last_of('/');
+    std::string name = (slashIndex == std::string::npos) ? path : path.substr(slashIndex + 1);
+    return name.substr(0, name.find("."));
+}
+
+// parses a comma separated list of object indices and ranges, e.g. "0,3-5"
+static bool parseIndexList(const std::string &list, std::vector<unsigned int> &indices) {
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        unsigned int first = 0;
+        unsigned int last = 0;
+        char dash = 0;
+        std::stringstream itemStream(item);
+        if (!(itemStream >> first)) {
+            return false;
+        }
+        last = first;
+        if (itemStream >> dash) {
+            if (dash != '-' || !(itemStream >> last) || last < first) {
+                return false;
+            }
+        }
+        for (unsigned int i = first; i <= last; i++) {
+            indices.push_back(i);
+        }
+    }
+    return !indices.empty();
+}
+
+// how the meshes are stored, given by -w, -q, -c and --weld
+struct MeshOptions {
+    // 16 bit weights for skinned meshes
+    bool use16BitWeights;
+    // morph targets with 16 bit deltas
+    bool quantizeMorphTargets;
+    // a BVH after every mesh
+    bool storeBvh;
+    // merge vertices within weldTolerance
+    bool weld;
+    WeldTolerance weldTolerance;
+    // the vertices the weld merged so far
+    size_t weldedVertices;
+};
+
+// "POSITION,ANGLE,UV" of --weld
+static bool parseWeldTolerance(const std::string &text, WeldTolerance &tolerance) {
+    char rest;
+    if (sscanf(text.c_str(), "%f,%f,%f%c", &tolerance.position, &tolerance.normalAngle,
+               &tolerance.uv, &rest) != 3) {
+        return false;
+    }
+    return tolerance.position >= 0.0f && tolerance.normalAngle >= 0.0f && tolerance.uv >= 0.0f;
+}
+
+static void applyMeshOptions(Mesh *mesh, void *options) {
+    MeshOptions *meshOptions = (MeshOptions*) options;
+    if (meshOptions->weld) {
+        meshOptions->weldedVertices += weldVertices(mesh, meshOptions->weldTolerance);
+    }
+    if (meshOptions->use16BitWeights && hasBones(mesh->flags)) {
+        uint16_t flags = mesh->flags;
+        setUses16BitWeights(flags);
+        mesh->flags = flags;
+    }
+    if (meshOptions->quantizeMorphTargets) {
+        mesh->quantizeMorphTargets = true;
+    }
+    if (meshOptions->storeBvh) {
+        mesh->storeBvh = true;
+    }
+}
+
+static void applyMeshOptions(std::vector<Mesh*> &meshes, MeshOptions &options) {
+    for (size_t i = 0; i < meshes.size(); i++) {
+        applyMeshOptions(meshes[i], &options);
+    }
+}
+
+// the JSON statistics stay the only output
+static void displayWeldResult(const CommandParser &parser, const MeshOptions &options) {
+    if (options.weld && !parser.boolOption(kStatsJsonOption)) {
+        std::cout << "welded " << options.weldedVertices << " vertices" << std::endl;
+    }
+}
+
+// loads all input models and writes their meshes into a single pack. Every
+// mesh is named "<input file stem>/<mesh name>", the mesh index is used for
+// meshes without a name.
+bool createPack(const std::list<std::string> &inFiles, const std::string &outFile,
+        bool doOptimize, bool exportStructOfArrays, MeshOptions &options) {
+    std::vector<Mesh*> meshes;
+    std::vector<std::string> names;
+    std::map<std::string, bool> usedNames;
+    bool success = true;
+
+    std::list<std::string>::const_iterator it = inFiles.begin();
+    for (; it != inFiles.end() && success; ++it) {
+        std::vector<Mesh*> *fileMeshes = loadModel(it->c_str());
+        if (!fileMeshes) {
+            std::cerr << "model could not be loaded: " << *it << std::endl;
+            success = false;
+            break;
+        }
+        const std::string stem = fileStem(*it);
+        for (size_t i = 0; i < fileMeshes->size(); i++) {
+            Mesh *mesh = fileMeshes->at(i);
+            std::stringstream name;
+            name << stem << "/";
+            if (mesh->name[0]) {
+                name << mesh->name;
+            } else {
+                name << i;
+            }
+            if (usedNames.find(name.str()) != usedNames.end()) {
+                name << "#" << i;
+            }
+            usedNames[name.str()] = true;
+            names.push_back(name.str());
+            meshes.push_back(mesh);
+        }
+        delete fileMeshes;
+    }
+
+    applyMeshOptions(meshes, options);
+    if (success) {
+        success = writePackFile(outFile.c_str(), names, &meshes, doOptimize, exportStructOfArrays);
+    }
+    for (size_t i = 0; i < meshes.size(); i++) {
+        delete meshes[i];
+    }
+    return success;
+}
+
+bool displayPackInfo(const std::string &fileName) {
+    Pack *pack = openPack(fileName.c_str());
+    if (!pack) {
+        return false;
+    }
+    std::cout << std::endl << "pack: " << fileName << ":" << std::endl;
+    std::cout << std::left;
+    std::cout << "  " << std::setw(kInfoFormatWidth);
+    std::cout << "pack version" << ": " << (int) pack->header->version[0] << "."
+              << (int) pack->header->version[1] << std::endl;
+    std::cout << "  " << std::setw(kInfoFormatWidth);
+    std::cout << "object count" << ": " << pack->header->objectCount << std::endl << std::endl;
+    for (uint32_t i = 0; i < pack->header->objectCount; i++) {
+        const PackEntry *entry = &pack->entries[i];
+        std::cout << "    " << std::setw(kInfoDataFormatWidth * 3);
+        std::cout << packEntryName(pack, entry) << ": " << entry->objectSize << " bytes" << std::endl;
+    }
+    std::cout << std::right << std::endl;
+    closePack(pack);
+    return true;
+}
+
+static std::string formatVector(const float *vector) {
+    std::stringstream stream;
+    stream << "(" << vector[0] << ", " << vector[1] << ", " << vector[2] << ")";
+    return stream.str();
+}
 
 // TODO: enhance such that input files with multiple objects can be supported
 void readAndDisplayInfo(const std::string &fileName) {
@@ -50,6 +282,14 @@ void readAndDisplayInfo(const std::string &fileName) {
         }
 
         ObjectHeader* objectHeader = readObjectHeader(in);
+        // the material table precedes the models
+        uint32_t materialCount = 0;
+        if (objectHeader && objectHeader->type == MATERIALS) {
+            materialCount = asBlockHeader(objectHeader)->elementCount;
+            in.seekg(calcObjectDataSize(objectHeader), std::ios::cur);
+            delete objectHeader;
+            objectHeader = readObjectHeader(in);
+        }
         if (!objectHeader) {
             std::cerr << "could not read object header" << std::endl;
             return;
@@ -64,7 +304,9 @@ void readAndDisplayInfo(const std::string &fileName) {
         std::cout << "  " << std::setw(kInfoFormatWidth);
         std::cout << "file version" << ": " << majorVersion << "." << minorVersion << std::endl;
         std::cout << "  " << std::setw(kInfoFormatWidth);
-        std::cout << "object count" << ": " << objectCount << std::endl << std::endl;
+        std::cout << "object count" << ": " << objectCount << std::endl;
+        std::cout << "  " << std::setw(kInfoFormatWidth);
+        std::cout << "materials" << ": " << materialCount << std::endl << std::endl;
 
         delete fileHeader;
 
@@ -80,7 +322,20 @@ void readAndDisplayInfo(const std::string &fileName) {
         std::cout << "  " << std::setw(kInfoFormatWidth);
         std::cout << "vertex count" << ": " << objectHeader->vertexCount << std::endl;
         std::cout << "  " << std::setw(kInfoFormatWidth);
-        std::cout << "index count" << ": " << objectHeader->indexCount << std::endl << std::endl;
+        std::cout << "index count" << ": " << objectHeader->indexCount << std::endl;
+        std::cout << "  " << std::setw(kInfoFormatWidth);
+        std::cout << "bounds min" << ": " << formatVector(objectHeader->boundsMin) << std::endl;
+        std::cout << "  " << std::setw(kInfoFormatWidth);
+        std::cout << "bounds max" << ": " << formatVector(objectHeader->boundsMax) << std::endl;
+        std::cout << "  " << std::setw(kInfoFormatWidth);
+        std::cout << "sphere" << ": " << formatVector(objectHeader->sphereCenter)
+                  << " r " << objectHeader->sphereRadius << std::endl;
+        std::cout << "  " << std::setw(kInfoFormatWidth) << "material" << ": ";
+        if (objectHeader->materialIndex == kNoMaterial) {
+            std::cout << "none" << std::endl << std::endl;
+        } else {
+            std::cout << objectHeader->materialIndex << std::endl << std::endl;
+        }
 
 
         uint16_t vertexFlags = objectHeader->vertexFlags;
@@ -110,6 +365,14 @@ void readAndDisplayInfo(const std::string &fileName) {
 
         std::cout << "    " << std::setw(kInfoDataFormatWidth);
         std::cout << "tan & bitan" << ": " << (hasTanBitan(vertexFlags) ? "yes" : "no") << std::endl;
+        std::cout << "    " << std::setw(kInfoDataFormatWidth);
+        std::cout << "bones" << ": ";
+        if (hasBones(vertexFlags)) {
+            std::cout << objectHeader->boneCount << " (" << calcBoneWeightSize(vertexFlags) * 8
+                      << " bit weights)" << std::endl;
+        } else {
+            std::cout << "no" << std::endl;
+        }
         std::cout << std::right << std::endl;
 
         delete objectHeader;
@@ -119,18 +382,188 @@ void readAndDisplayInfo(const std::string &fileName) {
 
 }
 
+// prints the statistics and writes the trace if they were asked for, returns
+// the exit code of success
+static int finishReports(const CommandParser &parser, const ConvertStats &stats,
+        const std::string &inFile, const std::string &outFile, bool success) {
+    collectConvertStats(0);
+    if (parser.boolOption(kStatsJsonOption)) {
+        printConvertStatsJson(std::cout, stats, inFile, outFile);
+    } else if (parser.boolOption(kStatsOption)) {
+        printConvertStats(std::cout, stats);
+    }
+    const std::string traceFile = parser.valueOption(kTraceOption);
+    if (!traceFile.empty()) {
+        stopTrace();
+        success = writeTraceFile(traceFile.c_str()) && success;
+    }
+    return success ? 0 : 1;
+}
+
+static void displayModelAnalysis(const ObjectHeader *header, const ObjectBuffers &buffers) {
+    const uint16_t vertexFlags = header->vertexFlags;
+    const uint32_t numVertices = header->vertexCount;
+    // models without indices are lists of corners
+    const uint16_t *indices = header->indexCount > 0 ? buffers.indices : 0;
+    const uint32_t numIndices = header->indexCount > 0 ? header->indexCount : numVertices;
+
+    std::cout << "    " << std::setw(kInfoDataFormatWidth) << "vertices" << ": "
+              << numVertices << std::endl;
+    std::cout << "    " << std::setw(kInfoDataFormatWidth) << "triangles" << ": "
+              << numIndices / 3 << std::endl;
+
+    std::cout << "    " << std::setw(kInfoDataFormatWidth) << "cache size" << ": " << std::right;
+    std::cout << std::setw(kAnalyzeColumnWidth) << "fifo acmr";
+    std::cout << std::setw(kAnalyzeColumnWidth) << "fifo atvr";
+    std::cout << std::setw(kAnalyzeColumnWidth) << "lru acmr";
+    std::cout << std::setw(kAnalyzeColumnWidth) << "lru atvr" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < sizeof(kAnalyzedCacheSizes) / sizeof(unsigned int); i++) {
+        std::cout << "    " << std::left << std::setw(kInfoDataFormatWidth)
+                  << kAnalyzedCacheSizes[i] << ": " << std::right;
+        for (unsigned int model = 0; model < kNumVertexCacheModels; model++) {
+            const VertexCacheStats cache = analyzeVertexCache(indices, numIndices, numVertices,
+                    (VertexCacheModel) model, kAnalyzedCacheSizes[i]);
+            std::cout << std::setw(kAnalyzeColumnWidth) << cache.acmr;
+            std::cout << std::setw(kAnalyzeColumnWidth) << cache.atvr;
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::left;
+
+    // every stream of a struct of arrays object is fetched on its own
+    uint64_t fetchedBytes = 0;
+    double usedBytes = 0.0;
+    for (unsigned int i = 0; i < kNumVertexArrays; i++) {
+        if (!buffers.vertices[i]) {
+            continue;
+        }
+        const size_t stride = header->type == STRUCT_OF_ARRAYS ?
+                              vertexArrayElementSize(i) * sizeof(float) :
+                              calcVertexSize(vertexFlags) * sizeof(float);
+        const VertexFetchStats fetch = analyzeVertexFetch(indices, numIndices, numVertices,
+                                                          stride);
+        fetchedBytes += fetch.fetchedBytes;
+        usedBytes += fetch.fetchedBytes * (double) fetch.efficiency;
+    }
+    std::cout << "    " << std::setw(kInfoDataFormatWidth) << "fetch" << ": ";
+    if (fetchedBytes > 0) {
+        std::cout << fetchedBytes / usedBytes << " overfetch, "
+                  << std::setprecision(1) << 100.0 * usedBytes / fetchedBytes
+                  << "% efficiency" << std::setprecision(3) << std::endl;
+    } else {
+        std::cout << "-" << std::endl;
+    }
+
+    std::cout << "    " << std::setw(kInfoDataFormatWidth) << "overdraw" << ": ";
+    if (hasPositions(vertexFlags)) {
+        const size_t stride = header->type == STRUCT_OF_ARRAYS ? kPositionSize :
+                              calcVertexSize(vertexFlags);
+        const OverdrawStats overdraw = analyzeOverdraw(buffers.vertices[POSITION_ARRAY],
+                stride, numVertices, indices, numIndices);
+        std::cout << overdraw.overdraw << " (" << kOverdrawViews << " views, "
+                  << overdraw.coveredPixels << " pixels covered)" << std::endl;
+    } else {
+        std::cout << "-" << std::endl;
+    }
+    std::cout.unsetf(std::ios::floatfield);
+
+    // bytes of every attribute, interleaved or not
+    for (unsigned int i = 0; i < kNumVertexArrays; i++) {
+        if (hasVertexArray(vertexFlags, i)) {
+            std::cout << "    " << std::setw(kInfoDataFormatWidth) << kVertexArrayNames[i] << ": "
+                      << (uint64_t) numVertices * vertexArrayElementSize(i) * sizeof(float)
+                      << " bytes" << std::endl;
+        }
+    }
+    std::cout << "    " << std::setw(kInfoDataFormatWidth) << "indices" << ": "
+              << header->indexCount * sizeof(uint16_t) << " bytes" << std::endl;
+    if (hasBones(vertexFlags)) {
+        std::cout << "    " << std::setw(kInfoDataFormatWidth) << "skin" << ": "
+                  << calcSkinDataSize(header) << " bytes" << std::endl;
+    }
+}
+
+// vertex cache, vertex fetch and overdraw metrics and stream sizes of every
+// model of the file, other objects are only listed
+bool analyzeFile(const std::string &fileName) {
+    std::ifstream in(fileName.c_str(), std::ios::binary);
+    FileHeader *fileHeader = readFileHeader(in);
+    if (!fileHeader) {
+        std::cerr << "could not read file header" << std::endl;
+        return false;
+    }
+    const unsigned int objectCount = fileHeader->objectCount;
+    delete fileHeader;
+
+    std::cout << std::endl << "file: " << fileName << ":" << std::endl << std::left;
+    bool success = true;
+    for (unsigned int i = 0; i < objectCount && success; i++) {
+        ObjectHeader *header = readObjectHeader(in);
+        if (!header) {
+            std::cerr << "could not read object header " << i << std::endl;
+            success = false;
+            break;
+        }
+        const uint32_t type = header->type <= MATERIALS ? header->type : 0;
+        std::stringstream title;
+        title << "object " << i;
+        std::cout << std::endl << "  " << std::setw(kInfoFormatWidth) << title.str() << ": "
+                  << kObjectTypeNames[type];
+        if (header->type == STRUCT_OF_ARRAYS || header->type == ARRAY_OF_STRUCTS) {
+            std::cout << std::endl;
+            ObjectBufferSizes sizes;
+            calcObjectBufferSizes(header, &sizes);
+            std::vector<float> memory(sizes.totalSize / sizeof(float) + 1);
+            ObjectBuffers buffers;
+            success = readObjectInto(in, header, &memory[0], memory.size() * sizeof(float),
+                                     &buffers);
+            if (success) {
+                displayModelAnalysis(header, buffers);
+            }
+        } else {
+            const size_t dataSize = calcObjectDataSize(header);
+            std::cout << ", " << dataSize << " bytes" << std::endl;
+            in.seekg(dataSize, std::ios::cur);
+            success = !in.fail();
+        }
+        delete header;
+    }
+    std::cout << std::right << std::endl;
+    return success;
+}
+
 int main(int argc, char **argv) {
 
     CommandParser parser(argc, argv);
 
     parser.addBoolOption(kArraysOption, "export as struct of arrays. [-a | -s]");
+    parser.addBoolOption(kSharedBuffersOption, "share vertex and index buffers between meshes with equal vertex format");
+    parser.addBoolOption(kBvhOption, "build a BVH per object for ray and collision queries");
+    parser.addValueOption(kDropOption, "LIST", "copy all objects except LIST (e.g. 0,3-5) to the output file");
+    parser.addBoolOption(kMaterialsOption, "export the material table of the model");
     // parser.addBoolOption(kHalfFloatOption, "use half float (16-bit)");
+    parser.addValueOption(kTexturesOption, "FILTER", "embed the textures of the materials with mip chains built with FILTER (box or kaiser)");
     parser.addHelpOption(kHelpOption, "display this help screen");
     parser.addBoolOption(kDisplayInfoOption, "show meta data of input file");
+    parser.addBoolOption(kAnalyzeOption, "show vertex cache, vertex fetch and overdraw metrics and stream sizes of every model of the input .rcm file");
+    parser.addBoolOption(kAnimationsOption, "export the animation clips of the model");
+    parser.addBoolOption(kMergeOption, "merge the objects of all input .rcm files into one file");
     parser.addBoolOption(kNoOptimizationOption, "do not optimize model");
     parser.addValueOption(kOutputFileOption, "FILE", "export model to FILE");
+    parser.addBoolOption(kPackOption, "pack meshes of all input files into one pack");
+    parser.addBoolOption(kQuantizeMorphOption, "store morph target deltas with 16 instead of 32 bit");
+    parser.addBoolOption(kInstancesOption, "store identical meshes once and write an instance table");
     parser.addBoolOption(kStructsOption, "export as array of structs (default). [-s | -a]");
+    parser.addBoolOption(kTranscodeOption, "rewrite an .rcm file with the layout given by -a or -s");
+    parser.addBoolOption(kSortOption, "order objects by material and vertex layout");
     parser.addBoolOption(kVerboseOption, "enable verbose output");
+    parser.addBoolOption(kWeightsOption, "store bone weights with 16 instead of 8 bit");
+    parser.addValueOption(kExtractOption, "LIST", "copy only the objects in LIST (e.g. 0,3-5) to the output file");
+    parser.addBoolOption(kStatsOption, "report time, data, vertices, allocations and memory of each conversion stage");
+    parser.addBoolOption(kStatsJsonOption, "report the statistics of --stats as JSON");
+    parser.addValueOption(kTraceOption, "FILE", "write a timeline of the conversion on all threads to FILE (Chrome trace format)");
+    parser.addValueOption(kWeldOption, "TOLERANCES", "merge vertices whose positions, normals (angle in degrees) and uvs differ by at most TOLERANCES (e.g. 0.0001,1,0.0001)");
 
     //parser.setUsageString("hey, this is my awesome usgae string");
     parser.appendToPreDescText("This tool can be used to convert standard 3D models from");
@@ -167,15 +600,113 @@ int main(int argc, char **argv) {
     const std::string inFile = trailingArgs.front();
 
     if (parser.boolOption(kDisplayInfoOption)) {
-        readAndDisplayInfo(inFile);
+        std::ifstream in(inFile.c_str(), std::ios::binary);
+        char magic[2] = {0, 0};
+        in.read(magic, sizeof(magic));
+        in.close();
+        if ((unsigned char) magic[0] == kPackMagicNumber[0] &&
+            (unsigned char) magic[1] == kPackMagicNumber[1]) {
+            displayPackInfo(inFile);
+        } else {
+            readAndDisplayInfo(inFile);
+        }
         return 0;
     }
 
+    if (parser.boolOption(kAnalyzeOption)) {
+        return analyzeFile(inFile) ? 0 : 1;
+    }
+
+    // the stages of the conversions below are measured for --stats and --trace
+    ConvertStats stats;
+    stats.countAllocations = countAllocations;
+    if (parser.boolOption(kStatsOption) || parser.boolOption(kStatsJsonOption)) {
+        collectConvertStats(&stats);
+    }
+    if (!parser.valueOption(kTraceOption).empty()) {
+        startTrace();
+    }
+
+    MeshOptions meshOptions = MeshOptions();
+    meshOptions.use16BitWeights = parser.boolOption(kWeightsOption);
+    meshOptions.quantizeMorphTargets = parser.boolOption(kQuantizeMorphOption);
+    meshOptions.storeBvh = parser.boolOption(kBvhOption);
+    const std::string weldTolerances = parser.valueOption(kWeldOption);
+    if (!weldTolerances.empty()) {
+        if (!parseWeldTolerance(weldTolerances, meshOptions.weldTolerance)) {
+            std::stringstream error;
+            error << "invalid weld tolerances: " << weldTolerances;
+            parser.showError(error);
+            return 1;
+        }
+        meshOptions.weld = true;
+    }
+
+    // the weld only makes vertices equal, the optimization merges them
+    if (meshOptions.weld && !doOptimize) {
+        std::stringstream error;
+        error << "--weld can not be combined with -n";
+        parser.showError(error);
+        return 1;
+    }
+    if ((parser.boolOption(kSharedBuffersOption) || parser.boolOption(kPackOption)) &&
+        (meshOptions.storeBvh || meshOptions.quantizeMorphTargets)) {
+        std::stringstream error;
+        error << "BVHs and morph targets can not be combined with shared buffers or packs";
+        parser.showError(error);
+        return 1;
+    }
+
+    if (parser.boolOption(kPackOption)) {
+        const std::string defaultPackFile = fileStem(inFile).append(kDefaultPackExtension);
+        const std::string packFile = parser.valueOption(kOutputFileOption, defaultPackFile);
+        const bool success = createPack(trailingArgs, packFile, doOptimize, exportStructOfArrays,
+                                        meshOptions);
+        if (success) {
+            displayWeldResult(parser, meshOptions);
+        }
+        return finishReports(parser, stats, inFile, packFile, success);
+    }
+
     size_t dotIndex = inFile.find(".");
     const std::string defaultOutFile = inFile.substr(0, dotIndex).append(kDefaultFileExtension);
 
     const std::string outFile = parser.valueOption(kOutputFileOption, defaultOutFile);
 
+    // merge, extract, drop and transcode work on existing .rcm files without
+    // the source model, so they always need an explicit output file
+    const std::string extractList = parser.valueOption(kExtractOption, "");
+    const std::string dropList = parser.valueOption(kDropOption, "");
+    if (parser.boolOption(kMergeOption) || parser.boolOption(kTranscodeOption) ||
+        !extractList.empty() || !dropList.empty()) {
+        const std::string editFile = parser.valueOption(kOutputFileOption, "");
+        if (editFile.empty()) {
+            std::stringstream error;
+            error << "no output file given";
+            parser.showError(error);
+            return 1;
+        }
+        if (parser.boolOption(kMergeOption)) {
+            std::vector<std::string> inFiles(trailingArgs.begin(), trailingArgs.end());
+            return mergeFiles(inFiles, editFile.c_str()) ? 0 : 1;
+        }
+        if (parser.boolOption(kTranscodeOption)) {
+            const ObjectType layout = exportStructOfArrays ? STRUCT_OF_ARRAYS : ARRAY_OF_STRUCTS;
+            return transcodeFile(inFile.c_str(), editFile.c_str(), layout) ? 0 : 1;
+        }
+        std::vector<unsigned int> indices;
+        if (!parseIndexList(extractList.empty() ? dropList : extractList, indices)) {
+            std::stringstream error;
+            error << "invalid object list";
+            parser.showError(error);
+            return 1;
+        }
+        if (!extractList.empty()) {
+            return extractObjects(inFile.c_str(), indices, editFile.c_str()) ? 0 : 1;
+        }
+        return dropObjects(inFile.c_str(), indices, editFile.c_str()) ? 0 : 1;
+    }
+
     if (parser.boolOption("-v")) {
         std::cout << std::endl << "exporting with following options:" << std::left << std::endl;
         std::cout << "  " << std::setw(kFormatWidth);
@@ -193,13 +724,82 @@ int main(int argc, char **argv) {
         std::cout << std::endl << std::right;
     }
 
-    // now after loads of boiler plate, do the im- and export
+    const bool exportInstances = parser.boolOption(kInstancesOption);
+    const bool exportAnimations = parser.boolOption(kAnimationsOption);
+    const std::string mipFilter = parser.valueOption(kTexturesOption);
+    const bool exportTextures = !mipFilter.empty();
+    if (exportTextures && mipFilter != "box" && mipFilter != "kaiser") {
+        std::stringstream error;
+        error << "unknown mip filter: " << mipFilter;
+        parser.showError(error);
+        return 1;
+    }
+    const bool exportMaterials = parser.boolOption(kMaterialsOption);
+    const bool sortByMaterial = parser.boolOption(kSortOption);
+    if (exportInstances || exportAnimations || exportTextures || exportMaterials || sortByMaterial) {
+        if (parser.boolOption(kSharedBuffersOption)) {
+            std::stringstream error;
+            error << "instances, animations, textures and materials can not be combined with "
+                  << "shared buffers";
+            parser.showError(error);
+            return 1;
+        }
+        // without the instance table every duplicate mesh has to stay, it
+        // is the only record of where the mesh was placed
+        Scene *scene = loadScene(inFile.c_str(), false, exportTextures, exportInstances);
+        if (!scene) {
+            std::cerr << "model could not be loaded" << std::endl;
+            return 1;
+        }
+        if (!exportInstances) {
+            scene->instances.clear();
+        }
+        if (!exportAnimations) {
+            scene->animations.clear();
+        }
+        if (sortByMaterial) {
+            sortMeshesByMaterial(scene);
+        }
+        if (!exportMaterials) {
+            scene->materials.clear();
+        }
+        scene->mipFilter = mipFilter == "kaiser" ? MIP_FILTER_KAISER : MIP_FILTER_BOX;
+        applyMeshOptions(scene->meshes, meshOptions);
+        const bool success = writeSceneFile(outFile.c_str(), scene, doOptimize,
+                                            exportStructOfArrays);
+        delete scene;
+        if (success) {
+            displayWeldResult(parser, meshOptions);
+        }
+        return finishReports(parser, stats, inFile, outFile, success);
+    }
+
+    // now after loads of boiler plate, do the im- and export. Without shared
+    // buffers every mesh is written on its own, so only one is held at a time.
+    if (!parser.boolOption(kSharedBuffersOption)) {
+        const bool success = streamModel(inFile.c_str(), outFile.c_str(), doOptimize,
+                                         exportStructOfArrays, applyMeshOptions,
+                                         (void*) &meshOptions);
+        if (success) {
+            displayWeldResult(parser, meshOptions);
+        } else {
+            std::cerr << "model could not be converted" << std::endl;
+        }
+        return finishReports(parser, stats, inFile, outFile, success);
+    }
     std::vector<Mesh*> *meshes = loadModel(inFile.c_str());
     if (!meshes) {
         std::cerr << "model could not be loaded" << std::endl;
         return 1;
     }
-    writeFile(outFile.c_str(), meshes, doOptimize, exportStructOfArrays);
+    applyMeshOptions(*meshes, meshOptions);
+    const bool success = writeSharedBuffersFile(outFile.c_str(), meshes, doOptimize,
+                                                exportStructOfArrays);
+    if (success) {
+        displayWeldResult(parser, meshOptions);
+    } else {
+        std::cerr << "model could not be converted" << std::endl;
+    }
 
     // clear all meshes
     std::vector<Mesh*>::iterator it = meshes->begin();
@@ -210,6 +810,6 @@ int main(int argc, char **argv) {
     meshes->clear();
     delete meshes;
 
-    return 0;
+    return finishReports(parser, stats, inFile, outFile, success);
 }
 
@@ -0,0 +1,147 @@
+/* src/generator.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include <iostream>
+#include <stdlib.h>
+
+#include "rcmgenerator.h"
+
+#include "command_parser.h"
+
+static const char* kArraysOption = "-a";
+static const char* kCountOption = "-c";
+static const char* kAttributesOption = "-f";
+static const char* kHelpOption = "-h";
+static const char* kNoOptimizationOption = "-n";
+static const char* kOutputFileOption = "-o";
+static const char* kSeedOption = "-r";
+
+static const char* kDefaultFileExtension = ".rcm";
+
+struct AttributeName {
+    const char *name;
+    unsigned short flags;
+};
+
+static const AttributeName kAttributeNames[] = {
+    {"normals", HAS_NORMALS},
+    {"uv0", HAS_UV0},
+    {"uv1", HAS_UV1},
+    {"uv2", HAS_UV2},
+    {"uv3", HAS_UV3},
+    {"color0", HAS_COLOR0},
+    {"color1", HAS_COLOR1},
+    {"color2", HAS_COLOR2},
+    {"color3", HAS_COLOR3},
+    {"tangents", HAS_TAN_AND_BITAN},
+    {"bones", HAS_BONES},
+    {"weights16", HAS_BONES | USES_16BIT_WEIGHTS},
+};
+
+// parses a comma separated list of attribute names into vertex flags
+static bool parseAttributes(const std::string &list, unsigned short &flags) {
+    flags = HAS_POSITIONS;
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t end = list.find(',', start);
+        end = end == std::string::npos ? list.size() : end;
+        const std::string name = list.substr(start, end - start);
+        bool known = false;
+        for (size_t i = 0; i < sizeof(kAttributeNames) / sizeof(AttributeName); i++) {
+            if (name == kAttributeNames[i].name) {
+                flags |= kAttributeNames[i].flags;
+                known = true;
+            }
+        }
+        if (!known) {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    CommandParser parser(argc, argv);
+
+    parser.addBoolOption(kArraysOption, "export as struct of arrays");
+    parser.addValueOption(kCountOption, "COUNT", "generate about COUNT vertices (default 10000)");
+    parser.addValueOption(kAttributesOption, "LIST", "vertex attributes besides the positions "
+                          "(default normals,uv0), any of normals, uv0-uv3, color0-color3, "
+                          "tangents, bones, weights16");
+    parser.addHelpOption(kHelpOption, "display this help screen");
+    parser.addBoolOption(kNoOptimizationOption, "do not optimize model");
+    parser.addValueOption(kOutputFileOption, "FILE", "export model to FILE (default SHAPE.rcm)");
+    parser.addValueOption(kSeedOption, "SEED", "seed of the random values (default 1)");
+
+    parser.appendToPreDescText("This tool writes procedural meshes (grid, sphere or scan)");
+    parser.appendToPreDescText("to .rcm files, e.g. for tests and benchmarks that should");
+    parser.appendToPreDescText("not depend on model files.");
+
+    if (parser.parse()) {
+        return 1;
+    }
+    if (parser.boolOption(kHelpOption)) {
+        parser.showHelpDialog();
+        return 0;
+    }
+
+    std::list<std::string> trailingArgs = parser.trailingArgs();
+    if (trailingArgs.empty()) {
+        std::stringstream error;
+        error << "no shape given";
+        parser.showError(error);
+        return 1;
+    }
+    const std::string shapeName = trailingArgs.front();
+    GeneratedShape shape;
+    if (shapeName == "grid") {
+        shape = GENERATE_GRID;
+    } else if (shapeName == "sphere") {
+        shape = GENERATE_SPHERE;
+    } else if (shapeName == "scan") {
+        shape = GENERATE_SCAN;
+    } else {
+        std::stringstream error;
+        error << "unknown shape: " << shapeName;
+        parser.showError(error);
+        return 1;
+    }
+
+    unsigned short flags = 0;
+    if (!parseAttributes(parser.valueOption(kAttributesOption, "normals,uv0"), flags)) {
+        std::stringstream error;
+        error << "invalid attribute list";
+        parser.showError(error);
+        return 1;
+    }
+    const size_t count = strtoull(parser.valueOption(kCountOption, "10000").c_str(), 0, 10);
+    const uint32_t seed = strtoul(parser.valueOption(kSeedOption, "1").c_str(), 0, 10);
+    const std::string outFile = parser.valueOption(kOutputFileOption,
+                                                   shapeName + kDefaultFileExtension);
+
+    Mesh *mesh = generateMesh(shape, count, flags, seed);
+    if (!mesh) {
+        return 1;
+    }
+    std::vector<Mesh*> meshes(1, mesh);
+    const bool doOptimize = !parser.boolOption(kNoOptimizationOption);
+    const bool success = writeFile(outFile.c_str(), &meshes, doOptimize,
+                                   parser.boolOption(kArraysOption));
+    delete mesh;
+    return success ? 0 : 1;
+}
@@ -22,6 +22,7 @@
 #include <fstream>
 #include <map>
 #include "../rcm.h"
+#include "../rcmstats.h"
 #include "../rcmwriter.h"
 
 struct ObjectData {
@@ -97,12 +98,34 @@ int writeArrayOfStructsData(std::ofstream &out, std::vector<Vertex<float> > &ver
 
 int writeStructOfArraysData(std::ofstream &out, const ObjectData *data);
 
+// meshes with more than kMaxIndexedVertices vertices become lists of corners
 Mesh* convertAiMesh(const aiMesh *aimesh);
 
+// converts the channels of an assimp animation, times are converted from
+// ticks to seconds
+void convertAiAnimation(const aiAnimation *aianimation, Animation &animation);
+
+// converts an embedded texture to RGBA, compressed ones are decoded
+bool convertAiTexture(const aiTexture *aitexture, Texture &texture);
+
+// decodes a PNG or JPEG file in memory into width, height and pixels of
+// texture. Fails if the decoder was not available at build time.
+bool decodeImage(const uint8_t *data, size_t size, Texture &texture);
+
+// decodeImage() for an image file
+bool loadImageFile(const char *path, Texture &texture);
+
 void writeFileHeader(std::ofstream &out, unsigned int numObjects);
 
+// materialIndex is written to the object header, it refers to the material
+// table of the file. Fails for indexed meshes with more than
+// kMaxIndexedVertices vertices, larger meshes have to be lists of corners.
 bool writeObject(std::ofstream &out, const Mesh* mesh,
-        bool doOptimize = true, bool useStructOfArrays = false);
+        bool doOptimize = true, bool useStructOfArrays = false,
+        uint32_t materialIndex = kNoMaterial);
+
+// converts the parameters and texture paths of an assimp material
+void convertAiMaterial(const aiMaterial *aimaterial, Material &material);
 
 template<typename T>
 bool findVertexIndex(std::map<T, unsigned short> &vertices,
@@ -116,10 +139,44 @@ bool findVertexIndex(std::map<T, unsigned short> &vertices,
     }
 }
 
+// fails if there are more distinct vertices than kMaxIndexedVertices
 bool optimizeArrayOfStructs(float *vertices,
             size_t vertexSize,
             size_t vertexCount,
             std::vector<unsigned short> &indicesOut,
             std::vector<Vertex<float> > &verticesOut);
 
+// measures one stage for the statistics collected on this thread and does
+// nothing if none are collected. The time and allocations of a timer nested
+// in another one are not counted to the outer stage.
+class StageTimer {
+public:
+    explicit StageTimer(ConvertStage stage);
+    ~StageTimer();
+
+    void addInput(uint64_t bytes, uint64_t vertices);
+    void addOutput(uint64_t bytes, uint64_t vertices);
+
+private:
+    StageTimer(const StageTimer &);
+    StageTimer& operator=(const StageTimer &);
+
+    ConvertStage mStage;
+    ConvertStats *mStats;
+    StageTimer *mParent;
+    double mStartWall;
+    double mStartCpu;
+    uint64_t mStartAllocations;
+    double mNestedWall;
+    double mNestedCpu;
+    uint64_t mNestedAllocations;
+};
+
+// adds to the output of a stage without timing it, e.g. the vertices a write
+// function writes
+void addStageOutput(ConvertStage stage, uint64_t bytes, uint64_t vertices);
+
+// bytes of the vertices, indices and skin of a mesh
+uint64_t calcMeshBytes(const Mesh *mesh);
+
 #endif // RCM_INTERNAL_H
@@ -0,0 +1,144 @@
+/* src/internal/thread_pool.h
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Minimal fixed size thread pool. Tasks are executed in FIFO order by
+ * the worker threads. wait() blocks until every task that has been
+ * enqueued so far has finished.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int numThreads = 0) : mPending(0), mStop(false) {
+        if (numThreads == 0) {
+            numThreads = std::thread::hardware_concurrency();
+        }
+        if (numThreads == 0) {
+            numThreads = 1;
+        }
+        for (unsigned int i = 0; i < numThreads; i++) {
+            mThreads.push_back(std::thread(&ThreadPool::run, this));
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mTaskCondition.notify_all();
+        for (size_t i = 0; i < mThreads.size(); i++) {
+            mThreads[i].join();
+        }
+    }
+
+    void enqueue(const std::function<void()> &task) {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mTasks.push_back(task);
+            mPending++;
+        }
+        mTaskCondition.notify_one();
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDoneCondition.wait(lock, [this] { return mPending == 0; });
+    }
+
+    size_t size() const {
+        return mThreads.size();
+    }
+
+private:
+    ThreadPool(const ThreadPool &);
+    ThreadPool& operator=(const ThreadPool &);
+
+    void run() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mTaskCondition.wait(lock, [this] { return mStop || !mTasks.empty(); });
+                if (mTasks.empty()) {
+                    return;
+                }
+                task = mTasks.front();
+                mTasks.pop_front();
+            }
+            task();
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                if (--mPending == 0) {
+                    mDoneCondition.notify_all();
+                }
+            }
+        }
+    }
+
+    std::vector<std::thread> mThreads;
+    std::deque<std::function<void()> > mTasks;
+    std::mutex mMutex;
+    std::condition_variable mTaskCondition;
+    std::condition_variable mDoneCondition;
+    size_t mPending;
+    bool mStop;
+};
+
+/**
+ * Calls task(first, end) for consecutive ranges of the count elements with
+ * at least minRange elements each. The ranges run on a pool of all hardware
+ * threads, a single range runs on the calling thread.
+ */
+inline void parallelFor(size_t count, size_t minRange,
+        const std::function<void(size_t, size_t)> &task) {
+    unsigned int numThreads = std::thread::hardware_concurrency();
+    if (numThreads == 0) {
+        numThreads = 1;
+    }
+    // a few ranges per thread even out ranges that take longer
+    size_t numRanges = count / (minRange > 0 ? minRange : 1);
+    if (numRanges > (size_t) numThreads * 4) {
+        numRanges = (size_t) numThreads * 4;
+    }
+    if (numRanges <= 1 || numThreads == 1) {
+        if (count > 0) {
+            task(0, count);
+        }
+        return;
+    }
+    ThreadPool pool(numRanges < numThreads ? numRanges : numThreads);
+    for (size_t i = 0; i < numRanges; i++) {
+        const size_t first = count * i / numRanges;
+        const size_t end = count * (i + 1) / numRanges;
+        pool.enqueue([&task, first, end] {
+            task(first, end);
+        });
+    }
+    pool.wait();
+}
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,60 @@
+/* src/internal/trace.h
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <stdint.h>
+#include "../rcmtrace.h"
+
+extern std::atomic<bool> gTraceEnabled;
+
+// nanoseconds since the start of the trace
+uint64_t traceTime();
+
+// name has to outlive the trace, usually it is a string literal
+void recordTraceEvent(const char *name, uint64_t start, uint64_t duration);
+
+/**
+ * Records the lifetime of the scope as one event of the running trace.
+ * Without a trace it costs a relaxed load and a branch.
+ */
+class TraceScope {
+public:
+    explicit TraceScope(const char *name) : mName(0), mStart(0) {
+        if (gTraceEnabled.load(std::memory_order_relaxed)) {
+            mName = name;
+            mStart = traceTime();
+        }
+    }
+
+    ~TraceScope() {
+        if (mName) {
+            recordTraceEvent(mName, mStart, traceTime() - mStart);
+        }
+    }
+
+private:
+    TraceScope(const TraceScope &);
+    TraceScope& operator=(const TraceScope &);
+
+    const char *mName;
+    uint64_t mStart;
+};
+
+#endif // TRACE_H
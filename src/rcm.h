@@ -24,15 +24,20 @@
 /* Format of the model file.
 file header meta data:
   magic number,           2 byte [0][1] 0xde 0xad
-  version (major, minor), 2 byte [2][3] 0x0 0x1
+  version (major, minor), 2 byte [2][3] 0x0 0x2
   object count,           1 byte -> numberOfMeshes + number of textures
   unused                  1 byte
 per object meta data:
   type:                   1 byte
       - model (struct of arrays) 0x1  STRUCT_OF_ARRAYS
       - model (array of structs) 0x2  ARRAY_OF_STRUCTS
-      - textures?
-      - normal maps?
+      - draw ranges              0x3  DRAW_RANGES
+      - instances                0x4  INSTANCES
+      - animation clip           0x5  ANIMATION
+      - morph targets            0x6  MORPH_TARGETS
+      - bounding volume hierarchy 0x7 BVH
+      - texture with mip chain   0x8  TEXTURE
+      - material table           0x9  MATERIALS
 per model meta data:
   vertex size),   1 byte
   flags:          2 byte
@@ -48,19 +53,89 @@ per model meta data:
       - color 3   0x0800              HAS_COLOR3
       - tan+bitan 0x1000              HAS_TAN_AND_BITAN
       - bones     0x2000              HAS_BONES
+      - 16 bit bone weights 0x4000    USES_16BIT_WEIGHTS
       - halffloat 0x8000              USES_HALF_FLOAT
   vertex count, 4 byte
   index count,  4 byte
   bone count,   4 byte
+  bounding box, 6 floats (min x, y, z, max x, y, z) of the positions
+  bounding sphere, 4 floats (center x, y, z, radius)
+  material index, 4 byte (into the MATERIALS object, 0xffffffff for none)
+  reserved,     4 byte
 per model data:
   vertex count * (positions, normals, uvs...)
   index count * (unsigned short)
-  bone count * (whatever a bone will be...)
+per model skin data (only with HAS_BONES):
+  bone count * (bone name hash, 8 byte (FNV-1a 64 of the name),
+                inverse bind matrix, 16 floats, column major)
+  vertex count * 4 bone indices, 1 byte each
+  vertex count * 4 bone weights, unorm8 or unorm16 with USES_16BIT_WEIGHTS,
+                 sorted from largest to smallest, summing up to exactly 1
+every object that is not a model starts with a block header of the same size
+as the model meta data, so a reader can skip objects of unknown types:
+  type,         1 byte
+  unused,       1 byte
+  flags,        2 byte
+  element count 4 byte
+  data size,    4 byte -> bytes of data following the block header
+  unused,       52 byte
+draw ranges data (follows the model that holds the shared buffers):
+  element count * (first vertex, vertex count, first index, index count),
+                  4 byte each
+  element count * indirect draw command (index count, instance count,
+                  first index, base vertex, base instance), 4 byte each, laid
+                  out like DrawElementsIndirectCommand and
+                  VkDrawIndexedIndirectCommand. Models without indices draw
+                  the vertex count of each range from its first vertex.
+instances data:
+  element count * (object index of the model in the file, 4 byte,
+                   transform, 16 floats, column major)
+animation data (element count is the number of tracks):
+  compressed clip as described in rcmanim.h
+morph targets data (follows the model it belongs to, element count is the
+number of targets):
+  sparse targets as described in rcmmorph.h
+bvh data (follows the model and its morph targets, element count is the
+number of nodes):
+  quantized 4-wide tree as described in rcmbvh.h
+texture data (element count is the number of mip levels):
+  levels laid out for upload as described in rcmtexture.h
+materials data (comes first in the file, element count is the number of
+materials):
+  material table as described in rcmmaterial.h
+*/
+
+/* Format of a pack file. A pack bundles many objects in one file and finds
+them by name. All offsets are relative to the start of the pack, so it can be
+used directly from a memory mapping.
+pack header:
+  magic number,           2 byte 0xbe 0xef
+  version (major, minor), 2 byte 0x0 0x2
+  object count,           4 byte
+  bucket bits,            4 byte  (there are 1 << bucket bits buckets)
+  unused,                 4 byte
+  entry table offset,     8 byte
+  bucket table offset,    8 byte
+  name table offset,      8 byte
+  name table size,        8 byte
+objects:
+  object header + data of every object (same as in an .rcm file), each object
+  starts at a multiple of 16 bytes, so its data is 16 byte aligned as well.
+entry table, object count * 32 byte, sorted by name hash:
+  name hash,     8 byte (FNV-1a 64 of the name)
+  object offset, 8 byte
+  object size,   8 byte  (object header + data)
+  name offset,   4 byte  (into the name table)
+  name length,   4 byte
+bucket table, ((1 << bucket bits) + 1) * 4 byte:
+  index of the first entry whose hash has the bucket number in its top bits
+name table:
+  all names, each terminated by 0
 */
 
 const unsigned char kMagicNumber[] = {0xDE, 0xAD};
 const unsigned char kFileFormatVersionMajor = 0x0;
-const unsigned char kFileFormatVersionMinor = 0x1;
+const unsigned char kFileFormatVersionMinor = 0x2;
 
 const unsigned int kMaxNumTexCoords = 4;
 const unsigned int kMaxNumColors = 4;
@@ -69,8 +144,18 @@ const unsigned int kMaxNumColors = 4;
 enum ObjectType {
       STRUCT_OF_ARRAYS = 0x1,
       ARRAY_OF_STRUCTS = 0x2,
+      DRAW_RANGES = 0x3,
+      INSTANCES = 0x4,
+      ANIMATION = 0x5,
+      MORPH_TARGETS = 0x6,
+      BVH = 0x7,
+      TEXTURE = 0x8,
+      MATERIALS = 0x9,
 };
 
+// material index of a model without material
+const uint32_t kNoMaterial = 0xffffffff;
+
 struct FileHeader {
     uint8_t magicNumber[2];
     uint8_t version[2];
@@ -78,6 +163,12 @@ struct FileHeader {
     uint8_t unused;
 };
 
+// object headers change between minor versions as long as the major version is 0
+inline bool isSupportedFileVersion(const FileHeader *header) {
+    return header->version[0] == kFileFormatVersionMajor &&
+           header->version[1] == kFileFormatVersionMinor;
+}
+
 struct ObjectHeader {
     uint8_t type;
     uint8_t vertexSize;
@@ -85,8 +176,112 @@ struct ObjectHeader {
     uint32_t vertexCount;
     uint32_t indexCount;
     uint32_t boneCount;
+    // bounds of all positions, zero if the model has none
+    float boundsMin[3];
+    float boundsMax[3];
+    float sphereCenter[3];
+    float sphereRadius;
+    uint32_t materialIndex;
+    uint32_t reserved;
+};
+
+struct BlockHeader {
+    uint8_t type;
+    uint8_t unused;
+    uint16_t flags;
+    uint32_t elementCount;
+    uint32_t dataSize;
+    uint32_t reserved[13];
+};
+
+static_assert(sizeof(BlockHeader) == sizeof(ObjectHeader),
+              "block header has to have the size of an object header");
+
+// range of one mesh inside the shared buffers of a model
+struct DrawRange {
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+struct DrawCommand {
+    uint32_t indexCount;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t baseInstance;
+};
+
+const unsigned int kMaxBoneInfluences = 4;
+// bone indices are stored in one byte
+const unsigned int kMaxBones = 256;
+
+// indices are stored in two bytes, larger models are lists of corners
+// without indices
+const unsigned int kMaxIndexedVertices = 0x10000;
+
+struct BoneData {
+    uint64_t nameHash;
+    float inverseBindMatrix[16];
+};
+
+// placement of the model with the given object index in the scene. In a
+// file the index counts every object before the model, including the
+// material table and the morph targets and BVHs of earlier models.
+struct Instance {
+    uint32_t objectIndex;
+    float transform[16];
+};
+
+const unsigned char kPackMagicNumber[] = {0xBE, 0xEF};
+const unsigned char kPackFormatVersionMajor = 0x0;
+// packs embed object headers, so they follow the version of the file format
+const unsigned char kPackFormatVersionMinor = 0x2;
+const unsigned int kPackObjectAlignment = 16;
+
+struct PackHeader {
+    uint8_t magicNumber[2];
+    uint8_t version[2];
+    uint32_t objectCount;
+    uint32_t bucketBits;
+    uint32_t unused;
+    uint64_t entryTableOffset;
+    uint64_t bucketTableOffset;
+    uint64_t nameTableOffset;
+    uint64_t nameTableSize;
+};
+
+struct PackEntry {
+    uint64_t nameHash;
+    uint64_t objectOffset;
+    uint64_t objectSize;
+    uint32_t nameOffset;
+    uint32_t nameLength;
 };
 
+const uint64_t kHashSeed = 0xcbf29ce484222325ULL;
+
+// FNV-1a, pass the result of a previous call as seed to hash several blocks
+inline uint64_t hashBytes(const void *data, size_t length, uint64_t hash = kHashSeed) {
+    const uint8_t *bytes = (const uint8_t*) data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// used for the name lookup in packs
+inline uint64_t hashName(const char *name, size_t length) {
+    return hashBytes(name, length);
+}
+
+// the bucket of a hash is given by its top bits
+inline uint32_t packBucket(uint64_t hash, uint32_t bucketBits) {
+    return bucketBits == 0 ? 0 : (uint32_t) (hash >> (64 - bucketBits));
+}
+
 
 /* 2 bytes */
 enum ModelDataFlags {
@@ -102,6 +297,7 @@ enum ModelDataFlags {
     HAS_COLOR3 = 0x0800,
     HAS_TAN_AND_BITAN = 0x1000,
     HAS_BONES = 0x2000,
+    USES_16BIT_WEIGHTS = 0x4000,
     USES_HALF_FLOAT = 0x8000,
 };
 
@@ -257,6 +453,14 @@ inline void setHasBones(uint16_t &vertexFlags) {
     vertexFlags |= HAS_BONES;
 }
 
+inline bool uses16BitWeights(uint16_t vertexFlags) {
+    return (vertexFlags & USES_16BIT_WEIGHTS);
+}
+
+inline void setUses16BitWeights(uint16_t &vertexFlags) {
+    vertexFlags |= USES_16BIT_WEIGHTS;
+}
+
 inline bool usesHalfFloat(uint16_t vertexFlags) {
     return (vertexFlags & USES_HALF_FLOAT);
 }
@@ -303,5 +507,39 @@ inline unsigned int calcVertexSize(unsigned short vertexFlags) {
     return vertexSize;
 }
 
+// true for objects that hold vertices and indices, all other objects start
+// with a BlockHeader
+inline bool isModelObject(uint8_t type) {
+    return type == STRUCT_OF_ARRAYS || type == ARRAY_OF_STRUCTS;
+}
+
+inline const BlockHeader* asBlockHeader(const ObjectHeader *header) {
+    return reinterpret_cast<const BlockHeader*>(header);
+}
+
+inline size_t calcBoneWeightSize(uint16_t vertexFlags) {
+    return uses16BitWeights(vertexFlags) ? sizeof(uint16_t) : sizeof(uint8_t);
+}
+
+// size in bytes of the skin data following the indices of a model
+inline size_t calcSkinDataSize(const ObjectHeader *header) {
+    if (!hasBones(header->vertexFlags)) {
+        return 0;
+    }
+    return (size_t) header->boneCount * sizeof(BoneData) +
+           (size_t) header->vertexCount * kMaxBoneInfluences *
+           (sizeof(uint8_t) + calcBoneWeightSize(header->vertexFlags));
+}
+
+// size in bytes of the data following an object header (vertices, indices
+// and skin data)
+inline size_t calcObjectDataSize(const ObjectHeader *header) {
+    if (!isModelObject(header->type)) {
+        return asBlockHeader(header)->dataSize;
+    }
+    return (size_t) header->vertexCount * calcVertexSize(header->vertexFlags) * sizeof(float) +
+           (size_t) header->indexCount * sizeof(uint16_t) + calcSkinDataSize(header);
+}
+
 #endif // RCM_H
 
@@ -0,0 +1,241 @@
+/* src/rcmanalyze.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include "rcmanalyze.h"
+#include "internal/trace.h"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+static inline uint32_t cornerVertex(const uint16_t *indices, uint32_t corner) {
+    return indices ? indices[corner] : corner;
+}
+
+// number of distinct vertices the triangles refer to
+static uint32_t countReferencedVertices(const uint16_t *indices, uint32_t numCorners,
+        uint32_t numVertices) {
+    std::vector<uint8_t> referenced(numVertices, 0);
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < numCorners; i++) {
+        const uint32_t vertex = cornerVertex(indices, i);
+        if (vertex < numVertices && !referenced[vertex]) {
+            referenced[vertex] = 1;
+            count++;
+        }
+    }
+    return count;
+}
+
+VertexCacheStats analyzeVertexCache(const uint16_t *indices, uint32_t numIndices,
+        uint32_t numVertices, VertexCacheModel model, unsigned int cacheSize) {
+    TraceScope trace("analyzeVertexCache");
+    VertexCacheStats stats;
+    memset(&stats, 0, sizeof(VertexCacheStats));
+    const uint32_t numCorners = numIndices - numIndices % 3;
+    if (cacheSize == 0 || numCorners == 0) {
+        return stats;
+    }
+    uint32_t misses = 0;
+    // FIFO: miss count at which a vertex entered the cache, 0 if never
+    std::vector<uint32_t> entered(model == VERTEX_CACHE_FIFO ? numVertices : 0, 0);
+    // LRU: most recently used vertex first
+    std::vector<uint32_t> cache;
+    cache.reserve(cacheSize + 1);
+    for (uint32_t i = 0; i < numCorners; i++) {
+        const uint32_t vertex = cornerVertex(indices, i);
+        if (vertex >= numVertices) {
+            continue;
+        }
+        if (model == VERTEX_CACHE_FIFO) {
+            // the vertex was pushed out by cacheSize later misses
+            if (entered[vertex] == 0 || misses - entered[vertex] >= cacheSize) {
+                misses++;
+                entered[vertex] = misses;
+            }
+        } else {
+            std::vector<uint32_t>::iterator it = std::find(cache.begin(), cache.end(), vertex);
+            if (it != cache.end()) {
+                cache.erase(it);
+            } else {
+                misses++;
+                if (cache.size() == cacheSize) {
+                    cache.pop_back();
+                }
+            }
+            cache.insert(cache.begin(), vertex);
+        }
+    }
+    const uint32_t referenced = countReferencedVertices(indices, numCorners, numVertices);
+    stats.transformedVertices = misses;
+    stats.acmr = (float) misses / (numCorners / 3);
+    stats.atvr = referenced > 0 ? (float) misses / referenced : 0.0f;
+    return stats;
+}
+
+VertexFetchStats analyzeVertexFetch(const uint16_t *indices, uint32_t numIndices,
+        uint32_t numVertices, size_t vertexStride) {
+    TraceScope trace("analyzeVertexFetch");
+    VertexFetchStats stats;
+    memset(&stats, 0, sizeof(VertexFetchStats));
+    const uint32_t numCorners = numIndices - numIndices % 3;
+    if (vertexStride == 0 || numCorners == 0) {
+        return stats;
+    }
+    const size_t numLines = (numVertices * vertexStride + kFetchCacheLineSize - 1) /
+                            kFetchCacheLineSize;
+    // like the FIFO vertex cache: the load count at which a line was loaded
+    std::vector<uint64_t> loaded(numLines, 0);
+    uint64_t loads = 0;
+    for (uint32_t i = 0; i < numCorners; i++) {
+        const uint32_t vertex = cornerVertex(indices, i);
+        if (vertex >= numVertices) {
+            continue;
+        }
+        const size_t first = vertex * vertexStride / kFetchCacheLineSize;
+        const size_t last = ((vertex + 1) * vertexStride - 1) / kFetchCacheLineSize;
+        for (size_t line = first; line <= last; line++) {
+            if (loaded[line] == 0 || loads - loaded[line] >= kFetchCacheLines) {
+                loads++;
+                loaded[line] = loads;
+            }
+        }
+    }
+    const uint64_t usedBytes = (uint64_t) countReferencedVertices(indices, numCorners,
+                                                                 numVertices) * vertexStride;
+    stats.fetchedBytes = loads * kFetchCacheLineSize;
+    stats.overfetch = usedBytes > 0 ? (float) stats.fetchedBytes / usedBytes : 0.0f;
+    stats.efficiency = stats.fetchedBytes > 0 ? (float) usedBytes / stats.fetchedBytes : 0.0f;
+    return stats;
+}
+
+struct RasterVertex {
+    float x;
+    float y;
+    float z;
+};
+
+static inline float edge(const RasterVertex &a, const RasterVertex &b, float x, float y) {
+    return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+}
+
+// draws one triangle with positive area into the depth buffer
+static void rasterize(const RasterVertex &a, const RasterVertex &b, const RasterVertex &c,
+        float area, std::vector<float> &depth, int width, int height, OverdrawStats &stats) {
+    const int minX = std::max(0, (int) floorf(std::min(a.x, std::min(b.x, c.x))));
+    const int minY = std::max(0, (int) floorf(std::min(a.y, std::min(b.y, c.y))));
+    const int maxX = std::min(width - 1, (int) ceilf(std::max(a.x, std::max(b.x, c.x))));
+    const int maxY = std::min(height - 1, (int) ceilf(std::max(a.y, std::max(b.y, c.y))));
+    for (int y = minY; y <= maxY; y++) {
+        for (int x = minX; x <= maxX; x++) {
+            // sampled at the pixel center
+            const float px = x + 0.5f;
+            const float py = y + 0.5f;
+            const float wa = edge(b, c, px, py);
+            const float wb = edge(c, a, px, py);
+            const float wc = edge(a, b, px, py);
+            if (wa < 0.0f || wb < 0.0f || wc < 0.0f) {
+                continue;
+            }
+            const float z = (wa * a.z + wb * b.z + wc * c.z) / area;
+            float &stored = depth[y * width + x];
+            if (stored == FLT_MAX) {
+                stats.coveredPixels++;
+            }
+            if (z < stored) {
+                stored = z;
+                stats.shadedPixels++;
+            }
+        }
+    }
+}
+
+OverdrawStats analyzeOverdraw(const float *positions, size_t positionStride,
+        uint32_t numVertices, const uint16_t *indices, uint32_t numIndices) {
+    TraceScope trace("analyzeOverdraw");
+    OverdrawStats stats;
+    memset(&stats, 0, sizeof(OverdrawStats));
+    const uint32_t numCorners = numIndices - numIndices % 3;
+    if (numVertices == 0 || numCorners == 0) {
+        return stats;
+    }
+    float boundsMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float boundsMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (uint32_t i = 0; i < numVertices; i++) {
+        for (unsigned int k = 0; k < 3; k++) {
+            boundsMin[k] = std::min(boundsMin[k], positions[i * positionStride + k]);
+            boundsMax[k] = std::max(boundsMax[k], positions[i * positionStride + k]);
+        }
+    }
+
+    std::vector<float> depth;
+    for (unsigned int view = 0; view < kOverdrawViews; view++) {
+        // looking along the axis from its positive or negative side, the
+        // image plane is spanned by the other two axes
+        const unsigned int axis = view / 2;
+        const float side = view % 2 == 0 ? 1.0f : -1.0f;
+        const unsigned int u = (axis + 1) % 3;
+        const unsigned int v = (axis + 2) % 3;
+        const float extentU = boundsMax[u] - boundsMin[u];
+        const float extentV = boundsMax[v] - boundsMin[v];
+        const float extent = std::max(extentU, extentV);
+        if (!(extent > 0.0f)) {
+            continue;
+        }
+        const float scale = kOverdrawResolution / extent;
+        const int width = std::max(1, std::min((int) kOverdrawResolution,
+                                               (int) ceilf(extentU * scale)));
+        const int height = std::max(1, std::min((int) kOverdrawResolution,
+                                                (int) ceilf(extentV * scale)));
+        depth.assign(width * height, FLT_MAX);
+
+        for (uint32_t i = 0; i < numCorners; i += 3) {
+            RasterVertex corners[3];
+            bool valid = true;
+            for (unsigned int k = 0; k < 3; k++) {
+                const uint32_t vertex = cornerVertex(indices, i + k);
+                if (vertex >= numVertices) {
+                    valid = false;
+                    break;
+                }
+                const float *position = positions + vertex * positionStride;
+                corners[k].x = (position[u] - boundsMin[u]) * scale;
+                corners[k].y = (position[v] - boundsMin[v]) * scale;
+                // smaller is closer to the viewer
+                corners[k].z = -side * position[axis];
+            }
+            if (!valid) {
+                continue;
+            }
+            // the area has the sign of the normal along the axis, seen from
+            // the negative side the front faces are clockwise
+            float area = edge(corners[0], corners[1], corners[2].x, corners[2].y);
+            if (side * area <= 0.0f) {
+                continue;
+            }
+            if (area < 0.0f) {
+                std::swap(corners[1], corners[2]);
+                area = -area;
+            }
+            rasterize(corners[0], corners[1], corners[2], area, depth, width, height, stats);
+        }
+    }
+    stats.overdraw = stats.coveredPixels > 0 ?
+                     (float) stats.shadedPixels / stats.coveredPixels : 0.0f;
+    return stats;
+}
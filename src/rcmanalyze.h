@@ -0,0 +1,87 @@
+/* src/rcmanalyze.h
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#ifndef RCM_ANALYZE_H
+#define RCM_ANALYZE_H
+
+#include "rcm.h"
+
+/* How well a model suits the GPU, estimated on the CPU.
+
+Every function takes the triangles as indices, or as a list of corners if
+indices is 0 (then numIndices is the number of corners and vertex i is
+corner i). Triangles are counter clockwise when seen from the front.
+*/
+
+enum VertexCacheModel {
+    // a vertex stays in the cache for cacheSize misses, like most GPUs
+    VERTEX_CACHE_FIFO = 0,
+    // a hit moves the vertex to the front again
+    VERTEX_CACHE_LRU,
+    kNumVertexCacheModels
+};
+
+struct VertexCacheStats {
+    uint32_t transformedVertices;
+    // average cache miss ratio, transformed vertices per triangle, from 0.5
+    // for large regular grids to 3
+    float acmr;
+    // average transformed vertex ratio, transformed vertices per referenced
+    // vertex, 1 is optimal
+    float atvr;
+};
+
+// simulates the post transform cache of a GPU
+VertexCacheStats analyzeVertexCache(const uint16_t *indices, uint32_t numIndices,
+        uint32_t numVertices, VertexCacheModel model, unsigned int cacheSize);
+
+// memory the vertex fetch of a GPU reads through a FIFO cache of
+// kFetchCacheLines lines of kFetchCacheLineSize bytes
+const unsigned int kFetchCacheLineSize = 64;
+const unsigned int kFetchCacheLines = 256;
+
+struct VertexFetchStats {
+    uint64_t fetchedBytes;
+    // fetched bytes per byte of the referenced vertices, 1 is optimal
+    float overfetch;
+    // 1 / overfetch, the part of the fetched bytes that is used
+    float efficiency;
+};
+
+// vertexStride is the distance of two vertices in the stream in bytes
+VertexFetchStats analyzeVertexFetch(const uint16_t *indices, uint32_t numIndices,
+        uint32_t numVertices, size_t vertexStride);
+
+// the overdraw is rasterized from every side along the axes, the longer
+// side of the bounds is kOverdrawResolution pixels
+const unsigned int kOverdrawViews = 6;
+const unsigned int kOverdrawResolution = 256;
+
+struct OverdrawStats {
+    // pixels covered by at least one front facing triangle
+    uint64_t coveredPixels;
+    // pixels that pass the depth test when drawn in index order
+    uint64_t shadedPixels;
+    // shaded per covered pixels, 1 is optimal
+    float overdraw;
+};
+
+// positionStride is the distance of two positions in floats
+OverdrawStats analyzeOverdraw(const float *positions, size_t positionStride,
+        uint32_t numVertices, const uint16_t *indices, uint32_t numIndices);
+
+#endif // RCM_ANALYZE_H
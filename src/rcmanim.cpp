@@ -0,0 +1,437 @@
+/* src/rcmanim.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include "rcmanim.h"
+#include "internal/trace.h"
+#include <iostream>
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// frames are stored in 16 bit
+static const unsigned int kMaxFrames = 0xffff;
+// the three smallest components of a unit quaternion lie within +-1/sqrt(2)
+static const float kSmallestThreeRange = 0.70710678f;
+static const float kQuantize15 = 32767.0f;
+static const float kQuantize16 = 65535.0f;
+
+// one resampled channel, every frame has 4 floats (vectors leave w at 0)
+typedef std::vector<float> Samples;
+
+static void lerpScalar(const float *a, const float *b, float t, float *out) {
+    for (unsigned int i = 0; i < 4; i++) {
+        out[i] = a[i] + (b[i] - a[i]) * t;
+    }
+}
+
+static void normalizeQuaternion(float *q) {
+    const float length = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    if (length > 0.0f) {
+        for (unsigned int i = 0; i < 4; i++) {
+            q[i] /= length;
+        }
+    } else {
+        q[0] = q[1] = q[2] = 0.0f;
+        q[3] = 1.0f;
+    }
+}
+
+static float dot4(const float *a, const float *b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+}
+
+// linear interpolation, for rotations along the shorter arc and normalized
+static void interpolate(const float *a, const float *b, float t, bool isRotation, float *out) {
+    if (!isRotation) {
+        lerpScalar(a, b, t, out);
+        return;
+    }
+    float other[4] = {b[0], b[1], b[2], b[3]};
+    if (dot4(a, b) < 0.0f) {
+        for (unsigned int i = 0; i < 4; i++) {
+            other[i] = -other[i];
+        }
+    }
+    lerpScalar(a, other, t, out);
+    normalizeQuaternion(out);
+}
+
+template<typename Key, unsigned int N>
+static void resampleChannel(const std::vector<Key> &keys, const float *defaultValue,
+        unsigned int numFrames, float sampleRate, float duration, Samples &samples) {
+    const bool isRotation = N == 4;
+    samples.assign(numFrames * 4, 0.0f);
+    size_t key = 0;
+    for (unsigned int f = 0; f < numFrames; f++) {
+        float *sample = &samples[f * 4];
+        float time = f / sampleRate;
+        if (time > duration) {
+            time = duration;
+        }
+        if (keys.empty()) {
+            memcpy(sample, defaultValue, N * sizeof(float));
+        } else if (time <= keys[0].time || keys.size() == 1) {
+            memcpy(sample, keys[0].value, N * sizeof(float));
+        } else {
+            while (key + 1 < keys.size() && keys[key + 1].time <= time) {
+                key++;
+            }
+            if (key + 1 == keys.size()) {
+                memcpy(sample, keys[key].value, N * sizeof(float));
+            } else {
+                float a[4] = {0, 0, 0, 0};
+                float b[4] = {0, 0, 0, 0};
+                memcpy(a, keys[key].value, N * sizeof(float));
+                memcpy(b, keys[key + 1].value, N * sizeof(float));
+                const float span = keys[key + 1].time - keys[key].time;
+                const float t = span > 0.0f ? (time - keys[key].time) / span : 0.0f;
+                interpolate(a, b, t, isRotation, sample);
+            }
+        }
+        // keep consecutive rotations in the same hemisphere
+        if (isRotation) {
+            normalizeQuaternion(sample);
+            if (f > 0 && dot4(sample, sample - 4) < 0.0f) {
+                for (unsigned int i = 0; i < 4; i++) {
+                    sample[i] = -sample[i];
+                }
+            }
+        }
+    }
+}
+
+// true if the interpolation between the frames first and last reproduces all
+// frames in between within the tolerance
+static bool segmentFits(const Samples &samples, unsigned int first, unsigned int last,
+        bool isRotation, float tolerance) {
+    const float *a = &samples[first * 4];
+    const float *b = &samples[last * 4];
+    for (unsigned int f = first + 1; f < last; f++) {
+        float value[4];
+        interpolate(a, b, (float) (f - first) / (last - first), isRotation, value);
+        for (unsigned int i = 0; i < 4; i++) {
+            if (fabsf(value[i] - samples[f * 4 + i]) > tolerance) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// greedy fit: every segment is extended as long as the straight line from its
+// first frame still covers all frames in between
+static void fitChannel(const Samples &samples, unsigned int numFrames, bool isRotation,
+        float tolerance, std::vector<unsigned int> &frames) {
+    frames.clear();
+    frames.push_back(0);
+    if (numFrames == 1 || segmentFits(samples, 0, numFrames - 1, isRotation, tolerance)) {
+        bool constant = true;
+        for (unsigned int f = 1; f < numFrames && constant; f++) {
+            for (unsigned int i = 0; i < 4; i++) {
+                constant = constant && fabsf(samples[f * 4 + i] - samples[i]) <= tolerance;
+            }
+        }
+        if (!constant) {
+            frames.push_back(numFrames - 1);
+        }
+        return;
+    }
+    unsigned int first = 0;
+    while (first < numFrames - 1) {
+        unsigned int last = first + 1;
+        while (last < numFrames - 1 && segmentFits(samples, first, last + 1, isRotation, tolerance)) {
+            last++;
+        }
+        frames.push_back(last);
+        first = last;
+    }
+}
+
+static uint16_t quantize(float value, float rangeMin, float rangeExtent, float steps) {
+    if (rangeExtent <= 0.0f) {
+        return 0;
+    }
+    float normalized = (value - rangeMin) / rangeExtent;
+    normalized = normalized < 0.0f ? 0.0f : (normalized > 1.0f ? 1.0f : normalized);
+    return (uint16_t) (normalized * steps + 0.5f);
+}
+
+// smallest three: the index of the largest component goes into the top bits
+// of the first two values, the other components take 15 bits each. The
+// largest component is made positive and restored from the unit length.
+static void encodeRotation(const float *rotation, uint16_t *value) {
+    float q[4];
+    memcpy(q, rotation, sizeof(q));
+    unsigned int largest = 0;
+    for (unsigned int i = 1; i < 4; i++) {
+        if (fabsf(q[i]) > fabsf(q[largest])) {
+            largest = i;
+        }
+    }
+    const float sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+    for (unsigned int i = 0, n = 0; i < 4; i++) {
+        if (i != largest) {
+            value[n++] = quantize(q[i] * sign, -kSmallestThreeRange, 2.0f * kSmallestThreeRange,
+                                  kQuantize15);
+        }
+    }
+    value[0] |= (largest >> 1) << 15;
+    value[1] |= (largest & 1) << 15;
+}
+
+static void decodeRotation(const uint16_t *value, float *rotation) {
+    const unsigned int largest = ((value[0] >> 15) << 1) | (value[1] >> 15);
+    const float scale = 2.0f * kSmallestThreeRange / kQuantize15;
+    float sum = 0.0f;
+    for (unsigned int i = 0, n = 0; i < 4; i++) {
+        if (i != largest) {
+            const float component = (value[n++] & 0x7fff) * scale - kSmallestThreeRange;
+            rotation[i] = component;
+            sum += component * component;
+        }
+    }
+    rotation[largest] = sum < 1.0f ? sqrtf(1.0f - sum) : 0.0f;
+}
+
+static void decodeVector(const uint16_t *value, const ChannelHeader &channel, float *vector) {
+    for (unsigned int i = 0; i < 3; i++) {
+        vector[i] = channel.rangeMin[i] + value[i] * (channel.rangeExtent[i] / kQuantize16);
+    }
+    vector[3] = 0.0f;
+}
+
+static void compressChannel(const Samples &samples, unsigned int numFrames, bool isRotation,
+        float tolerance, ChannelHeader &channel, std::vector<AnimationKey> &keys) {
+    std::vector<unsigned int> frames;
+    fitChannel(samples, numFrames, isRotation, tolerance, frames);
+    memset(&channel, 0, sizeof(ChannelHeader));
+    channel.firstKey = keys.size();
+    channel.keyCount = frames.size();
+    if (!isRotation) {
+        for (unsigned int i = 0; i < 3; i++) {
+            float low = samples[frames[0] * 4 + i];
+            float high = low;
+            for (size_t k = 1; k < frames.size(); k++) {
+                const float value = samples[frames[k] * 4 + i];
+                low = value < low ? value : low;
+                high = value > high ? value : high;
+            }
+            channel.rangeMin[i] = low;
+            channel.rangeExtent[i] = high - low;
+        }
+    }
+    for (size_t k = 0; k < frames.size(); k++) {
+        const float *sample = &samples[frames[k] * 4];
+        AnimationKey key;
+        key.frame = frames[k];
+        if (isRotation) {
+            encodeRotation(sample, key.value);
+        } else {
+            for (unsigned int i = 0; i < 3; i++) {
+                key.value[i] = quantize(sample[i], channel.rangeMin[i], channel.rangeExtent[i],
+                                        kQuantize16);
+            }
+        }
+        keys.push_back(key);
+    }
+}
+
+bool compressAnimation(const Animation &animation, std::vector<uint8_t> &out,
+        float sampleRate, float tolerance) {
+    TraceScope trace("compressAnimation");
+    if (sampleRate <= 0.0f || animation.duration < 0.0f) {
+        std::cerr << "invalid sample rate or duration" << std::endl;
+        return false;
+    }
+    const float frameCount = ceilf(animation.duration * sampleRate - 1e-4f) + 1.0f;
+    if (frameCount > kMaxFrames) {
+        std::cerr << "animation too long for the sample rate: " << animation.duration << "s"
+                  << std::endl;
+        return false;
+    }
+    const unsigned int numFrames = (unsigned int) frameCount;
+    const float zero[3] = {0.0f, 0.0f, 0.0f};
+    const float one[3] = {1.0f, 1.0f, 1.0f};
+    const float identity[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+
+    std::vector<CompressedTrack> tracks(animation.tracks.size());
+    std::vector<AnimationKey> keys;
+    Samples samples;
+    for (size_t t = 0; t < animation.tracks.size(); t++) {
+        const AnimationTrack &track = animation.tracks[t];
+        tracks[t].nameHash = track.nameHash;
+        resampleChannel<VectorKey, 3>(track.translations, zero, numFrames, sampleRate,
+                                      animation.duration, samples);
+        compressChannel(samples, numFrames, false, tolerance,
+                        tracks[t].channels[TRANSLATION_CHANNEL], keys);
+        resampleChannel<RotationKey, 4>(track.rotations, identity, numFrames, sampleRate,
+                                        animation.duration, samples);
+        compressChannel(samples, numFrames, true, tolerance,
+                        tracks[t].channels[ROTATION_CHANNEL], keys);
+        resampleChannel<VectorKey, 3>(track.scales, one, numFrames, sampleRate,
+                                      animation.duration, samples);
+        compressChannel(samples, numFrames, false, tolerance,
+                        tracks[t].channels[SCALE_CHANNEL], keys);
+    }
+
+    AnimationHeader header;
+    header.nameHash = animation.nameHash;
+    header.duration = animation.duration;
+    header.sampleRate = sampleRate;
+    header.trackCount = tracks.size();
+    header.keyCount = keys.size();
+    const size_t tracksSize = tracks.size() * sizeof(CompressedTrack);
+    const size_t keysSize = keys.size() * sizeof(AnimationKey);
+    out.resize(sizeof(AnimationHeader) + tracksSize + keysSize);
+    memcpy(&out[0], &header, sizeof(AnimationHeader));
+    if (tracksSize > 0) {
+        memcpy(&out[sizeof(AnimationHeader)], &tracks[0], tracksSize);
+    }
+    if (keysSize > 0) {
+        memcpy(&out[sizeof(AnimationHeader) + tracksSize], &keys[0], keysSize);
+    }
+    return true;
+}
+
+bool openAnimation(const void *data, size_t size, AnimationView *view) {
+    if (!data || size < sizeof(AnimationHeader) || ((uintptr_t) data % sizeof(uint64_t)) != 0) {
+        return false;
+    }
+    const AnimationHeader *header = (const AnimationHeader*) data;
+    const size_t expected = sizeof(AnimationHeader) +
+                            (size_t) header->trackCount * sizeof(CompressedTrack) +
+                            (size_t) header->keyCount * sizeof(AnimationKey);
+    if (expected != size || header->sampleRate <= 0.0f) {
+        std::cerr << "animation data does not match its size" << std::endl;
+        return false;
+    }
+    const CompressedTrack *tracks = (const CompressedTrack*) (header + 1);
+    for (uint32_t t = 0; t < header->trackCount; t++) {
+        for (unsigned int c = 0; c < kNumAnimationChannels; c++) {
+            const ChannelHeader &channel = tracks[t].channels[c];
+            if (channel.keyCount == 0 || channel.firstKey > header->keyCount ||
+                channel.keyCount > header->keyCount - channel.firstKey) {
+                std::cerr << "animation channel out of range" << std::endl;
+                return false;
+            }
+        }
+    }
+    view->header = header;
+    view->tracks = tracks;
+    view->keys = (const AnimationKey*) (tracks + header->trackCount);
+    view->allocation = 0;
+    return true;
+}
+
+// moves the cursor to the last key at or before frame
+static inline void seekKey(const AnimationKey *keys, uint32_t keyCount, float frame,
+        uint32_t &cursor) {
+    if (cursor >= keyCount) {
+        cursor = 0;
+    }
+    while (cursor > 0 && keys[cursor].frame > frame) {
+        cursor--;
+    }
+    while (cursor + 1 < keyCount && keys[cursor + 1].frame <= frame) {
+        cursor++;
+    }
+}
+
+#ifdef __SSE2__
+static inline __m128 lerp4(__m128 a, __m128 b, float t) {
+    return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(t)));
+}
+
+// sum of all four lanes in every lane
+static inline __m128 horizontalSum(__m128 v) {
+    __m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_add_ps(v, shuffled);
+    shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2));
+    return _mm_add_ps(v, shuffled);
+}
+
+static inline void nlerp4(const float *a, const float *b, float t, float *out) {
+    const __m128 qa = _mm_loadu_ps(a);
+    __m128 qb = _mm_loadu_ps(b);
+    // flip b into the hemisphere of a: xor with the sign of the dot product
+    const __m128 sign = _mm_and_ps(horizontalSum(_mm_mul_ps(qa, qb)), _mm_set1_ps(-0.0f));
+    qb = _mm_xor_ps(qb, sign);
+    const __m128 q = lerp4(qa, qb, t);
+    _mm_storeu_ps(out, _mm_div_ps(q, _mm_sqrt_ps(horizontalSum(_mm_mul_ps(q, q)))));
+}
+
+static inline void vlerp4(const float *a, const float *b, float t, float *out) {
+    _mm_storeu_ps(out, lerp4(_mm_loadu_ps(a), _mm_loadu_ps(b), t));
+}
+#else
+static inline void nlerp4(const float *a, const float *b, float t, float *out) {
+    interpolate(a, b, t, true, out);
+}
+
+static inline void vlerp4(const float *a, const float *b, float t, float *out) {
+    lerpScalar(a, b, t, out);
+}
+#endif
+
+// decodes the two keys around frame and interpolates them into value
+static inline void sampleChannel(const AnimationView &view, const ChannelHeader &channel,
+        bool isRotation, float frame, uint32_t &cursor, float *value) {
+    const AnimationKey *keys = view.keys + channel.firstKey;
+    seekKey(keys, channel.keyCount, frame, cursor);
+    const AnimationKey &first = keys[cursor];
+    const AnimationKey &next = keys[cursor + 1 < channel.keyCount ? cursor + 1 : cursor];
+    float t = 0.0f;
+    if (next.frame > first.frame) {
+        t = (frame - first.frame) / (next.frame - first.frame);
+        t = t > 1.0f ? 1.0f : t;
+    }
+    float a[4];
+    float b[4];
+    if (isRotation) {
+        decodeRotation(first.value, a);
+        decodeRotation(next.value, b);
+        nlerp4(a, b, t, value);
+    } else {
+        decodeVector(first.value, channel, a);
+        decodeVector(next.value, channel, b);
+        vlerp4(a, b, t, value);
+    }
+}
+
+void sampleAnimation(const AnimationView &view, float time, uint32_t *cursors,
+        NodeTransform *transforms) {
+    const AnimationHeader *header = view.header;
+    time = time < 0.0f ? 0.0f : (time > header->duration ? header->duration : time);
+    const float frame = time * header->sampleRate;
+    for (uint32_t t = 0; t < header->trackCount; t++) {
+        const CompressedTrack &track = view.tracks[t];
+        uint32_t *trackCursors = cursors + t * kNumAnimationChannels;
+        float value[4];
+        NodeTransform &transform = transforms[t];
+        sampleChannel(view, track.channels[TRANSLATION_CHANNEL], false, frame,
+                      trackCursors[TRANSLATION_CHANNEL], value);
+        memcpy(transform.translation, value, sizeof(transform.translation));
+        sampleChannel(view, track.channels[ROTATION_CHANNEL], true, frame,
+                      trackCursors[ROTATION_CHANNEL], transform.rotation);
+        sampleChannel(view, track.channels[SCALE_CHANNEL], false, frame,
+                      trackCursors[SCALE_CHANNEL], value);
+        memcpy(transform.scale, value, sizeof(transform.scale));
+    }
+}
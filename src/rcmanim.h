@@ -0,0 +1,139 @@
+/* src/rcmanim.h
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#ifndef RCM_ANIM_H
+#define RCM_ANIM_H
+
+#include "rcm.h"
+#include <vector>
+
+/* Compression of skeletal animation clips.
+
+Every track animates one node (bone) with a translation, a rotation and a
+scale channel. The compressor resamples each channel at a fixed rate and
+keeps only the samples that are needed to reproduce the channel by linear
+interpolation within the tolerance. A channel that does not change keeps a
+single key. Translations and scales are stored as 16 bit values inside the
+range of their channel, rotations with the smallest three components in 15
+bits each.
+
+The sampler walks the keys with one cursor per channel, so playing a clip
+forward touches every key once and in memory order.
+*/
+
+const float kDefaultAnimationSampleRate = 30.0f;
+const float kDefaultAnimationTolerance = 0.001f;
+
+// source keys, times are in seconds
+struct VectorKey {
+    float time;
+    float value[3];
+};
+
+// rotation as quaternion x, y, z, w
+struct RotationKey {
+    float time;
+    float value[4];
+};
+
+struct AnimationTrack {
+    // hash of the animated node, matches BoneData::nameHash
+    uint64_t nameHash;
+    std::vector<VectorKey> translations;
+    std::vector<RotationKey> rotations;
+    std::vector<VectorKey> scales;
+};
+
+struct Animation {
+    uint64_t nameHash;
+    float duration;
+    std::vector<AnimationTrack> tracks;
+};
+
+/* compressed layout, this is the data of an ANIMATION object:
+  AnimationHeader
+  track count * CompressedTrack
+  key count * AnimationKey, the keys of one channel follow each other
+*/
+
+enum AnimationChannel {
+    TRANSLATION_CHANNEL = 0,
+    ROTATION_CHANNEL,
+    SCALE_CHANNEL,
+    kNumAnimationChannels
+};
+
+struct AnimationHeader {
+    uint64_t nameHash;
+    float duration;
+    float sampleRate;
+    uint32_t trackCount;
+    uint32_t keyCount;
+};
+
+struct ChannelHeader {
+    uint32_t firstKey;
+    uint32_t keyCount;
+    // translation and scale values are min + value / 65535 * extent
+    float rangeMin[3];
+    float rangeExtent[3];
+};
+
+struct CompressedTrack {
+    uint64_t nameHash;
+    ChannelHeader channels[kNumAnimationChannels];
+};
+
+struct AnimationKey {
+    // sample number at the sample rate of the clip
+    uint16_t frame;
+    uint16_t value[3];
+};
+
+// local transform of a node, rotation is x, y, z, w
+struct NodeTransform {
+    float translation[3];
+    float rotation[4];
+    float scale[3];
+};
+
+// compressed clip, referencing memory owned by someone else
+struct AnimationView {
+    const AnimationHeader *header;
+    const CompressedTrack *tracks;
+    const AnimationKey *keys;
+    // set if the data had to be copied, release with delete[] (char*)
+    void *allocation;
+};
+
+// resamples and compresses the clip. The error of every sampled value stays
+// within tolerance plus the quantization error.
+bool compressAnimation(const Animation &animation, std::vector<uint8_t> &out,
+        float sampleRate = kDefaultAnimationSampleRate,
+        float tolerance = kDefaultAnimationTolerance);
+
+// checks the compressed data and sets up the view, data has to be 8 byte aligned
+bool openAnimation(const void *data, size_t size, AnimationView *view);
+
+// samples all tracks at the given time into transforms, one per track.
+// cursors holds trackCount * kNumAnimationChannels entries that remember the
+// last key of every channel between calls, initialize them with 0. Time is
+// clamped to the duration of the clip.
+void sampleAnimation(const AnimationView &view, float time, uint32_t *cursors,
+        NodeTransform *transforms);
+
+#endif // RCM_ANIM_H
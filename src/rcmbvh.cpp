@@ -0,0 +1,745 @@
+/* src/rcmbvh.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include "rcmbvh.h"
+#include "internal/thread_pool.h"
+#include "internal/trace.h"
+#include <algorithm>
+#include <iostream>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const unsigned int kNumBins = 16;
+// ranges with fewer triangles are built by a single task
+static const unsigned int kMinTaskTriangles = 4096;
+// leaves store the first triangle in 27 bits
+static const uint32_t kMaxTriangles = 1u << 27;
+static const float kInv255 = 1.0f / 255.0f;
+
+struct Box {
+    float min[3];
+    float max[3];
+};
+
+static void resetBox(Box &box) {
+    for (unsigned int k = 0; k < 3; k++) {
+        box.min[k] = FLT_MAX;
+        box.max[k] = -FLT_MAX;
+    }
+}
+
+static void growBox(Box &box, const Box &other) {
+    for (unsigned int k = 0; k < 3; k++) {
+        box.min[k] = std::min(box.min[k], other.min[k]);
+        box.max[k] = std::max(box.max[k], other.max[k]);
+    }
+}
+
+static void growBox(Box &box, const float *point) {
+    for (unsigned int k = 0; k < 3; k++) {
+        box.min[k] = std::min(box.min[k], point[k]);
+        box.max[k] = std::max(box.max[k], point[k]);
+    }
+}
+
+static float surfaceArea(const Box &box) {
+    const float dx = box.max[0] - box.min[0];
+    const float dy = box.max[1] - box.min[1];
+    const float dz = box.max[2] - box.min[2];
+    if (dx < 0.0f) {
+        return 0.0f;
+    }
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+struct BuildPrimitive {
+    Box box;
+    float centroid[3];
+    uint32_t triangle;
+};
+
+struct BuildNode {
+    Box box;
+    uint32_t first;
+    uint32_t count;
+    // children in the same tree, -1 for leaves
+    int32_t left;
+    int32_t right;
+    // leaves of the top tree that are built by a task: index of the subtree
+    int32_t subtree;
+};
+
+typedef std::vector<BuildNode> BuildTree;
+
+static BuildNode createNode(const std::vector<BuildPrimitive> &primitives,
+        uint32_t first, uint32_t count) {
+    BuildNode node;
+    resetBox(node.box);
+    for (uint32_t i = first; i < first + count; i++) {
+        growBox(node.box, primitives[i].box);
+    }
+    node.first = first;
+    node.count = count;
+    node.left = -1;
+    node.right = -1;
+    node.subtree = -1;
+    return node;
+}
+
+static unsigned int binIndex(float centroid, float low, float scale) {
+    const unsigned int bin = (unsigned int) ((centroid - low) * scale);
+    return bin < kNumBins ? bin : kNumBins - 1;
+}
+
+// finds the split of the range with the lowest SAH cost over binned
+// centroids and partitions the range. Returns false if a leaf is cheaper.
+static bool splitRange(std::vector<BuildPrimitive> &primitives, const BuildNode &node,
+        uint32_t &mid) {
+    if (node.count <= 1) {
+        return false;
+    }
+    Box centroids;
+    resetBox(centroids);
+    for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        growBox(centroids, primitives[i].centroid);
+    }
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    unsigned int bestBin = 0;
+    for (unsigned int axis = 0; axis < 3; axis++) {
+        const float extent = centroids.max[axis] - centroids.min[axis];
+        if (extent <= 0.0f) {
+            continue;
+        }
+        const float scale = kNumBins / extent;
+        Box bins[kNumBins];
+        uint32_t counts[kNumBins] = {0};
+        for (unsigned int b = 0; b < kNumBins; b++) {
+            resetBox(bins[b]);
+        }
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            const unsigned int b = binIndex(primitives[i].centroid[axis], centroids.min[axis], scale);
+            growBox(bins[b], primitives[i].box);
+            counts[b]++;
+        }
+        // sweep from the right, then from the left to evaluate every plane
+        float rightArea[kNumBins];
+        uint32_t rightCount[kNumBins];
+        Box box;
+        resetBox(box);
+        uint32_t count = 0;
+        for (unsigned int b = kNumBins - 1; b > 0; b--) {
+            growBox(box, bins[b]);
+            count += counts[b];
+            rightArea[b] = surfaceArea(box);
+            rightCount[b] = count;
+        }
+        resetBox(box);
+        count = 0;
+        for (unsigned int b = 0; b < kNumBins - 1; b++) {
+            growBox(box, bins[b]);
+            count += counts[b];
+            if (count == 0 || rightCount[b + 1] == 0) {
+                continue;
+            }
+            const float cost = surfaceArea(box) * count + rightArea[b + 1] * rightCount[b + 1];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b;
+            }
+        }
+    }
+
+    // traversal and intersection cost are both 1
+    const float area = surfaceArea(node.box);
+    const bool mustSplit = node.count > kBvhMaxLeafTriangles;
+    if (bestAxis < 0 || (!mustSplit && area + bestCost >= area * node.count)) {
+        if (!mustSplit) {
+            return false;
+        }
+        // all centroids are equal, split in the middle
+        mid = node.first + node.count / 2;
+        return true;
+    }
+    const float low = centroids.min[bestAxis];
+    const float scale = kNumBins / (centroids.max[bestAxis] - low);
+    BuildPrimitive *begin = &primitives[node.first];
+    BuildPrimitive *split = std::partition(begin, begin + node.count,
+            [bestAxis, bestBin, low, scale](const BuildPrimitive &primitive) {
+                return binIndex(primitive.centroid[bestAxis], low, scale) <= bestBin;
+            });
+    mid = node.first + (uint32_t) (split - begin);
+    if (mid == node.first || mid == node.first + node.count) {
+        mid = node.first + node.count / 2;
+    }
+    return true;
+}
+
+// builds a binary tree over the range, without recursion so degenerate
+// input can not exhaust the stack
+static void buildTree(std::vector<BuildPrimitive> &primitives, uint32_t first, uint32_t count,
+        BuildTree &tree) {
+    TraceScope trace("buildTree");
+    tree.push_back(createNode(primitives, first, count));
+    std::vector<int32_t> stack(1, 0);
+    while (!stack.empty()) {
+        const int32_t index = stack.back();
+        stack.pop_back();
+        const BuildNode node = tree[index];
+        uint32_t mid;
+        if (!splitRange(primitives, node, mid)) {
+            continue;
+        }
+        const int32_t left = tree.size();
+        tree.push_back(createNode(primitives, node.first, mid - node.first));
+        tree.push_back(createNode(primitives, mid, node.first + node.count - mid));
+        tree[index].left = left;
+        tree[index].right = left + 1;
+        stack.push_back(left);
+        stack.push_back(left + 1);
+    }
+}
+
+// the top of the tree is split on the calling thread until there are enough
+// ranges for all threads, the ranges are then built in parallel. Every task
+// works on its own part of the primitives.
+static void buildTrees(std::vector<BuildPrimitive> &primitives, unsigned int numThreads,
+        BuildTree &top, std::vector<BuildTree> &subtrees) {
+    if (numThreads == 0) {
+        numThreads = std::thread::hardware_concurrency();
+    }
+    const size_t wantedTasks = (numThreads > 0 ? numThreads : 1) * 4;
+    top.push_back(createNode(primitives, 0, primitives.size()));
+    std::vector<int32_t> tasks;
+    // breadth first, so the ranges of the tasks have similar sizes
+    for (size_t next = 0; next < top.size(); next++) {
+        const BuildNode node = top[next];
+        if (node.count <= kMinTaskTriangles || tasks.size() + top.size() - next >= wantedTasks) {
+            top[next].subtree = tasks.size();
+            tasks.push_back(next);
+            continue;
+        }
+        uint32_t mid;
+        if (!splitRange(primitives, node, mid)) {
+            continue;
+        }
+        const int32_t left = top.size();
+        top.push_back(createNode(primitives, node.first, mid - node.first));
+        top.push_back(createNode(primitives, mid, node.first + node.count - mid));
+        top[next].left = left;
+        top[next].right = left + 1;
+    }
+
+    subtrees.resize(tasks.size());
+    if (tasks.size() == 1) {
+        buildTree(primitives, top[tasks[0]].first, top[tasks[0]].count, subtrees[0]);
+        return;
+    }
+    ThreadPool pool(numThreads);
+    for (size_t i = 0; i < tasks.size(); i++) {
+        const uint32_t first = top[tasks[i]].first;
+        const uint32_t count = top[tasks[i]].count;
+        BuildTree *subtree = &subtrees[i];
+        std::vector<BuildPrimitive> *shared = &primitives;
+        pool.enqueue([shared, first, count, subtree] {
+            buildTree(*shared, first, count, *subtree);
+        });
+    }
+    pool.wait();
+}
+
+struct NodeRef {
+    const BuildTree *tree;
+    int32_t index;
+};
+
+static const BuildNode& buildNode(const NodeRef &ref) {
+    return (*ref.tree)[ref.index];
+}
+
+static bool isInner(const NodeRef &ref) {
+    return buildNode(ref).left >= 0;
+}
+
+// nodes of the top tree that were built by a task continue in their subtree
+static NodeRef resolve(const BuildTree &top, const std::vector<BuildTree> &subtrees,
+        const BuildTree *tree, int32_t index) {
+    NodeRef ref = {tree, index};
+    if (tree == &top && top[index].subtree >= 0) {
+        ref.tree = &subtrees[top[index].subtree];
+        ref.index = 0;
+    }
+    return ref;
+}
+
+static void setNodeBox(BvhNode &node, const Box &box) {
+    for (unsigned int k = 0; k < 3; k++) {
+        node.origin[k] = box.min[k];
+        float extent = box.max[k] - box.min[k];
+        // the largest quantized value has to reach the end of the box
+        while (node.origin[k] + 255.0f * (extent * kInv255) < box.max[k]) {
+            extent = nextafterf(extent, FLT_MAX);
+        }
+        node.extent[k] = extent;
+    }
+}
+
+// quantizes the box of a child, rounded outwards with the same arithmetic
+// the traversal uses to restore it
+static void setChildBox(BvhNode &node, unsigned int child, const Box &box) {
+    for (unsigned int k = 0; k < 3; k++) {
+        const float scale = node.extent[k] * kInv255;
+        int low = 0;
+        int high = 0;
+        if (scale > 0.0f) {
+            low = std::max(0, std::min(255, (int) floorf((box.min[k] - node.origin[k]) / scale)));
+            high = std::max(0, std::min(255, (int) ceilf((box.max[k] - node.origin[k]) / scale)));
+            while (low > 0 && node.origin[k] + low * scale > box.min[k]) {
+                low--;
+            }
+            while (high < 255 && node.origin[k] + high * scale < box.max[k]) {
+                high++;
+            }
+        }
+        node.childMin[k][child] = (uint8_t) low;
+        node.childMax[k][child] = (uint8_t) high;
+    }
+}
+
+// turns the binary tree into nodes with up to four children by pulling up
+// the children of the largest inner child. Nodes are stored in depth first
+// order, so every child has a larger index than its parent.
+static void collapseTrees(const std::vector<BuildPrimitive> &primitives, const BuildTree &top,
+        const std::vector<BuildTree> &subtrees, std::vector<BvhNode> &nodes,
+        std::vector<uint32_t> &triangles) {
+    struct Pending {
+        NodeRef ref;
+        uint32_t node;
+    };
+    Pending root = {resolve(top, subtrees, &top, 0), 0};
+    std::vector<Pending> stack(1, root);
+    nodes.resize(1);
+    while (!stack.empty()) {
+        const Pending pending = stack.back();
+        stack.pop_back();
+        NodeRef children[4];
+        unsigned int numChildren = 0;
+        if (isInner(pending.ref)) {
+            const BuildNode &parent = buildNode(pending.ref);
+            children[numChildren++] = resolve(top, subtrees, pending.ref.tree, parent.left);
+            children[numChildren++] = resolve(top, subtrees, pending.ref.tree, parent.right);
+            while (numChildren < 4) {
+                int largest = -1;
+                float largestArea = -1.0f;
+                for (unsigned int c = 0; c < numChildren; c++) {
+                    const float area = surfaceArea(buildNode(children[c]).box);
+                    if (isInner(children[c]) && area > largestArea) {
+                        largest = c;
+                        largestArea = area;
+                    }
+                }
+                if (largest < 0) {
+                    break;
+                }
+                const NodeRef inner = children[largest];
+                children[largest] = resolve(top, subtrees, inner.tree, buildNode(inner).left);
+                children[numChildren++] = resolve(top, subtrees, inner.tree, buildNode(inner).right);
+            }
+        } else {
+            // a root with few triangles is a node with a single leaf
+            children[numChildren++] = pending.ref;
+        }
+
+        BvhNode node;
+        memset(&node, 0, sizeof(BvhNode));
+        setNodeBox(node, buildNode(pending.ref).box);
+        for (unsigned int c = 0; c < 4; c++) {
+            if (c >= numChildren) {
+                node.children[c] = kBvhEmptyChild;
+                continue;
+            }
+            const BuildNode &child = buildNode(children[c]);
+            setChildBox(node, c, child.box);
+            if (isInner(children[c])) {
+                node.children[c] = nodes.size();
+                Pending next = {children[c], (uint32_t) nodes.size()};
+                nodes.push_back(BvhNode());
+                stack.push_back(next);
+            } else {
+                node.children[c] = kBvhLeafFlag | ((uint32_t) triangles.size() << 4) |
+                                   (child.count - 1);
+                for (uint32_t i = child.first; i < child.first + child.count; i++) {
+                    triangles.push_back(primitives[i].triangle);
+                }
+            }
+        }
+        nodes[pending.node] = node;
+    }
+}
+
+// offset of the nodes from the start of the data at dataOffset in the file,
+// the nodes start on a cache line of the file
+static uint32_t bvhNodeOffset(size_t dataOffset) {
+    const size_t nodeStart = dataOffset + sizeof(BvhHeader);
+    return sizeof(BvhHeader) +
+           (kBvhNodeAlignment - nodeStart % kBvhNodeAlignment) % kBvhNodeAlignment;
+}
+
+// vertex of a corner, without indices the corners are the vertices
+static inline uint32_t cornerVertex(const uint16_t *indices, size_t corner) {
+    return indices ? indices[corner] : (uint32_t) corner;
+}
+
+bool buildBvh(const float *positions, size_t stride, unsigned int numVertices,
+        const uint16_t *indices, unsigned int numIndices, size_t dataOffset,
+        std::vector<uint8_t> &out, unsigned int numThreads) {
+    TraceScope trace("buildBvh");
+    const uint32_t numTriangles = numIndices / 3;
+    if (numTriangles >= kMaxTriangles) {
+        std::cerr << "too many triangles for a BVH: " << numTriangles << std::endl;
+        return false;
+    }
+    std::vector<BuildPrimitive> primitives(numTriangles);
+    for (uint32_t t = 0; t < numTriangles; t++) {
+        BuildPrimitive &primitive = primitives[t];
+        resetBox(primitive.box);
+        for (unsigned int c = 0; c < 3; c++) {
+            const uint32_t index = cornerVertex(indices, t * 3 + c);
+            if (index >= numVertices) {
+                std::cerr << "index out of range: " << index << std::endl;
+                return false;
+            }
+            growBox(primitive.box, positions + index * stride);
+        }
+        for (unsigned int k = 0; k < 3; k++) {
+            primitive.centroid[k] = (primitive.box.min[k] + primitive.box.max[k]) * 0.5f;
+        }
+        primitive.triangle = t;
+    }
+
+    std::vector<BvhNode> nodes;
+    std::vector<uint32_t> triangles;
+    if (numTriangles > 0) {
+        BuildTree top;
+        std::vector<BuildTree> subtrees;
+        buildTrees(primitives, numThreads, top, subtrees);
+        collapseTrees(primitives, top, subtrees, nodes, triangles);
+    }
+
+    BvhHeader header;
+    header.nodeCount = nodes.size();
+    header.triangleCount = numTriangles;
+    header.nodeOffset = bvhNodeOffset(dataOffset);
+    header.triangleOffset = header.nodeOffset + nodes.size() * sizeof(BvhNode);
+    out.assign(header.triangleOffset + triangles.size() * sizeof(uint32_t), 0);
+    memcpy(&out[0], &header, sizeof(BvhHeader));
+    if (!nodes.empty()) {
+        memcpy(&out[header.nodeOffset], &nodes[0], nodes.size() * sizeof(BvhNode));
+        memcpy(&out[header.triangleOffset], &triangles[0], triangles.size() * sizeof(uint32_t));
+    }
+    return true;
+}
+
+bool relayoutBvh(const void *data, size_t size, size_t dataOffset, std::vector<uint8_t> &out) {
+    BvhHeader header;
+    if (!data || size < sizeof(BvhHeader)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(BvhHeader));
+    if (header.nodeOffset < sizeof(BvhHeader) || header.triangleOffset < header.nodeOffset ||
+        header.triangleOffset > size) {
+        std::cerr << "BVH does not match its size" << std::endl;
+        return false;
+    }
+    // the nodes and the triangles move together
+    const size_t tail = size - header.nodeOffset;
+    const uint32_t nodeOffset = bvhNodeOffset(dataOffset);
+    const char *nodes = (const char*) data + header.nodeOffset;
+    header.triangleOffset = header.triangleOffset - header.nodeOffset + nodeOffset;
+    header.nodeOffset = nodeOffset;
+    out.assign(nodeOffset + tail, 0);
+    memcpy(&out[0], &header, sizeof(BvhHeader));
+    if (tail > 0) {
+        memcpy(&out[nodeOffset], nodes, tail);
+    }
+    return true;
+}
+
+bool openBvh(const void *data, size_t size, uint32_t nodeCount, uint32_t numIndices,
+        BvhView *view) {
+    if (!data || !view || size < sizeof(BvhHeader)) {
+        return false;
+    }
+    // the header is not aligned if the data starts anywhere in a file
+    BvhHeader header;
+    memcpy(&header, data, sizeof(BvhHeader));
+    const uint32_t numTriangles = header.triangleCount;
+    if (header.nodeCount != nodeCount || numTriangles != numIndices / 3 ||
+        (nodeCount == 0) != (numTriangles == 0) || header.nodeOffset < sizeof(BvhHeader) ||
+        header.triangleOffset != header.nodeOffset + (size_t) nodeCount * sizeof(BvhNode) ||
+        header.triangleOffset + (size_t) numTriangles * sizeof(uint32_t) != size) {
+        std::cerr << "BVH does not match its size" << std::endl;
+        return false;
+    }
+    const BvhNode *nodes = (const BvhNode*) ((const char*) data + header.nodeOffset);
+    const uint32_t *triangles = (const uint32_t*) ((const char*) data + header.triangleOffset);
+    if ((uintptr_t) nodes % sizeof(uint32_t) != 0) {
+        return false;
+    }
+    // children have larger indices than their parent, so every traversal ends
+    for (uint32_t i = 0; i < nodeCount; i++) {
+        for (unsigned int c = 0; c < 4; c++) {
+            const uint32_t child = nodes[i].children[c];
+            if (child == kBvhEmptyChild) {
+                continue;
+            }
+            const bool valid = isBvhLeaf(child) ?
+                    bvhLeafFirst(child) + bvhLeafCount(child) <= numTriangles :
+                    child > i && child < nodeCount;
+            if (!valid) {
+                std::cerr << "BVH node " << i << " is broken" << std::endl;
+                return false;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < numTriangles; i++) {
+        if (triangles[i] >= numTriangles) {
+            std::cerr << "BVH triangle out of range" << std::endl;
+            return false;
+        }
+    }
+    view->header = header;
+    view->nodes = nodes;
+    view->triangles = triangles;
+    view->allocation = 0;
+    return true;
+}
+
+// boxes of the four children of a node, [axis][child]
+#ifdef __SSE2__
+static inline __m128 loadQuantized(const uint8_t *values) {
+    int32_t packed;
+    memcpy(&packed, values, sizeof(packed));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bytes = _mm_cvtsi32_si128(packed);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+}
+
+static inline void dequantizeChildren(const BvhNode &node, float low[3][4], float high[3][4]) {
+    for (unsigned int k = 0; k < 3; k++) {
+        const __m128 origin = _mm_set1_ps(node.origin[k]);
+        const __m128 scale = _mm_set1_ps(node.extent[k] * kInv255);
+        _mm_storeu_ps(low[k], _mm_add_ps(origin, _mm_mul_ps(loadQuantized(node.childMin[k]), scale)));
+        _mm_storeu_ps(high[k], _mm_add_ps(origin, _mm_mul_ps(loadQuantized(node.childMax[k]), scale)));
+    }
+}
+
+// slab test of the ray against four boxes at once
+static inline void intersectChildren(const float low[3][4], const float high[3][4],
+        const float *origin, const float *invDirection, float *tNear, float *tFar) {
+    __m128 nearest = _mm_set1_ps(-FLT_MAX);
+    __m128 farthest = _mm_set1_ps(FLT_MAX);
+    for (unsigned int k = 0; k < 3; k++) {
+        const __m128 o = _mm_set1_ps(origin[k]);
+        const __m128 inv = _mm_set1_ps(invDirection[k]);
+        const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(low[k]), o), inv);
+        const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(high[k]), o), inv);
+        nearest = _mm_max_ps(nearest, _mm_min_ps(t0, t1));
+        farthest = _mm_min_ps(farthest, _mm_max_ps(t0, t1));
+    }
+    _mm_storeu_ps(tNear, nearest);
+    _mm_storeu_ps(tFar, farthest);
+}
+#else
+static inline void dequantizeChildren(const BvhNode &node, float low[3][4], float high[3][4]) {
+    for (unsigned int k = 0; k < 3; k++) {
+        const float scale = node.extent[k] * kInv255;
+        for (unsigned int c = 0; c < 4; c++) {
+            low[k][c] = node.origin[k] + node.childMin[k][c] * scale;
+            high[k][c] = node.origin[k] + node.childMax[k][c] * scale;
+        }
+    }
+}
+
+static inline void intersectChildren(const float low[3][4], const float high[3][4],
+        const float *origin, const float *invDirection, float *tNear, float *tFar) {
+    for (unsigned int c = 0; c < 4; c++) {
+        tNear[c] = -FLT_MAX;
+        tFar[c] = FLT_MAX;
+        for (unsigned int k = 0; k < 3; k++) {
+            const float t0 = (low[k][c] - origin[k]) * invDirection[k];
+            const float t1 = (high[k][c] - origin[k]) * invDirection[k];
+            tNear[c] = std::max(tNear[c], std::min(t0, t1));
+            tFar[c] = std::min(tFar[c], std::max(t0, t1));
+        }
+    }
+}
+#endif
+
+static void subtract(const float *a, const float *b, float *out) {
+    out[0] = a[0] - b[0];
+    out[1] = a[1] - b[1];
+    out[2] = a[2] - b[2];
+}
+
+static void cross(const float *a, const float *b, float *out) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static float dot(const float *a, const float *b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Moeller-Trumbore, both sides of the triangle count
+static bool intersectTriangle(const float *a, const float *b, const float *c,
+        const float *origin, const float *direction, float &t, float &u, float &v) {
+    float edge1[3], edge2[3], p[3], s[3], q[3];
+    subtract(b, a, edge1);
+    subtract(c, a, edge2);
+    cross(direction, edge2, p);
+    const float determinant = dot(edge1, p);
+    if (determinant == 0.0f) {
+        return false;
+    }
+    const float inverse = 1.0f / determinant;
+    subtract(origin, a, s);
+    u = dot(s, p) * inverse;
+    if (u < 0.0f || u > 1.0f) {
+        return false;
+    }
+    cross(s, edge1, q);
+    v = dot(direction, q) * inverse;
+    if (v < 0.0f || u + v > 1.0f) {
+        return false;
+    }
+    t = dot(edge2, q) * inverse;
+    return true;
+}
+
+bool intersectBvh(const BvhView &view, const float *positions, size_t stride,
+        const uint16_t *indices, const float *origin, const float *direction,
+        float maxDistance, BvhHit *hit) {
+    if (view.header.nodeCount == 0) {
+        return false;
+    }
+    // a huge finite value keeps 0 * inverse away from NaN
+    float invDirection[3];
+    for (unsigned int k = 0; k < 3; k++) {
+        invDirection[k] = direction[k] != 0.0f ? 1.0f / direction[k] :
+                          (signbit(direction[k]) ? -1e30f : 1e30f);
+    }
+    float closest = maxDistance;
+    bool found = false;
+    std::vector<uint32_t> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+    float low[3][4], high[3][4], tNear[4], tFar[4];
+    while (!stack.empty()) {
+        const BvhNode &node = view.nodes[stack.back()];
+        stack.pop_back();
+        dequantizeChildren(node, low, high);
+        intersectChildren(low, high, origin, invDirection, tNear, tFar);
+        for (unsigned int c = 0; c < 4; c++) {
+            const uint32_t child = node.children[c];
+            // a little slack for the rounding of the slab test
+            const float farthest = tFar[c] + 1e-5f * fabsf(tFar[c]);
+            if (child == kBvhEmptyChild || tNear[c] > farthest || farthest < 0.0f ||
+                tNear[c] > closest) {
+                continue;
+            }
+            if (!isBvhLeaf(child)) {
+                stack.push_back(child);
+                continue;
+            }
+            const uint32_t first = bvhLeafFirst(child);
+            for (uint32_t i = first; i < first + bvhLeafCount(child); i++) {
+                const uint32_t triangle = view.triangles[i];
+                const size_t corner = (size_t) triangle * 3;
+                float t, u, v;
+                if (intersectTriangle(positions + cornerVertex(indices, corner) * stride,
+                                      positions + cornerVertex(indices, corner + 1) * stride,
+                                      positions + cornerVertex(indices, corner + 2) * stride,
+                                      origin, direction, t, u, v) &&
+                    t >= 0.0f && t <= closest) {
+                    closest = t;
+                    found = true;
+                    hit->triangle = triangle;
+                    hit->distance = t;
+                    hit->u = u;
+                    hit->v = v;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+void overlapBvh(const BvhView &view, const float *positions, size_t stride,
+        const uint16_t *indices, const float *boxMin, const float *boxMax,
+        std::vector<uint32_t> &triangles) {
+    if (view.header.nodeCount == 0) {
+        return;
+    }
+    std::vector<uint32_t> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+    float low[3][4], high[3][4];
+    while (!stack.empty()) {
+        const BvhNode &node = view.nodes[stack.back()];
+        stack.pop_back();
+        dequantizeChildren(node, low, high);
+        for (unsigned int c = 0; c < 4; c++) {
+            const uint32_t child = node.children[c];
+            bool overlaps = child != kBvhEmptyChild;
+            for (unsigned int k = 0; k < 3 && overlaps; k++) {
+                overlaps = low[k][c] <= boxMax[k] && high[k][c] >= boxMin[k];
+            }
+            if (!overlaps) {
+                continue;
+            }
+            if (!isBvhLeaf(child)) {
+                stack.push_back(child);
+                continue;
+            }
+            const uint32_t first = bvhLeafFirst(child);
+            for (uint32_t i = first; i < first + bvhLeafCount(child); i++) {
+                const uint32_t triangle = view.triangles[i];
+                Box box;
+                resetBox(box);
+                for (unsigned int corner = 0; corner < 3; corner++) {
+                    growBox(box, positions +
+                                 cornerVertex(indices, (size_t) triangle * 3 + corner) * stride);
+                }
+                bool inside = true;
+                for (unsigned int k = 0; k < 3 && inside; k++) {
+                    inside = box.min[k] <= boxMax[k] && box.max[k] >= boxMin[k];
+                }
+                if (inside) {
+                    triangles.push_back(triangle);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,125 @@
+/* src/rcmbvh.h
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#ifndef RCM_BVH_H
+#define RCM_BVH_H
+
+#include "rcm.h"
+#include <vector>
+
+/* Bounding volume hierarchy over the triangles of a model.
+
+The tree is built with the surface area heuristic over binned centroids and
+then collapsed into nodes with up to four children. A node stores the box of
+its children quantized to 8 bit inside the box of the node and fills exactly
+one cache line. All references are indices, so the data can be used directly
+from a memory mapping.
+
+layout of the data of a BVH object, element count is the number of nodes:
+  BvhHeader
+  padding up to nodeOffset, the writer aligns the nodes to 64 bytes in the file
+  node count * BvhNode, the root is node 0
+  triangle count * triangle index, 4 byte, leaves refer to ranges of it
+*/
+
+// most triangles in one leaf, the count is stored in 4 bits
+const unsigned int kBvhMaxLeafTriangles = 8;
+const unsigned int kBvhNodeAlignment = 64;
+// child references: empty slot, leaf or index of an inner node
+const uint32_t kBvhEmptyChild = 0xffffffff;
+const uint32_t kBvhLeafFlag = 0x80000000;
+
+struct BvhHeader {
+    uint32_t nodeCount;
+    uint32_t triangleCount;
+    // from the start of the object data
+    uint32_t nodeOffset;
+    uint32_t triangleOffset;
+};
+
+struct BvhNode {
+    // box of the node, child bounds are origin + value / 255 * extent
+    float origin[3];
+    float extent[3];
+    // [axis][child], rounded outwards
+    uint8_t childMin[3][4];
+    uint8_t childMax[3][4];
+    uint32_t children[4];
+};
+
+static_assert(sizeof(BvhNode) == kBvhNodeAlignment, "a node has to fill one cache line");
+
+inline bool isBvhLeaf(uint32_t child) {
+    return child != kBvhEmptyChild && (child & kBvhLeafFlag) != 0;
+}
+
+// first entry of the triangle index array referenced by a leaf
+inline uint32_t bvhLeafFirst(uint32_t child) {
+    return (child & ~kBvhLeafFlag) >> 4;
+}
+
+inline uint32_t bvhLeafCount(uint32_t child) {
+    return (child & 0xf) + 1;
+}
+
+struct BvhView {
+    BvhHeader header;
+    const BvhNode *nodes;
+    const uint32_t *triangles;
+    // set if the data had to be copied, release with delete[] (char*)
+    void *allocation;
+};
+
+struct BvhHit {
+    uint32_t triangle;
+    float distance;
+    // barycentric coordinates of the hit relative to the second and third corner
+    float u;
+    float v;
+};
+
+// builds the hierarchy over the triangles given by indices. positions points
+// to the first position, stride is the distance between two vertices in
+// floats. Lists of corners pass 0 as indices and their vertex count as
+// numIndices, here and to the other functions. dataOffset is the position of the data in the file, it is used to
+// align the nodes. numThreads 0 uses all hardware threads.
+bool buildBvh(const float *positions, size_t stride, unsigned int numVertices,
+        const uint16_t *indices, unsigned int numIndices, size_t dataOffset,
+        std::vector<uint8_t> &out, unsigned int numThreads = 0);
+
+// copies the data of a BVH object that moves to dataOffset in a file and
+// aligns its nodes for that offset
+bool relayoutBvh(const void *data, size_t size, size_t dataOffset, std::vector<uint8_t> &out);
+
+// checks the data and sets up the view. The nodes have to be 4 byte aligned
+// in memory, they are if the data is used where the writer placed it in a
+// 64 byte aligned file mapping.
+bool openBvh(const void *data, size_t size, uint32_t nodeCount, uint32_t numIndices,
+        BvhView *view);
+
+// finds the closest triangle hit by the ray within maxDistance. The ray is
+// tested against both sides of the triangles.
+bool intersectBvh(const BvhView &view, const float *positions, size_t stride,
+        const uint16_t *indices, const float *origin, const float *direction,
+        float maxDistance, BvhHit *hit);
+
+// appends every triangle whose bounding box overlaps the given box
+void overlapBvh(const BvhView &view, const float *positions, size_t stride,
+        const uint16_t *indices, const float *boxMin, const float *boxMax,
+        std::vector<uint32_t> &triangles);
+
+#endif // RCM_BVH_H
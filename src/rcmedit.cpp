@@ -0,0 +1,541 @@
+/* src/rcmedit.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include "rcmedit.h"
+#include "rcmbvh.h"
+#include "rcmreader.h"
+#include "rcmtexture.h"
+#include "internal/trace.h"
+#include <iostream>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+// maximum number of objects the one byte object count of the file header allows
+static const unsigned int kMaxObjectCount = 255;
+
+struct CopyRange {
+    int fd;
+    uint64_t offset;
+    uint64_t size;
+    uint8_t type;
+};
+
+static bool readFully(int fd, void *buffer, size_t length, uint64_t offset) {
+    char *target = (char*) buffer;
+    while (length > 0) {
+        ssize_t result = pread(fd, target, length, offset);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        target += result;
+        length -= result;
+        offset += result;
+    }
+    return true;
+}
+
+static bool writeFully(int fd, const void *buffer, size_t length) {
+    const char *source = (const char*) buffer;
+    while (length > 0) {
+        ssize_t result = write(fd, source, length);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        source += result;
+        length -= result;
+    }
+    return true;
+}
+
+static bool pwriteFully(int fd, const void *buffer, size_t length, uint64_t offset) {
+    const char *source = (const char*) buffer;
+    while (length > 0) {
+        ssize_t result = pwrite(fd, source, length, offset);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        source += result;
+        length -= result;
+        offset += result;
+    }
+    return true;
+}
+
+// copies a range from in to the current position of out. The kernel copies
+// the data (or even shares the extents on filesystems that support it), a
+// plain read/write loop is only used if neither call is supported.
+static bool copyRange(int in, uint64_t offset, uint64_t size, int out) {
+#ifdef __linux__
+    loff_t inOffset = offset;
+    while (size > 0) {
+        ssize_t result = copy_file_range(in, &inOffset, out, 0, size, 0);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            break;
+        }
+        size -= result;
+    }
+    offset = inOffset;
+    while (size > 0) {
+        off_t sendOffset = offset;
+        ssize_t result = sendfile(out, in, &sendOffset, size);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            break;
+        }
+        size -= result;
+        offset = sendOffset;
+    }
+#endif
+    char buffer[64 * 1024];
+    while (size > 0) {
+        size_t length = size < sizeof(buffer) ? size : sizeof(buffer);
+        if (!readFully(in, buffer, length, offset) || !writeFully(out, buffer, length)) {
+            return false;
+        }
+        size -= length;
+        offset += length;
+    }
+    return true;
+}
+
+// true if path names the file that is already open as fd. Writing the output
+// over one of the inputs would truncate it before it has been read.
+static bool isOpenFile(int fd, const char *path) {
+    struct stat openInfo;
+    struct stat pathInfo;
+    if (fstat(fd, &openInfo) < 0 || stat(path, &pathInfo) < 0) {
+        return false;
+    }
+    return openInfo.st_dev == pathInfo.st_dev && openInfo.st_ino == pathInfo.st_ino;
+}
+
+static bool readObjects(int fd, const char *path, std::vector<ObjectLocation> &objects) {
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        return false;
+    }
+    const uint64_t fileSize = info.st_size;
+    FileHeader fileHeader;
+    if (fileSize < sizeof(FileHeader) || !readFully(fd, &fileHeader, sizeof(FileHeader), 0)) {
+        std::cerr << "file too small even for header: " << path << std::endl;
+        return false;
+    }
+    if (fileHeader.magicNumber[0] != kMagicNumber[0] ||
+        fileHeader.magicNumber[1] != kMagicNumber[1]) {
+        std::cerr << "magic number mismatch: " << path << std::endl;
+        return false;
+    }
+    if (!isSupportedFileVersion(&fileHeader)) {
+        std::cerr << "unsupported file version: " << path << std::endl;
+        return false;
+    }
+    uint64_t offset = sizeof(FileHeader);
+    for (unsigned int i = 0; i < fileHeader.objectCount; i++) {
+        ObjectLocation location;
+        if (offset + sizeof(ObjectHeader) > fileSize ||
+            !readFully(fd, &location.header, sizeof(ObjectHeader), offset)) {
+            std::cerr << "truncated object header " << i << ": " << path << std::endl;
+            return false;
+        }
+        location.offset = offset;
+        location.size = sizeof(ObjectHeader) + calcObjectDataSize(&location.header);
+        if (location.size > fileSize - offset) {
+            std::cerr << "truncated object data " << i << ": " << path << std::endl;
+            return false;
+        }
+        objects.push_back(location);
+        offset += location.size;
+    }
+    return true;
+}
+
+// objects that belong to the model before them
+static bool isModelBlock(uint32_t type) {
+    return type == DRAW_RANGES || type == MORPH_TARGETS || type == BVH;
+}
+
+// finds the model of every draw ranges, morph targets and BVH object, owners
+// receives the index of the model or the index of the object itself. Fails
+// for objects that refer to others by index.
+static bool findOwners(const std::vector<ObjectLocation> &objects, const char *path,
+        std::vector<unsigned int> &owners) {
+    unsigned int model = objects.size();
+    for (unsigned int i = 0; i < objects.size(); i++) {
+        const uint32_t type = objects[i].header.type;
+        if (type == INSTANCES || type == MATERIALS) {
+            std::cerr << "object " << i << " refers to other objects, files with instances "
+                      << "or materials can not be edited: " << path << std::endl;
+            return false;
+        }
+        if (isModelObject(type)) {
+            model = i;
+        } else if (!isModelBlock(type)) {
+            model = objects.size();
+        }
+        if (isModelBlock(type) && model == objects.size()) {
+            std::cerr << "object " << i << " does not follow a model: " << path << std::endl;
+            return false;
+        }
+        owners.push_back(isModelBlock(type) ? model : i);
+    }
+    return true;
+}
+
+bool listObjects(const char *path, std::vector<ObjectLocation> &objects) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "could not open file: " << path << std::endl;
+        return false;
+    }
+    bool success = readObjects(fd, path, objects);
+    close(fd);
+    return success;
+}
+
+// textures and BVHs align their data relative to the file, so they are laid
+// out again for position, where the object starts in the new file
+static bool copyRelayout(const CopyRange &range, uint64_t position, int out, uint64_t &size) {
+    std::vector<uint8_t> object(range.size);
+    if (!readFully(range.fd, &object[0], range.size, range.offset)) {
+        return false;
+    }
+    BlockHeader header;
+    memcpy(&header, &object[0], sizeof(BlockHeader));
+    const uint8_t *data = &object[sizeof(BlockHeader)];
+    const size_t dataOffset = position + sizeof(BlockHeader);
+    std::vector<uint8_t> relaid;
+    const bool success = header.type == TEXTURE ?
+            relayoutTexture(data, header.dataSize, header.flags, header.elementCount, dataOffset,
+                            relaid) :
+            relayoutBvh(data, header.dataSize, dataOffset, relaid);
+    if (!success) {
+        std::cerr << "could not place object data at offset " << dataOffset << std::endl;
+        return false;
+    }
+    header.dataSize = relaid.size();
+    size = sizeof(BlockHeader) + relaid.size();
+    return writeFully(out, &header, sizeof(BlockHeader)) &&
+           writeFully(out, &relaid[0], relaid.size());
+}
+
+static bool writeObjects(const char *outPath, const std::vector<CopyRange> &ranges) {
+    if (ranges.size() > kMaxObjectCount) {
+        std::cerr << "too many objects for one file: " << ranges.size()
+                  << " (max " << kMaxObjectCount << "), use a pack instead" << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < ranges.size(); i++) {
+        if (isOpenFile(ranges[i].fd, outPath)) {
+            std::cerr << "output file is also an input file: " << outPath << std::endl;
+            return false;
+        }
+    }
+    int out = open(outPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        std::cerr << "could not open file: " << outPath << std::endl;
+        return false;
+    }
+    FileHeader header;
+    header.magicNumber[0] = kMagicNumber[0];
+    header.magicNumber[1] = kMagicNumber[1];
+    header.version[0] = kFileFormatVersionMajor;
+    header.version[1] = kFileFormatVersionMinor;
+    header.objectCount = ranges.size();
+    header.unused = 0;
+    bool success = writeFully(out, &header, sizeof(FileHeader));
+    uint64_t position = sizeof(FileHeader);
+    for (size_t i = 0; success && i < ranges.size(); i++) {
+        uint64_t size = ranges[i].size;
+        if (ranges[i].type == TEXTURE || ranges[i].type == BVH) {
+            success = copyRelayout(ranges[i], position, out, size);
+        } else {
+            success = copyRange(ranges[i].fd, ranges[i].offset, ranges[i].size, out);
+        }
+        position += size;
+    }
+    if (close(out) < 0 || !success) {
+        std::cerr << "could not write file: " << outPath << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static CopyRange makeRange(int fd, const ObjectLocation &location) {
+    CopyRange range;
+    range.fd = fd;
+    range.offset = location.offset;
+    range.size = location.size;
+    range.type = location.header.type;
+    return range;
+}
+
+bool mergeFiles(const std::vector<std::string> &inPaths, const char *outPath) {
+    TraceScope trace("mergeFiles");
+    std::vector<int> files;
+    std::vector<CopyRange> ranges;
+    bool success = true;
+    for (size_t i = 0; success && i < inPaths.size(); i++) {
+        int fd = open(inPaths[i].c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "could not open file: " << inPaths[i] << std::endl;
+            success = false;
+            break;
+        }
+        files.push_back(fd);
+        std::vector<ObjectLocation> objects;
+        std::vector<unsigned int> owners;
+        success = readObjects(fd, inPaths[i].c_str(), objects) &&
+                  findOwners(objects, inPaths[i].c_str(), owners);
+        for (size_t n = 0; n < objects.size(); n++) {
+            ranges.push_back(makeRange(fd, objects[n]));
+        }
+    }
+    if (success) {
+        success = writeObjects(outPath, ranges);
+    }
+    for (size_t i = 0; i < files.size(); i++) {
+        close(files[i]);
+    }
+    return success;
+}
+
+static bool selectObjects(const char *inPath, const std::vector<unsigned int> &indices,
+        bool keepSelected, const char *outPath) {
+    int fd = open(inPath, O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "could not open file: " << inPath << std::endl;
+        return false;
+    }
+    std::vector<ObjectLocation> objects;
+    std::vector<unsigned int> owners;
+    bool success = readObjects(fd, inPath, objects) && findOwners(objects, inPath, owners);
+    std::vector<bool> selected(objects.size(), false);
+    std::vector<CopyRange> ranges;
+    for (size_t i = 0; success && i < indices.size(); i++) {
+        const unsigned int index = indices[i];
+        if (index >= objects.size()) {
+            std::cerr << "no object " << index << " in " << inPath << std::endl;
+            success = false;
+            break;
+        }
+        if (owners[index] != index) {
+            std::cerr << "object " << index << " belongs to the model " << owners[index]
+                      << ", select the model instead" << std::endl;
+            success = false;
+            break;
+        }
+        // the blocks of a model follow it directly
+        for (size_t n = index; n < objects.size() && owners[n] == index; n++) {
+            selected[n] = true;
+            if (keepSelected) {
+                ranges.push_back(makeRange(fd, objects[n]));
+            }
+        }
+    }
+    for (size_t i = 0; success && !keepSelected && i < objects.size(); i++) {
+        if (!selected[i]) {
+            ranges.push_back(makeRange(fd, objects[i]));
+        }
+    }
+    if (success) {
+        success = writeObjects(outPath, ranges);
+    }
+    close(fd);
+    return success;
+}
+
+bool extractObjects(const char *inPath, const std::vector<unsigned int> &indices,
+        const char *outPath) {
+    return selectObjects(inPath, indices, true, outPath);
+}
+
+bool dropObjects(const char *inPath, const std::vector<unsigned int> &indices,
+        const char *outPath) {
+    return selectObjects(inPath, indices, false, outPath);
+}
+
+// byte offsets of the single arrays inside struct of arrays object data,
+// relative to the end of the object header
+static void calcArrayOffsets(const ObjectHeader *header, uint64_t offsets[kNumVertexArrays]) {
+    uint64_t offset = 0;
+    for (unsigned int i = 0; i < kNumVertexArrays; i++) {
+        offsets[i] = offset;
+        if (hasVertexArray(header->vertexFlags, i)) {
+            offset += (uint64_t) header->vertexCount * vertexArrayElementSize(i) * sizeof(float);
+        }
+    }
+}
+
+// converts the vertex data of one object, in is positioned at inOffset and
+// out at outOffset, both pointing right behind the object header. Every
+// chunk of vertices is read once and written once: interleaved vertices are
+// split into the arrays at their final offsets, or the matching slices of
+// every array are gathered into interleaved vertices.
+static bool transcodeVertices(int in, uint64_t inOffset, int out, uint64_t outOffset,
+        const ObjectHeader *header, bool toStructOfArrays, size_t chunkSize) {
+    const unsigned int vertexSize = header->vertexSize;
+    const size_t vertexBytes = vertexSize * sizeof(float);
+    size_t chunkVertices = chunkSize / vertexBytes;
+    if (chunkVertices == 0) {
+        chunkVertices = 1;
+    }
+    uint64_t arrayOffsets[kNumVertexArrays];
+    calcArrayOffsets(header, arrayOffsets);
+
+    std::vector<float> interleaved(chunkVertices * vertexSize);
+    std::vector<float> array(chunkVertices * 4);
+    for (uint64_t first = 0; first < header->vertexCount; first += chunkVertices) {
+        size_t count = header->vertexCount - first;
+        if (count > chunkVertices) {
+            count = chunkVertices;
+        }
+        if (toStructOfArrays && !readFully(in, &interleaved[0], count * vertexBytes,
+                                           inOffset + first * vertexBytes)) {
+            return false;
+        }
+        unsigned int component = 0;
+        for (unsigned int i = 0; i < kNumVertexArrays; i++) {
+            if (!hasVertexArray(header->vertexFlags, i)) {
+                continue;
+            }
+            const unsigned int elementSize = vertexArrayElementSize(i);
+            const size_t sliceBytes = count * elementSize * sizeof(float);
+            const uint64_t sliceOffset = arrayOffsets[i] + first * elementSize * sizeof(float);
+            if (toStructOfArrays) {
+                for (size_t v = 0; v < count; v++) {
+                    memcpy(&array[v * elementSize], &interleaved[v * vertexSize + component],
+                           elementSize * sizeof(float));
+                }
+                if (!pwriteFully(out, &array[0], sliceBytes, outOffset + sliceOffset)) {
+                    return false;
+                }
+            } else {
+                if (!readFully(in, &array[0], sliceBytes, inOffset + sliceOffset)) {
+                    return false;
+                }
+                for (size_t v = 0; v < count; v++) {
+                    memcpy(&interleaved[v * vertexSize + component], &array[v * elementSize],
+                           elementSize * sizeof(float));
+                }
+            }
+            component += elementSize;
+        }
+        if (!toStructOfArrays && !pwriteFully(out, &interleaved[0], count * vertexBytes,
+                                              outOffset + first * vertexBytes)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool transcodeObjects(int in, const char *inPath, int out, ObjectType layout,
+        size_t chunkSize) {
+    std::vector<ObjectLocation> objects;
+    if (!readObjects(in, inPath, objects)) {
+        return false;
+    }
+    FileHeader fileHeader;
+    if (!readFully(in, &fileHeader, sizeof(FileHeader), 0) ||
+        !pwriteFully(out, &fileHeader, sizeof(FileHeader), 0)) {
+        return false;
+    }
+    uint64_t outOffset = sizeof(FileHeader);
+    for (size_t i = 0; i < objects.size(); i++) {
+        ObjectHeader header = objects[i].header;
+        const uint64_t dataOffset = objects[i].offset + sizeof(ObjectHeader);
+        if (header.type == layout || !isModelObject(header.type)) {
+            if (lseek(out, outOffset, SEEK_SET) < 0 ||
+                !copyRange(in, objects[i].offset, objects[i].size, out)) {
+                return false;
+            }
+            outOffset += objects[i].size;
+            continue;
+        }
+        if (header.vertexSize != calcVertexSize(header.vertexFlags)) {
+            std::cerr << "can not transcode object " << i << ": " << inPath << std::endl;
+            return false;
+        }
+        const uint64_t vertexDataSize =
+                (uint64_t) header.vertexCount * header.vertexSize * sizeof(float);
+        header.type = layout;
+        if (!pwriteFully(out, &header, sizeof(ObjectHeader), outOffset)) {
+            return false;
+        }
+        outOffset += sizeof(ObjectHeader);
+        if (!transcodeVertices(in, dataOffset, out, outOffset, &header,
+                               layout == STRUCT_OF_ARRAYS, chunkSize)) {
+            return false;
+        }
+        outOffset += vertexDataSize;
+        // indices and skin do not depend on the layout
+        const uint64_t indexSize = objects[i].size - sizeof(ObjectHeader) - vertexDataSize;
+        if (lseek(out, outOffset, SEEK_SET) < 0 ||
+            !copyRange(in, dataOffset + vertexDataSize, indexSize, out)) {
+            return false;
+        }
+        outOffset += indexSize;
+    }
+    return true;
+}
+
+bool transcodeFile(const char *inPath, const char *outPath, ObjectType layout,
+        size_t chunkSize) {
+    TraceScope trace("transcodeFile");
+    int in = open(inPath, O_RDONLY);
+    if (in < 0) {
+        std::cerr << "could not open file: " << inPath << std::endl;
+        return false;
+    }
+    if (isOpenFile(in, outPath)) {
+        std::cerr << "output file is also the input file: " << outPath << std::endl;
+        close(in);
+        return false;
+    }
+    int out = open(outPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        std::cerr << "could not open file: " << outPath << std::endl;
+        close(in);
+        return false;
+    }
+    bool success = transcodeObjects(in, inPath, out, layout, chunkSize);
+    if (close(out) < 0 || !success) {
+        std::cerr << "could not write file: " << outPath << std::endl;
+        success = false;
+    }
+    close(in);
+    return success;
+}
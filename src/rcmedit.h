@@ -0,0 +1,73 @@
+/* src/rcmedit.h
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#ifndef RCM_EDIT_H
+#define RCM_EDIT_H
+
+#include "rcm.h"
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Operations on existing .rcm files. Only the file header is rewritten,
+// objects are copied as they are (object header and data) with
+// copy_file_range() where available, no vertex data is decoded. Textures and
+// BVHs align their data relative to the file, they are laid out again for
+// their new position.
+//
+// Draw ranges, morph targets and BVHs belong to the model before them and
+// are copied or dropped together with it, selecting one of them on its own
+// fails. Instances and material tables refer to other objects by index,
+// files that contain them are not edited as the indices would break.
+
+// where an object is stored inside an .rcm file
+struct ObjectLocation {
+    ObjectHeader header;
+    // offset of the object header from the start of the file
+    uint64_t offset;
+    // size of object header and data
+    uint64_t size;
+};
+
+// walks the object headers of a file without reading any object data
+bool listObjects(const char *path, std::vector<ObjectLocation> &objects);
+
+// concatenates the objects of all input files in the given order
+bool mergeFiles(const std::vector<std::string> &inPaths, const char *outPath);
+
+// writes only the models and other objects with the given indices, in the
+// given order
+bool extractObjects(const char *inPath, const std::vector<unsigned int> &indices,
+        const char *outPath);
+
+// writes all objects except for the models and other objects with the
+// given indices
+bool dropObjects(const char *inPath, const std::vector<unsigned int> &indices,
+        const char *outPath);
+
+// default amount of vertex data transcodeFile() holds in memory at once
+static const size_t kDefaultTranscodeChunkSize = 4 * 1024 * 1024;
+
+// rewrites every object in the given layout (ARRAY_OF_STRUCTS or
+// STRUCT_OF_ARRAYS). Vertex data is converted in chunks of about chunkSize
+// bytes, so memory use does not depend on the size of the file. Objects that
+// already have the requested layout and objects that are no models are
+// copied unchanged.
+bool transcodeFile(const char *inPath, const char *outPath, ObjectType layout,
+        size_t chunkSize = kDefaultTranscodeChunkSize);
+
+#endif // RCM_EDIT_H
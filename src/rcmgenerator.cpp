@@ -0,0 +1,389 @@
+/* src/rcmgenerator.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include "rcmgenerator.h"
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static const float kPi = 3.14159265358979f;
+
+struct SurfacePoint {
+    float position[3];
+    float normal[3];
+    float uv[2];
+    float tangent[3];
+};
+
+// a shape is a parametric surface sampled on a grid of columns * rows
+// vertices, vertex (column, row) has the index row * columns + column
+struct Surface {
+    unsigned int columns;
+    unsigned int rows;
+    // the first and the last row collapse to a point, the triangles of zero
+    // area next to them are left out
+    bool closedPoles;
+    // scan meshes are written as corners even if they could be indexed
+    bool asCorners;
+    // the x range the bones are spread over
+    float extent;
+    float noise;
+    uint32_t seed;
+    // waves of the height fields
+    float frequency[2];
+    float phase[2];
+    void (*evaluate)(const Surface &surface, unsigned int column, unsigned int row,
+            SurfacePoint &point);
+};
+
+// well mixed bits for a vertex, equal for every corner of it
+static uint32_t hashVertex(uint32_t seed, uint32_t vertex, uint32_t channel) {
+    uint32_t h = seed * 0x9e3779b9u ^ vertex * 0x85ebca6bu ^ (channel + 1) * 0xc2b2ae35u;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// uniform in [0, 1)
+static float randomUnit(uint32_t seed, uint32_t vertex, uint32_t channel) {
+    return (hashVertex(seed, vertex, channel) >> 8) * (1.0f / 16777216.0f);
+}
+
+static void normalize(float *v) {
+    const float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0.0f) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+
+static void evaluateHeightField(const Surface &surface, unsigned int column, unsigned int row,
+        SurfacePoint &point) {
+    const float u = (float) column / (surface.columns - 1);
+    const float v = (float) row / (surface.rows - 1);
+    const float amplitude = 0.05f;
+    const float a = surface.frequency[0] * u + surface.phase[0];
+    const float b = surface.frequency[1] * v + surface.phase[1];
+    float height = amplitude * sinf(a) * cosf(b);
+    if (surface.noise > 0.0f) {
+        const uint32_t vertex = row * surface.columns + column;
+        height += surface.noise * (2.0f * randomUnit(surface.seed, vertex, 0) - 1.0f);
+    }
+    // slopes of the smooth field, the noise is not part of the normals just
+    // as a scanner estimates them from a filtered surface
+    const float du = amplitude * surface.frequency[0] * cosf(a) * cosf(b);
+    const float dv = -amplitude * surface.frequency[1] * sinf(a) * sinf(b);
+    point.position[0] = u - 0.5f;
+    point.position[1] = height;
+    point.position[2] = v - 0.5f;
+    point.normal[0] = -du;
+    point.normal[1] = 1.0f;
+    point.normal[2] = -dv;
+    normalize(point.normal);
+    point.uv[0] = u;
+    point.uv[1] = v;
+    point.tangent[0] = 1.0f;
+    point.tangent[1] = du;
+    point.tangent[2] = 0.0f;
+    normalize(point.tangent);
+}
+
+static void evaluateSphere(const Surface &surface, unsigned int column, unsigned int row,
+        SurfacePoint &point) {
+    const float u = (float) column / (surface.columns - 1);
+    const float v = (float) row / (surface.rows - 1);
+    const float theta = v * kPi;
+    const float phi = u * 2.0f * kPi;
+    // the poles are exact, so their vertices coincide
+    const float ringRadius = (row == 0 || row == surface.rows - 1) ? 0.0f : sinf(theta);
+    const float y = row == 0 ? 1.0f : (row == surface.rows - 1 ? -1.0f : cosf(theta));
+    point.position[0] = ringRadius * cosf(phi);
+    point.position[1] = y;
+    point.position[2] = -ringRadius * sinf(phi);
+    memcpy(point.normal, point.position, sizeof(point.normal));
+    point.uv[0] = u;
+    point.uv[1] = v;
+    point.tangent[0] = -sinf(phi);
+    point.tangent[1] = 0.0f;
+    point.tangent[2] = -cosf(phi);
+}
+
+static size_t countTriangles(const Surface &surface) {
+    const size_t cells = surface.columns - 1;
+    const size_t triangles = 2 * cells * (surface.rows - 1);
+    return surface.closedPoles ? triangles - 2 * cells : triangles;
+}
+
+// vertex indices of triangle t, counter clockwise seen from the front
+static void surfaceTriangle(const Surface &surface, size_t t, uint32_t *corners) {
+    const size_t cells = surface.columns - 1;
+    size_t row;
+    size_t cell;
+    bool second;
+    if (!surface.closedPoles) {
+        row = t / (2 * cells);
+        cell = (t / 2) % cells;
+        second = (t & 1) != 0;
+    } else if (t < cells) {
+        // only the second triangle of the cells at the first pole
+        row = 0;
+        cell = t;
+        second = true;
+    } else {
+        t -= cells;
+        const size_t middle = (surface.rows - 3) * 2 * cells;
+        if (t < middle) {
+            row = 1 + t / (2 * cells);
+            cell = (t / 2) % cells;
+            second = (t & 1) != 0;
+        } else {
+            // only the first triangle of the cells at the last pole
+            row = surface.rows - 2;
+            cell = t - middle;
+            second = false;
+        }
+    }
+    const uint32_t corner = row * surface.columns + cell;
+    if (!second) {
+        corners[0] = corner;
+        corners[1] = corner + surface.columns;
+        corners[2] = corner + 1;
+    } else {
+        corners[0] = corner + 1;
+        corners[1] = corner + surface.columns;
+        corners[2] = corner + surface.columns + 1;
+    }
+}
+
+static void writeVertex(const Surface &surface, const Mesh *mesh, uint32_t vertex,
+        float *out) {
+    SurfacePoint point;
+    surface.evaluate(surface, vertex % surface.columns, vertex / surface.columns, point);
+    const uint16_t flags = mesh->flags;
+    memcpy(out + positionOffset(), point.position, sizeof(point.position));
+    if (hasNormals(flags)) {
+        memcpy(out + normalsOffset(), point.normal, sizeof(point.normal));
+    }
+    // further uv sets are scaled, as lightmap or detail coordinates
+    const bool uvs[] = {
+        hasTexCoords0(flags), hasTexCoords1(flags), hasTexCoords2(flags), hasTexCoords3(flags)
+    };
+    const int uvOffsets[] = {
+        texCoords0Offset(flags), texCoords1Offset(flags), texCoords2Offset(flags),
+        texCoords3Offset(flags)
+    };
+    for (unsigned int k = 0; k < kMaxNumTexCoords; k++) {
+        if (uvs[k]) {
+            out[uvOffsets[k]] = point.uv[0] * (k + 1);
+            out[uvOffsets[k] + 1] = point.uv[1] * (k + 1);
+        }
+    }
+    const bool colors[] = {hasColor0(flags), hasColor1(flags), hasColor2(flags), hasColor3(flags)};
+    const int colorOffsets[] = {
+        color0Offset(flags), color1Offset(flags), color2Offset(flags), color3Offset(flags)
+    };
+    for (unsigned int k = 0; k < kMaxNumColors; k++) {
+        if (colors[k]) {
+            for (unsigned int c = 0; c < 3; c++) {
+                out[colorOffsets[k] + c] = randomUnit(surface.seed, vertex, 1 + k * 3 + c);
+            }
+            out[colorOffsets[k] + 3] = 1.0f;
+        }
+    }
+    if (hasTanBitan(flags)) {
+        float *tangent = out + tanOffset(flags);
+        float *bitangent = out + bitanOffset(flags);
+        memcpy(tangent, point.tangent, sizeof(point.tangent));
+        bitangent[0] = point.normal[1] * point.tangent[2] - point.normal[2] * point.tangent[1];
+        bitangent[1] = point.normal[2] * point.tangent[0] - point.normal[0] * point.tangent[2];
+        bitangent[2] = point.normal[0] * point.tangent[1] - point.normal[1] * point.tangent[0];
+    }
+}
+
+// the four bones closest to x, weights fall off with the distance and are
+// sorted from largest to smallest
+static void writeSkin(const Surface &surface, float x, unsigned char *bones, float *weights) {
+    const float spacing = 2.0f * surface.extent / (kGeneratedBones - 1);
+    const float position = (x + surface.extent) / spacing;
+    int first = (int) floorf(position) - 1;
+    first = first < 0 ? 0 : first;
+    first = first > (int) (kGeneratedBones - kMaxBoneInfluences) ?
+            kGeneratedBones - kMaxBoneInfluences : first;
+    float sum = 0.0f;
+    for (unsigned int k = 0; k < kMaxBoneInfluences; k++) {
+        const float distance = position - (first + k);
+        bones[k] = first + k;
+        weights[k] = 1.0f / (1.0f + distance * distance);
+        sum += weights[k];
+    }
+    for (unsigned int k = 0; k < kMaxBoneInfluences; k++) {
+        weights[k] /= sum;
+    }
+    for (unsigned int k = 1; k < kMaxBoneInfluences; k++) {
+        for (unsigned int j = k; j > 0 && weights[j] > weights[j - 1]; j--) {
+            const float weight = weights[j];
+            weights[j] = weights[j - 1];
+            weights[j - 1] = weight;
+            const unsigned char bone = bones[j];
+            bones[j] = bones[j - 1];
+            bones[j - 1] = bone;
+        }
+    }
+}
+
+static void createBones(const Surface &surface, Mesh *mesh) {
+    const float spacing = 2.0f * surface.extent / (kGeneratedBones - 1);
+    mesh->numBones = kGeneratedBones;
+    mesh->bones = new BoneData[kGeneratedBones];
+    for (unsigned int b = 0; b < kGeneratedBones; b++) {
+        char name[16];
+        const int length = snprintf(name, sizeof(name), "bone%u", b);
+        BoneData &bone = mesh->bones[b];
+        bone.nameHash = hashName(name, length);
+        memset(bone.inverseBindMatrix, 0, sizeof(bone.inverseBindMatrix));
+        bone.inverseBindMatrix[0] = 1.0f;
+        bone.inverseBindMatrix[5] = 1.0f;
+        bone.inverseBindMatrix[10] = 1.0f;
+        bone.inverseBindMatrix[15] = 1.0f;
+        bone.inverseBindMatrix[12] = surface.extent - b * spacing;
+    }
+}
+
+static Mesh* createMesh(const Surface &surface, const char *name, unsigned short flags) {
+    if (surface.columns < 2 || surface.rows < (surface.closedPoles ? 3u : 2u)) {
+        std::cerr << "generated mesh is too small" << std::endl;
+        return 0;
+    }
+    const size_t numPoints = (size_t) surface.columns * surface.rows;
+    const size_t numTriangles = countTriangles(surface);
+    const bool asCorners = surface.asCorners || numPoints > kMaxIndexedVertices;
+    const size_t numVertices = asCorners ? numTriangles * 3 : numPoints;
+    if (numPoints > 0xffffffffu || numVertices > 0xffffffffu) {
+        std::cerr << "generated mesh has too many vertices" << std::endl;
+        return 0;
+    }
+    Mesh *mesh = new Mesh();
+    strncpy(mesh->name, name, sizeof(mesh->name) - 1);
+    mesh->flags = (flags | HAS_POSITIONS) & ~USES_HALF_FLOAT;
+    mesh->vertexSize = calcVertexSize(mesh->flags);
+    mesh->numTexCoords = hasTexCoords0(flags) + hasTexCoords1(flags) + hasTexCoords2(flags) +
+                         hasTexCoords3(flags);
+    mesh->numColors = hasColor0(flags) + hasColor1(flags) + hasColor2(flags) + hasColor3(flags);
+    mesh->numVertices = numVertices;
+    mesh->numIndices = asCorners ? 0 : numTriangles * 3;
+    mesh->vertices = new float[numVertices * mesh->vertexSize];
+    mesh->indices = new unsigned short[mesh->numIndices];
+    const bool hasSkin = hasBones(mesh->flags);
+    if (hasSkin) {
+        createBones(surface, mesh);
+        mesh->boneIndices = new unsigned char[numVertices * kMaxBoneInfluences];
+        mesh->boneWeights = new float[numVertices * kMaxBoneInfluences];
+    }
+    for (size_t t = 0; t < numTriangles; t++) {
+        uint32_t corners[3];
+        surfaceTriangle(surface, t, corners);
+        for (unsigned int k = 0; k < 3; k++) {
+            if (asCorners) {
+                writeVertex(surface, mesh, corners[k],
+                            mesh->vertices + (t * 3 + k) * mesh->vertexSize);
+            } else {
+                mesh->indices[t * 3 + k] = (unsigned short) corners[k];
+            }
+        }
+    }
+    if (!asCorners) {
+        for (size_t i = 0; i < numVertices; i++) {
+            writeVertex(surface, mesh, i, mesh->vertices + i * mesh->vertexSize);
+        }
+    }
+    if (hasSkin) {
+        for (size_t i = 0; i < numVertices; i++) {
+            writeSkin(surface, mesh->vertices[i * mesh->vertexSize + positionOffset()],
+                      mesh->boneIndices + i * kMaxBoneInfluences,
+                      mesh->boneWeights + i * kMaxBoneInfluences);
+        }
+    }
+    return mesh;
+}
+
+static Surface createHeightField(unsigned int columns, unsigned int rows, uint32_t seed) {
+    Surface surface;
+    memset(&surface, 0, sizeof(Surface));
+    surface.columns = columns;
+    surface.rows = rows;
+    surface.extent = 0.5f;
+    surface.seed = seed;
+    for (unsigned int k = 0; k < 2; k++) {
+        surface.frequency[k] = 2.0f + 10.0f * randomUnit(seed, 0, 100 + k);
+        surface.phase[k] = 2.0f * kPi * randomUnit(seed, 0, 102 + k);
+    }
+    surface.evaluate = evaluateHeightField;
+    return surface;
+}
+
+Mesh* generateGrid(unsigned int columns, unsigned int rows, unsigned short flags,
+        uint32_t seed) {
+    return createMesh(createHeightField(columns, rows, seed), "grid", flags);
+}
+
+Mesh* generateSphere(unsigned int rings, unsigned int segments, unsigned short flags,
+        uint32_t seed) {
+    Surface surface;
+    memset(&surface, 0, sizeof(Surface));
+    surface.columns = segments + 1;
+    surface.rows = rings;
+    surface.closedPoles = true;
+    surface.extent = 1.0f;
+    surface.seed = seed;
+    surface.evaluate = evaluateSphere;
+    return createMesh(surface, "sphere", flags);
+}
+
+Mesh* generateScan(unsigned int columns, unsigned int rows, float noise,
+        unsigned short flags, uint32_t seed) {
+    Surface surface = createHeightField(columns, rows, seed);
+    surface.asCorners = true;
+    surface.noise = noise;
+    return createMesh(surface, "scan", flags);
+}
+
+Mesh* generateMesh(GeneratedShape shape, size_t numVertices, unsigned short flags,
+        uint32_t seed) {
+    switch (shape) {
+    case GENERATE_GRID: {
+        const unsigned int side = (unsigned int) ceil(sqrt((double) numVertices));
+        return generateGrid(side, side, flags, seed);
+    }
+    case GENERATE_SPHERE: {
+        // twice as many segments as rings gives square cells at the equator
+        const unsigned int rings = (unsigned int) ceil(sqrt(numVertices / 2.0));
+        return generateSphere(rings, 2 * rings, flags, seed);
+    }
+    case GENERATE_SCAN: {
+        // six corners per cell
+        const unsigned int side = 1 + (unsigned int) ceil(sqrt(numVertices / 6.0));
+        return generateScan(side, side, 0.002f, flags, seed);
+    }
+    }
+    std::cerr << "unknown shape: " << shape << std::endl;
+    return 0;
+}
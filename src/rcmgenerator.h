@@ -0,0 +1,70 @@
+/* src/rcmgenerator.h
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#ifndef RCM_GENERATOR_H
+#define RCM_GENERATOR_H
+
+#include "rcmwriter.h"
+
+/* Procedural meshes for tests, benchmarks and stress runs, without model
+files or assimp.
+
+Every mesh gets the attributes of the given vertex flags, positions are always
+generated. USES_HALF_FLOAT is ignored. With HAS_BONES the mesh is skinned to
+kGeneratedBones bones spread along the x axis. The seed varies the shape of
+the height fields and the vertex colors, the same parameters and seed always
+give the same mesh.
+
+Meshes with up to kMaxIndexedVertices vertices are indexed, larger ones are
+lists of corners (numIndices is 0) which every writer accepts unoptimized.
+Attributes are a function of the vertex only, so every corner of a vertex
+holds exactly the same floats.
+
+The functions print an error and return 0 for sizes that are too small or
+need more than 2^32 vertices.
+*/
+
+enum GeneratedShape {
+    GENERATE_GRID = 0,
+    GENERATE_SPHERE,
+    GENERATE_SCAN,
+};
+
+const unsigned int kGeneratedBones = 16;
+
+// wavy height field of columns * rows vertices over the unit square in the xz
+// plane, centered at the origin, facing +y
+Mesh* generateGrid(unsigned int columns, unsigned int rows, unsigned short flags,
+        uint32_t seed);
+
+// sphere of radius 1 with rings rows of vertices from pole to pole and
+// segments quads around, the seam and the poles hold separate vertices for
+// their uvs
+Mesh* generateSphere(unsigned int rings, unsigned int segments, unsigned short flags,
+        uint32_t seed);
+
+// triangle soup like the raw output of a scanner: a grid whose heights are
+// displaced by up to noise, written as a list of corners where every inner
+// vertex appears six times
+Mesh* generateScan(unsigned int columns, unsigned int rows, float noise,
+        unsigned short flags, uint32_t seed);
+
+// a shape with about numVertices vertices (corners for GENERATE_SCAN)
+Mesh* generateMesh(GeneratedShape shape, size_t numVertices, unsigned short flags,
+        uint32_t seed);
+
+#endif // RCM_GENERATOR_H
@@ -0,0 +1,145 @@
+/* src/rcmimage.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include "internal/rcm_internal.h"
+#include <iostream>
+#include <iterator>
+#include <string.h>
+
+#ifdef RCM_HAVE_PNG
+#include <png.h>
+#endif
+#ifdef RCM_HAVE_JPEG
+#include <setjmp.h>
+#include <stdio.h>
+#include <jpeglib.h>
+#endif
+
+static bool isPng(const uint8_t *data, size_t size) {
+    static const uint8_t kSignature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    return size >= sizeof(kSignature) && memcmp(data, kSignature, sizeof(kSignature)) == 0;
+}
+
+static bool isJpeg(const uint8_t *data, size_t size) {
+    return size >= 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff;
+}
+
+#ifdef RCM_HAVE_PNG
+static bool decodePng(const uint8_t *data, size_t size, Texture &texture) {
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_memory(&image, data, size)) {
+        std::cerr << "could not read PNG: " << image.message << std::endl;
+        return false;
+    }
+    image.format = PNG_FORMAT_RGBA;
+    texture.width = image.width;
+    texture.height = image.height;
+    texture.pixels.resize(PNG_IMAGE_SIZE(image));
+    if (!png_image_finish_read(&image, 0, &texture.pixels[0], 0, 0)) {
+        std::cerr << "could not decode PNG: " << image.message << std::endl;
+        png_image_free(&image);
+        return false;
+    }
+    return true;
+}
+#endif
+
+#ifdef RCM_HAVE_JPEG
+// libjpeg exits the process on errors unless the handler jumps back
+struct JpegError {
+    jpeg_error_mgr manager;
+    jmp_buf jump;
+};
+
+static void onJpegError(j_common_ptr info) {
+    char message[JMSG_LENGTH_MAX];
+    (*info->err->format_message)(info, message);
+    std::cerr << "could not decode JPEG: " << message << std::endl;
+    longjmp(((JpegError*) info->err)->jump, 1);
+}
+
+static bool decodeJpeg(const uint8_t *data, size_t size, Texture &texture) {
+    jpeg_decompress_struct info;
+    JpegError error;
+    std::vector<uint8_t> row;
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = onJpegError;
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, (unsigned char*) data, size);
+    jpeg_read_header(&info, TRUE);
+    info.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&info);
+    texture.width = info.output_width;
+    texture.height = info.output_height;
+    texture.pixels.resize((size_t) texture.width * texture.height * 4);
+    row.resize((size_t) texture.width * 3);
+    while (info.output_scanline < info.output_height) {
+        uint8_t *out = &texture.pixels[(size_t) info.output_scanline * texture.width * 4];
+        JSAMPROW rows[] = {&row[0]};
+        jpeg_read_scanlines(&info, rows, 1);
+        for (uint32_t x = 0; x < texture.width; x++) {
+            out[x * 4] = row[x * 3];
+            out[x * 4 + 1] = row[x * 3 + 1];
+            out[x * 4 + 2] = row[x * 3 + 2];
+            out[x * 4 + 3] = 255;
+        }
+    }
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    return true;
+}
+#endif
+
+bool decodeImage(const uint8_t *data, size_t size, Texture &texture) {
+#if !defined(RCM_HAVE_PNG) && !defined(RCM_HAVE_JPEG)
+    (void) texture;
+#endif
+    if (isPng(data, size)) {
+#ifdef RCM_HAVE_PNG
+        return decodePng(data, size, texture);
+#else
+        std::cerr << "built without PNG support" << std::endl;
+        return false;
+#endif
+    }
+    if (isJpeg(data, size)) {
+#ifdef RCM_HAVE_JPEG
+        return decodeJpeg(data, size, texture);
+#else
+        std::cerr << "built without JPEG support" << std::endl;
+        return false;
+#endif
+    }
+    std::cerr << "unsupported image format" << std::endl;
+    return false;
+}
+
+bool loadImageFile(const char *path, Texture &texture) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "could not open image: " << path << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return !data.empty() && decodeImage(&data[0], data.size(), texture);
+}
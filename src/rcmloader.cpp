@@ -0,0 +1,398 @@
+/* src/rcmloader.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include "rcmloader.h"
+#include "internal/thread_pool.h"
+#include "internal/trace.h"
+#include <deque>
+#include <iostream>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef RCM_HAVE_IO_URING
+#include <liburing.h>
+#endif
+
+enum LoadState {
+    READ_FILE_HEADER,
+    READ_OBJECT_HEADER,
+    READ_DATA,
+    DONE,
+};
+
+// every request walks through the file header and the object headers until
+// it reaches the requested object and then reads the object data. Each step
+// is a single read so the same state machine drives both the blocking and the
+// io_uring path.
+struct LoadJob {
+    LoadRequest request;
+    std::promise<LoadResult> promise;
+    int fd;
+    LoadState state;
+    unsigned int currentObject;
+    off_t offset;
+    char *target;
+    size_t length;
+    size_t done;
+    FileHeader fileHeader;
+    bool ownsBuffer;
+    // the buffer was taken from the allocator of the request
+    bool allocatedBuffer;
+    LoadResult result;
+};
+
+static void beginRead(LoadJob *job, void *target, size_t length) {
+    job->target = (char*) target;
+    job->length = length;
+    job->done = 0;
+}
+
+static void failJob(LoadJob *job, int status) {
+    if (job->ownsBuffer) {
+        delete[] (char*) job->result.data;
+        job->ownsBuffer = false;
+    }
+    const ReaderAllocator *allocator = job->request.allocator;
+    if (job->allocatedBuffer && allocator->release) {
+        allocator->release(job->result.data, allocator->userData);
+    }
+    job->allocatedBuffer = false;
+    job->result.data = 0;
+    job->result.size = 0;
+    job->result.status = status;
+    job->state = DONE;
+}
+
+static void startJob(LoadJob *job) {
+    job->state = READ_FILE_HEADER;
+    job->offset = 0;
+    job->currentObject = 0;
+    beginRead(job, &job->fileHeader, sizeof(FileHeader));
+}
+
+// advance the state machine after the current read has been fully completed
+static void nextStep(LoadJob *job) {
+    switch (job->state) {
+    case READ_FILE_HEADER:
+        if (job->fileHeader.magicNumber[0] != kMagicNumber[0] ||
+            job->fileHeader.magicNumber[1] != kMagicNumber[1]) {
+            std::cerr << "magic number mismatch: " << job->request.path << std::endl;
+            failJob(job, -EINVAL);
+            return;
+        }
+        if (!isSupportedFileVersion(&job->fileHeader)) {
+            std::cerr << "unsupported file version: " << job->request.path << std::endl;
+            failJob(job, -EINVAL);
+            return;
+        }
+        if (job->request.objectIndex >= job->fileHeader.objectCount) {
+            std::cerr << "no object " << job->request.objectIndex << " in "
+                      << job->request.path << std::endl;
+            failJob(job, -ERANGE);
+            return;
+        }
+        job->offset = sizeof(FileHeader);
+        job->state = READ_OBJECT_HEADER;
+        beginRead(job, &job->result.header, sizeof(ObjectHeader));
+        break;
+    case READ_OBJECT_HEADER: {
+        const size_t dataSize = calcObjectDataSize(&job->result.header);
+        job->offset += sizeof(ObjectHeader);
+        if (job->currentObject < job->request.objectIndex) {
+            // skip the data of this object and read the next header
+            job->offset += dataSize;
+            job->currentObject++;
+            beginRead(job, &job->result.header, sizeof(ObjectHeader));
+            break;
+        }
+        void *buffer = job->request.buffer;
+        if (buffer) {
+            if (job->request.bufferSize < dataSize) {
+                failJob(job, -ENOBUFS);
+                return;
+            }
+        } else if (job->request.allocator) {
+            const ReaderAllocator *allocator = job->request.allocator;
+            buffer = allocator->allocate(dataSize, kObjectBufferAlignment, allocator->userData);
+            if (!buffer) {
+                failJob(job, -ENOMEM);
+                return;
+            }
+            job->allocatedBuffer = true;
+        } else {
+            buffer = new char[dataSize];
+            job->ownsBuffer = true;
+        }
+        job->result.data = buffer;
+        job->result.size = dataSize;
+        job->state = READ_DATA;
+        beginRead(job, buffer, dataSize);
+        if (dataSize == 0) {
+            job->state = DONE;
+        }
+        break;
+    }
+    case READ_DATA:
+        job->state = DONE;
+        break;
+    case DONE:
+        break;
+    }
+}
+
+// account for the result of a read. Short reads are continued from where
+// they stopped, reading past the end of the file fails the request.
+static void completeRead(LoadJob *job, ssize_t result) {
+    if (result < 0) {
+        failJob(job, (int) result);
+        return;
+    }
+    if (result == 0) {
+        std::cerr << "unexpected end of file: " << job->request.path << std::endl;
+        failJob(job, -EIO);
+        return;
+    }
+    job->done += result;
+    if (job->done == job->length) {
+        nextStep(job);
+    }
+}
+
+static void loadBlocking(LoadJob *job) {
+    TraceScope trace("loadBlocking");
+    while (job->state != DONE) {
+        ssize_t result = pread(job->fd, job->target + job->done,
+                               job->length - job->done, job->offset + job->done);
+        completeRead(job, result < 0 ? -errno : result);
+    }
+}
+
+static void finishJob(LoadJob *job) {
+    job->ownsBuffer = false;
+    job->allocatedBuffer = false;
+    if (job->request.callback) {
+        job->request.callback(job->request, job->result);
+    }
+    job->promise.set_value(job->result);
+}
+
+AsyncLoader::AsyncLoader(unsigned int queueDepth, unsigned int numThreads,
+        bool useIoUring) :
+        mQueueDepth(queueDepth > 0 ? queueDepth : 1),
+        mNumThreads(numThreads),
+        mRing(0) {
+#ifdef RCM_HAVE_IO_URING
+    if (useIoUring) {
+        struct io_uring *ring = new io_uring();
+        int status = io_uring_queue_init(mQueueDepth, ring, 0);
+        if (status < 0) {
+            // old kernel or io_uring disabled, use the thread pool
+            delete ring;
+        } else {
+            mRing = ring;
+        }
+    }
+#else
+    (void) useIoUring;
+#endif
+}
+
+AsyncLoader::~AsyncLoader() {
+#ifdef RCM_HAVE_IO_URING
+    if (mRing) {
+        struct io_uring *ring = (struct io_uring*) mRing;
+        io_uring_queue_exit(ring);
+        delete ring;
+    }
+#endif
+    for (size_t i = 0; i < mJobs.size(); i++) {
+        delete mJobs[i];
+    }
+    closeFiles();
+}
+
+bool AsyncLoader::usesIoUring() const {
+    return mRing != 0;
+}
+
+std::future<LoadResult> AsyncLoader::add(const LoadRequest &request) {
+    LoadJob *job = new LoadJob();
+    job->request = request;
+    job->fd = -1;
+    job->ownsBuffer = false;
+    job->allocatedBuffer = false;
+    memset(&job->result, 0, sizeof(LoadResult));
+    mJobs.push_back(job);
+    return job->promise.get_future();
+}
+
+void AsyncLoader::run() {
+    // open every file only once, no matter how many objects are requested
+    for (size_t i = 0; i < mJobs.size(); i++) {
+        LoadJob *job = mJobs[i];
+        std::map<std::string, int>::iterator it = mFiles.find(job->request.path);
+        if (it == mFiles.end()) {
+            int fd = open(job->request.path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                fd = -errno;
+                std::cerr << "could not open file: " << job->request.path << std::endl;
+            }
+            it = mFiles.insert(std::make_pair(job->request.path, fd)).first;
+        }
+        job->fd = it->second;
+        startJob(job);
+        if (job->fd < 0) {
+            failJob(job, job->fd);
+        }
+    }
+
+    if (mRing) {
+        runIoUring();
+    } else {
+        runThreadPool();
+    }
+
+    for (size_t i = 0; i < mJobs.size(); i++) {
+        delete mJobs[i];
+    }
+    mJobs.clear();
+    closeFiles();
+}
+
+void AsyncLoader::runThreadPool() {
+    ThreadPool pool(mNumThreads);
+    for (size_t i = 0; i < mJobs.size(); i++) {
+        LoadJob *job = mJobs[i];
+        pool.enqueue([job] {
+            loadBlocking(job);
+            finishJob(job);
+        });
+    }
+    pool.wait();
+}
+
+void AsyncLoader::runIoUring() {
+#ifdef RCM_HAVE_IO_URING
+    struct io_uring *ring = (struct io_uring*) mRing;
+    std::deque<LoadJob*> ready;
+    size_t remaining = mJobs.size();
+    for (size_t i = 0; i < mJobs.size(); i++) {
+        if (mJobs[i]->state == DONE) {
+            finishJob(mJobs[i]);
+            remaining--;
+        } else {
+            ready.push_back(mJobs[i]);
+        }
+    }
+
+    unsigned int inFlight = 0;
+    while (remaining > 0) {
+        // keep the submission queue as full as possible
+        while (!ready.empty() && inFlight < mQueueDepth) {
+            struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+            if (!sqe) {
+                break;
+            }
+            LoadJob *job = ready.front();
+            ready.pop_front();
+            io_uring_prep_read(sqe, job->fd, job->target + job->done,
+                               job->length - job->done, job->offset + job->done);
+            io_uring_sqe_set_data(sqe, job);
+            inFlight++;
+        }
+        io_uring_submit(ring);
+
+        struct io_uring_cqe *cqe = 0;
+        int status = io_uring_wait_cqe(ring, &cqe);
+        if (status < 0) {
+            if (status == -EINTR) {
+                continue;
+            }
+            std::cerr << "io_uring_wait_cqe failed: " << strerror(-status) << std::endl;
+            break;
+        }
+        // drain everything that has completed so far. Callbacks of finished
+        // jobs run while the remaining reads are still being serviced.
+        while (cqe) {
+            LoadJob *job = (LoadJob*) io_uring_cqe_get_data(cqe);
+            ssize_t result = cqe->res;
+            io_uring_cqe_seen(ring, cqe);
+            inFlight--;
+            completeRead(job, result);
+            if (job->state == DONE) {
+                finishJob(job);
+                remaining--;
+            } else {
+                ready.push_back(job);
+            }
+            cqe = 0;
+            if (io_uring_peek_cqe(ring, &cqe) < 0) {
+                cqe = 0;
+            }
+        }
+    }
+    // the ring failed. Reads still in flight write into the buffers of their
+    // jobs, so they have to complete before the blocking path takes over.
+    while (inFlight > 0) {
+        struct io_uring_cqe *cqe = 0;
+        int status = io_uring_wait_cqe(ring, &cqe);
+        if (status == -EINTR) {
+            continue;
+        }
+        if (status < 0) {
+            break;
+        }
+        LoadJob *job = (LoadJob*) io_uring_cqe_get_data(cqe);
+        ssize_t result = cqe->res;
+        io_uring_cqe_seen(ring, cqe);
+        inFlight--;
+        completeRead(job, result);
+        if (job->state == DONE) {
+            finishJob(job);
+            remaining--;
+        }
+    }
+    if (inFlight > 0) {
+        // not even the completions can be waited for, tearing down the ring
+        // cancels the reads
+        io_uring_queue_exit(ring);
+        delete ring;
+        mRing = 0;
+    }
+    for (size_t i = 0; remaining > 0 && i < mJobs.size(); i++) {
+        LoadJob *job = mJobs[i];
+        if (job->state != DONE) {
+            loadBlocking(job);
+            finishJob(job);
+            remaining--;
+        }
+    }
+#endif
+}
+
+void AsyncLoader::closeFiles() {
+    std::map<std::string, int>::iterator it = mFiles.begin();
+    while (it != mFiles.end()) {
+        if (it->second >= 0) {
+            close(it->second);
+        }
+        ++it;
+    }
+    mFiles.clear();
+}
@@ -0,0 +1,128 @@
+/* src/rcmloader.h
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#ifndef RCM_LOADER_H
+#define RCM_LOADER_H
+
+#include "rcm.h"
+#include "rcmreader.h"
+#include <future>
+#include <map>
+#include <string>
+#include <vector>
+
+struct LoadRequest;
+
+/**
+ * Result of a single load request. On success status is 0 and data points
+ * to the object data (vertices followed by indices, exactly as stored in
+ * the file). If the request provided neither a buffer nor an allocator, data
+ * was allocated with new char[] and has to be released with delete[].
+ * On failure status holds a negative errno value and data is 0.
+ */
+struct LoadResult {
+    int status;
+    ObjectHeader header;
+    void *data;
+    size_t size;
+};
+
+typedef void (*LoadCallback)(const LoadRequest &request, const LoadResult &result);
+
+struct LoadRequest {
+    LoadRequest() : objectIndex(0), buffer(0), bufferSize(0), allocator(0),
+            callback(0), userData(0) {}
+
+    std::string path;
+    unsigned int objectIndex;
+    // optional destination for the object data
+    void *buffer;
+    size_t bufferSize;
+    // used once the object size is known if no buffer is given
+    const ReaderAllocator *allocator;
+    // optional, called from the thread that completed the request
+    LoadCallback callback;
+    void *userData;
+};
+
+struct LoadJob;
+
+/**
+ * Loads a batch of objects from .rcm files. All requests are collected with
+ * add() and then issued at once with run(). Reads go through io_uring if the
+ * library was built with liburing and the kernel supports it, otherwise a
+ * pool of threads issues blocking pread() calls. Completion is reported
+ * through the callback of the request and/or the future returned by add().
+ * Callbacks of finished requests run while the remaining reads are still in
+ * flight, so parsing of loaded data overlaps with the outstanding I/O.
+ *
+ * Example:
+ *
+ *  AsyncLoader loader;
+ *  std::future<LoadResult> a = loader.add(request);
+ *  std::future<LoadResult> b = loader.add(otherRequest);
+ *  loader.run();
+ *  LoadResult result = a.get();
+ */
+class AsyncLoader {
+public:
+    /**
+     * C'tor for the loader.
+     *
+     * @param queueDepth maximum number of reads in flight
+     * @param numThreads number of threads for the fallback path, 0 picks the
+     *                   number of hardware threads
+     * @param useIoUring set to false to always use the thread pool
+     */
+    AsyncLoader(unsigned int queueDepth = 64, unsigned int numThreads = 0,
+            bool useIoUring = true);
+    ~AsyncLoader();
+
+    /**
+     * Queue a request. Nothing is read until run() is called.
+     *
+     * @param request describes the file, the object and the destination
+     * @return a future that becomes ready when the request is completed
+     */
+    std::future<LoadResult> add(const LoadRequest &request);
+
+    /**
+     * Issue all queued requests and block until every one of them is done.
+     */
+    void run();
+
+    /**
+     * @return true if reads are submitted through io_uring
+     */
+    bool usesIoUring() const;
+
+private:
+    AsyncLoader(const AsyncLoader &);
+    AsyncLoader& operator=(const AsyncLoader &);
+
+    void runThreadPool();
+    void runIoUring();
+    void closeFiles();
+
+    std::vector<LoadJob*> mJobs;
+    std::map<std::string, int> mFiles;
+    unsigned int mQueueDepth;
+    unsigned int mNumThreads;
+    void *mRing;
+};
+
+#endif // RCM_LOADER_H
@@ -0,0 +1,98 @@
+/* src/rcmmaterial.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include "rcmmaterial.h"
+#include <iostream>
+#include <map>
+#include <string.h>
+
+void encodeMaterials(const std::vector<Material> &materials,
+        const std::vector<Texture> &textures, std::vector<uint8_t> &out) {
+    std::vector<MaterialEntry> entries(materials.size());
+    // every path is stored once
+    std::map<std::string, uint32_t> paths;
+    std::string names;
+    for (size_t m = 0; m < materials.size(); m++) {
+        const Material &material = materials[m];
+        MaterialEntry &entry = entries[m];
+        entry.nameHash = material.nameHash;
+        memcpy(entry.diffuse, material.diffuse, sizeof(entry.diffuse));
+        memcpy(entry.specular, material.specular, sizeof(entry.specular));
+        entry.shininess = material.shininess;
+        memcpy(entry.emissive, material.emissive, sizeof(entry.emissive));
+        entry.flags = material.flags;
+        for (unsigned int s = 0; s < kNumTextureSlots; s++) {
+            const std::string &path = material.texturePaths[s];
+            entry.textures[s].texture = kNoTexture;
+            entry.textures[s].path = kNoTexture;
+            if (path.empty()) {
+                continue;
+            }
+            std::map<std::string, uint32_t>::iterator known = paths.find(path);
+            if (known == paths.end()) {
+                known = paths.insert(std::make_pair(path, (uint32_t) names.size())).first;
+                names.append(path.c_str(), path.size() + 1);
+            }
+            entry.textures[s].path = known->second;
+            const uint64_t hash = hashName(path.c_str(), path.size());
+            for (size_t t = 0; t < textures.size(); t++) {
+                if (textures[t].nameHash == hash) {
+                    entry.textures[s].texture = t;
+                    break;
+                }
+            }
+        }
+    }
+    const size_t entriesSize = entries.size() * sizeof(MaterialEntry);
+    out.assign(entriesSize + names.size(), 0);
+    if (entriesSize > 0) {
+        memcpy(&out[0], &entries[0], entriesSize);
+    }
+    if (!names.empty()) {
+        memcpy(&out[entriesSize], names.data(), names.size());
+    }
+}
+
+bool openMaterials(const void *data, size_t size, uint32_t materialCount, MaterialsView *view) {
+    const size_t entriesSize = (size_t) materialCount * sizeof(MaterialEntry);
+    if (!view || size < entriesSize || (materialCount > 0 && !data) ||
+        ((uintptr_t) data % sizeof(uint64_t)) != 0) {
+        return false;
+    }
+    const MaterialEntry *materials = (const MaterialEntry*) data;
+    const char *names = (const char*) data + entriesSize;
+    const size_t namesSize = size - entriesSize;
+    if (namesSize > 0 && names[namesSize - 1] != 0) {
+        std::cerr << "material names are not terminated" << std::endl;
+        return false;
+    }
+    for (uint32_t m = 0; m < materialCount; m++) {
+        for (unsigned int s = 0; s < kNumTextureSlots; s++) {
+            const uint32_t path = materials[m].textures[s].path;
+            if (path != kNoTexture && path >= namesSize) {
+                std::cerr << "material " << m << " refers to a missing path" << std::endl;
+                return false;
+            }
+        }
+    }
+    view->materialCount = materialCount;
+    view->materials = materials;
+    view->names = names;
+    view->namesSize = namesSize;
+    view->allocation = 0;
+    return true;
+}
@@ -0,0 +1,110 @@
+/* src/rcmmaterial.h
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#ifndef RCM_MATERIAL_H
+#define RCM_MATERIAL_H
+
+#include "rcm.h"
+#include "rcmtexture.h"
+#include <string>
+#include <vector>
+
+/* Material table of a file.
+
+Models refer to their material by index (materialIndex of the object
+header). A material holds the basic shading parameters and one texture per
+slot. A texture is referenced by the path the model uses for it and, if the
+file embeds it, by the index of its TEXTURE object among the TEXTURE objects
+of the file.
+
+layout of the data of a MATERIALS object, element count is the number of
+materials:
+  material count * MaterialEntry
+  name table, the texture paths, each terminated by 0
+*/
+
+// empty texture slot or texture that is not embedded
+const uint32_t kNoTexture = 0xffffffff;
+
+enum MaterialTextureSlot {
+    DIFFUSE_TEXTURE = 0,
+    NORMAL_TEXTURE,
+    SPECULAR_TEXTURE,
+    EMISSIVE_TEXTURE,
+    OPACITY_TEXTURE,
+    kNumTextureSlots
+};
+
+enum MaterialFlags {
+    MATERIAL_TWO_SIDED = 0x1,
+};
+
+// source material
+struct Material {
+    uint64_t nameHash;
+    // color and opacity
+    float diffuse[4];
+    float specular[3];
+    float shininess;
+    float emissive[3];
+    uint32_t flags;
+    // empty if the slot is not used
+    std::string texturePaths[kNumTextureSlots];
+};
+
+struct MaterialTextureRef {
+    // index among the TEXTURE objects of the file or kNoTexture
+    uint32_t texture;
+    // offset of the path in the name table, kNoTexture for an empty slot
+    uint32_t path;
+};
+
+struct MaterialEntry {
+    uint64_t nameHash;
+    float diffuse[4];
+    float specular[3];
+    float shininess;
+    float emissive[3];
+    uint32_t flags;
+    MaterialTextureRef textures[kNumTextureSlots];
+};
+
+struct MaterialsView {
+    uint32_t materialCount;
+    const MaterialEntry *materials;
+    const char *names;
+    uint32_t namesSize;
+    // set if the data had to be copied, release with delete[] (char*)
+    void *allocation;
+};
+
+// encodes the materials, textures are the textures written to the same file
+// in the order of their objects
+void encodeMaterials(const std::vector<Material> &materials,
+        const std::vector<Texture> &textures, std::vector<uint8_t> &out);
+
+// checks the data and sets up the view, data has to be 8 byte aligned
+bool openMaterials(const void *data, size_t size, uint32_t materialCount, MaterialsView *view);
+
+// path of the texture in the given slot of a material, 0 for an empty slot
+inline const char* materialTexturePath(const MaterialsView &view, const MaterialEntry &material,
+        MaterialTextureSlot slot) {
+    const uint32_t offset = material.textures[slot].path;
+    return offset == kNoTexture ? 0 : view.names + offset;
+}
+
+#endif // RCM_MATERIAL_H
@@ -0,0 +1,272 @@
+/* src/rcmmorph.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include "rcmmorph.h"
+#include "internal/trace.h"
+#include <iostream>
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const float kQuantizeScale = 32767.0f;
+// the kernel works on this many moved vertices at once
+static const unsigned int kMorphBlockSize = 4;
+// a block holds 12 or 24 values, the pattern of the scale factors repeats
+// after 12 values for both 3 and 6 components
+static const unsigned int kFactorPeriod = 12;
+
+static size_t calcDeltaDataSize(uint16_t flags, size_t deltaCount) {
+    const size_t valueSize = (flags & MORPH_QUANTIZED) ? sizeof(int16_t) : sizeof(float);
+    const size_t size = deltaCount * morphDeltaComponents(flags) * valueSize;
+    return (size + 3) & ~(size_t) 3;
+}
+
+static bool movesVertex(const MorphTarget &target, unsigned int vertex) {
+    for (unsigned int k = 0; k < 3; k++) {
+        const size_t offset = vertex * 3 + k;
+        if (fabsf(target.positionDeltas[offset]) > kMorphDeltaEpsilon ||
+            (target.normalDeltas && fabsf(target.normalDeltas[offset]) > kMorphDeltaEpsilon)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static float maxAbs(const float *values, const std::vector<uint32_t> &vertices) {
+    float result = 0.0f;
+    for (size_t i = 0; values && i < vertices.size(); i++) {
+        for (unsigned int k = 0; k < 3; k++) {
+            const float value = fabsf(values[vertices[i] * 3 + k]);
+            result = value > result ? value : result;
+        }
+    }
+    return result;
+}
+
+static int16_t quantizeDelta(float value, float scale) {
+    return scale > 0.0f ? (int16_t) lrintf(value / scale * kQuantizeScale) : 0;
+}
+
+// appends the three components of vertex, zeros if values is 0
+static void appendDelta(const float *values, uint32_t vertex, float scale, bool quantize,
+        std::vector<float> &floats, std::vector<int16_t> &quantized) {
+    for (unsigned int k = 0; k < 3; k++) {
+        const float value = values ? values[vertex * 3 + k] : 0.0f;
+        if (quantize) {
+            quantized.push_back(quantizeDelta(value, scale));
+        } else {
+            floats.push_back(value);
+        }
+    }
+}
+
+bool encodeMorphTargets(const MorphTarget *targets, unsigned int numTargets,
+        unsigned int numVertices, bool quantize, std::vector<uint8_t> &out, uint16_t &flags) {
+    TraceScope trace("encodeMorphTargets");
+    flags = quantize ? MORPH_QUANTIZED : 0;
+    for (unsigned int t = 0; t < numTargets; t++) {
+        if (!targets[t].positionDeltas) {
+            std::cerr << "morph target without position deltas" << std::endl;
+            return false;
+        }
+        if (targets[t].normalDeltas) {
+            flags |= MORPH_NORMALS;
+        }
+    }
+    const bool hasNormals = (flags & MORPH_NORMALS) != 0;
+
+    std::vector<MorphTargetHeader> headers(numTargets);
+    std::vector<uint32_t> vertexIndices;
+    std::vector<float> floats;
+    std::vector<int16_t> quantized;
+    for (unsigned int t = 0; t < numTargets; t++) {
+        const MorphTarget &target = targets[t];
+        std::vector<uint32_t> moved;
+        for (unsigned int v = 0; v < numVertices; v++) {
+            if (movesVertex(target, v)) {
+                moved.push_back(v);
+            }
+        }
+        MorphTargetHeader &header = headers[t];
+        header.nameHash = target.nameHash;
+        header.firstDelta = vertexIndices.size();
+        header.deltaCount = moved.size();
+        header.positionScale = quantize ? maxAbs(target.positionDeltas, moved) : 1.0f;
+        header.normalScale = quantize ? maxAbs(target.normalDeltas, moved) : 1.0f;
+        vertexIndices.insert(vertexIndices.end(), moved.begin(), moved.end());
+        for (size_t i = 0; i < moved.size(); i++) {
+            appendDelta(target.positionDeltas, moved[i], header.positionScale, quantize,
+                        floats, quantized);
+            if (hasNormals) {
+                appendDelta(target.normalDeltas, moved[i], header.normalScale, quantize,
+                            floats, quantized);
+            }
+        }
+    }
+
+    const size_t headersSize = headers.size() * sizeof(MorphTargetHeader);
+    const size_t indicesSize = vertexIndices.size() * sizeof(uint32_t);
+    const size_t deltasSize = calcDeltaDataSize(flags, vertexIndices.size());
+    out.assign(headersSize + indicesSize + deltasSize, 0);
+    if (headersSize > 0) {
+        memcpy(&out[0], &headers[0], headersSize);
+    }
+    if (indicesSize > 0) {
+        memcpy(&out[headersSize], &vertexIndices[0], indicesSize);
+    }
+    if (!floats.empty()) {
+        memcpy(&out[headersSize + indicesSize], &floats[0], floats.size() * sizeof(float));
+    } else if (!quantized.empty()) {
+        memcpy(&out[headersSize + indicesSize], &quantized[0], quantized.size() * sizeof(int16_t));
+    }
+    return true;
+}
+
+bool openMorphTargets(const void *data, size_t size, uint16_t flags, uint32_t targetCount,
+        uint32_t vertexCount, MorphTargetsView *view) {
+    const size_t headersSize = (size_t) targetCount * sizeof(MorphTargetHeader);
+    if (!data || !view || size < headersSize || ((uintptr_t) data % sizeof(uint64_t)) != 0) {
+        return false;
+    }
+    const MorphTargetHeader *targets = (const MorphTargetHeader*) data;
+    // the deltas of the targets follow each other
+    size_t deltaCount = 0;
+    for (uint32_t t = 0; t < targetCount; t++) {
+        if (targets[t].firstDelta != deltaCount) {
+            std::cerr << "morph target out of order" << std::endl;
+            return false;
+        }
+        deltaCount += targets[t].deltaCount;
+    }
+    if (headersSize + deltaCount * sizeof(uint32_t) + calcDeltaDataSize(flags, deltaCount) != size) {
+        std::cerr << "morph targets do not match their size" << std::endl;
+        return false;
+    }
+    const uint32_t *vertexIndices = (const uint32_t*) ((const char*) data + headersSize);
+    for (uint32_t t = 0; t < targetCount; t++) {
+        const uint32_t *vertices = vertexIndices + targets[t].firstDelta;
+        for (uint32_t i = 0; i < targets[t].deltaCount; i++) {
+            if (vertices[i] >= vertexCount || (i > 0 && vertices[i] <= vertices[i - 1])) {
+                std::cerr << "morph target vertex out of range" << std::endl;
+                return false;
+            }
+        }
+    }
+    view->flags = flags;
+    view->targetCount = targetCount;
+    view->deltaCount = deltaCount;
+    view->targets = targets;
+    view->vertexIndices = vertexIndices;
+    view->deltas = view->vertexIndices + deltaCount;
+    view->allocation = 0;
+    return true;
+}
+
+// weighted deltas of kMorphBlockSize vertices, count values starting at src
+#ifdef __SSE2__
+static inline void scaleBlock(const float *src, unsigned int count, const float *factors,
+        float *dst) {
+    for (unsigned int i = 0; i < count; i += 4) {
+        const __m128 factor = _mm_loadu_ps(factors + i % kFactorPeriod);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), factor));
+    }
+}
+
+static inline void scaleBlock(const int16_t *src, unsigned int count, const float *factors,
+        float *dst) {
+    for (unsigned int i = 0; i < count; i += 4) {
+        // sign extend four int16 to int32 and convert them
+        __m128i values = _mm_loadl_epi64((const __m128i*) (src + i));
+        values = _mm_srai_epi32(_mm_unpacklo_epi16(values, values), 16);
+        const __m128 factor = _mm_loadu_ps(factors + i % kFactorPeriod);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(values), factor));
+    }
+}
+#else
+template<typename T>
+static inline void scaleBlock(const T *src, unsigned int count, const float *factors,
+        float *dst) {
+    for (unsigned int i = 0; i < count; i++) {
+        dst[i] = src[i] * factors[i % kFactorPeriod];
+    }
+}
+#endif
+
+template<typename T>
+static void applyTarget(const MorphTargetsView &view, const MorphTargetHeader &target,
+        const float *factors, float *positions, float *normals, size_t stride) {
+    const unsigned int components = morphDeltaComponents(view.flags);
+    const uint32_t *vertices = view.vertexIndices + target.firstDelta;
+    const T *deltas = (const T*) view.deltas + (size_t) target.firstDelta * components;
+    float block[kMorphBlockSize * 6];
+    for (uint32_t first = 0; first < target.deltaCount; first += kMorphBlockSize) {
+        const uint32_t count = target.deltaCount - first < kMorphBlockSize ?
+                               target.deltaCount - first : kMorphBlockSize;
+        const T *src = deltas + (size_t) first * components;
+        if (count == kMorphBlockSize) {
+            scaleBlock(src, kMorphBlockSize * components, factors, block);
+        } else {
+            for (unsigned int i = 0; i < count * components; i++) {
+                block[i] = src[i] * factors[i % kFactorPeriod];
+            }
+        }
+        // scatter into the base vertices
+        for (uint32_t i = 0; i < count; i++) {
+            const size_t offset = vertices[first + i] * stride;
+            const float *delta = block + i * components;
+            positions[offset] += delta[0];
+            positions[offset + 1] += delta[1];
+            positions[offset + 2] += delta[2];
+            if (normals && components == 6) {
+                normals[offset] += delta[3];
+                normals[offset + 1] += delta[4];
+                normals[offset + 2] += delta[5];
+            }
+        }
+    }
+}
+
+void applyMorphTargets(const MorphTargetsView &view, const float *weights,
+        float *positions, float *normals, size_t stride) {
+    const bool quantized = (view.flags & MORPH_QUANTIZED) != 0;
+    const unsigned int components = morphDeltaComponents(view.flags);
+    for (uint32_t t = 0; t < view.targetCount; t++) {
+        if (weights[t] == 0.0f) {
+            continue;
+        }
+        const MorphTargetHeader &target = view.targets[t];
+        // weight and dequantization scale of every value of a block
+        float positionFactor = weights[t];
+        float normalFactor = weights[t];
+        if (quantized) {
+            positionFactor *= target.positionScale / kQuantizeScale;
+            normalFactor *= target.normalScale / kQuantizeScale;
+        }
+        float factors[kFactorPeriod];
+        for (unsigned int i = 0; i < kFactorPeriod; i++) {
+            factors[i] = (i % components) < 3 ? positionFactor : normalFactor;
+        }
+        if (quantized) {
+            applyTarget<int16_t>(view, target, factors, positions, normals, stride);
+        } else {
+            applyTarget<float>(view, target, factors, positions, normals, stride);
+        }
+    }
+}
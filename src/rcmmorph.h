@@ -0,0 +1,100 @@
+/* src/rcmmorph.h
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#ifndef RCM_MORPH_H
+#define RCM_MORPH_H
+
+#include "rcm.h"
+#include <vector>
+
+/* Sparse morph targets (blend shapes).
+
+A target only stores the vertices it moves: a sorted list of vertex indices
+and the position (and normal) difference to the base mesh for each of them.
+Differences are stored as floats or, with MORPH_QUANTIZED, as 16 bit values
+scaled by the largest difference of the target.
+
+layout of the data of a MORPH_TARGETS object, element count is the number of
+targets:
+  target count * MorphTargetHeader
+  delta count * vertex index, 4 byte, ascending within a target
+  delta count * (position delta, normal delta with MORPH_NORMALS), 3 floats
+                or 3 int16 each, padded to 4 byte
+*/
+
+// differences smaller than this do not move a vertex
+const float kMorphDeltaEpsilon = 1e-6f;
+
+// flags of the block header
+enum MorphFlags {
+    MORPH_NORMALS = 0x1,
+    MORPH_QUANTIZED = 0x2,
+};
+
+// source target, deltas are given for every vertex of the base mesh
+struct MorphTarget {
+    uint64_t nameHash;
+    // numVertices * 3 floats
+    float *positionDeltas;
+    // numVertices * 3 floats, 0 if the target does not change the normals
+    float *normalDeltas;
+};
+
+struct MorphTargetHeader {
+    uint64_t nameHash;
+    uint32_t firstDelta;
+    uint32_t deltaCount;
+    // quantized deltas are value / 32767 * scale
+    float positionScale;
+    float normalScale;
+};
+
+struct MorphTargetsView {
+    uint16_t flags;
+    uint32_t targetCount;
+    uint32_t deltaCount;
+    const MorphTargetHeader *targets;
+    const uint32_t *vertexIndices;
+    // float or int16_t, depending on MORPH_QUANTIZED
+    const void *deltas;
+    // set if the data had to be copied, release with delete[] (char*)
+    void *allocation;
+};
+
+// number of delta components of every moved vertex
+inline unsigned int morphDeltaComponents(uint16_t flags) {
+    return (flags & MORPH_NORMALS) ? 6 : 3;
+}
+
+// encodes the targets of a mesh with numVertices vertices into out and
+// returns the block header flags in flags
+bool encodeMorphTargets(const MorphTarget *targets, unsigned int numTargets,
+        unsigned int numVertices, bool quantize, std::vector<uint8_t> &out, uint16_t &flags);
+
+// checks the data against the vertex count of the base mesh and sets up the
+// view, data has to be 8 byte aligned
+bool openMorphTargets(const void *data, size_t size, uint16_t flags, uint32_t targetCount,
+        uint32_t vertexCount, MorphTargetsView *view);
+
+// adds the targets scaled by weights (one per target) to the base vertices.
+// Positions and normals point to the first vertex, stride is the distance
+// between two vertices in floats (vertexSize for array of structs, 3 for
+// struct of arrays). normals may be 0, they are not normalized again.
+void applyMorphTargets(const MorphTargetsView &view, const float *weights,
+        float *positions, float *normals, size_t stride);
+
+#endif // RCM_MORPH_H
@@ -0,0 +1,162 @@
+/* src/rcmpack.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include "rcmpack.h"
+#include "internal/trace.h"
+#include <iostream>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool rangeInside(uint64_t offset, uint64_t length, size_t size) {
+    return offset <= size && length <= size - offset;
+}
+
+static Pack* validatePack(const uint8_t *data, size_t size) {
+    if (size < sizeof(PackHeader) || ((uintptr_t) data % sizeof(uint64_t)) != 0) {
+        std::cerr << "pack too small or not aligned" << std::endl;
+        return 0;
+    }
+    const PackHeader *header = (const PackHeader*) data;
+    if (header->magicNumber[0] != kPackMagicNumber[0] ||
+        header->magicNumber[1] != kPackMagicNumber[1]) {
+        std::cerr << "pack magic number mismatch. abort" << std::endl;
+        return 0;
+    }
+    if (header->version[0] != kPackFormatVersionMajor ||
+        header->version[1] != kPackFormatVersionMinor) {
+        std::cerr << "unsupported pack version" << std::endl;
+        return 0;
+    }
+    if (header->bucketBits > 24) {
+        std::cerr << "pack has too many buckets" << std::endl;
+        return 0;
+    }
+    const uint64_t bucketCount = 1ULL << header->bucketBits;
+    if (header->entryTableOffset % sizeof(uint64_t) != 0 ||
+        header->bucketTableOffset % sizeof(uint32_t) != 0 ||
+        !rangeInside(header->entryTableOffset,
+                     (uint64_t) header->objectCount * sizeof(PackEntry), size) ||
+        !rangeInside(header->bucketTableOffset, (bucketCount + 1) * sizeof(uint32_t), size) ||
+        !rangeInside(header->nameTableOffset, header->nameTableSize, size)) {
+        std::cerr << "pack tables exceed the pack size" << std::endl;
+        return 0;
+    }
+
+    Pack *pack = new Pack();
+    pack->data = data;
+    pack->size = size;
+    pack->header = header;
+    pack->entries = (const PackEntry*) (data + header->entryTableOffset);
+    pack->buckets = (const uint32_t*) (data + header->bucketTableOffset);
+    pack->names = (const char*) (data + header->nameTableOffset);
+    pack->mapping = 0;
+
+    for (uint64_t b = 0; b <= bucketCount; b++) {
+        if (pack->buckets[b] > header->objectCount ||
+            (b > 0 && pack->buckets[b] < pack->buckets[b - 1])) {
+            std::cerr << "corrupt pack bucket table" << std::endl;
+            delete pack;
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < header->objectCount; i++) {
+        const PackEntry &entry = pack->entries[i];
+        if (!rangeInside(entry.objectOffset, entry.objectSize, size) ||
+            !rangeInside(entry.nameOffset, (uint64_t) entry.nameLength + 1, header->nameTableSize) ||
+            pack->names[entry.nameOffset + entry.nameLength] != 0) {
+            std::cerr << "corrupt pack entry " << i << std::endl;
+            delete pack;
+            return 0;
+        }
+    }
+    return pack;
+}
+
+Pack* openPack(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "could not open file: " << path << std::endl;
+        return 0;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size == 0) {
+        std::cerr << "could not stat file: " << path << std::endl;
+        close(fd);
+        return 0;
+    }
+    const size_t size = info.st_size;
+    void *mapping = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "could not map file: " << path << std::endl;
+        return 0;
+    }
+    Pack *pack = validatePack((const uint8_t*) mapping, size);
+    if (!pack) {
+        munmap(mapping, size);
+        return 0;
+    }
+    pack->mapping = mapping;
+    return pack;
+}
+
+Pack* openPack(const void *data, size_t size) {
+    return validatePack((const uint8_t*) data, size);
+}
+
+void closePack(Pack *pack) {
+    if (!pack) {
+        return;
+    }
+    if (pack->mapping) {
+        munmap(pack->mapping, pack->size);
+    }
+    delete pack;
+}
+
+const PackEntry* findPackEntry(const Pack *pack, const char *name) {
+    const size_t length = strlen(name);
+    const uint64_t hash = hashName(name, length);
+    const uint32_t bucket = packBucket(hash, pack->header->bucketBits);
+    const uint32_t end = pack->buckets[bucket + 1];
+    for (uint32_t i = pack->buckets[bucket]; i < end; i++) {
+        const PackEntry *entry = &pack->entries[i];
+        if (entry->nameHash == hash && entry->nameLength == length &&
+            memcmp(pack->names + entry->nameOffset, name, length) == 0) {
+            return entry;
+        }
+    }
+    return 0;
+}
+
+bool readPackObject(const Pack *pack, const PackEntry *entry,
+        ObjectHeader *header, ObjectView *view) {
+    TraceScope trace("readPackObject");
+    MemoryStream in(pack->data + entry->objectOffset, entry->objectSize);
+    if (!readObjectHeader(in, header)) {
+        return false;
+    }
+    if (!isModelObject(header->type)) {
+        std::cerr << "pack entry is not a model: " << packEntryName(pack, entry) << std::endl;
+        return false;
+    }
+    return readObjectView(in, header, view);
+}
@@ -0,0 +1,56 @@
+/* src/rcmpack.h
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#ifndef RCM_PACK_H
+#define RCM_PACK_H
+
+#include "rcm.h"
+#include "rcmreader.h"
+
+// a pack that has been validated and is ready for lookups. All pointers
+// point into the pack memory, nothing is copied.
+struct Pack {
+    const uint8_t *data;
+    size_t size;
+    const PackHeader *header;
+    const PackEntry *entries;
+    const uint32_t *buckets;
+    const char *names;
+    // set if the pack memory is a mapping owned by the pack
+    void *mapping;
+};
+
+// maps the pack file read only into memory and validates it
+Pack* openPack(const char *path);
+
+// uses pack data that is already in memory, e.g. embedded or mapped by the
+// caller. The data has to be 8 byte aligned and outlive the pack.
+Pack* openPack(const void *data, size_t size);
+
+void closePack(Pack *pack);
+
+const PackEntry* findPackEntry(const Pack *pack, const char *name);
+
+inline const char* packEntryName(const Pack *pack, const PackEntry *entry) {
+    return pack->names + entry->nameOffset;
+}
+
+// parses the object header of an entry and references its data in place
+bool readPackObject(const Pack *pack, const PackEntry *entry,
+        ObjectHeader *header, ObjectView *view);
+
+#endif // RCM_PACK_H
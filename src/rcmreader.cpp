@@ -16,7 +16,9 @@
  * */
 
 #include "rcmreader.h"
+#include "internal/trace.h"
 #include <iostream>
+#include <string.h>
 
 FileHeader* readFileHeader(std::ifstream &in) {
     if (!in.is_open()) {
@@ -36,6 +38,13 @@ FileHeader* readFileHeader(std::ifstream &in) {
         header->magicNumber[1] != kMagicNumber[1]) {
         std::cerr << "magic number mismatch. abort import" << std::endl;
         in.close();
+        delete header;
+        return NULL;
+    }
+    if (!isSupportedFileVersion(header)) {
+        std::cerr << "unsupported file version. abort import" << std::endl;
+        in.close();
+        delete header;
         return NULL;
     }
     return header;
@@ -50,7 +59,141 @@ ObjectHeader* readObjectHeader(std::ifstream &in) {
     return header;
 }
 
+bool readDrawRanges(std::ifstream &in, const ObjectHeader *object,
+        DrawRange *ranges, DrawCommand *commands) {
+    if (!in.is_open() || !object || object->type != DRAW_RANGES) {
+        return false;
+    }
+    const BlockHeader *block = asBlockHeader(object);
+    if (block->dataSize != block->elementCount * (sizeof(DrawRange) + sizeof(DrawCommand))) {
+        std::cerr << "draw ranges do not match their size" << std::endl;
+        return false;
+    }
+    in.read((char*) ranges, block->elementCount * sizeof(DrawRange));
+    in.read((char*) commands, block->elementCount * sizeof(DrawCommand));
+    return !in.fail();
+}
+
+bool readInstances(std::ifstream &in, const ObjectHeader *object, Instance *instances) {
+    if (!in.is_open() || !object || object->type != INSTANCES) {
+        return false;
+    }
+    const BlockHeader *block = asBlockHeader(object);
+    if (block->dataSize != block->elementCount * sizeof(Instance)) {
+        std::cerr << "instances do not match their size" << std::endl;
+        return false;
+    }
+    in.read((char*) instances, block->dataSize);
+    return !in.fail();
+}
+
+bool readAnimation(std::ifstream &in, const ObjectHeader *object, AnimationView *view) {
+    TraceScope trace("readAnimation");
+    if (!in.is_open() || !object || object->type != ANIMATION || !view) {
+        return false;
+    }
+    const BlockHeader *block = asBlockHeader(object);
+    // char arrays from new are aligned for every fundamental type
+    char *data = new char[block->dataSize];
+    in.read(data, block->dataSize);
+    if (in.fail() || !openAnimation(data, block->dataSize, view)) {
+        delete[] data;
+        return false;
+    }
+    view->allocation = data;
+    return true;
+}
+
+bool readMorphTargets(std::ifstream &in, const ObjectHeader *object, uint32_t vertexCount,
+        MorphTargetsView *view) {
+    TraceScope trace("readMorphTargets");
+    if (!in.is_open() || !object || object->type != MORPH_TARGETS || !view) {
+        return false;
+    }
+    const BlockHeader *block = asBlockHeader(object);
+    char *data = new char[block->dataSize];
+    in.read(data, block->dataSize);
+    if (in.fail() || !openMorphTargets(data, block->dataSize, block->flags, block->elementCount,
+                                       vertexCount, view)) {
+        delete[] data;
+        return false;
+    }
+    view->allocation = data;
+    return true;
+}
+
+// copies BVH data of size bytes into a new allocation in which the nodes start
+// on a cache line, returns the allocation and the start of the data in aligned
+static char* copyBvhData(const char *data, size_t size, const char **aligned) {
+    BvhHeader header;
+    memcpy(&header, data, sizeof(BvhHeader));
+    char *copy = new char[size + kBvhNodeAlignment];
+    const uintptr_t nodes = (uintptr_t) copy + header.nodeOffset;
+    const size_t shift = (kBvhNodeAlignment - nodes % kBvhNodeAlignment) % kBvhNodeAlignment;
+    memcpy(copy + shift, data, size);
+    *aligned = copy + shift;
+    return copy;
+}
+
+bool readBvh(std::ifstream &in, const ObjectHeader *object, uint32_t indexCount,
+        BvhView *view) {
+    TraceScope trace("readBvh");
+    if (!in.is_open() || !object || object->type != BVH || !view) {
+        return false;
+    }
+    const BlockHeader *block = asBlockHeader(object);
+    if (block->dataSize < sizeof(BvhHeader)) {
+        return false;
+    }
+    std::vector<char> data(block->dataSize);
+    in.read(&data[0], block->dataSize);
+    if (in.fail()) {
+        return false;
+    }
+    const char *aligned;
+    char *copy = copyBvhData(&data[0], data.size(), &aligned);
+    if (!openBvh(aligned, block->dataSize, block->elementCount, indexCount, view)) {
+        delete[] copy;
+        return false;
+    }
+    view->allocation = copy;
+    return true;
+}
+
+bool readTexture(std::ifstream &in, const ObjectHeader *object, TextureView *view) {
+    TraceScope trace("readTexture");
+    if (!in.is_open() || !object || object->type != TEXTURE || !view) {
+        return false;
+    }
+    const BlockHeader *block = asBlockHeader(object);
+    char *data = new char[block->dataSize];
+    in.read(data, block->dataSize);
+    if (in.fail() || !openTexture(data, block->dataSize, block->flags, block->elementCount, view)) {
+        delete[] data;
+        return false;
+    }
+    view->allocation = data;
+    return true;
+}
+
+bool readMaterials(std::ifstream &in, const ObjectHeader *object, MaterialsView *view) {
+    TraceScope trace("readMaterials");
+    if (!in.is_open() || !object || object->type != MATERIALS || !view) {
+        return false;
+    }
+    const BlockHeader *block = asBlockHeader(object);
+    char *data = new char[block->dataSize];
+    in.read(data, block->dataSize);
+    if (in.fail() || !openMaterials(data, block->dataSize, block->elementCount, view)) {
+        delete[] data;
+        return false;
+    }
+    view->allocation = data;
+    return true;
+}
+
 Bla* readArrayOfStructs(std::ifstream &in, const ObjectHeader *object) {
+    TraceScope trace("readArrayOfStructs");
     if (!in.is_open()) {
         return 0;
     }
@@ -66,6 +209,8 @@ Bla* readArrayOfStructs(std::ifstream &in, const ObjectHeader *object) {
     bla->indices = new unsigned short[indexCount];
     in.read((char*) bla->vertices[0], size * sizeof(float));
     in.read((char*) bla->indices, indexCount * sizeof(unsigned short));
+    // the skin is not part of Bla, skip it to keep the stream at the next object
+    in.seekg(calcSkinDataSize(object), std::ios::cur);
 
     return bla;
 }
@@ -77,6 +222,7 @@ void readData(std::ifstream &in, float **data, unsigned int elementSize, unsigne
 }
 
 Bla* readStructOfArrays(std::ifstream &in, const ObjectHeader *object) {
+    TraceScope trace("readStructOfArrays");
     if (!in.is_open()) {
         return 0;
     }
@@ -101,7 +247,7 @@ Bla* readStructOfArrays(std::ifstream &in, const ObjectHeader *object) {
     if (hasPositions(vertexFlags)) {
         readData(in, &bla->vertices[0], kPositionSize, vertexCount);
     }
-    if (hasPositions(vertexFlags)) {
+    if (hasNormals(vertexFlags)) {
         readData(in, &bla->vertices[1], kNormalsSize, vertexCount);
     }
     if (hasTexCoords0(vertexFlags)) {
@@ -133,6 +279,441 @@ Bla* readStructOfArrays(std::ifstream &in, const ObjectHeader *object) {
         readData(in, &bla->vertices[11], kBitanSize, vertexCount);
     }
     in.read((char*) bla->indices, indexCount * sizeof(unsigned short));
+    // the skin is not part of Bla, skip it to keep the stream at the next object
+    in.seekg(calcSkinDataSize(object), std::ios::cur);
 
     return bla;
 }
+
+bool hasVertexArray(uint16_t vertexFlags, unsigned int array) {
+    switch (array) {
+    case POSITION_ARRAY: return hasPositions(vertexFlags);
+    case NORMALS_ARRAY: return hasNormals(vertexFlags);
+    case UV0_ARRAY: return hasTexCoords0(vertexFlags);
+    case UV1_ARRAY: return hasTexCoords1(vertexFlags);
+    case UV2_ARRAY: return hasTexCoords2(vertexFlags);
+    case UV3_ARRAY: return hasTexCoords3(vertexFlags);
+    case COLOR0_ARRAY: return hasColor0(vertexFlags);
+    case COLOR1_ARRAY: return hasColor1(vertexFlags);
+    case COLOR2_ARRAY: return hasColor2(vertexFlags);
+    case COLOR3_ARRAY: return hasColor3(vertexFlags);
+    case TANGENT_ARRAY: return hasTanBitan(vertexFlags);
+    case BITANGENT_ARRAY: return hasTanBitan(vertexFlags);
+    }
+    return false;
+}
+
+unsigned int vertexArrayElementSize(unsigned int array) {
+    switch (array) {
+    case POSITION_ARRAY: return kPositionSize;
+    case NORMALS_ARRAY: return kNormalsSize;
+    case UV0_ARRAY:
+    case UV1_ARRAY:
+    case UV2_ARRAY:
+    case UV3_ARRAY: return kTextureSize;
+    case COLOR0_ARRAY:
+    case COLOR1_ARRAY:
+    case COLOR2_ARRAY:
+    case COLOR3_ARRAY: return kColorSize;
+    case TANGENT_ARRAY: return kTanSize;
+    case BITANGENT_ARRAY: return kBitanSize;
+    }
+    return 0;
+}
+
+static size_t alignBufferOffset(size_t offset) {
+    return (offset + kObjectBufferAlignment - 1) & ~(kObjectBufferAlignment - 1);
+}
+
+void calcObjectBufferSizes(const ObjectHeader *object, ObjectBufferSizes *sizes) {
+    memset(sizes, 0, sizeof(ObjectBufferSizes));
+    const size_t vertexCount = object->vertexCount;
+    size_t offset = 0;
+    if (object->type == STRUCT_OF_ARRAYS) {
+        for (unsigned int i = 0; i < kNumVertexArrays; i++) {
+            if (hasVertexArray(object->vertexFlags, i)) {
+                sizes->arrayOffset[i] = offset;
+                sizes->arraySize[i] = vertexCount * vertexArrayElementSize(i) * sizeof(float);
+                offset = alignBufferOffset(offset + sizes->arraySize[i]);
+            }
+        }
+    } else {
+        sizes->arraySize[POSITION_ARRAY] =
+                vertexCount * calcVertexSize(object->vertexFlags) * sizeof(float);
+        offset = alignBufferOffset(sizes->arraySize[POSITION_ARRAY]);
+    }
+    sizes->indexOffset = offset;
+    sizes->indexSize = object->indexCount * sizeof(unsigned short);
+    offset = alignBufferOffset(offset + sizes->indexSize);
+    sizes->skinOffset = offset;
+    sizes->skinSize = calcSkinDataSize(object);
+    sizes->totalSize = sizes->skinSize > 0 ? offset + sizes->skinSize :
+                                              sizes->indexOffset + sizes->indexSize;
+}
+
+// sets the skin pointers of buffers to the skin data at skin, or to 0 if the
+// object has no skin
+static void setSkinPointers(const ObjectHeader *object, uint8_t *skin, ObjectBuffers *buffers) {
+    buffers->bones = 0;
+    buffers->boneIndices = 0;
+    buffers->boneWeights = 0;
+    if (!hasBones(object->vertexFlags)) {
+        return;
+    }
+    buffers->bones = (BoneData*) skin;
+    buffers->boneIndices = skin + object->boneCount * sizeof(BoneData);
+    buffers->boneWeights = buffers->boneIndices + object->vertexCount * kMaxBoneInfluences;
+}
+
+// the data of a block would be sized from fields that mean something else
+static bool checkModelObject(const ObjectHeader *object) {
+    if (!isModelObject(object->type)) {
+        std::cerr << "object of type " << (int) object->type << " is not a model" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool readObjectInto(std::ifstream &in, const ObjectHeader *object,
+        void *buffer, size_t bufferSize, ObjectBuffers *buffers) {
+    TraceScope trace("readObjectInto");
+    if (!in.is_open() || !object || !buffers || !checkModelObject(object)) {
+        return false;
+    }
+    ObjectBufferSizes sizes;
+    calcObjectBufferSizes(object, &sizes);
+    if (!buffer || bufferSize < sizes.totalSize) {
+        std::cerr << "buffer too small for object data" << std::endl;
+        return false;
+    }
+    char *base = (char*) buffer;
+    for (unsigned int i = 0; i < kNumVertexArrays; i++) {
+        buffers->vertices[i] = 0;
+        if (sizes.arraySize[i] > 0) {
+            buffers->vertices[i] = (float*) (base + sizes.arrayOffset[i]);
+            in.read((char*) buffers->vertices[i], sizes.arraySize[i]);
+        }
+    }
+    buffers->indices = (unsigned short*) (base + sizes.indexOffset);
+    in.read((char*) buffers->indices, sizes.indexSize);
+    setSkinPointers(object, (uint8_t*) base + sizes.skinOffset, buffers);
+    in.read(base + sizes.skinOffset, sizes.skinSize);
+    return !in.fail();
+}
+
+bool readObject(std::ifstream &in, const ObjectHeader *object,
+        const ReaderAllocator &allocator, ObjectBuffers *buffers) {
+    TraceScope trace("readObject");
+    if (!object || !allocator.allocate || !checkModelObject(object)) {
+        return false;
+    }
+    ObjectBufferSizes sizes;
+    calcObjectBufferSizes(object, &sizes);
+    void *buffer = allocator.allocate(sizes.totalSize, kObjectBufferAlignment,
+                                      allocator.userData);
+    if (!buffer) {
+        std::cerr << "allocator failed for " << sizes.totalSize << " bytes" << std::endl;
+        return false;
+    }
+    if (!readObjectInto(in, object, buffer, sizes.totalSize, buffers)) {
+        if (allocator.release) {
+            allocator.release(buffer, allocator.userData);
+        }
+        return false;
+    }
+    return true;
+}
+
+bool readFileHeader(MemoryStream &in, FileHeader *header) {
+    if (in.size - in.position < sizeof(FileHeader)) {
+        std::cerr << "data too small even for header. abort" << std::endl;
+        return false;
+    }
+    FileHeader fileHeader;
+    memcpy(&fileHeader, in.data + in.position, sizeof(FileHeader));
+    if (fileHeader.magicNumber[0] != kMagicNumber[0] ||
+        fileHeader.magicNumber[1] != kMagicNumber[1]) {
+        std::cerr << "magic number mismatch. abort import" << std::endl;
+        return false;
+    }
+    if (!isSupportedFileVersion(&fileHeader)) {
+        std::cerr << "unsupported file version. abort import" << std::endl;
+        return false;
+    }
+    *header = fileHeader;
+    in.position += sizeof(FileHeader);
+    return true;
+}
+
+bool readObjectHeader(MemoryStream &in, ObjectHeader *header) {
+    if (in.size - in.position < sizeof(ObjectHeader)) {
+        std::cerr << "data too small for object header" << std::endl;
+        return false;
+    }
+    ObjectHeader objectHeader;
+    memcpy(&objectHeader, in.data + in.position, sizeof(ObjectHeader));
+    // blocks of other types are only checked against the size, so they can be skipped
+    if (isModelObject(objectHeader.type) &&
+        objectHeader.vertexSize != calcVertexSize(objectHeader.vertexFlags)) {
+        std::cerr << "vertex size does not match vertex flags" << std::endl;
+        return false;
+    }
+    const size_t remaining = in.size - in.position - sizeof(ObjectHeader);
+    if (calcObjectDataSize(&objectHeader) > remaining) {
+        std::cerr << "object data exceeds the end of the data" << std::endl;
+        return false;
+    }
+    *header = objectHeader;
+    in.position += sizeof(ObjectHeader);
+    return true;
+}
+
+bool skipObject(MemoryStream &in, const ObjectHeader *object) {
+    const size_t dataSize = calcObjectDataSize(object);
+    if (in.size - in.position < dataSize) {
+        return false;
+    }
+    in.position += dataSize;
+    return true;
+}
+
+bool readDrawRanges(MemoryStream &in, const ObjectHeader *object,
+        DrawRange *ranges, DrawCommand *commands) {
+    if (!object || object->type != DRAW_RANGES) {
+        return false;
+    }
+    const BlockHeader *block = asBlockHeader(object);
+    const size_t rangesSize = block->elementCount * sizeof(DrawRange);
+    const size_t commandsSize = block->elementCount * sizeof(DrawCommand);
+    if (block->dataSize != rangesSize + commandsSize || in.size - in.position < block->dataSize) {
+        std::cerr << "draw ranges do not match their size" << std::endl;
+        return false;
+    }
+    memcpy(ranges, in.data + in.position, rangesSize);
+    memcpy(commands, in.data + in.position + rangesSize, commandsSize);
+    in.position += block->dataSize;
+    return true;
+}
+
+bool readInstances(MemoryStream &in, const ObjectHeader *object, Instance *instances) {
+    if (!object || object->type != INSTANCES) {
+        return false;
+    }
+    const BlockHeader *block = asBlockHeader(object);
+    if (block->dataSize != block->elementCount * sizeof(Instance) ||
+        in.size - in.position < block->dataSize) {
+        std::cerr << "instances do not match their size" << std::endl;
+        return false;
+    }
+    memcpy(instances, in.data + in.position, block->dataSize);
+    in.position += block->dataSize;
+    return true;
+}
+
+bool readAnimation(MemoryStream &in, const ObjectHeader *object, AnimationView *view) {
+    TraceScope trace("readAnimation");
+    if (!object || object->type != ANIMATION || !view) {
+        return false;
+    }
+    const BlockHeader *block = asBlockHeader(object);
+    if (in.size - in.position < block->dataSize) {
+        return false;
+    }
+    const char *data = (const char*) in.data + in.position;
+    char *copy = 0;
+    if ((uintptr_t) data % sizeof(uint64_t) != 0) {
+        copy = new char[block->dataSize];
+        memcpy(copy, data, block->dataSize);
+        data = copy;
+    }
+    if (!openAnimation(data, block->dataSize, view)) {
+        delete[] copy;
+        return false;
+    }
+    view->allocation = copy;
+    in.position += block->dataSize;
+    return true;
+}
+
+bool readMorphTargets(MemoryStream &in, const ObjectHeader *object, uint32_t vertexCount,
+        MorphTargetsView *view) {
+    TraceScope trace("readMorphTargets");
+    if (!object || object->type != MORPH_TARGETS || !view) {
+        return false;
+    }
+    const BlockHeader *block = asBlockHeader(object);
+    if (in.size - in.position < block->dataSize) {
+        return false;
+    }
+    const char *data = (const char*) in.data + in.position;
+    char *copy = 0;
+    if ((uintptr_t) data % sizeof(uint64_t) != 0) {
+        copy = new char[block->dataSize];
+        memcpy(copy, data, block->dataSize);
+        data = copy;
+    }
+    if (!openMorphTargets(data, block->dataSize, block->flags, block->elementCount,
+                          vertexCount, view)) {
+        delete[] copy;
+        return false;
+    }
+    view->allocation = copy;
+    in.position += block->dataSize;
+    return true;
+}
+
+bool readBvh(MemoryStream &in, const ObjectHeader *object, uint32_t indexCount,
+        BvhView *view) {
+    TraceScope trace("readBvh");
+    if (!object || object->type != BVH || !view) {
+        return false;
+    }
+    const BlockHeader *block = asBlockHeader(object);
+    if (block->dataSize < sizeof(BvhHeader) || in.size - in.position < block->dataSize) {
+        return false;
+    }
+    const char *data = (const char*) in.data + in.position;
+    BvhHeader header;
+    memcpy(&header, data, sizeof(BvhHeader));
+    char *copy = 0;
+    if ((uintptr_t) (data + header.nodeOffset) % sizeof(uint32_t) != 0) {
+        copy = copyBvhData(data, block->dataSize, &data);
+    }
+    if (!openBvh(data, block->dataSize, block->elementCount, indexCount, view)) {
+        delete[] copy;
+        return false;
+    }
+    view->allocation = copy;
+    in.position += block->dataSize;
+    return true;
+}
+
+bool readTexture(MemoryStream &in, const ObjectHeader *object, TextureView *view) {
+    TraceScope trace("readTexture");
+    if (!object || object->type != TEXTURE || !view) {
+        return false;
+    }
+    const BlockHeader *block = asBlockHeader(object);
+    if (in.size - in.position < block->dataSize ||
+        !openTexture(in.data + in.position, block->dataSize, block->flags, block->elementCount,
+                     view)) {
+        return false;
+    }
+    in.position += block->dataSize;
+    return true;
+}
+
+bool readMaterials(MemoryStream &in, const ObjectHeader *object, MaterialsView *view) {
+    TraceScope trace("readMaterials");
+    if (!object || object->type != MATERIALS || !view) {
+        return false;
+    }
+    const BlockHeader *block = asBlockHeader(object);
+    if (in.size - in.position < block->dataSize) {
+        return false;
+    }
+    const char *data = (const char*) in.data + in.position;
+    char *copy = 0;
+    if ((uintptr_t) data % sizeof(uint64_t) != 0) {
+        copy = new char[block->dataSize];
+        memcpy(copy, data, block->dataSize);
+        data = copy;
+    }
+    if (!openMaterials(data, block->dataSize, block->elementCount, view)) {
+        delete[] copy;
+        return false;
+    }
+    view->allocation = copy;
+    in.position += block->dataSize;
+    return true;
+}
+
+bool readObjectInto(MemoryStream &in, const ObjectHeader *object,
+        void *buffer, size_t bufferSize, ObjectBuffers *buffers) {
+    TraceScope trace("readObjectInto");
+    if (!object || !buffers || !checkModelObject(object) ||
+        in.size - in.position < calcObjectDataSize(object)) {
+        return false;
+    }
+    ObjectBufferSizes sizes;
+    calcObjectBufferSizes(object, &sizes);
+    if (!buffer || bufferSize < sizes.totalSize) {
+        std::cerr << "buffer too small for object data" << std::endl;
+        return false;
+    }
+    char *base = (char*) buffer;
+    const uint8_t *source = in.data + in.position;
+    for (unsigned int i = 0; i < kNumVertexArrays; i++) {
+        buffers->vertices[i] = 0;
+        if (sizes.arraySize[i] > 0) {
+            buffers->vertices[i] = (float*) (base + sizes.arrayOffset[i]);
+            memcpy(buffers->vertices[i], source, sizes.arraySize[i]);
+            source += sizes.arraySize[i];
+        }
+    }
+    buffers->indices = (unsigned short*) (base + sizes.indexOffset);
+    memcpy(buffers->indices, source, sizes.indexSize);
+    setSkinPointers(object, (uint8_t*) base + sizes.skinOffset, buffers);
+    memcpy(base + sizes.skinOffset, source + sizes.indexSize, sizes.skinSize);
+    in.position += calcObjectDataSize(object);
+    return true;
+}
+
+bool readObjectView(MemoryStream &in, const ObjectHeader *object, ObjectView *view,
+        const ReaderAllocator *allocator) {
+    TraceScope trace("readObjectView");
+    if (!object || !view || !checkModelObject(object) ||
+        in.size - in.position < calcObjectDataSize(object)) {
+        return false;
+    }
+    ObjectBufferSizes sizes;
+    calcObjectBufferSizes(object, &sizes);
+
+    // the arrays follow each other without padding in the file. As all of
+    // them hold floats, the vertex data is aligned if its start is. The bone
+    // table of a skin needs 8 byte alignment.
+    const uint8_t *source = in.data + in.position;
+    const size_t vertexBytes = calcObjectDataSize(object) - sizes.indexSize - sizes.skinSize;
+    const uint8_t *skin = source + vertexBytes + sizes.indexSize;
+    if (((uintptr_t) source % sizeof(float)) == 0 &&
+        (sizes.skinSize == 0 || ((uintptr_t) skin % sizeof(uint64_t)) == 0)) {
+        for (unsigned int i = 0; i < kNumVertexArrays; i++) {
+            view->vertices[i] = 0;
+            if (sizes.arraySize[i] > 0) {
+                view->vertices[i] = (const float*) source;
+                source += sizes.arraySize[i];
+            }
+        }
+        view->indices = (const unsigned short*) (in.data + in.position + vertexBytes);
+        ObjectBuffers buffers;
+        setSkinPointers(object, (uint8_t*) skin, &buffers);
+        view->bones = buffers.bones;
+        view->boneIndices = buffers.boneIndices;
+        view->boneWeights = buffers.boneWeights;
+        view->allocation = 0;
+        in.position += calcObjectDataSize(object);
+        return true;
+    }
+
+    void *buffer = 0;
+    if (allocator) {
+        buffer = allocator->allocate(sizes.totalSize, kObjectBufferAlignment, allocator->userData);
+    } else {
+        buffer = new char[sizes.totalSize];
+    }
+    if (!buffer) {
+        std::cerr << "allocator failed for " << sizes.totalSize << " bytes" << std::endl;
+        return false;
+    }
+    ObjectBuffers buffers;
+    readObjectInto(in, object, buffer, sizes.totalSize, &buffers);
+    for (unsigned int i = 0; i < kNumVertexArrays; i++) {
+        view->vertices[i] = buffers.vertices[i];
+    }
+    view->indices = buffers.indices;
+    view->bones = buffers.bones;
+    view->boneIndices = buffers.boneIndices;
+    view->boneWeights = buffers.boneWeights;
+    view->allocation = buffer;
+    return true;
+}
@@ -19,6 +19,11 @@
 #define RCM_READER_H
 
 #include "rcm.h"
+#include "rcmanim.h"
+#include "rcmbvh.h"
+#include "rcmmaterial.h"
+#include "rcmtexture.h"
+#include "rcmmorph.h"
 #include <fstream>
 
 struct Bla {
@@ -27,9 +32,171 @@ struct Bla {
     unsigned short *indices;
 };
 
+// indices into the vertex arrays of a struct of arrays object. An array of
+// structs object only uses POSITION_ARRAY which then holds the whole vertices.
+enum VertexArray {
+    POSITION_ARRAY = 0,
+    NORMALS_ARRAY,
+    UV0_ARRAY,
+    UV1_ARRAY,
+    UV2_ARRAY,
+    UV3_ARRAY,
+    COLOR0_ARRAY,
+    COLOR1_ARRAY,
+    COLOR2_ARRAY,
+    COLOR3_ARRAY,
+    TANGENT_ARRAY,
+    BITANGENT_ARRAY,
+    kNumVertexArrays
+};
+
+// every array inside a buffer sized by calcObjectBufferSizes() starts at a
+// multiple of this alignment relative to the start of the buffer
+const size_t kObjectBufferAlignment = 16;
+
+// byte sizes and offsets of all arrays of one object inside a single buffer.
+// Arrays that are not present have size 0.
+struct ObjectBufferSizes {
+    size_t arraySize[kNumVertexArrays];
+    size_t arrayOffset[kNumVertexArrays];
+    size_t indexSize;
+    size_t indexOffset;
+    size_t skinSize;
+    size_t skinOffset;
+    size_t totalSize;
+};
+
+// pointers into caller owned memory. Arrays that are not present are 0.
+// boneWeights holds unorm8 or, with USES_16BIT_WEIGHTS, unorm16 values.
+struct ObjectBuffers {
+    float *vertices[kNumVertexArrays];
+    unsigned short *indices;
+    BoneData *bones;
+    uint8_t *boneIndices;
+    uint8_t *boneWeights;
+};
+
+// allocator used by readObject(). allocate() has to return memory of at
+// least the given size, aligned to the given alignment, or 0 on failure.
+// release() is optional and gets back memory of a read that failed after
+// the allocation, it can be 0 if the allocator frees its memory at once.
+struct ReaderAllocator {
+    void* (*allocate)(size_t size, size_t alignment, void *userData);
+    void *userData;
+    void (*release)(void *data, void *userData);
+};
+
+// read position inside a complete .rcm file that is held in memory
+struct MemoryStream {
+    MemoryStream(const void *data, size_t size) :
+            data((const uint8_t*) data), size(size), position(0) {}
+
+    const uint8_t *data;
+    size_t size;
+    size_t position;
+};
+
+// object data that is referenced in place where alignment allows it.
+// Otherwise the data was copied into allocation, see readObjectView().
+struct ObjectView {
+    const float *vertices[kNumVertexArrays];
+    const unsigned short *indices;
+    const BoneData *bones;
+    const uint8_t *boneIndices;
+    const uint8_t *boneWeights;
+    void *allocation;
+};
+
 FileHeader* readFileHeader(std::ifstream &in);
 ObjectHeader* readObjectHeader(std::ifstream &in);
 Bla* readArrayOfStructs(std::ifstream &in, const ObjectHeader *object);
 Bla* readStructOfArrays(std::ifstream &in, const ObjectHeader *object);
 
+// reads a DRAW_RANGES object, ranges and commands have to hold the element
+// count of the block header (asBlockHeader(object)->elementCount) entries
+bool readDrawRanges(std::ifstream &in, const ObjectHeader *object,
+        DrawRange *ranges, DrawCommand *commands);
+
+// reads an INSTANCES object into instances, which has room for the element
+// count of the block header
+bool readInstances(std::ifstream &in, const ObjectHeader *object, Instance *instances);
+
+// reads an ANIMATION object into a new allocation referenced by view
+bool readAnimation(std::ifstream &in, const ObjectHeader *object, AnimationView *view);
+
+// reads a MORPH_TARGETS object into a new allocation referenced by view.
+// vertexCount is the vertex count of the model in front of it.
+bool readMorphTargets(std::ifstream &in, const ObjectHeader *object, uint32_t vertexCount,
+        MorphTargetsView *view);
+
+// reads a BVH object into a new allocation referenced by view. indexCount is
+// the index count of the model it belongs to, or its vertex count if the
+// model is a list of corners.
+bool readBvh(std::ifstream &in, const ObjectHeader *object, uint32_t indexCount,
+        BvhView *view);
+
+// reads a TEXTURE object into a new allocation referenced by view
+bool readTexture(std::ifstream &in, const ObjectHeader *object, TextureView *view);
+
+// reads a MATERIALS object into a new allocation referenced by view
+bool readMaterials(std::ifstream &in, const ObjectHeader *object, MaterialsView *view);
+
+// true if the vertex flags contain the given VertexArray
+bool hasVertexArray(uint16_t vertexFlags, unsigned int array);
+// number of floats of one element of the given VertexArray
+unsigned int vertexArrayElementSize(unsigned int array);
+
+// fills sizes with what is needed to hold the object described by the
+// header. Works for both layouts, does not touch the stream.
+void calcObjectBufferSizes(const ObjectHeader *object, ObjectBufferSizes *sizes);
+
+// reads the object data into buffer which has to be at least
+// sizes.totalSize bytes and aligned to kObjectBufferAlignment. buffers
+// receives the pointers to the single arrays inside buffer.
+bool readObjectInto(std::ifstream &in, const ObjectHeader *object,
+        void *buffer, size_t bufferSize, ObjectBuffers *buffers);
+
+// same as above but requests the memory with one call to the allocator
+bool readObject(std::ifstream &in, const ObjectHeader *object,
+        const ReaderAllocator &allocator, ObjectBuffers *buffers);
+
+// the memory variants check every header against the remaining size of the
+// stream and never read out of bounds. They return false on any error and
+// leave the stream position untouched in that case.
+bool readFileHeader(MemoryStream &in, FileHeader *header);
+bool readObjectHeader(MemoryStream &in, ObjectHeader *header);
+bool skipObject(MemoryStream &in, const ObjectHeader *object);
+bool readDrawRanges(MemoryStream &in, const ObjectHeader *object,
+        DrawRange *ranges, DrawCommand *commands);
+bool readInstances(MemoryStream &in, const ObjectHeader *object, Instance *instances);
+
+// sets up view to use the clip in place, it is only copied into
+// view->allocation if it is not 8 byte aligned in memory
+bool readAnimation(MemoryStream &in, const ObjectHeader *object, AnimationView *view);
+
+// like readAnimation() for a MORPH_TARGETS object
+bool readMorphTargets(MemoryStream &in, const ObjectHeader *object, uint32_t vertexCount,
+        MorphTargetsView *view);
+
+// like readAnimation() for a BVH object, the data is copied if the nodes are
+// not 4 byte aligned in memory
+bool readBvh(MemoryStream &in, const ObjectHeader *object, uint32_t indexCount,
+        BvhView *view);
+
+// sets up view for a TEXTURE object, the levels are used in place
+bool readTexture(MemoryStream &in, const ObjectHeader *object, TextureView *view);
+
+// like readAnimation() for a MATERIALS object
+bool readMaterials(MemoryStream &in, const ObjectHeader *object, MaterialsView *view);
+bool readObjectInto(MemoryStream &in, const ObjectHeader *object,
+        void *buffer, size_t bufferSize, ObjectBuffers *buffers);
+
+// references the object data inside the stream memory without copying if
+// every array is suitably aligned. If not, the data is copied into a single
+// block taken from allocator (or new char[] if allocator is 0) and
+// view->allocation points to that block, it is 0 for zero copy views.
+// Fails for objects that are not models.
+bool readObjectView(MemoryStream &in, const ObjectHeader *object, ObjectView *view,
+        const ReaderAllocator *allocator = 0);
+
 #endif // RCM_READER_H
@@ -0,0 +1,238 @@
+/* src/rcmstats.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include "internal/rcm_internal.h"
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <sys/resource.h>
+
+static const char* kStageNames[kNumConvertStages] = {
+    "import", "convert", "dedup", "layout", "write"
+};
+
+static const int kNameWidth = 9;
+static const int kColumnWidth = 13;
+
+// the statistics and the innermost running timer of this thread
+static thread_local ConvertStats *sStats = 0;
+static thread_local StageTimer *sCurrentTimer = 0;
+
+ConvertStats::ConvertStats() : countAllocations(0) {
+    memset(stages, 0, sizeof(stages));
+}
+
+void collectConvertStats(ConvertStats *stats) {
+    sStats = stats;
+}
+
+const char* stageName(ConvertStage stage) {
+    return stage < kNumConvertStages ? kStageNames[stage] : "unknown";
+}
+
+static double wallTime() {
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double cpuTime(const struct rusage &usage) {
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+static uint64_t peakRssBytes(const struct rusage &usage) {
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    // kilobytes everywhere else
+    return (uint64_t) usage.ru_maxrss * 1024;
+#endif
+}
+
+StageTimer::StageTimer(ConvertStage stage)
+    : mStage(stage), mStats(sStats), mParent(0), mStartWall(0.0), mStartCpu(0.0),
+      mStartAllocations(0), mNestedWall(0.0), mNestedCpu(0.0), mNestedAllocations(0) {
+    if (!mStats) {
+        return;
+    }
+    mParent = sCurrentTimer;
+    sCurrentTimer = this;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    mStartCpu = cpuTime(usage);
+    mStartAllocations = mStats->countAllocations ? mStats->countAllocations() : 0;
+    mStartWall = wallTime();
+}
+
+StageTimer::~StageTimer() {
+    if (!mStats) {
+        return;
+    }
+    const double wall = wallTime() - mStartWall;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    const double cpu = cpuTime(usage) - mStartCpu;
+    const uint64_t allocations = mStats->countAllocations ?
+                                 mStats->countAllocations() - mStartAllocations : 0;
+
+    StageStats &stage = mStats->stages[mStage];
+    stage.calls++;
+    stage.wallSeconds += wall - mNestedWall;
+    stage.cpuSeconds += cpu - mNestedCpu;
+    stage.allocations += allocations - mNestedAllocations;
+    const uint64_t peak = peakRssBytes(usage);
+    stage.peakRssBytes = peak > stage.peakRssBytes ? peak : stage.peakRssBytes;
+    if (mParent) {
+        mParent->mNestedWall += wall;
+        mParent->mNestedCpu += cpu;
+        mParent->mNestedAllocations += allocations;
+    }
+    sCurrentTimer = mParent;
+}
+
+void StageTimer::addInput(uint64_t bytes, uint64_t vertices) {
+    if (mStats) {
+        mStats->stages[mStage].bytesIn += bytes;
+        mStats->stages[mStage].verticesIn += vertices;
+    }
+}
+
+void StageTimer::addOutput(uint64_t bytes, uint64_t vertices) {
+    if (mStats) {
+        mStats->stages[mStage].bytesOut += bytes;
+        mStats->stages[mStage].verticesOut += vertices;
+    }
+}
+
+void addStageOutput(ConvertStage stage, uint64_t bytes, uint64_t vertices) {
+    if (sStats) {
+        sStats->stages[stage].bytesOut += bytes;
+        sStats->stages[stage].verticesOut += vertices;
+    }
+}
+
+uint64_t calcMeshBytes(const Mesh *mesh) {
+    uint64_t bytes = (uint64_t) mesh->numVertices * mesh->vertexSize * sizeof(float) +
+                     (uint64_t) mesh->numIndices * sizeof(unsigned short);
+    if (hasBones(mesh->flags)) {
+        bytes += mesh->numBones * sizeof(BoneData) +
+                 (uint64_t) mesh->numVertices * kMaxBoneInfluences * (1 + sizeof(float));
+    }
+    return bytes;
+}
+
+// sum of all stages, the peak is the largest one
+static StageStats sumStages(const ConvertStats &stats) {
+    StageStats total;
+    memset(&total, 0, sizeof(StageStats));
+    for (unsigned int i = 0; i < kNumConvertStages; i++) {
+        const StageStats &stage = stats.stages[i];
+        total.calls += stage.calls;
+        total.wallSeconds += stage.wallSeconds;
+        total.cpuSeconds += stage.cpuSeconds;
+        total.bytesIn += stage.bytesIn;
+        total.bytesOut += stage.bytesOut;
+        total.verticesIn += stage.verticesIn;
+        total.verticesOut += stage.verticesOut;
+        total.allocations += stage.allocations;
+        if (stage.peakRssBytes > total.peakRssBytes) {
+            total.peakRssBytes = stage.peakRssBytes;
+        }
+    }
+    return total;
+}
+
+static void printStageRow(std::ostream &out, const char *name, const StageStats &stage) {
+    out << std::setw(kNameWidth) << std::left << name << std::right;
+    out << std::setw(kColumnWidth) << stage.calls;
+    out << std::setw(kColumnWidth) << stage.wallSeconds * 1000.0;
+    out << std::setw(kColumnWidth) << stage.cpuSeconds * 1000.0;
+    out << std::setw(kColumnWidth) << stage.bytesIn;
+    out << std::setw(kColumnWidth) << stage.bytesOut;
+    out << std::setw(kColumnWidth) << stage.verticesIn;
+    out << std::setw(kColumnWidth) << stage.verticesOut;
+    out << std::setw(kColumnWidth) << stage.allocations;
+    out << std::setw(kColumnWidth) << stage.peakRssBytes / (1024.0 * 1024.0);
+    out << std::endl;
+}
+
+void printConvertStats(std::ostream &out, const ConvertStats &stats) {
+    std::ostringstream table;
+    table << std::fixed << std::setprecision(2);
+    table << std::setw(kNameWidth) << std::left << "stage" << std::right;
+    const char *columns[] = {"calls", "wall ms", "cpu ms", "bytes in", "bytes out",
+                             "vertices in", "vertices out", "allocations", "peak rss MB"};
+    for (size_t i = 0; i < sizeof(columns) / sizeof(columns[0]); i++) {
+        table << std::setw(kColumnWidth) << columns[i];
+    }
+    table << std::endl;
+    for (unsigned int i = 0; i < kNumConvertStages; i++) {
+        printStageRow(table, kStageNames[i], stats.stages[i]);
+    }
+    printStageRow(table, "total", sumStages(stats));
+    out << table.str();
+}
+
+static void printJsonString(std::ostream &out, const std::string &text) {
+    out << '"';
+    for (size_t i = 0; i < text.size(); i++) {
+        const unsigned char c = text[i];
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (unsigned int) c
+                << std::dec << std::setfill(' ');
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+static void printStageJson(std::ostream &out, const StageStats &stage) {
+    out << "\"calls\": " << stage.calls;
+    out << ", \"wall_seconds\": " << stage.wallSeconds;
+    out << ", \"cpu_seconds\": " << stage.cpuSeconds;
+    out << ", \"bytes_in\": " << stage.bytesIn;
+    out << ", \"bytes_out\": " << stage.bytesOut;
+    out << ", \"vertices_in\": " << stage.verticesIn;
+    out << ", \"vertices_out\": " << stage.verticesOut;
+    out << ", \"allocations\": " << stage.allocations;
+    out << ", \"peak_rss_bytes\": " << stage.peakRssBytes;
+}
+
+void printConvertStatsJson(std::ostream &out, const ConvertStats &stats,
+        const std::string &input, const std::string &output) {
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(6);
+    json << "{" << std::endl << "  \"input\": ";
+    printJsonString(json, input);
+    json << "," << std::endl << "  \"output\": ";
+    printJsonString(json, output);
+    json << "," << std::endl;
+    json << "  \"allocations_counted\": " << (stats.countAllocations ? "true" : "false");
+    json << "," << std::endl << "  \"stages\": [" << std::endl;
+    for (unsigned int i = 0; i < kNumConvertStages; i++) {
+        json << "    {\"stage\": \"" << kStageNames[i] << "\", ";
+        printStageJson(json, stats.stages[i]);
+        json << "}" << (i + 1 < kNumConvertStages ? "," : "") << std::endl;
+    }
+    json << "  ]," << std::endl << "  \"total\": {";
+    printStageJson(json, sumStages(stats));
+    json << "}" << std::endl << "}" << std::endl;
+    out << json.str();
+}
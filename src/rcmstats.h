@@ -0,0 +1,84 @@
+/* src/rcmstats.h
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#ifndef RCM_STATS_H
+#define RCM_STATS_H
+
+#include <stdint.h>
+#include <ostream>
+#include <string>
+
+/* Cost of the stages of a conversion.
+
+While statistics are collected, loadModel(), loadScene(), streamModel(),
+createOptimizedMesh() and the write functions add the time, the data and the
+vertices of every stage they run on the calling thread. Stages are exclusive: the write stage
+does not contain the deduplication and layout conversion it triggers. CPU
+time is the time of the whole process, so work of helper threads (like the
+mip chains) counts to the stage that waits for it.
+*/
+
+enum ConvertStage {
+    // assimp reads the model file
+    STAGE_IMPORT = 0,
+    // assimp meshes to interleaved meshes, convertAiMesh()
+    STAGE_CONVERT,
+    // equal meshes and equal vertices are merged
+    STAGE_DEDUP,
+    // interleaved vertices to struct of arrays
+    STAGE_LAYOUT,
+    // headers and data are encoded and written to the file
+    STAGE_WRITE,
+    kNumConvertStages
+};
+
+struct StageStats {
+    unsigned int calls;
+    double wallSeconds;
+    double cpuSeconds;
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    uint64_t verticesIn;
+    uint64_t verticesOut;
+    uint64_t allocations;
+    // peak resident set size of the process at the end of the stage
+    uint64_t peakRssBytes;
+};
+
+struct ConvertStats {
+    ConvertStats();
+
+    StageStats stages[kNumConvertStages];
+    // number of allocations of the process so far, allocations are not
+    // counted if it is 0. The library does not replace operator new, the
+    // tool that collects the statistics has to.
+    uint64_t (*countAllocations)();
+};
+
+// adds the stages run on this thread to stats, 0 stops collecting
+void collectConvertStats(ConvertStats *stats);
+
+const char* stageName(ConvertStage stage);
+
+// human readable table of the stages
+void printConvertStats(std::ostream &out, const ConvertStats &stats);
+
+// one JSON object with the input and output file and one entry per stage
+void printConvertStatsJson(std::ostream &out, const ConvertStats &stats,
+        const std::string &input, const std::string &output);
+
+#endif // RCM_STATS_H
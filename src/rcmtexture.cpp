@@ -0,0 +1,404 @@
+/* src/rcmtexture.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include "rcmtexture.h"
+#include "internal/thread_pool.h"
+#include "internal/trace.h"
+#include <iostream>
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const uint32_t kMaxTextureSize = 1u << (kMaxTextureLevels - 1);
+// half width of the Kaiser window in texels of the smaller level
+static const float kKaiserWidth = 3.0f;
+static const float kKaiserAlpha = 4.0f;
+static const float kPi = 3.14159265358979f;
+
+static size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// sRGB to linear for every 8 bit value
+struct LinearTable {
+    float values[256];
+
+    LinearTable() {
+        for (unsigned int i = 0; i < 256; i++) {
+            const float c = i / 255.0f;
+            values[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+    }
+};
+
+static const LinearTable kLinearTable;
+
+static uint8_t toByte(float value) {
+    value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+    return (uint8_t) (value * 255.0f + 0.5f);
+}
+
+static uint8_t toSrgb(float value) {
+    value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+    return toByte(value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f);
+}
+
+// texels to the space the filter works in
+static void decodeTexels(const std::vector<uint8_t> &pixels, uint16_t flags,
+        std::vector<float> &texels) {
+    texels.resize(pixels.size());
+    for (size_t i = 0; i < pixels.size(); i++) {
+        const bool isAlpha = (i & 3) == 3;
+        if ((flags & TEXTURE_NORMAL_MAP) && !isAlpha) {
+            texels[i] = pixels[i] / 127.5f - 1.0f;
+        } else if ((flags & TEXTURE_SRGB) && !isAlpha) {
+            texels[i] = kLinearTable.values[pixels[i]];
+        } else {
+            texels[i] = pixels[i] / 255.0f;
+        }
+    }
+}
+
+static void encodeTexels(const std::vector<float> &texels, uint16_t flags,
+        std::vector<uint8_t> &pixels) {
+    pixels.resize(texels.size());
+    for (size_t i = 0; i < texels.size(); i++) {
+        const bool isAlpha = (i & 3) == 3;
+        if ((flags & TEXTURE_NORMAL_MAP) && !isAlpha) {
+            pixels[i] = toByte((texels[i] + 1.0f) * 0.5f);
+        } else if ((flags & TEXTURE_SRGB) && !isAlpha) {
+            pixels[i] = toSrgb(texels[i]);
+        } else {
+            pixels[i] = toByte(texels[i]);
+        }
+    }
+}
+
+static void normalize(std::vector<float> &texels) {
+    for (size_t i = 0; i < texels.size(); i += 4) {
+        float *n = &texels[i];
+        const float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length > 0.0f) {
+            n[0] /= length;
+            n[1] /= length;
+            n[2] /= length;
+        }
+    }
+}
+
+struct FilterTap {
+    uint32_t index;
+    float weight;
+};
+
+// the source texels of every destination texel along one axis, the taps of
+// texel d are taps[first[d]] to taps[first[d + 1]]
+struct FilterTaps {
+    std::vector<uint32_t> first;
+    std::vector<FilterTap> taps;
+};
+
+static float besselI0(float x) {
+    float sum = 1.0f;
+    float term = 1.0f;
+    for (unsigned int k = 1; k < 20; k++) {
+        const float factor = x / (2.0f * k);
+        term *= factor * factor;
+        sum += term;
+    }
+    return sum;
+}
+
+// x is the distance in texels of the smaller level
+static float kaiser(float x) {
+    if (fabsf(x) >= kKaiserWidth) {
+        return 0.0f;
+    }
+    const float sinc = x == 0.0f ? 1.0f : sinf(kPi * x) / (kPi * x);
+    const float t = x / kKaiserWidth;
+    return sinc * besselI0(kKaiserAlpha * sqrtf(1.0f - t * t)) / besselI0(kKaiserAlpha);
+}
+
+static void calcTaps(uint32_t srcSize, uint32_t dstSize, MipFilter filter, FilterTaps &result) {
+    const float scale = (float) srcSize / dstSize;
+    result.first.assign(1, 0);
+    result.taps.clear();
+    for (uint32_t d = 0; d < dstSize; d++) {
+        const size_t begin = result.taps.size();
+        float sum = 0.0f;
+        if (filter == MIP_FILTER_BOX) {
+            // the weight of a source texel is how much of it the texel covers
+            const float low = d * scale;
+            const float high = (d + 1) * scale;
+            for (uint32_t s = (uint32_t) low; s < srcSize && s < high; s++) {
+                const float weight = fminf(high, s + 1.0f) - fmaxf(low, (float) s);
+                if (weight > 0.0f) {
+                    FilterTap tap = {s, weight};
+                    result.taps.push_back(tap);
+                    sum += weight;
+                }
+            }
+        } else {
+            const float center = (d + 0.5f) * scale;
+            const float radius = kKaiserWidth * scale;
+            for (int s = (int) floorf(center - radius); s <= (int) ceilf(center + radius); s++) {
+                const float weight = kaiser((s + 0.5f - center) / scale);
+                if (weight == 0.0f) {
+                    continue;
+                }
+                // the border texels repeat
+                const int clamped = s < 0 ? 0 : (s >= (int) srcSize ? srcSize - 1 : s);
+                FilterTap tap = {(uint32_t) clamped, weight};
+                result.taps.push_back(tap);
+                sum += weight;
+            }
+        }
+        for (size_t i = begin; i < result.taps.size(); i++) {
+            result.taps[i].weight /= sum;
+        }
+        result.first.push_back(result.taps.size());
+    }
+}
+
+// dst += weight * src for count floats, count is a multiple of 4
+#ifdef __SSE2__
+static inline void addWeighted(float *dst, const float *src, float weight, size_t count) {
+    const __m128 w = _mm_set1_ps(weight);
+    for (size_t i = 0; i < count; i += 4) {
+        const __m128 sum = _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), w));
+        _mm_storeu_ps(dst + i, sum);
+    }
+}
+#else
+static inline void addWeighted(float *dst, const float *src, float weight, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] += src[i] * weight;
+    }
+}
+#endif
+
+// separable filter, rows first and then columns
+static void downsample(const std::vector<float> &src, uint32_t width, uint32_t height,
+        uint32_t dstWidth, uint32_t dstHeight, MipFilter filter, std::vector<float> &temp,
+        std::vector<float> &dst) {
+    FilterTaps taps;
+    calcTaps(width, dstWidth, filter, taps);
+    temp.assign((size_t) dstWidth * height * 4, 0.0f);
+    for (uint32_t y = 0; y < height; y++) {
+        const float *row = &src[(size_t) y * width * 4];
+        float *out = &temp[(size_t) y * dstWidth * 4];
+        for (uint32_t x = 0; x < dstWidth; x++) {
+            for (uint32_t t = taps.first[x]; t < taps.first[x + 1]; t++) {
+                addWeighted(out + x * 4, row + taps.taps[t].index * 4, taps.taps[t].weight, 4);
+            }
+        }
+    }
+    calcTaps(height, dstHeight, filter, taps);
+    const size_t rowSize = (size_t) dstWidth * 4;
+    dst.assign(rowSize * dstHeight, 0.0f);
+    for (uint32_t y = 0; y < dstHeight; y++) {
+        for (uint32_t t = taps.first[y]; t < taps.first[y + 1]; t++) {
+            addWeighted(&dst[y * rowSize], &temp[taps.taps[t].index * rowSize],
+                        taps.taps[t].weight, rowSize);
+        }
+    }
+}
+
+bool generateMipChain(const Texture &texture, MipFilter filter, MipChain &levels) {
+    TraceScope trace("generateMipChain");
+    if (texture.width == 0 || texture.height == 0 ||
+        texture.width > kMaxTextureSize || texture.height > kMaxTextureSize) {
+        std::cerr << "unsupported texture size: " << texture.width << " x " << texture.height
+                  << std::endl;
+        return false;
+    }
+    if (texture.pixels.size() != (size_t) texture.width * texture.height * 4) {
+        std::cerr << "texture pixels do not match its size" << std::endl;
+        return false;
+    }
+    const uint32_t levelCount = textureLevelCount(texture.width, texture.height);
+    levels.resize(levelCount);
+    levels[0] = texture.pixels;
+    // every level is filtered from the unquantized level above
+    std::vector<float> current;
+    std::vector<float> next;
+    std::vector<float> temp;
+    decodeTexels(texture.pixels, texture.flags, current);
+    for (uint32_t level = 1; level < levelCount; level++) {
+        downsample(current, textureLevelSize(texture.width, level - 1),
+                   textureLevelSize(texture.height, level - 1),
+                   textureLevelSize(texture.width, level), textureLevelSize(texture.height, level),
+                   filter, temp, next);
+        if (texture.flags & TEXTURE_NORMAL_MAP) {
+            normalize(next);
+        }
+        encodeTexels(next, texture.flags, levels[level]);
+        current.swap(next);
+    }
+    return true;
+}
+
+bool generateMipChains(const std::vector<Texture> &textures, MipFilter filter,
+        std::vector<MipChain> &chains, unsigned int numThreads) {
+    chains.clear();
+    chains.resize(textures.size());
+    if (textures.empty()) {
+        return true;
+    }
+    // not std::vector<bool>, the tasks write their results at the same time
+    std::vector<uint8_t> results(textures.size(), 0);
+    ThreadPool pool(numThreads);
+    for (size_t i = 0; i < textures.size(); i++) {
+        const Texture *texture = &textures[i];
+        MipChain *chain = &chains[i];
+        uint8_t *result = &results[i];
+        pool.enqueue([texture, filter, chain, result] {
+            *result = generateMipChain(*texture, filter, *chain) ? 1 : 0;
+        });
+    }
+    pool.wait();
+    for (size_t i = 0; i < results.size(); i++) {
+        if (!results[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// places the levels of table behind the header and the table, each at a
+// multiple of kTextureLevelAlignment bytes of the file. size receives the
+// size of the object data.
+static bool placeTextureLevels(std::vector<TextureLevel> &table, size_t dataOffset,
+        size_t &size) {
+    size = sizeof(TextureHeader) + table.size() * sizeof(TextureLevel);
+    for (size_t i = 0; i < table.size(); i++) {
+        TextureLevel &level = table[i];
+        // aligned in the file, not in the data
+        const size_t offset = alignUp(dataOffset + size, kTextureLevelAlignment) - dataOffset;
+        if (offset + level.size > UINT32_MAX) {
+            std::cerr << "texture too large for one object" << std::endl;
+            return false;
+        }
+        level.offset = offset;
+        size = offset + level.size;
+    }
+    return true;
+}
+
+bool encodeTexture(const Texture &texture, const MipChain &levels, size_t dataOffset,
+        std::vector<uint8_t> &out) {
+    const uint32_t levelCount = textureLevelCount(texture.width, texture.height);
+    if (levels.size() != levelCount || levelCount > kMaxTextureLevels) {
+        std::cerr << "mip chain does not match the texture" << std::endl;
+        return false;
+    }
+    TextureHeader header;
+    header.nameHash = texture.nameHash;
+    header.width = texture.width;
+    header.height = texture.height;
+    header.format = TEXTURE_RGBA8;
+    header.levelCount = levelCount;
+    std::vector<TextureLevel> table(levelCount);
+    for (uint32_t i = 0; i < levelCount; i++) {
+        TextureLevel &level = table[i];
+        level.width = textureLevelSize(texture.width, i);
+        level.height = textureLevelSize(texture.height, i);
+        if (levels[i].size() != (size_t) level.width * level.height * 4) {
+            std::cerr << "mip level " << i << " does not match its size" << std::endl;
+            return false;
+        }
+        level.rowPitch = alignUp(level.width * 4, kTextureRowAlignment);
+        const size_t levelSize = (size_t) level.rowPitch * level.height;
+        if (levelSize > UINT32_MAX) {
+            std::cerr << "texture too large for one object" << std::endl;
+            return false;
+        }
+        level.size = levelSize;
+    }
+    size_t size = 0;
+    if (!placeTextureLevels(table, dataOffset, size)) {
+        return false;
+    }
+
+    out.assign(size, 0);
+    memcpy(&out[0], &header, sizeof(TextureHeader));
+    memcpy(&out[sizeof(TextureHeader)], &table[0], levelCount * sizeof(TextureLevel));
+    for (uint32_t i = 0; i < levelCount; i++) {
+        const size_t rowSize = (size_t) table[i].width * 4;
+        for (uint32_t y = 0; y < table[i].height; y++) {
+            memcpy(&out[table[i].offset + (size_t) y * table[i].rowPitch],
+                   &levels[i][y * rowSize], rowSize);
+        }
+    }
+    return true;
+}
+
+bool openTexture(const void *data, size_t size, uint16_t flags, uint32_t levelCount,
+        TextureView *view) {
+    const size_t tableEnd = sizeof(TextureHeader) + (size_t) levelCount * sizeof(TextureLevel);
+    if (!data || !view || levelCount == 0 || levelCount > kMaxTextureLevels || size < tableEnd) {
+        return false;
+    }
+    memcpy(&view->header, data, sizeof(TextureHeader));
+    const TextureHeader &header = view->header;
+    if (header.format != TEXTURE_RGBA8 || header.levelCount != levelCount ||
+        header.width == 0 || header.height == 0 ||
+        textureLevelCount(header.width, header.height) != levelCount) {
+        std::cerr << "unsupported texture" << std::endl;
+        return false;
+    }
+    memcpy(view->levels, (const char*) data + sizeof(TextureHeader),
+           levelCount * sizeof(TextureLevel));
+    for (uint32_t i = 0; i < levelCount; i++) {
+        const TextureLevel &level = view->levels[i];
+        if (level.width != textureLevelSize(header.width, i) ||
+            level.height != textureLevelSize(header.height, i) ||
+            level.rowPitch < level.width * 4 ||
+            level.size < (size_t) level.rowPitch * (level.height - 1) + level.width * 4 ||
+            level.offset < tableEnd || (size_t) level.offset + level.size > size) {
+            std::cerr << "texture level " << i << " does not match the data" << std::endl;
+            return false;
+        }
+    }
+    view->flags = flags;
+    view->data = (const uint8_t*) data;
+    view->allocation = 0;
+    return true;
+}
+
+bool relayoutTexture(const void *data, size_t size, uint16_t flags, uint32_t levelCount,
+        size_t dataOffset, std::vector<uint8_t> &out) {
+    TextureView view;
+    if (!openTexture(data, size, flags, levelCount, &view)) {
+        return false;
+    }
+    std::vector<TextureLevel> table(view.levels, view.levels + levelCount);
+    size_t newSize = 0;
+    if (!placeTextureLevels(table, dataOffset, newSize)) {
+        return false;
+    }
+    out.assign(newSize, 0);
+    memcpy(&out[0], &view.header, sizeof(TextureHeader));
+    memcpy(&out[sizeof(TextureHeader)], &table[0], levelCount * sizeof(TextureLevel));
+    for (uint32_t i = 0; i < levelCount; i++) {
+        memcpy(&out[table[i].offset], view.data + view.levels[i].offset, table[i].size);
+    }
+    return true;
+}
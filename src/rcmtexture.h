@@ -0,0 +1,146 @@
+/* src/rcmtexture.h
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#ifndef RCM_TEXTURE_H
+#define RCM_TEXTURE_H
+
+#include "rcm.h"
+#include <vector>
+
+/* Textures with their complete mip chain.
+
+The levels are stored uncompressed as 8 bit RGBA in the layout a GPU copies
+from a buffer into an image: every row starts at a multiple of
+kTextureRowAlignment bytes and every level at a multiple of
+kTextureLevelAlignment bytes of the file. These are the placement rules of
+D3D12 and they satisfy Vulkan and OpenGL as well, so a loader can upload the
+levels straight from a mapping of the file.
+
+The smaller levels are filtered in linear space from the level above. Color
+textures (TEXTURE_SRGB) are converted from sRGB first, normal maps
+(TEXTURE_NORMAL_MAP) are normalized again on every level.
+
+layout of the data of a TEXTURE object, element count is the number of levels
+and the flags are the TextureFlags:
+  TextureHeader
+  level count * TextureLevel
+  padding, the levels, each followed by padding up to the next level
+*/
+
+const unsigned int kTextureRowAlignment = 256;
+const unsigned int kTextureLevelAlignment = 512;
+// enough for 32768 texels
+const unsigned int kMaxTextureLevels = 16;
+
+enum TextureFlags {
+    TEXTURE_SRGB = 0x1,
+    TEXTURE_NORMAL_MAP = 0x2,
+};
+
+enum TextureFormat {
+    TEXTURE_RGBA8 = 0x1,
+};
+
+enum MipFilter {
+    // average of the texels covered by the smaller texel
+    MIP_FILTER_BOX = 0,
+    // windowed sinc, sharper but slower
+    MIP_FILTER_KAISER,
+};
+
+// source image
+struct Texture {
+    // hash of the path the materials use for the image
+    uint64_t nameHash;
+    uint32_t width;
+    uint32_t height;
+    uint16_t flags;
+    // width * height texels, rows from top to bottom, RGBA 8 bit each
+    std::vector<uint8_t> pixels;
+};
+
+struct TextureHeader {
+    uint64_t nameHash;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t levelCount;
+};
+
+struct TextureLevel {
+    uint32_t width;
+    uint32_t height;
+    // bytes from one row to the next
+    uint32_t rowPitch;
+    // from the start of the object data
+    uint32_t offset;
+    uint32_t size;
+};
+
+// tightly packed RGBA levels, level 0 is the texture itself
+typedef std::vector<std::vector<uint8_t> > MipChain;
+
+struct TextureView {
+    // copies, the data of a texture object does not have to be aligned
+    TextureHeader header;
+    TextureLevel levels[kMaxTextureLevels];
+    uint16_t flags;
+    // start of the object data, the texels of level i are at data + levels[i].offset
+    const uint8_t *data;
+    // set if the data had to be copied, release with delete[] (char*)
+    void *allocation;
+};
+
+// number of levels down to 1 x 1
+inline uint32_t textureLevelCount(uint32_t width, uint32_t height) {
+    uint32_t size = width > height ? width : height;
+    uint32_t count = 1;
+    while (size > 1) {
+        size >>= 1;
+        count++;
+    }
+    return count;
+}
+
+// size of a level along one axis
+inline uint32_t textureLevelSize(uint32_t size, uint32_t level) {
+    return (size >> level) > 0 ? size >> level : 1;
+}
+
+// computes every level of the texture
+bool generateMipChain(const Texture &texture, MipFilter filter, MipChain &levels);
+
+// generateMipChain() for every texture, the textures are spread over
+// numThreads threads. 0 uses all hardware threads.
+bool generateMipChains(const std::vector<Texture> &textures, MipFilter filter,
+        std::vector<MipChain> &chains, unsigned int numThreads = 0);
+
+// lays out the levels for upload. dataOffset is the position of the data in
+// the file, it is used to align the levels.
+bool encodeTexture(const Texture &texture, const MipChain &levels, size_t dataOffset,
+        std::vector<uint8_t> &out);
+
+// copies the data of a texture object that moves to dataOffset in a file
+// and places its levels for that offset
+bool relayoutTexture(const void *data, size_t size, uint16_t flags, uint32_t levelCount,
+        size_t dataOffset, std::vector<uint8_t> &out);
+
+// checks the data and sets up the view
+bool openTexture(const void *data, size_t size, uint16_t flags, uint32_t levelCount,
+        TextureView *view);
+
+#endif // RCM_TEXTURE_H
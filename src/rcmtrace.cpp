@@ -0,0 +1,169 @@
+/* src/rcmtrace.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include "internal/trace.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+struct TraceEvent {
+    const char *name;
+    uint64_t start;
+    uint64_t duration;
+};
+
+// ring buffer of one thread. Only its thread writes events, count is
+// published after the event so the writer of the trace sees whole events.
+struct TraceBuffer {
+    explicit TraceBuffer(unsigned int lane) : count(0), lane(lane), events(kTraceBufferEvents) {}
+
+    std::atomic<uint64_t> count;
+    unsigned int lane;
+    std::vector<TraceEvent> events;
+};
+
+std::atomic<bool> gTraceEnabled(false);
+
+static std::atomic<int64_t> sTraceStart(0);
+
+// every buffer ever created, the free ones belonged to threads that ended.
+// Buffers are never deleted, their events are written with the trace.
+static std::mutex sBuffersMutex;
+static std::vector<TraceBuffer*> sBuffers;
+static std::vector<TraceBuffer*> sFreeBuffers;
+
+// returns the buffer to the free ones when the thread ends
+struct BufferLease {
+    BufferLease() : buffer(0) {}
+
+    ~BufferLease() {
+        if (buffer) {
+            std::lock_guard<std::mutex> lock(sBuffersMutex);
+            sFreeBuffers.push_back(buffer);
+        }
+    }
+
+    TraceBuffer *buffer;
+};
+
+static thread_local BufferLease sLease;
+
+static int64_t clockTime() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t traceTime() {
+    return clockTime() - sTraceStart.load(std::memory_order_relaxed);
+}
+
+static TraceBuffer* leaseBuffer() {
+    std::lock_guard<std::mutex> lock(sBuffersMutex);
+    if (!sFreeBuffers.empty()) {
+        TraceBuffer *buffer = sFreeBuffers.back();
+        sFreeBuffers.pop_back();
+        return buffer;
+    }
+    TraceBuffer *buffer = new TraceBuffer(sBuffers.size());
+    sBuffers.push_back(buffer);
+    return buffer;
+}
+
+void recordTraceEvent(const char *name, uint64_t start, uint64_t duration) {
+    TraceBuffer *buffer = sLease.buffer;
+    if (!buffer) {
+        buffer = sLease.buffer = leaseBuffer();
+    }
+    const uint64_t count = buffer->count.load(std::memory_order_relaxed);
+    TraceEvent &event = buffer->events[count % kTraceBufferEvents];
+    event.name = name;
+    event.start = start;
+    event.duration = duration;
+    buffer->count.store(count + 1, std::memory_order_release);
+}
+
+void startTrace() {
+    std::lock_guard<std::mutex> lock(sBuffersMutex);
+    for (size_t i = 0; i < sBuffers.size(); i++) {
+        sBuffers[i]->count.store(0, std::memory_order_relaxed);
+    }
+    sTraceStart.store(clockTime(), std::memory_order_relaxed);
+    gTraceEnabled.store(true, std::memory_order_release);
+}
+
+void stopTrace() {
+    gTraceEnabled.store(false, std::memory_order_release);
+}
+
+bool isTracing() {
+    return gTraceEnabled.load(std::memory_order_relaxed);
+}
+
+static void writeJsonString(std::ostream &out, const char *text) {
+    out << '"';
+    for (; *text; text++) {
+        const unsigned char c = *text;
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c >= 0x20) {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+void writeTrace(std::ostream &out) {
+    std::ostringstream json;
+    // timestamps and durations are in microseconds
+    json << std::fixed << std::setprecision(3);
+    json << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    std::lock_guard<std::mutex> lock(sBuffersMutex);
+    for (size_t i = 0; i < sBuffers.size(); i++) {
+        const TraceBuffer *buffer = sBuffers[i];
+        const uint64_t count = buffer->count.load(std::memory_order_acquire);
+        // a full ring holds the latest events
+        const uint64_t begin = count > kTraceBufferEvents ? count - kTraceBufferEvents : 0;
+        for (uint64_t e = begin; e < count; e++) {
+            const TraceEvent &event = buffer->events[e % kTraceBufferEvents];
+            json << (first ? "" : ",") << std::endl;
+            json << "{\"name\": ";
+            writeJsonString(json, event.name);
+            json << ", \"cat\": \"rcm\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->lane;
+            json << ", \"ts\": " << event.start / 1000.0;
+            json << ", \"dur\": " << event.duration / 1000.0 << "}";
+            first = false;
+        }
+    }
+    json << std::endl << "]}" << std::endl;
+    out << json.str();
+}
+
+bool writeTraceFile(const char *path) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "could not open file: " << path << std::endl;
+        return false;
+    }
+    writeTrace(out);
+    out.close();
+    return !out.fail();
+}
@@ -0,0 +1,53 @@
+/* src/rcmtrace.h
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#ifndef RCM_TRACE_H
+#define RCM_TRACE_H
+
+#include <stddef.h>
+#include <ostream>
+
+/* Timeline of the work of the library on all threads.
+
+While a trace runs, the loading, converting, writing and reading functions
+record when they start and how long they take. Every thread records into a
+ring buffer of its own without taking a lock and keeps only its latest
+kTraceBufferEvents events. A thread that ends hands its buffer to the next
+new thread, so the pool threads of consecutive calls share their lanes in the
+timeline. Without a running trace a traced function only checks a flag.
+
+The trace is written in the Chrome trace event format, which chrome://tracing
+and Perfetto open.
+*/
+
+const size_t kTraceBufferEvents = 1 << 16;
+
+// drops the events of an earlier trace and starts recording. No traced
+// function may run on another thread at that time.
+void startTrace();
+
+// stops recording. The events can be written once the traced work on the
+// other threads has finished.
+void stopTrace();
+
+bool isTracing();
+
+void writeTrace(std::ostream &out);
+
+bool writeTraceFile(const char *path);
+
+#endif // RCM_TRACE_H
@@ -0,0 +1,741 @@
+/* src/rcmweld.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include "rcmweld.h"
+#include "internal/rcm_internal.h"
+#include "internal/thread_pool.h"
+#include "internal/trace.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <sstream>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+static const uint32_t kEmptySlot = 0xffffffff;
+static const size_t kInitialTableSize = 1024;
+
+// offsets of the attributes that are compared with a tolerance
+struct WeldLayout {
+    float positionTolerance2;
+    float cosAngle;
+    float uvTolerance2;
+    int uvBegin;
+    int uvEnd;
+    // colors are compared as they are
+    int colorBegin;
+    int colorEnd;
+    bool hasNormals;
+    bool hasTangents;
+};
+
+static inline bool withinDistance(const float *a, const float *b, unsigned int size,
+        float tolerance2) {
+    float distance2 = 0.0f;
+    for (unsigned int k = 0; k < size; k++) {
+        distance2 += (a[k] - b[k]) * (a[k] - b[k]);
+    }
+    return distance2 <= tolerance2 || memcmp(a, b, size * sizeof(float)) == 0;
+}
+
+static inline bool withinAngle(const float *a, const float *b, float cosAngle) {
+    if (memcmp(a, b, 3 * sizeof(float)) == 0) {
+        return true;
+    }
+    const float dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    const float lengths2 = (a[0] * a[0] + a[1] * a[1] + a[2] * a[2]) *
+                           (b[0] * b[0] + b[1] * b[1] + b[2] * b[2]);
+    return lengths2 > 0.0f && dot >= cosAngle * sqrtf(lengths2);
+}
+
+static bool withinTolerance(const Mesh *mesh, const WeldLayout &layout,
+        uint32_t a, uint32_t b) {
+    const float *va = mesh->vertices + a * mesh->vertexSize;
+    const float *vb = mesh->vertices + b * mesh->vertexSize;
+    if (!withinDistance(va + positionOffset(), vb + positionOffset(), kPositionSize,
+                        layout.positionTolerance2)) {
+        return false;
+    }
+    if (layout.hasNormals &&
+        !withinAngle(va + normalsOffset(), vb + normalsOffset(), layout.cosAngle)) {
+        return false;
+    }
+    for (int offset = layout.uvBegin; offset < layout.uvEnd; offset += kTextureSize) {
+        if (!withinDistance(va + offset, vb + offset, kTextureSize, layout.uvTolerance2)) {
+            return false;
+        }
+    }
+    if (memcmp(va + layout.colorBegin, vb + layout.colorBegin,
+               (layout.colorEnd - layout.colorBegin) * sizeof(float)) != 0) {
+        return false;
+    }
+    if (layout.hasTangents &&
+        (!withinAngle(va + tanOffset(mesh->flags), vb + tanOffset(mesh->flags), layout.cosAngle) ||
+         !withinAngle(va + bitanOffset(mesh->flags), vb + bitanOffset(mesh->flags),
+                      layout.cosAngle))) {
+        return false;
+    }
+    if (hasBones(mesh->flags) &&
+        (memcmp(mesh->boneIndices + a * kMaxBoneInfluences,
+                mesh->boneIndices + b * kMaxBoneInfluences, kMaxBoneInfluences) != 0 ||
+         memcmp(mesh->boneWeights + a * kMaxBoneInfluences,
+                mesh->boneWeights + b * kMaxBoneInfluences,
+                kMaxBoneInfluences * sizeof(float)) != 0)) {
+        return false;
+    }
+    for (unsigned int t = 0; t < mesh->numMorphTargets; t++) {
+        const MorphTarget &target = mesh->morphTargets[t];
+        if (memcmp(target.positionDeltas + a * 3, target.positionDeltas + b * 3,
+                   3 * sizeof(float)) != 0 ||
+            (target.normalDeltas && memcmp(target.normalDeltas + a * 3,
+                                           target.normalDeltas + b * 3,
+                                           3 * sizeof(float)) != 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// cell of the hash grid, without a tolerance the bits of the position
+struct WeldCell {
+    int64_t coords[3];
+};
+
+// cells further out are clamped, so the neighbors of every cell stay within
+// int64_t. Coordinates that are not a number share the outermost cell.
+static const double kMaxWeldCell = 4611686018427387904.0;
+
+static WeldCell weldCell(const float *position, float cellSize) {
+    WeldCell cell;
+    for (unsigned int k = 0; k < 3; k++) {
+        if (cellSize > 0.0f) {
+            const double coord = floor((double) position[k] / cellSize);
+            cell.coords[k] = (int64_t) (isnan(coord) ? kMaxWeldCell :
+                                        std::max(-kMaxWeldCell, std::min(kMaxWeldCell, coord)));
+        } else {
+            int32_t bits;
+            memcpy(&bits, &position[k], sizeof(int32_t));
+            cell.coords[k] = bits;
+        }
+    }
+    return cell;
+}
+
+static inline size_t cellBucket(const WeldCell &cell, size_t mask) {
+    return hashBytes(cell.coords, sizeof(cell.coords)) & mask;
+}
+
+// calls visit with the bucket of cell and of every cell within reach of it
+template <typename Visit>
+static void visitNeighborBuckets(const WeldCell &cell, int reach, size_t mask,
+        const Visit &visit) {
+    for (int dx = -reach; dx <= reach; dx++) {
+        for (int dy = -reach; dy <= reach; dy++) {
+            for (int dz = -reach; dz <= reach; dz++) {
+                WeldCell neighbor = cell;
+                neighbor.coords[0] += dx;
+                neighbor.coords[1] += dy;
+                neighbor.coords[2] += dz;
+                visit(cellBucket(neighbor, mask));
+            }
+        }
+    }
+}
+
+size_t weldVertices(Mesh *mesh, const WeldTolerance &tolerance, unsigned int numThreads) {
+    TraceScope trace("weldVertices");
+    StageTimer timer(STAGE_DEDUP);
+    if (!mesh || !hasPositions(mesh->flags) || mesh->numVertices < 2) {
+        return 0;
+    }
+    WeldLayout layout;
+    layout.positionTolerance2 = tolerance.position * tolerance.position;
+    layout.cosAngle = cosf(std::min(180.0f, tolerance.normalAngle) * (float) M_PI / 180.0f);
+    layout.uvTolerance2 = tolerance.uv * tolerance.uv;
+    layout.uvBegin = texCoords0Offset(mesh->flags);
+    layout.uvEnd = color0Offset(mesh->flags);
+    layout.colorBegin = color0Offset(mesh->flags);
+    layout.colorEnd = tanOffset(mesh->flags);
+    layout.hasNormals = hasNormals(mesh->flags);
+    layout.hasTangents = hasTanBitan(mesh->flags);
+
+    // sort the vertices into the buckets of their cells, in the order of
+    // their index within every bucket
+    const uint32_t numVertices = mesh->numVertices;
+    const float cellSize = tolerance.position > 0.0f ? tolerance.position : 0.0f;
+    size_t numBuckets = 1;
+    while (numBuckets < numVertices) {
+        numBuckets *= 2;
+    }
+    const size_t mask = numBuckets - 1;
+    std::vector<WeldCell> cells(numVertices);
+    std::vector<uint32_t> bucketStart(numBuckets + 1, 0);
+    for (uint32_t i = 0; i < numVertices; i++) {
+        cells[i] = weldCell(mesh->vertices + i * mesh->vertexSize + positionOffset(), cellSize);
+        bucketStart[cellBucket(cells[i], mask) + 1]++;
+    }
+    for (size_t b = 0; b < numBuckets; b++) {
+        bucketStart[b + 1] += bucketStart[b];
+    }
+    std::vector<uint32_t> bucketVertices(numVertices);
+    {
+        std::vector<uint32_t> next(bucketStart.begin(), bucketStart.end() - 1);
+        for (uint32_t i = 0; i < numVertices; i++) {
+            bucketVertices[next[cellBucket(cells[i], mask)]++] = i;
+        }
+    }
+
+    // the first earlier vertex within tolerance of every vertex, found in the
+    // neighbor cells. Buckets hold their vertices in index order, so a bucket
+    // is searched up to its first match or the best match of another bucket.
+    if (numThreads == 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const uint32_t kNone = 0xffffffff;
+    const int reach = cellSize > 0.0f ? 1 : 0;
+    std::vector<uint32_t> firstMatches(numVertices, kNone);
+    {
+        ThreadPool pool(numThreads);
+        const size_t numTasks = std::min((size_t) numVertices, (size_t) numThreads * 4);
+        for (size_t t = 0; t < numTasks; t++) {
+            const uint32_t first = numVertices * t / numTasks;
+            const uint32_t end = numVertices * (t + 1) / numTasks;
+            pool.enqueue([=, &cells, &bucketStart, &bucketVertices, &layout, &firstMatches] {
+                TraceScope trace("weldCells");
+                for (uint32_t i = first; i < end; i++) {
+                    uint32_t match = kNone;
+                    visitNeighborBuckets(cells[i], reach, mask, [&](size_t b) {
+                        for (uint32_t w = bucketStart[b]; w < bucketStart[b + 1] &&
+                             bucketVertices[w] < std::min(i, match); w++) {
+                            if (withinTolerance(mesh, layout, i, bucketVertices[w])) {
+                                match = bucketVertices[w];
+                            }
+                        }
+                    });
+                    firstMatches[i] = match;
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    // in the order of the vertices, so every vertex that another one could
+    // become a copy of is final when it is needed. Vertices that kept their
+    // values are listed per bucket in index order. If the first match of a
+    // vertex became a copy itself, the first of them within tolerance is
+    // searched instead.
+    std::vector<uint32_t> source(numVertices);
+    std::vector<uint32_t> keptFirst(numBuckets, kNone);
+    std::vector<uint32_t> keptLast(numBuckets, kNone);
+    std::vector<uint32_t> keptNext(numVertices, kNone);
+    size_t merged = 0;
+    for (uint32_t i = 0; i < numVertices; i++) {
+        uint32_t j = firstMatches[i];
+        if (j != kNone && source[j] != j) {
+            j = kNone;
+            visitNeighborBuckets(cells[i], reach, mask, [&](size_t b) {
+                for (uint32_t k = keptFirst[b]; k != kNone && k < j; k = keptNext[k]) {
+                    if (withinTolerance(mesh, layout, i, k)) {
+                        j = k;
+                    }
+                }
+            });
+        }
+        if (j != kNone) {
+            source[i] = j;
+            memcpy(mesh->vertices + i * mesh->vertexSize, mesh->vertices + j * mesh->vertexSize,
+                   mesh->vertexSize * sizeof(float));
+            merged++;
+            continue;
+        }
+        source[i] = i;
+        const size_t b = cellBucket(cells[i], mask);
+        if (keptLast[b] == kNone) {
+            keptFirst[b] = i;
+        } else {
+            keptNext[keptLast[b]] = i;
+        }
+        keptLast[b] = i;
+    }
+    return merged;
+}
+
+// sequential writes to a file through a buffer of a fixed size
+class WeldWriter {
+public:
+    WeldWriter() : mUsed(0) {}
+
+    bool open(const std::string &path, size_t bufferSize) {
+        mBuffer.resize(bufferSize);
+        mUsed = 0;
+        mOut.open(path.c_str(), std::ios::trunc | std::ios::binary);
+        if (!mOut.is_open()) {
+            std::cerr << "could not open file: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void write(const void *data, size_t size) {
+        const char *bytes = (const char*) data;
+        while (size > 0) {
+            if (mUsed == mBuffer.size()) {
+                flush();
+            }
+            const size_t count = std::min(size, mBuffer.size() - mUsed);
+            memcpy(&mBuffer[mUsed], bytes, count);
+            mUsed += count;
+            bytes += count;
+            size -= count;
+        }
+    }
+
+    bool close() {
+        if (!mOut.is_open()) {
+            return false;
+        }
+        flush();
+        mOut.close();
+        std::vector<char>().swap(mBuffer);
+        return !mOut.fail();
+    }
+
+private:
+    void flush() {
+        mOut.write(&mBuffer[0], mUsed);
+        mUsed = 0;
+    }
+
+    std::ofstream mOut;
+    std::vector<char> mBuffer;
+    size_t mUsed;
+};
+
+// sequential reads from a file through a buffer of a fixed size
+class WeldReader {
+public:
+    WeldReader() : mPosition(0), mEnd(0) {}
+
+    bool open(const std::string &path, size_t bufferSize) {
+        mBuffer.resize(bufferSize);
+        mPosition = 0;
+        mEnd = 0;
+        mIn.open(path.c_str(), std::ios::binary);
+        if (!mIn.is_open()) {
+            std::cerr << "could not open file: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // false at the end of the file
+    bool read(void *data, size_t size) {
+        char *bytes = (char*) data;
+        while (size > 0) {
+            if (mPosition == mEnd) {
+                mIn.read(&mBuffer[0], mBuffer.size());
+                mPosition = 0;
+                mEnd = mIn.gcount();
+                if (mEnd == 0) {
+                    return false;
+                }
+            }
+            const size_t count = std::min(size, mEnd - mPosition);
+            memcpy(bytes, &mBuffer[mPosition], count);
+            mPosition += count;
+            bytes += count;
+            size -= count;
+        }
+        return true;
+    }
+
+    void close() {
+        mIn.close();
+        std::vector<char>().swap(mBuffer);
+    }
+
+private:
+    std::ifstream mIn;
+    std::vector<char> mBuffer;
+    size_t mPosition;
+    size_t mEnd;
+};
+
+// the temporary files of a weld, named after the process and the call so
+// that welds can run side by side in one directory
+struct WeldFiles {
+    WeldFiles(const char *tempDir, unsigned int numPartitions) :
+        numPartitions(numPartitions) {
+        static std::atomic<unsigned int> sCalls(0);
+        std::stringstream prefix;
+        prefix << tempDir << "/rcmweld-" << getpid() << "-" << sCalls++ << "-";
+        this->prefix = prefix.str();
+    }
+
+    ~WeldFiles() {
+        unlink(order().c_str());
+        for (unsigned int i = 0; i < numPartitions; i++) {
+            unlink(corners(i).c_str());
+            unlink(localIndices(i).c_str());
+            unlink(vertices(i).c_str());
+            unlink(globalIndices(i).c_str());
+            unlink(indices(i).c_str());
+        }
+    }
+
+    std::string path(const char *kind, unsigned int partition) const {
+        std::stringstream path;
+        path << prefix << kind << partition;
+        return path.str();
+    }
+
+    // the partition of every corner
+    std::string order() const { return path("order", 0); }
+    // the corners of a partition
+    std::string corners(unsigned int partition) const { return path("corners", partition); }
+    // the index of every corner of a partition among the vertices of the partition
+    std::string localIndices(unsigned int partition) const { return path("local", partition); }
+    // the distinct vertices of a partition
+    std::string vertices(unsigned int partition) const { return path("vertices", partition); }
+    // the final index of every vertex of a partition
+    std::string globalIndices(unsigned int partition) const { return path("global", partition); }
+    // the final index of every corner of a partition
+    std::string indices(unsigned int partition) const { return path("indices", partition); }
+
+    std::string prefix;
+    unsigned int numPartitions;
+};
+
+static void growTable(std::vector<uint32_t> &table, const std::vector<float> &vertices,
+        size_t vertexSize) {
+    table.assign(table.size() * 2, kEmptySlot);
+    const size_t mask = table.size() - 1;
+    const uint32_t count = vertices.size() / vertexSize;
+    for (uint32_t i = 0; i < count; i++) {
+        size_t slot = hashBytes(&vertices[i * vertexSize], vertexSize * sizeof(float)) & mask;
+        while (table[slot] != kEmptySlot) {
+            slot = (slot + 1) & mask;
+        }
+        table[slot] = i;
+    }
+}
+
+// welds the corners of one partition in memory. The corners are in the
+// order of the input, so the vertices are in the order of their first corner.
+static bool weldPartition(const WeldFiles &files, unsigned int partition,
+        size_t vertexSize, size_t bufferSize) {
+    TraceScope trace("weldPartition");
+    const size_t vertexBytes = vertexSize * sizeof(float);
+    WeldReader in;
+    WeldWriter local;
+    if (!in.open(files.corners(partition), bufferSize) ||
+        !local.open(files.localIndices(partition), bufferSize)) {
+        return false;
+    }
+    std::vector<float> vertices;
+    std::vector<uint32_t> table(kInitialTableSize, kEmptySlot);
+    std::vector<float> corner(vertexSize);
+    uint32_t count = 0;
+    while (in.read(&corner[0], vertexBytes)) {
+        const size_t mask = table.size() - 1;
+        size_t slot = hashBytes(&corner[0], vertexBytes) & mask;
+        while (table[slot] != kEmptySlot &&
+               memcmp(&vertices[table[slot] * vertexSize], &corner[0], vertexBytes) != 0) {
+            slot = (slot + 1) & mask;
+        }
+        if (table[slot] != kEmptySlot) {
+            local.write(&table[slot], sizeof(uint32_t));
+            continue;
+        }
+        local.write(&count, sizeof(uint32_t));
+        table[slot] = count++;
+        vertices.insert(vertices.end(), corner.begin(), corner.end());
+        // at most half of the slots are used
+        if (count * 2 > table.size()) {
+            growTable(table, vertices, vertexSize);
+        }
+    }
+    in.close();
+    std::vector<uint32_t>().swap(table);
+    unlink(files.corners(partition).c_str());
+
+    std::ofstream out(files.vertices(partition).c_str(), std::ios::trunc | std::ios::binary);
+    out.write((char*) vertices.data(), vertices.size() * sizeof(float));
+    out.close();
+    return local.close() && !out.fail();
+}
+
+// replaces the partition indices of the corners of a partition with the final ones
+static bool remapPartition(const WeldFiles &files, unsigned int partition, size_t bufferSize) {
+    TraceScope trace("remapPartition");
+    std::ifstream globalIn(files.globalIndices(partition).c_str(),
+                           std::ios::binary | std::ios::ate);
+    if (!globalIn.is_open()) {
+        std::cerr << "could not open file: " << files.globalIndices(partition) << std::endl;
+        return false;
+    }
+    std::vector<uint32_t> globalIndices((size_t) globalIn.tellg() / sizeof(uint32_t));
+    globalIn.seekg(0);
+    globalIn.read((char*) globalIndices.data(), globalIndices.size() * sizeof(uint32_t));
+    globalIn.close();
+
+    WeldReader in;
+    WeldWriter out;
+    if (!in.open(files.localIndices(partition), bufferSize) ||
+        !out.open(files.indices(partition), bufferSize)) {
+        return false;
+    }
+    uint32_t index;
+    while (in.read(&index, sizeof(uint32_t))) {
+        if (index >= globalIndices.size()) {
+            std::cerr << "corrupt weld partition: " << files.localIndices(partition) << std::endl;
+            return false;
+        }
+        out.write(&globalIndices[index], sizeof(uint32_t));
+    }
+    in.close();
+    unlink(files.localIndices(partition).c_str());
+    unlink(files.globalIndices(partition).c_str());
+    return out.close();
+}
+
+// runs task for every partition on the pool, true if all succeeded
+template<typename Task>
+static bool forEachPartition(ThreadPool &pool, unsigned int numPartitions, Task task) {
+    // not std::vector<bool>, the tasks write their results at the same time
+    std::vector<uint8_t> results(numPartitions, 0);
+    for (unsigned int i = 0; i < numPartitions; i++) {
+        uint8_t *result = &results[i];
+        pool.enqueue([task, i, result] {
+            *result = task(i) ? 1 : 0;
+        });
+    }
+    pool.wait();
+    return std::find(results.begin(), results.end(), 0) == results.end();
+}
+
+// descriptors left to the rest of the process while the partitions are open
+static const unsigned int kReservedFiles = 16;
+
+// numbering the vertices keeps three streams of every partition open, so
+// the partitions are limited by the files the process may open as well
+static unsigned int maxOpenPartitions() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY) {
+        return kMaxWeldPartitions;
+    }
+    const rlim_t files = limit.rlim_cur > kReservedFiles + 3 ? limit.rlim_cur - kReservedFiles : 3;
+    return (unsigned int) std::min((rlim_t) kMaxWeldPartitions, files / 3);
+}
+
+bool weldFile(const char *cornerPath, size_t vertexSize, const char *vertexPath,
+        const char *indexPath, const char *tempDir, size_t memoryBudget,
+        unsigned int numThreads, uint64_t *numVertices) {
+    TraceScope trace("weldFile");
+    StageTimer timer(STAGE_DEDUP);
+    if (vertexSize == 0) {
+        std::cerr << "vertex size is 0" << std::endl;
+        return false;
+    }
+    if (memoryBudget < kMinWeldMemory) {
+        std::cerr << "memory budget below " << kMinWeldMemory << " bytes" << std::endl;
+        return false;
+    }
+    const size_t vertexBytes = vertexSize * sizeof(float);
+    std::ifstream cornerFile(cornerPath, std::ios::binary | std::ios::ate);
+    if (!cornerFile.is_open()) {
+        std::cerr << "could not open file: " << cornerPath << std::endl;
+        return false;
+    }
+    const uint64_t fileSize = cornerFile.tellg();
+    cornerFile.close();
+    if (fileSize % vertexBytes != 0) {
+        std::cerr << "corner file does not hold whole vertices: " << cornerPath << std::endl;
+        return false;
+    }
+    const uint64_t numCorners = fileSize / vertexBytes;
+    if (numCorners > 0xffffffffULL) {
+        std::cerr << "too many corners for 32 bit indices: " << numCorners << std::endl;
+        return false;
+    }
+    timer.addInput(fileSize, numCorners);
+
+    // a partition takes its vertices and a table of at most two slots per
+    // vertex. Half the share of a thread is left for partitions that got
+    // more corners than the average. With fewer threads the shares grow.
+    if (numThreads == 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const uint64_t partitionBytes = 2 * numCorners * (vertexBytes + 2 * sizeof(uint32_t));
+    const unsigned int maxPartitions = maxOpenPartitions();
+    uint64_t numPartitions = 1;
+    for (; numThreads > 0; numThreads--) {
+        const uint64_t share = memoryBudget / numThreads;
+        numPartitions = std::max((uint64_t) 1, (partitionBytes + share - 1) / share);
+        if (numPartitions <= maxPartitions || numThreads == 1) {
+            break;
+        }
+    }
+    if (numPartitions > maxPartitions) {
+        std::cerr << "memory budget too small for " << numCorners << " corners in "
+                  << maxPartitions << " partitions" << std::endl;
+        return false;
+    }
+    // the buffers take at most half of the budget, numbering the vertices
+    // has three streams of each partition open at once
+    const size_t bufferSize = std::max(kMinWeldBufferSize,
+                                       memoryBudget / 2 / (3 * numPartitions + 2));
+    WeldFiles files(tempDir, numPartitions);
+
+    // hash every corner into its partition
+    {
+        TraceScope trace("partitionCorners");
+        WeldReader in;
+        WeldWriter order;
+        std::vector<WeldWriter> partitions(numPartitions);
+        bool opened = in.open(cornerPath, bufferSize) && order.open(files.order(), bufferSize);
+        for (unsigned int i = 0; i < numPartitions && opened; i++) {
+            opened = partitions[i].open(files.corners(i), bufferSize);
+        }
+        if (!opened) {
+            return false;
+        }
+        std::vector<float> corner(vertexSize);
+        while (in.read(&corner[0], vertexBytes)) {
+            const uint64_t hash = hashBytes(&corner[0], vertexBytes);
+            // the tables of the partitions use the lower bits
+            const uint16_t partition = (hash >> 32) % numPartitions;
+            order.write(&partition, sizeof(uint16_t));
+            partitions[partition].write(&corner[0], vertexBytes);
+        }
+        in.close();
+        bool closed = order.close();
+        for (unsigned int i = 0; i < numPartitions; i++) {
+            closed = partitions[i].close() && closed;
+        }
+        if (!closed) {
+            std::cerr << "could not write weld partitions to " << tempDir << std::endl;
+            return false;
+        }
+    }
+
+    ThreadPool pool(numThreads);
+    if (!forEachPartition(pool, numPartitions, [&files, vertexSize, bufferSize](unsigned int i) {
+            return weldPartition(files, i, vertexSize, bufferSize);
+        })) {
+        return false;
+    }
+
+    // number the vertices in the order of their first corner, which is
+    // the first corner of their partition that refers to them
+    uint32_t vertexCount = 0;
+    {
+        TraceScope trace("numberVertices");
+        WeldReader order;
+        WeldWriter out;
+        std::vector<WeldReader> localIn(numPartitions);
+        std::vector<WeldReader> verticesIn(numPartitions);
+        std::vector<WeldWriter> globalOut(numPartitions);
+        bool opened = order.open(files.order(), bufferSize) && out.open(vertexPath, bufferSize);
+        for (unsigned int i = 0; i < numPartitions && opened; i++) {
+            opened = localIn[i].open(files.localIndices(i), bufferSize) &&
+                     verticesIn[i].open(files.vertices(i), bufferSize) &&
+                     globalOut[i].open(files.globalIndices(i), bufferSize);
+        }
+        if (!opened) {
+            return false;
+        }
+        std::vector<uint32_t> partitionVertices(numPartitions, 0);
+        std::vector<float> vertex(vertexSize);
+        uint16_t partition;
+        uint32_t index;
+        while (order.read(&partition, sizeof(uint16_t))) {
+            if (!localIn[partition].read(&index, sizeof(uint32_t))) {
+                std::cerr << "corrupt weld partition: " << files.localIndices(partition) << std::endl;
+                return false;
+            }
+            if (index == partitionVertices[partition]) {
+                if (!verticesIn[partition].read(&vertex[0], vertexBytes)) {
+                    std::cerr << "corrupt weld partition: " << files.vertices(partition)
+                              << std::endl;
+                    return false;
+                }
+                out.write(&vertex[0], vertexBytes);
+                globalOut[partition].write(&vertexCount, sizeof(uint32_t));
+                partitionVertices[partition]++;
+                vertexCount++;
+            }
+        }
+        order.close();
+        bool closed = out.close();
+        for (unsigned int i = 0; i < numPartitions; i++) {
+            localIn[i].close();
+            verticesIn[i].close();
+            unlink(files.vertices(i).c_str());
+            closed = globalOut[i].close() && closed;
+        }
+        if (!closed) {
+            std::cerr << "could not write file: " << vertexPath << std::endl;
+            return false;
+        }
+    }
+
+    if (!forEachPartition(pool, numPartitions, [&files, bufferSize](unsigned int i) {
+            return remapPartition(files, i, bufferSize);
+        })) {
+        return false;
+    }
+
+    // the indices back in the order of the corners
+    {
+        TraceScope trace("mergeIndices");
+        WeldReader order;
+        WeldWriter out;
+        std::vector<WeldReader> indicesIn(numPartitions);
+        bool opened = order.open(files.order(), bufferSize) && out.open(indexPath, bufferSize);
+        for (unsigned int i = 0; i < numPartitions && opened; i++) {
+            opened = indicesIn[i].open(files.indices(i), bufferSize);
+        }
+        if (!opened) {
+            return false;
+        }
+        uint16_t partition;
+        uint32_t index;
+        while (order.read(&partition, sizeof(uint16_t))) {
+            if (!indicesIn[partition].read(&index, sizeof(uint32_t))) {
+                std::cerr << "corrupt weld partition: " << files.indices(partition) << std::endl;
+                return false;
+            }
+            out.write(&index, sizeof(uint32_t));
+        }
+        if (!out.close()) {
+            std::cerr << "could not write file: " << indexPath << std::endl;
+            return false;
+        }
+    }
+
+    timer.addOutput((uint64_t) vertexCount * vertexBytes + numCorners * sizeof(uint32_t),
+                    vertexCount);
+    if (numVertices) {
+        *numVertices = vertexCount;
+    }
+    return true;
+}
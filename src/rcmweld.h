@@ -0,0 +1,74 @@
+/* src/rcmweld.h
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#ifndef RCM_WELD_H
+#define RCM_WELD_H
+
+#include "rcm.h"
+#include "rcmwriter.h"
+#include <stddef.h>
+
+// tolerances of weldVertices(), 0 only merges equal values
+struct WeldTolerance {
+    // distance between the positions
+    float position;
+    // angle between the normals, the tangents and the bitangents in degrees
+    float normalAngle;
+    // distance between the texture coordinates of every channel
+    float uv;
+};
+
+// makes every vertex that is within tolerance of an earlier vertex a copy of
+// the first such vertex that was not changed itself, so createOptimizedMesh()
+// merges them. Colors, skin and morph target deltas have to be equal. The
+// vertices are sorted into a uniform hash grid with cells of the position
+// tolerance and the cells are compared on numThreads threads, 0 uses all
+// hardware threads. Returns the number of changed vertices.
+size_t weldVertices(Mesh *mesh, const WeldTolerance &tolerance, unsigned int numThreads = 0);
+
+/* Welding of corner lists that do not fit into memory.
+
+The corners are read from a file of vertexSize floats per corner, like the
+vertices of a Mesh before createOptimizedMesh(). Corners with equal bytes
+become one vertex and the vertices are numbered in the order of their first
+corner, like optimizeArrayOfStructs() does in memory. The result is written
+to two files: the vertices, and a 32 bit index for every corner.
+
+The corners are hashed into partition files in tempDir that are small
+enough to be welded in memory. The partitions are welded in parallel and
+their indices are merged back into the order of the corners.
+*/
+
+// the smallest memory budget weldFile() accepts
+const size_t kMinWeldMemory = 64 * 1024;
+
+// at most as many partitions as files can be open at once, fewer if the
+// process may open less than three files per partition (RLIMIT_NOFILE)
+const unsigned int kMaxWeldPartitions = 512;
+
+// no stream buffer is smaller, even if the budget is exceeded
+const size_t kMinWeldBufferSize = 4096;
+
+// welds the corners of cornerPath into vertexPath and indexPath. The
+// buffers and tables stay within memoryBudget bytes, fails if the corners
+// need more partitions than can be open at once. numThreads 0 uses all
+// hardware threads. numVertices receives the number of distinct vertices.
+bool weldFile(const char *cornerPath, size_t vertexSize, const char *vertexPath,
+        const char *indexPath, const char *tempDir, size_t memoryBudget,
+        unsigned int numThreads = 0, uint64_t *numVertices = 0);
+
+#endif // RCM_WELD_H
@@ -16,11 +16,69 @@
  * */
 
 #include "internal/rcm_internal.h"
+#include "internal/thread_pool.h"
+#include "internal/trace.h"
+#include <algorithm>
 #include <iostream>
+#include <math.h>
+#include <sys/stat.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 
-std::vector<Mesh*>* loadModel(const char *path, bool useAssimpOptimization) {
+// loops of a single mesh over fewer elements run on the calling thread
+static const size_t kParallelRange = 1 << 15;
+
+// the dedup sorts the corners by the top bits of their hash into shards that
+// are searched on separate threads
+static const uint32_t kDedupShardBits = 8;
+
+static uint64_t fileSize(const char *path) {
+    struct stat info;
+    return stat(path, &info) == 0 ? info.st_size : 0;
+}
+
+// bytes of the vertex attributes, faces and bone weights of an assimp mesh
+static uint64_t calcAiMeshBytes(const aiMesh *aimesh) {
+    uint64_t floatsPerVertex = aimesh->GetNumUVChannels() * 3 +
+                               aimesh->GetNumColorChannels() * 4;
+    if (aimesh->HasPositions()) {
+        floatsPerVertex += 3;
+    }
+    if (aimesh->HasNormals()) {
+        floatsPerVertex += 3;
+    }
+    if (aimesh->HasTangentsAndBitangents()) {
+        floatsPerVertex += 6;
+    }
+    uint64_t bytes = aimesh->mNumVertices * floatsPerVertex * sizeof(float) +
+                     (uint64_t) aimesh->mNumFaces * 3 * sizeof(unsigned int);
+    for (unsigned int i = 0; i < aimesh->mNumBones; i++) {
+        bytes += aimesh->mBones[i]->mNumWeights * sizeof(aiVertexWeight);
+    }
+    return bytes;
+}
+
+// reads the file with assimp, counted as the import stage
+static const aiScene* importScene(Assimp::Importer &importer, const char *path,
+        unsigned int importerFlags) {
+    TraceScope trace("import");
+    StageTimer timer(STAGE_IMPORT);
+    timer.addInput(fileSize(path), 0);
+    const aiScene *scene = importer.ReadFile(path, importerFlags);
+    if (scene) {
+        for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+            timer.addOutput(calcAiMeshBytes(scene->mMeshes[i]), scene->mMeshes[i]->mNumVertices);
+        }
+    }
+    return scene;
+}
+
+// post processing of the models read by loadModel() and streamModel()
+static unsigned int modelImporterFlags(bool useAssimpOptimization) {
     unsigned int importerFlags = 0;
     if (useAssimpOptimization) {
         importerFlags |= aiProcess_JoinIdenticalVertices;
@@ -28,9 +86,14 @@ std::vector<Mesh*>* loadModel(const char *path, bool useAssimpOptimization) {
     //importerFlags |= aiProcess_GenUVCoords;
     importerFlags |= aiProcess_Triangulate;
     importerFlags |= aiProcess_FixInfacingNormals;
+    return importerFlags;
+}
+
+std::vector<Mesh*>* loadModel(const char *path, bool useAssimpOptimization) {
+    TraceScope trace("loadModel");
     Assimp::Importer importer;
 
-    const aiScene *scene = importer.ReadFile(path, importerFlags);
+    const aiScene *scene = importScene(importer, path, modelImporterFlags(useAssimpOptimization));
     if (!scene) {
         std::cerr << importer.GetErrorString() << std::endl;
         return 0;
@@ -61,47 +124,501 @@ std::vector<Mesh*>* loadModel(const char *path, bool useAssimpOptimization) {
     return 0;
 }
 
-Mesh* convertAiMesh(const aiMesh *aimesh) {
-    if (!aimesh) {
-        std::cerr << "aimesh is null" << std::endl;
+static uint64_t hashMesh(const Mesh *mesh) {
+    uint64_t hash = hashBytes(&mesh->flags, sizeof(mesh->flags));
+    hash = hashBytes(&mesh->numVertices, sizeof(mesh->numVertices), hash);
+    hash = hashBytes(&mesh->numIndices, sizeof(mesh->numIndices), hash);
+    hash = hashBytes(mesh->vertices, mesh->numVertices * mesh->vertexSize * sizeof(float), hash);
+    hash = hashBytes(mesh->indices, mesh->numIndices * sizeof(unsigned short), hash);
+    if (hasBones(mesh->flags)) {
+        hash = hashBytes(mesh->boneIndices, mesh->numVertices * kMaxBoneInfluences, hash);
+        hash = hashBytes(mesh->boneWeights,
+                         mesh->numVertices * kMaxBoneInfluences * sizeof(float), hash);
+        hash = hashBytes(mesh->bones, mesh->numBones * sizeof(BoneData), hash);
+    }
+    hash = hashBytes(&mesh->numMorphTargets, sizeof(mesh->numMorphTargets), hash);
+    hash = hashBytes(&mesh->materialIndex, sizeof(mesh->materialIndex), hash);
+    return hash;
+}
+
+static bool equalMorphTargets(const Mesh *a, const Mesh *b) {
+    if (a->numMorphTargets != b->numMorphTargets ||
+        a->quantizeMorphTargets != b->quantizeMorphTargets) {
+        return false;
+    }
+    const size_t size = a->numVertices * 3 * sizeof(float);
+    for (unsigned int i = 0; i < a->numMorphTargets; i++) {
+        const MorphTarget &ta = a->morphTargets[i];
+        const MorphTarget &tb = b->morphTargets[i];
+        if (ta.nameHash != tb.nameHash || !ta.normalDeltas != !tb.normalDeltas ||
+            memcmp(ta.positionDeltas, tb.positionDeltas, size) != 0 ||
+            (ta.normalDeltas && memcmp(ta.normalDeltas, tb.normalDeltas, size) != 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool equalMeshes(const Mesh *a, const Mesh *b) {
+    return a->flags == b->flags && a->vertexSize == b->vertexSize &&
+           a->materialIndex == b->materialIndex &&
+           a->numVertices == b->numVertices && a->numIndices == b->numIndices &&
+           memcmp(a->vertices, b->vertices, a->numVertices * a->vertexSize * sizeof(float)) == 0 &&
+           memcmp(a->indices, b->indices, a->numIndices * sizeof(unsigned short)) == 0 &&
+           (!hasBones(a->flags) || (a->numBones == b->numBones &&
+            memcmp(a->boneIndices, b->boneIndices, a->numVertices * kMaxBoneInfluences) == 0 &&
+            memcmp(a->boneWeights, b->boneWeights,
+                   a->numVertices * kMaxBoneInfluences * sizeof(float)) == 0 &&
+            memcmp(a->bones, b->bones, a->numBones * sizeof(BoneData)) == 0)) &&
+           equalMorphTargets(a, b);
+}
+
+size_t removeDuplicateMeshes(std::vector<Mesh*> &meshes, std::vector<unsigned int> &meshMap) {
+    TraceScope trace("removeDuplicateMeshes");
+    StageTimer timer(STAGE_DEDUP);
+    // unique meshes by content hash, equal hashes are compared in full
+    std::multimap<uint64_t, unsigned int> known;
+    std::vector<Mesh*> unique;
+    meshMap.clear();
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const uint64_t bytes = calcMeshBytes(meshes[i]);
+        timer.addInput(bytes, meshes[i]->numVertices);
+        const uint64_t hash = hashMesh(meshes[i]);
+        unsigned int index = unique.size();
+        std::multimap<uint64_t, unsigned int>::iterator it = known.lower_bound(hash);
+        for (; it != known.end() && it->first == hash; ++it) {
+            if (equalMeshes(unique[it->second], meshes[i])) {
+                index = it->second;
+                break;
+            }
+        }
+        if (index == unique.size()) {
+            known.insert(std::make_pair(hash, index));
+            unique.push_back(meshes[i]);
+            timer.addOutput(bytes, meshes[i]->numVertices);
+        } else {
+            delete meshes[i];
+        }
+        meshMap.push_back(index);
+    }
+    const size_t removed = meshes.size() - unique.size();
+    meshes.swap(unique);
+    return removed;
+}
+
+static void toColumnMajor(const aiMatrix4x4 &m, float *matrix) {
+    const float columns[16] = {
+        m.a1, m.b1, m.c1, m.d1,
+        m.a2, m.b2, m.c2, m.d2,
+        m.a3, m.b3, m.c3, m.d3,
+        m.a4, m.b4, m.c4, m.d4,
+    };
+    memcpy(matrix, columns, sizeof(columns));
+}
+
+static void addInstance(unsigned int objectIndex, const aiMatrix4x4 &m,
+        std::vector<Instance> &instances) {
+    Instance instance;
+    instance.objectIndex = objectIndex;
+    toColumnMajor(m, instance.transform);
+    instances.push_back(instance);
+}
+
+static void collectInstances(const aiNode *node, const aiMatrix4x4 &parentTransform,
+        const std::vector<unsigned int> &meshMap, std::vector<Instance> &instances) {
+    const aiMatrix4x4 transform = parentTransform * node->mTransformation;
+    for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+        if (node->mMeshes[i] < meshMap.size()) {
+            addInstance(meshMap[node->mMeshes[i]], transform, instances);
+        }
+    }
+    for (unsigned int i = 0; i < node->mNumChildren; i++) {
+        collectInstances(node->mChildren[i], transform, meshMap, instances);
+    }
+}
+
+// texture types of the materials that are converted, color textures are sRGB
+static const aiTextureType kTextureTypes[] = {
+    aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_AMBIENT, aiTextureType_EMISSIVE,
+    aiTextureType_HEIGHT, aiTextureType_NORMALS, aiTextureType_SHININESS, aiTextureType_OPACITY,
+    aiTextureType_DISPLACEMENT, aiTextureType_LIGHTMAP, aiTextureType_REFLECTION
+};
+
+static uint16_t textureFlags(aiTextureType type) {
+    switch (type) {
+    case aiTextureType_DIFFUSE:
+    case aiTextureType_SPECULAR:
+    case aiTextureType_AMBIENT:
+    case aiTextureType_EMISSIVE:
+    case aiTextureType_REFLECTION:
+        return TEXTURE_SRGB;
+    case aiTextureType_NORMALS:
+        return TEXTURE_NORMAL_MAP;
+    default:
         return 0;
     }
-    uint32_t numVertices = aimesh->mNumVertices;
-    uint32_t numIndices = aimesh->mNumFaces * 3;
-    uint32_t vertexSize = 0;
-    uint32_t posOffset = 0;
-    uint32_t normalOffset = 0;
-    uint32_t texOffset = 0;
+}
 
-    uint16_t vertexFlags = 0;
+bool convertAiTexture(const aiTexture *aitexture, Texture &texture) {
+    // a height of 0 means the texture holds a compressed file of mWidth bytes
+    if (aitexture->mHeight == 0) {
+        return decodeImage((const uint8_t*) aitexture->pcData, aitexture->mWidth, texture);
+    }
+    texture.width = aitexture->mWidth;
+    texture.height = aitexture->mHeight;
+    texture.pixels.resize((size_t) texture.width * texture.height * 4);
+    for (size_t i = 0; i < (size_t) texture.width * texture.height; i++) {
+        const aiTexel &texel = aitexture->pcData[i];
+        texture.pixels[i * 4] = texel.r;
+        texture.pixels[i * 4 + 1] = texel.g;
+        texture.pixels[i * 4 + 2] = texel.b;
+        texture.pixels[i * 4 + 3] = texel.a;
+    }
+    return true;
+}
 
-    if (aimesh->HasPositions()) {
-        vertexSize += kPositionSize;
-        setHasPositions(vertexFlags);
+// loads every image used by a material once. Images that can not be loaded
+// are left out, the materials still refer to them by the hash of the path.
+static void collectTextures(const aiScene *aiscene, const char *modelPath,
+        std::vector<Texture> &textures) {
+    std::string directory(modelPath);
+    const size_t slash = directory.find_last_of('/');
+    directory = slash == std::string::npos ? "" : directory.substr(0, slash + 1);
+    for (unsigned int m = 0; m < aiscene->mNumMaterials; m++) {
+        const aiMaterial *material = aiscene->mMaterials[m];
+        for (size_t t = 0; t < sizeof(kTextureTypes) / sizeof(kTextureTypes[0]); t++) {
+            for (unsigned int i = 0; i < material->GetTextureCount(kTextureTypes[t]); i++) {
+                aiString path;
+                if (material->GetTexture(kTextureTypes[t], i, &path) != aiReturn_SUCCESS) {
+                    continue;
+                }
+                const uint64_t nameHash = hashName(path.C_Str(), path.length);
+                bool known = false;
+                for (size_t k = 0; k < textures.size() && !known; k++) {
+                    known = textures[k].nameHash == nameHash;
+                }
+                if (known) {
+                    continue;
+                }
+                Texture texture;
+                texture.nameHash = nameHash;
+                texture.flags = textureFlags(kTextureTypes[t]);
+                const aiTexture *embedded = aiscene->GetEmbeddedTexture(path.C_Str());
+                bool loaded;
+                if (embedded) {
+                    loaded = convertAiTexture(embedded, texture);
+                } else {
+                    std::string file(path.C_Str());
+                    std::replace(file.begin(), file.end(), '\\', '/');
+                    loaded = loadImageFile((file[0] == '/' ? file : directory + file).c_str(),
+                                           texture);
+                }
+                if (loaded) {
+                    textures.push_back(texture);
+                } else {
+                    std::cerr << "skipping texture " << path.C_Str() << std::endl;
+                }
+            }
+        }
     }
-    if (aimesh->HasNormals()) {
-        vertexSize += kNormalsSize;
-        setHasNormals(vertexFlags);
+}
+
+// assimp texture type of every material slot
+static const aiTextureType kSlotTextureTypes[kNumTextureSlots] = {
+    aiTextureType_DIFFUSE, aiTextureType_NORMALS, aiTextureType_SPECULAR, aiTextureType_EMISSIVE,
+    aiTextureType_OPACITY
+};
+
+static void getColor(const aiMaterial *aimaterial, const char *key, unsigned int type,
+        unsigned int index, float *color) {
+    aiColor3D value;
+    if (aimaterial->Get(key, type, index, value) == aiReturn_SUCCESS) {
+        color[0] = value.r;
+        color[1] = value.g;
+        color[2] = value.b;
     }
+}
 
-    unsigned int numTexCoords = aimesh->GetNumUVChannels();
-    numTexCoords = (numTexCoords > kMaxNumTexCoords) ? kMaxNumTexCoords : numTexCoords;
-    vertexSize += numTexCoords * kTextureSize;
-    setHasTexCoords(vertexFlags, numTexCoords);
+void convertAiMaterial(const aiMaterial *aimaterial, Material &material) {
+    aiString name;
+    material.nameHash = aimaterial->Get(AI_MATKEY_NAME, name) == aiReturn_SUCCESS ?
+                        hashName(name.C_Str(), name.length) : 0;
+    // the defaults of assimp for missing properties
+    const float white[] = {1.0f, 1.0f, 1.0f, 1.0f};
+    memcpy(material.diffuse, white, sizeof(material.diffuse));
+    memset(material.specular, 0, sizeof(material.specular));
+    memset(material.emissive, 0, sizeof(material.emissive));
+    material.shininess = 0.0f;
+    material.flags = 0;
+    getColor(aimaterial, AI_MATKEY_COLOR_DIFFUSE, material.diffuse);
+    getColor(aimaterial, AI_MATKEY_COLOR_SPECULAR, material.specular);
+    getColor(aimaterial, AI_MATKEY_COLOR_EMISSIVE, material.emissive);
+    aimaterial->Get(AI_MATKEY_OPACITY, material.diffuse[3]);
+    aimaterial->Get(AI_MATKEY_SHININESS, material.shininess);
+    int twoSided = 0;
+    if (aimaterial->Get(AI_MATKEY_TWOSIDED, twoSided) == aiReturn_SUCCESS && twoSided) {
+        material.flags |= MATERIAL_TWO_SIDED;
+    }
+    for (unsigned int s = 0; s < kNumTextureSlots; s++) {
+        aiString path;
+        material.texturePaths[s].clear();
+        if (aimaterial->GetTextureCount(kSlotTextureTypes[s]) > 0 &&
+            aimaterial->GetTexture(kSlotTextureTypes[s], 0, &path) == aiReturn_SUCCESS) {
+            material.texturePaths[s].assign(path.C_Str(), path.length);
+        }
+    }
+}
 
-    unsigned int numColors = aimesh->GetNumColorChannels();
-    numColors = (numColors > kMaxNumColors) ? kMaxNumColors : numColors;
-    vertexSize += numColors * kColorSize;
-    setHasColors(vertexFlags, numColors);
+// the material of a mesh first, then its vertex layout
+struct MaterialOrder {
+    const std::vector<Mesh*> *meshes;
 
-    if (aimesh->HasTangentsAndBitangents()) {
-        vertexSize += kTanSize + kBitanSize;
-        setHasTanBitan(vertexFlags);
+    bool operator()(unsigned int a, unsigned int b) const {
+        const Mesh *ma = (*meshes)[a];
+        const Mesh *mb = (*meshes)[b];
+        if (ma->materialIndex != mb->materialIndex) {
+            return ma->materialIndex < mb->materialIndex;
+        }
+        return ma->flags < mb->flags;
     }
+};
 
-    float *vertices = new float[vertexSize * numVertices];
+void sortMeshesByMaterial(Scene *scene) {
+    TraceScope trace("sortMeshesByMaterial");
+    std::vector<unsigned int> order(scene->meshes.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    MaterialOrder compare = {&scene->meshes};
+    std::stable_sort(order.begin(), order.end(), compare);
+    std::vector<Mesh*> sorted(order.size());
+    std::vector<unsigned int> newIndex(order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        sorted[i] = scene->meshes[order[i]];
+        newIndex[order[i]] = i;
+    }
+    scene->meshes.swap(sorted);
+    for (size_t i = 0; i < scene->instances.size(); i++) {
+        scene->instances[i].objectIndex = newIndex[scene->instances[i].objectIndex];
+    }
+}
+
+Scene* loadScene(const char *path, bool useAssimpOptimization, bool loadTextures,
+        bool shareMeshes) {
+    TraceScope trace("loadScene");
+    unsigned int importerFlags = aiProcess_Triangulate | aiProcess_FixInfacingNormals;
+    if (useAssimpOptimization) {
+        importerFlags |= aiProcess_JoinIdenticalVertices;
+    }
+    Assimp::Importer importer;
+    const aiScene *aiscene = importScene(importer, path, importerFlags);
+    if (!aiscene) {
+        std::cerr << importer.GetErrorString() << std::endl;
+        return 0;
+    }
+    if (!aiscene->HasMeshes()) {
+        std::cerr << "scene does not have meshes" << std::endl;
+        importer.FreeScene();
+        return 0;
+    }
+    Scene *scene = new Scene();
+    for (unsigned int i = 0; i < aiscene->mNumMeshes; i++) {
+        Mesh *mesh = convertAiMesh(aiscene->mMeshes[i]);
+        if (!mesh) {
+            // instances refer to meshes by index, so no mesh may be left out
+            std::cerr << "problem converting mesh" << std::endl;
+            importer.FreeScene();
+            delete scene;
+            return 0;
+        }
+        scene->meshes.push_back(mesh);
+    }
+    std::vector<unsigned int> meshMap;
+    if (shareMeshes) {
+        removeDuplicateMeshes(scene->meshes, meshMap);
+    } else {
+        for (unsigned int i = 0; i < scene->meshes.size(); i++) {
+            meshMap.push_back(i);
+        }
+    }
+    if (aiscene->mRootNode) {
+        collectInstances(aiscene->mRootNode, aiMatrix4x4(), meshMap, scene->instances);
+    } else {
+        for (size_t i = 0; i < meshMap.size(); i++) {
+            addInstance(meshMap[i], aiMatrix4x4(), scene->instances);
+        }
+    }
+    scene->animations.resize(aiscene->mNumAnimations);
+    for (unsigned int i = 0; i < aiscene->mNumAnimations; i++) {
+        convertAiAnimation(aiscene->mAnimations[i], scene->animations[i]);
+    }
+    scene->materials.resize(aiscene->mNumMaterials);
+    for (unsigned int i = 0; i < aiscene->mNumMaterials; i++) {
+        convertAiMaterial(aiscene->mMaterials[i], scene->materials[i]);
+    }
+    if (loadTextures) {
+        collectTextures(aiscene, path, scene->textures);
+    }
+    importer.FreeScene();
+    return scene;
+}
+
+// assimp uses 25 ticks per second if the file does not say otherwise
+static const double kDefaultTicksPerSecond = 25.0;
+
+void convertAiAnimation(const aiAnimation *aianimation, Animation &animation) {
+    const double ticksPerSecond = aianimation->mTicksPerSecond > 0.0 ?
+                                  aianimation->mTicksPerSecond : kDefaultTicksPerSecond;
+    animation.nameHash = hashName(aianimation->mName.C_Str(), aianimation->mName.length);
+    animation.duration = (float) (aianimation->mDuration / ticksPerSecond);
+    animation.tracks.resize(aianimation->mNumChannels);
+    for (unsigned int c = 0; c < aianimation->mNumChannels; c++) {
+        const aiNodeAnim *channel = aianimation->mChannels[c];
+        AnimationTrack &track = animation.tracks[c];
+        track.nameHash = hashName(channel->mNodeName.C_Str(), channel->mNodeName.length);
+        track.translations.resize(channel->mNumPositionKeys);
+        for (unsigned int k = 0; k < channel->mNumPositionKeys; k++) {
+            const aiVectorKey &key = channel->mPositionKeys[k];
+            track.translations[k].time = (float) (key.mTime / ticksPerSecond);
+            track.translations[k].value[0] = key.mValue.x;
+            track.translations[k].value[1] = key.mValue.y;
+            track.translations[k].value[2] = key.mValue.z;
+        }
+        track.rotations.resize(channel->mNumRotationKeys);
+        for (unsigned int k = 0; k < channel->mNumRotationKeys; k++) {
+            const aiQuatKey &key = channel->mRotationKeys[k];
+            track.rotations[k].time = (float) (key.mTime / ticksPerSecond);
+            track.rotations[k].value[0] = key.mValue.x;
+            track.rotations[k].value[1] = key.mValue.y;
+            track.rotations[k].value[2] = key.mValue.z;
+            track.rotations[k].value[3] = key.mValue.w;
+        }
+        track.scales.resize(channel->mNumScalingKeys);
+        for (unsigned int k = 0; k < channel->mNumScalingKeys; k++) {
+            const aiVectorKey &key = channel->mScalingKeys[k];
+            track.scales[k].time = (float) (key.mTime / ticksPerSecond);
+            track.scales[k].value[0] = key.mValue.x;
+            track.scales[k].value[1] = key.mValue.y;
+            track.scales[k].value[2] = key.mValue.z;
+        }
+    }
+}
+
+// keeps the kMaxBoneInfluences largest influences of a vertex sorted by
+// weight, smaller ones are dropped
+static void insertInfluence(unsigned char *indices, float *weights,
+        unsigned char bone, float weight) {
+    unsigned int slot = 0;
+    while (slot < kMaxBoneInfluences && weights[slot] >= weight) {
+        slot++;
+    }
+    if (slot == kMaxBoneInfluences) {
+        return;
+    }
+    for (unsigned int i = kMaxBoneInfluences - 1; i > slot; i--) {
+        indices[i] = indices[i - 1];
+        weights[i] = weights[i - 1];
+    }
+    indices[slot] = bone;
+    weights[slot] = weight;
+}
+
+// gathers the weights that assimp stores per bone into kMaxBoneInfluences
+// slots per vertex. Every weight is visited once and goes straight to the
+// slots of its vertex, there is no search for the vertex in the bones.
+static bool convertAiBones(const aiMesh *aimesh, Mesh *mesh) {
+    const unsigned int numBones = aimesh->mNumBones;
+    if (numBones > kMaxBones) {
+        std::cerr << "too many bones: " << numBones << " (max " << kMaxBones << ")" << std::endl;
+        return false;
+    }
+    const size_t numInfluences = mesh->numVertices * kMaxBoneInfluences;
+    mesh->boneIndices = new unsigned char[numInfluences];
+    mesh->boneWeights = new float[numInfluences];
+    mesh->bones = new BoneData[numBones];
+    mesh->numBones = numBones;
+    memset(mesh->boneIndices, 0, numInfluences);
+    std::fill(mesh->boneWeights, mesh->boneWeights + numInfluences, 0.0f);
+
+    for (unsigned int b = 0; b < numBones; b++) {
+        const aiBone *bone = aimesh->mBones[b];
+        mesh->bones[b].nameHash = hashName(bone->mName.C_Str(), bone->mName.length);
+        toColumnMajor(bone->mOffsetMatrix, mesh->bones[b].inverseBindMatrix);
+        for (unsigned int w = 0; w < bone->mNumWeights; w++) {
+            const aiVertexWeight &weight = bone->mWeights[w];
+            if (weight.mVertexId < mesh->numVertices && weight.mWeight > 0.0f) {
+                const size_t slot = weight.mVertexId * kMaxBoneInfluences;
+                insertInfluence(&mesh->boneIndices[slot], &mesh->boneWeights[slot], b,
+                                weight.mWeight);
+            }
+        }
+    }
+    // normalize the kept weights, vertices without any weight follow bone 0
+    for (size_t slot = 0; slot < numInfluences; slot += kMaxBoneInfluences) {
+        float *weights = &mesh->boneWeights[slot];
+        float sum = 0.0f;
+        for (unsigned int i = 0; i < kMaxBoneInfluences; i++) {
+            sum += weights[i];
+        }
+        if (sum > 0.0f) {
+            for (unsigned int i = 0; i < kMaxBoneInfluences; i++) {
+                weights[i] /= sum;
+            }
+        } else {
+            weights[0] = 1.0f;
+        }
+    }
+    setHasBones(mesh->flags);
+    return true;
+}
+
+static float* subtractVectors(const aiVector3D *values, const aiVector3D *base,
+        unsigned int count) {
+    float *deltas = new float[count * 3];
+    for (unsigned int i = 0; i < count; i++) {
+        deltas[i * 3] = values[i].x - base[i].x;
+        deltas[i * 3 + 1] = values[i].y - base[i].y;
+        deltas[i * 3 + 2] = values[i].z - base[i].z;
+    }
+    return deltas;
+}
+
+// assimp stores the full replacement positions and normals of each blend
+// shape, the mesh keeps their difference to the base mesh
+static void convertAiAnimMeshes(const aiMesh *aimesh, Mesh *mesh) {
+    std::vector<MorphTarget> targets;
+    for (unsigned int i = 0; i < aimesh->mNumAnimMeshes; i++) {
+        const aiAnimMesh *animMesh = aimesh->mAnimMeshes[i];
+        if (!animMesh->HasPositions() || animMesh->mNumVertices != aimesh->mNumVertices) {
+            std::cerr << "skipping morph target " << i << " without matching positions"
+                      << std::endl;
+            continue;
+        }
+        MorphTarget target;
+        target.nameHash = hashName(animMesh->mName.C_Str(), animMesh->mName.length);
+        target.positionDeltas = subtractVectors(animMesh->mVertices, aimesh->mVertices,
+                                                aimesh->mNumVertices);
+        target.normalDeltas = 0;
+        if (animMesh->HasNormals() && aimesh->HasNormals()) {
+            target.normalDeltas = subtractVectors(animMesh->mNormals, aimesh->mNormals,
+                                                  aimesh->mNumVertices);
+        }
+        targets.push_back(target);
+    }
+    if (targets.empty()) {
+        return;
+    }
+    mesh->numMorphTargets = targets.size();
+    mesh->morphTargets = new MorphTarget[targets.size()];
+    std::copy(targets.begin(), targets.end(), mesh->morphTargets);
+}
+
+// converts the vertices first to end of aimesh into the interleaved layout
+static void convertAiVertices(const aiMesh *aimesh, uint16_t vertexFlags, size_t vertexSize,
+        unsigned int numTexCoords, unsigned int numColors, size_t first, size_t end,
+        float *vertices) {
     uint32_t offset = 0;
-    for (int i = 0, n = 0; i < numVertices; i++, n = i * vertexSize) {
+    for (size_t i = first, n = first * vertexSize; i < end; i++, n = i * vertexSize) {
         if (aimesh->HasPositions()) {
             offset = n + positionOffset();
             aiVector3D aipos = aimesh->mVertices[i];
@@ -154,15 +671,124 @@ Mesh* convertAiMesh(const aiMesh *aimesh) {
             vertices[offset + 2] = bitangent.z;
         }
     }
-    uint16_t *indices = new uint16_t[numIndices];
-    for (int i = 0, f = 0; i < numIndices; i += 3, f++) {
-        indices[i] = aimesh->mFaces[f].mIndices[0];
-        indices[i+1] = aimesh->mFaces[f].mIndices[1];
-        indices[i+2] = aimesh->mFaces[f].mIndices[2];
+}
+
+// copies the size values of the vertex of every corner of the faces into a
+// new array, with the faces' 32 bit indices
+template <typename T>
+static T* gatherCorners(const aiMesh *aimesh, const T *values, size_t size) {
+    const size_t numCorners = (size_t) aimesh->mNumFaces * 3;
+    T *corners = new T[numCorners * size];
+    parallelFor(numCorners, kParallelRange, [=](size_t first, size_t end) {
+        for (size_t i = first; i < end; i++) {
+            const size_t vertex = aimesh->mFaces[i / 3].mIndices[i % 3];
+            std::copy(values + vertex * size, values + (vertex + 1) * size, corners + i * size);
+        }
+    });
+    return corners;
+}
+
+// turns the converted vertices, skin and morph targets of mesh into a list of
+// the corners of the faces of aimesh, numIndices becomes 0
+static void expandToCorners(const aiMesh *aimesh, Mesh *mesh) {
+    float *vertices = gatherCorners(aimesh, mesh->vertices, mesh->vertexSize);
+    delete [] mesh->vertices;
+    mesh->vertices = vertices;
+    if (mesh->boneIndices) {
+        unsigned char *boneIndices = gatherCorners(aimesh, mesh->boneIndices, kMaxBoneInfluences);
+        float *boneWeights = gatherCorners(aimesh, mesh->boneWeights, kMaxBoneInfluences);
+        delete [] mesh->boneIndices;
+        delete [] mesh->boneWeights;
+        mesh->boneIndices = boneIndices;
+        mesh->boneWeights = boneWeights;
+    }
+    for (unsigned int t = 0; t < mesh->numMorphTargets; t++) {
+        MorphTarget &target = mesh->morphTargets[t];
+        float *positionDeltas = gatherCorners(aimesh, target.positionDeltas, 3);
+        delete [] target.positionDeltas;
+        target.positionDeltas = positionDeltas;
+        if (target.normalDeltas) {
+            float *normalDeltas = gatherCorners(aimesh, target.normalDeltas, 3);
+            delete [] target.normalDeltas;
+            target.normalDeltas = normalDeltas;
+        }
+    }
+    mesh->numVertices = aimesh->mNumFaces * 3;
+    mesh->numIndices = 0;
+}
+
+Mesh* convertAiMesh(const aiMesh *aimesh) {
+    TraceScope trace("convertAiMesh");
+    if (!aimesh) {
+        std::cerr << "aimesh is null" << std::endl;
+        return 0;
+    }
+    StageTimer timer(STAGE_CONVERT);
+    timer.addInput(calcAiMeshBytes(aimesh), aimesh->mNumVertices);
+    uint32_t numVertices = aimesh->mNumVertices;
+    uint32_t numIndices = aimesh->mNumFaces * 3;
+    uint32_t vertexSize = 0;
+    uint32_t posOffset = 0;
+    uint32_t normalOffset = 0;
+    uint32_t texOffset = 0;
+
+    uint16_t vertexFlags = 0;
+
+    if (aimesh->HasPositions()) {
+        vertexSize += kPositionSize;
+        setHasPositions(vertexFlags);
+    }
+    if (aimesh->HasNormals()) {
+        vertexSize += kNormalsSize;
+        setHasNormals(vertexFlags);
+    }
+
+    unsigned int numTexCoords = aimesh->GetNumUVChannels();
+    numTexCoords = (numTexCoords > kMaxNumTexCoords) ? kMaxNumTexCoords : numTexCoords;
+    vertexSize += numTexCoords * kTextureSize;
+    setHasTexCoords(vertexFlags, numTexCoords);
+
+    unsigned int numColors = aimesh->GetNumColorChannels();
+    numColors = (numColors > kMaxNumColors) ? kMaxNumColors : numColors;
+    vertexSize += numColors * kColorSize;
+    setHasColors(vertexFlags, numColors);
+
+    if (aimesh->HasTangentsAndBitangents()) {
+        vertexSize += kTanSize + kBitanSize;
+        setHasTanBitan(vertexFlags);
+    }
+
+    // the vertices and faces of large meshes are converted in ranges on
+    // several threads
+    float *vertices = new float[vertexSize * numVertices];
+    parallelFor(numVertices, kParallelRange, [=](size_t first, size_t end) {
+        convertAiVertices(aimesh, vertexFlags, vertexSize, numTexCoords, numColors,
+                          first, end, vertices);
+    });
+    // 16 bit indices can not address larger meshes, they become lists of
+    // corners once the skin and the morph targets are converted
+    const bool asCorners = numVertices > kMaxIndexedVertices;
+    uint16_t *indices = 0;
+    if (!asCorners) {
+        indices = new uint16_t[numIndices];
+        parallelFor(aimesh->mNumFaces, kParallelRange, [=](size_t first, size_t end) {
+            for (size_t f = first; f < end; f++) {
+                indices[f * 3] = aimesh->mFaces[f].mIndices[0];
+                indices[f * 3 + 1] = aimesh->mFaces[f].mIndices[1];
+                indices[f * 3 + 2] = aimesh->mFaces[f].mIndices[2];
+            }
+        });
     }
 
     Mesh *mesh = new Mesh();
-    
+
+    size_t nameLength = aimesh->mName.length;
+    if (nameLength >= sizeof(mesh->name)) {
+        nameLength = sizeof(mesh->name) - 1;
+    }
+    memcpy(mesh->name, aimesh->mName.C_Str(), nameLength);
+    mesh->name[nameLength] = 0;
+    mesh->materialIndex = aimesh->mMaterialIndex;
     mesh->flags = vertexFlags;
     mesh->numVertices = numVertices;
     mesh->numIndices = numIndices;
@@ -172,6 +798,17 @@ Mesh* convertAiMesh(const aiMesh *aimesh) {
     mesh->vertices = vertices;
     mesh->indices = indices;
 
+    if (aimesh->HasBones() && !convertAiBones(aimesh, mesh)) {
+        delete mesh;
+        return 0;
+    }
+    if (aimesh->mNumAnimMeshes > 0 && aimesh->HasPositions()) {
+        convertAiAnimMeshes(aimesh, mesh);
+    }
+    if (asCorners) {
+        expandToCorners(aimesh, mesh);
+    }
+    timer.addOutput(calcMeshBytes(mesh), mesh->numVertices);
     return mesh;
 }
 
@@ -303,146 +940,1025 @@ int writeStructOfArraysData(std::ofstream &out, const ObjectData *data) {
     return size;
 }
 
+typedef std::function<void(size_t corner, float *key)> BuildKeyFunction;
+
+// finds for every corner the first corner with an equal key of keySize
+// floats, written by buildKey. The corners are hashed in ranges and every
+// shard of hashes gets its own table, which is filled in corner order so the
+// first corner of a key always wins, like with a map filled serially.
+static void findFirstCorners(size_t numCorners, size_t keySize, const BuildKeyFunction &buildKey,
+        std::vector<uint32_t> &firstCorners) {
+    std::vector<uint64_t> hashes(numCorners);
+    parallelFor(numCorners, kParallelRange, [&](size_t first, size_t end) {
+        std::vector<float> key(keySize);
+        for (size_t i = first; i < end; i++) {
+            buildKey(i, key.data());
+            hashes[i] = hashBytes(key.data(), keySize * sizeof(float));
+        }
+    });
+
+    // counting sort into the shards keeps the corners of a shard in order
+    const uint32_t numShards = 1 << kDedupShardBits;
+    std::vector<size_t> shardStarts(numShards + 1, 0);
+    for (size_t i = 0; i < numCorners; i++) {
+        shardStarts[packBucket(hashes[i], kDedupShardBits) + 1]++;
+    }
+    for (uint32_t shard = 0; shard < numShards; shard++) {
+        shardStarts[shard + 1] += shardStarts[shard];
+    }
+    std::vector<uint32_t> shardCorners(numCorners);
+    std::vector<size_t> shardEnds(shardStarts.begin(), shardStarts.end() - 1);
+    for (size_t i = 0; i < numCorners; i++) {
+        shardCorners[shardEnds[packBucket(hashes[i], kDedupShardBits)]++] = i;
+    }
+
+    firstCorners.resize(numCorners);
+    const uint32_t kEmpty = 0xffffffff;
+    parallelFor(numShards, 1, [&](size_t firstShard, size_t endShard) {
+        std::vector<float> key(keySize);
+        std::vector<float> other(keySize);
+        std::vector<uint32_t> table;
+        for (size_t shard = firstShard; shard < endShard; shard++) {
+            const size_t begin = shardStarts[shard];
+            const size_t end = shardStarts[shard + 1];
+            // open addressing with the lower bits, at most half full
+            size_t tableSize = 16;
+            while (tableSize < 2 * (end - begin)) {
+                tableSize *= 2;
+            }
+            table.assign(tableSize, kEmpty);
+            for (size_t k = begin; k < end; k++) {
+                const uint32_t corner = shardCorners[k];
+                const uint64_t hash = hashes[corner];
+                bool builtKey = false;
+                size_t slot = hash & (tableSize - 1);
+                for (;;) {
+                    const uint32_t known = table[slot];
+                    if (known == kEmpty) {
+                        table[slot] = corner;
+                        firstCorners[corner] = corner;
+                        break;
+                    }
+                    if (hashes[known] == hash) {
+                        if (!builtKey) {
+                            buildKey(corner, key.data());
+                            builtKey = true;
+                        }
+                        buildKey(known, other.data());
+                        if (memcmp(key.data(), other.data(), keySize * sizeof(float)) == 0) {
+                            firstCorners[corner] = known;
+                            break;
+                        }
+                    }
+                    slot = (slot + 1) & (tableSize - 1);
+                }
+            }
+        }
+    });
+}
+
 bool optimizeArrayOfStructs(float *vertices,
             size_t vertexSize,
             size_t vertexCount,
             std::vector<unsigned short> &indicesOut,
             std::vector<Vertex<float> > &verticesOut
             ) {
+    TraceScope trace("optimizeArrayOfStructs");
     // TODO: move the following stuff into an export function
-    std::map<struct Vertex<float>, unsigned short> mymap;
-    unsigned short index;
-    for (int i = 0; i < vertexCount; i++) {
-        struct Vertex<float> vertex(8);
-        float *a = vertices + (i * vertexSize);
-        memcpy(vertex.array, a, vertexSize * sizeof(float));
-        bool found = findVertexIndex(mymap, vertex, index);
-        if (!found) {
+    std::vector<uint32_t> firstCorners;
+    findFirstCorners(vertexCount, vertexSize, [=](size_t corner, float *key) {
+        memcpy(key, vertices + corner * vertexSize, vertexSize * sizeof(float));
+    }, firstCorners);
+    const size_t indexOffset = indicesOut.size();
+    for (size_t i = 0; i < vertexCount; i++) {
+        if (firstCorners[i] == i) {
+            if (verticesOut.size() == kMaxIndexedVertices) {
+                std::cerr << "more distinct vertices than 16 bit indices can address"
+                          << std::endl;
+                return false;
+            }
+            struct Vertex<float> vertex(vertexSize);
+            memcpy(vertex.array, vertices + (i * vertexSize), vertexSize * sizeof(float));
             verticesOut.push_back(vertex);
             unsigned short newIndex =
                     (unsigned short) verticesOut.size() - 1;
             indicesOut.push_back(newIndex);
-            mymap[vertex] = newIndex;
         } else {
-            indicesOut.push_back(index);
+            indicesOut.push_back(indicesOut[indexOffset + firstCorners[i]]);
         }
     }
     return true;
 }
 
-void writeElementArray(std::ofstream &out, const Mesh *mesh, unsigned int offset, size_t elementSize) {
-    float *vertices = mesh->vertices;
-    unsigned int numVertices = mesh->numVertices;
-    size_t vertexSize = mesh->vertexSize;
+// copies one attribute of the vertices first to end to the array of that
+// attribute, returns the end of the whole array
+static float* copyElementArray(const Mesh *mesh, unsigned int offset, size_t elementSize,
+        size_t first, size_t end, float *array) {
+    const float *vertices = mesh->vertices;
+    const size_t vertexSize = mesh->vertexSize;
 
-    for (int i = offset; i < numVertices * vertexSize; i += vertexSize) {
-        out.write((char*) &vertices[i], elementSize * sizeof(float));
+    for (size_t i = first; i < end; i++) {
+        memcpy(array + i * elementSize, vertices + i * vertexSize + offset,
+               elementSize * sizeof(float));
     }
+    return array + mesh->numVertices * elementSize;
 }
 
-bool writeObject(std::ofstream &out, const Mesh* mesh,
-        bool doOptimize, bool useStructOfArrays) {
+// copies every attribute of the vertices first to end into its array
+static void transposeVertexRange(const Mesh *mesh, size_t first, size_t end, float *array) {
+    const unsigned short vertexFlags = mesh->flags;
+    if (hasPositions(vertexFlags)) {
+        array = copyElementArray(mesh, positionOffset(), kPositionSize, first, end, array);
+    }
+    if (hasNormals(vertexFlags)) {
+        array = copyElementArray(mesh, normalsOffset(), kNormalsSize, first, end, array);
+    }
+    if (hasTexCoords0(vertexFlags)) {
+        array = copyElementArray(mesh, texCoords0Offset(vertexFlags), kTextureSize, first, end,
+                                 array);
+    }
+    if (hasTexCoords1(vertexFlags)) {
+        array = copyElementArray(mesh, texCoords1Offset(vertexFlags), kTextureSize, first, end,
+                                 array);
+    }
+    if (hasTexCoords2(vertexFlags)) {
+        array = copyElementArray(mesh, texCoords2Offset(vertexFlags), kTextureSize, first, end,
+                                 array);
+    }
+    if (hasTexCoords3(vertexFlags)) {
+        array = copyElementArray(mesh, texCoords3Offset(vertexFlags), kTextureSize, first, end,
+                                 array);
+    }
+    if (hasColor0(vertexFlags)) {
+        array = copyElementArray(mesh, color0Offset(vertexFlags), kColorSize, first, end, array);
+    }
+    if (hasColor1(vertexFlags)) {
+        array = copyElementArray(mesh, color1Offset(vertexFlags), kColorSize, first, end, array);
+    }
+    if (hasColor2(vertexFlags)) {
+        array = copyElementArray(mesh, color2Offset(vertexFlags), kColorSize, first, end, array);
+    }
+    if (hasColor3(vertexFlags)) {
+        array = copyElementArray(mesh, color3Offset(vertexFlags), kColorSize, first, end, array);
+    }
+    if (hasTanBitan(vertexFlags)) {
+        array = copyElementArray(mesh, tanOffset(vertexFlags), kTanSize, first, end, array);
+        array = copyElementArray(mesh, bitanOffset(vertexFlags), kBitanSize, first, end, array);
+    }
+}
 
-    if (!mesh) {
-        std::cerr << "mesh is null" << std::endl;
-        return false;
+// the vertices of the mesh as struct of arrays, counted as the layout stage.
+// Large meshes are transposed in ranges of vertices on several threads.
+static void transposeVertices(const Mesh *mesh, std::vector<float> &arrays) {
+    TraceScope trace("transposeVertices");
+    StageTimer timer(STAGE_LAYOUT);
+    const uint64_t vertexBytes = (uint64_t) mesh->numVertices * mesh->vertexSize * sizeof(float);
+    timer.addInput(vertexBytes, mesh->numVertices);
+    arrays.resize(mesh->numVertices * mesh->vertexSize);
+    float *array = arrays.data();
+    parallelFor(mesh->numVertices, kParallelRange, [=](size_t first, size_t end) {
+        transposeVertexRange(mesh, first, end, array);
+    });
+    timer.addOutput(vertexBytes, mesh->numVertices);
+}
+
+// rounds the weights of one vertex to unorm values that sum up to exactly
+// maxValue. The rounding error goes to the first, largest weight.
+template<typename T>
+static void quantizeWeights(const float *weights, T *quantized, unsigned int maxValue) {
+    unsigned int sum = 0;
+    for (unsigned int i = 0; i < kMaxBoneInfluences; i++) {
+        quantized[i] = (T) (weights[i] * maxValue + 0.5f);
+        sum += quantized[i];
     }
+    quantized[0] += (T) (maxValue - sum);
+}
 
-    const unsigned short vertexFlags = mesh->flags;
+// quantized weights of a single vertex in the size given by the flags, returns the size
+static size_t quantizeVertexWeights(const Mesh *mesh, size_t vertex, void *quantized) {
+    const float *weights = &mesh->boneWeights[vertex * kMaxBoneInfluences];
+    if (uses16BitWeights(mesh->flags)) {
+        quantizeWeights(weights, (uint16_t*) quantized, 0xffff);
+    } else {
+        quantizeWeights(weights, (uint8_t*) quantized, 0xff);
+    }
+    return kMaxBoneInfluences * calcBoneWeightSize(mesh->flags);
+}
 
-    if (doOptimize) {
-        std::vector<unsigned short> indicesOut;
-        std::vector<Vertex<float> > verticesOut;
-        optimizeArrayOfStructs(mesh->vertices, mesh->vertexSize,
-                               mesh->numVertices,
-                               indicesOut, verticesOut);
-        ObjectHeader *header = createObjectHeader(mesh->flags, verticesOut.size(),
-                                                 indicesOut.size(), mesh->numBones,
-                                                 mesh->vertexSize, useStructOfArrays);
-        writeObjectHeader(out, header);
-        delete header;
-
-        // after this point create struct of arrays or leave as is
-        if (useStructOfArrays) {
-            ObjectData *data = convertArrayOfStructsToStructOfArrays(verticesOut, vertexFlags,
-                                                                     mesh->vertexSize);
-            writeStructOfArraysData(out, data);
-            delete data;
-        } else {
-            writeArrayOfStructsData(out, verticesOut);
+static void writeSkin(std::ofstream &out, const Mesh *mesh) {
+    out.write((char*) mesh->bones, mesh->numBones * sizeof(BoneData));
+    out.write((char*) mesh->boneIndices, mesh->numVertices * kMaxBoneInfluences);
+    for (size_t i = 0; i < mesh->numVertices; i++) {
+        uint16_t quantized[kMaxBoneInfluences];
+        const size_t size = quantizeVertexWeights(mesh, i, quantized);
+        out.write((char*) quantized, size);
+    }
+}
+
+Mesh* createOptimizedMesh(const Mesh *mesh) {
+    TraceScope trace("createOptimizedMesh");
+    StageTimer timer(STAGE_DEDUP);
+    timer.addInput(calcMeshBytes(mesh), mesh->numVertices);
+    const size_t vertexSize = mesh->vertexSize;
+    const bool hasSkin = hasBones(mesh->flags);
+    // the skin takes part in the comparison as it is written, with quantized
+    // weights: one slot for the bone indices and up to two for the weights
+    const size_t skinSize = kMaxBoneInfluences * (1 + sizeof(uint16_t));
+    const size_t morphOffset = vertexSize + (hasSkin ? skinSize / sizeof(float) : 0);
+    // vertices only stay equal if every morph target moves them the same way
+    const size_t keySize = morphOffset + mesh->numMorphTargets * 6;
+    // corners are visited through the indices, meshes without indices are
+    // a list of corners
+    const size_t numCorners = mesh->numIndices > 0 ? mesh->numIndices : mesh->numVertices;
+
+    std::vector<uint32_t> firstCorners;
+    findFirstCorners(numCorners, keySize, [=](size_t corner, float *key) {
+        const unsigned int source = mesh->numIndices > 0 ? mesh->indices[corner] : corner;
+        memset(key, 0, keySize * sizeof(float));
+        memcpy(key, mesh->vertices + source * vertexSize, vertexSize * sizeof(float));
+        if (hasSkin) {
+            char *skin = (char*) (key + vertexSize);
+            memcpy(skin, &mesh->boneIndices[source * kMaxBoneInfluences], kMaxBoneInfluences);
+            quantizeVertexWeights(mesh, source, skin + kMaxBoneInfluences);
         }
-        out.write((char*) &indicesOut[0],
-            indicesOut.size() * sizeof(uint16_t));
-    } else {
-        ObjectHeader *header = createObjectHeader(mesh->flags, mesh->numVertices,
-                                                 mesh->numIndices, mesh->numBones,
-                                                 mesh->vertexSize, useStructOfArrays);
-        writeObjectHeader(out, header);
-        delete header;
-
-        // write struct of arrays
-        if (useStructOfArrays) {
-            if (hasPositions(vertexFlags)) {
-                writeElementArray(out, mesh, positionOffset(), kPositionSize);
-            }
-            if (hasNormals(vertexFlags)) {
-                writeElementArray(out, mesh, normalsOffset(), kNormalsSize);
-            }
-            if (hasTexCoords0(vertexFlags)) {
-                writeElementArray(out, mesh, texCoords0Offset(vertexFlags), kTextureSize);
-            }
-            if (hasTexCoords1(vertexFlags)) {
-                writeElementArray(out, mesh, texCoords1Offset(vertexFlags), kTextureSize);
+        for (unsigned int t = 0; t < mesh->numMorphTargets; t++) {
+            const MorphTarget &target = mesh->morphTargets[t];
+            float *deltas = key + morphOffset + t * 6;
+            memcpy(deltas, target.positionDeltas + source * 3, 3 * sizeof(float));
+            if (target.normalDeltas) {
+                memcpy(deltas + 3, target.normalDeltas + source * 3, 3 * sizeof(float));
             }
-            if (hasTexCoords2(vertexFlags)) {
-                writeElementArray(out, mesh, texCoords2Offset(vertexFlags), kTextureSize);
-            }
-            if (hasTexCoords3(vertexFlags)) {
-                writeElementArray(out, mesh, texCoords3Offset(vertexFlags), kTextureSize);
-            }
-            if (hasColor0(vertexFlags)) {
-                writeElementArray(out, mesh, color0Offset(vertexFlags), kColorSize);
-            }
-            if (hasColor1(vertexFlags)) {
-                writeElementArray(out, mesh, color1Offset(vertexFlags), kColorSize);
-            }
-            if (hasColor2(vertexFlags)) {
-                writeElementArray(out, mesh, color2Offset(vertexFlags), kColorSize);
-            }
-            if (hasColor3(vertexFlags)) {
-                writeElementArray(out, mesh, color3Offset(vertexFlags), kColorSize);
-            }
-            if (hasTanBitan(vertexFlags)) {
-                writeElementArray(out, mesh, tanOffset(vertexFlags), kTanSize);
-                writeElementArray(out, mesh, bitanOffset(vertexFlags), kBitanSize);
+        }
+    }, firstCorners);
+
+    // vertices are numbered in the order of their first corner
+    std::vector<unsigned int> sourceVertices;
+    std::vector<unsigned short> indices;
+    indices.reserve(numCorners);
+    for (size_t i = 0; i < numCorners; i++) {
+        if (firstCorners[i] != i) {
+            indices.push_back(indices[firstCorners[i]]);
+            continue;
+        }
+        // not an error, the callers keep the mesh as it is
+        if (sourceVertices.size() == kMaxIndexedVertices) {
+            return 0;
+        }
+        indices.push_back((unsigned short) sourceVertices.size());
+        sourceVertices.push_back(mesh->numIndices > 0 ? mesh->indices[i] : i);
+    }
+
+    Mesh *optimized = new Mesh();
+    memcpy(optimized->name, mesh->name, sizeof(mesh->name));
+    optimized->flags = mesh->flags;
+    optimized->vertexSize = vertexSize;
+    optimized->numColors = mesh->numColors;
+    optimized->numTexCoords = mesh->numTexCoords;
+    optimized->numVertices = sourceVertices.size();
+    optimized->numIndices = indices.size();
+    optimized->vertices = new float[sourceVertices.size() * vertexSize];
+    optimized->indices = new unsigned short[indices.size()];
+    std::copy(indices.begin(), indices.end(), optimized->indices);
+    for (size_t i = 0; i < sourceVertices.size(); i++) {
+        memcpy(optimized->vertices + i * vertexSize, mesh->vertices + sourceVertices[i] * vertexSize,
+               vertexSize * sizeof(float));
+    }
+    if (hasSkin) {
+        const size_t numInfluences = sourceVertices.size() * kMaxBoneInfluences;
+        optimized->numBones = mesh->numBones;
+        optimized->bones = new BoneData[mesh->numBones];
+        std::copy(mesh->bones, mesh->bones + mesh->numBones, optimized->bones);
+        optimized->boneIndices = new unsigned char[numInfluences];
+        optimized->boneWeights = new float[numInfluences];
+        for (size_t i = 0; i < sourceVertices.size(); i++) {
+            const size_t from = sourceVertices[i] * kMaxBoneInfluences;
+            std::copy(mesh->boneIndices + from, mesh->boneIndices + from + kMaxBoneInfluences,
+                      optimized->boneIndices + i * kMaxBoneInfluences);
+            std::copy(mesh->boneWeights + from, mesh->boneWeights + from + kMaxBoneInfluences,
+                      optimized->boneWeights + i * kMaxBoneInfluences);
+        }
+    }
+    optimized->quantizeMorphTargets = mesh->quantizeMorphTargets;
+    optimized->storeBvh = mesh->storeBvh;
+    optimized->materialIndex = mesh->materialIndex;
+    if (mesh->numMorphTargets > 0) {
+        optimized->numMorphTargets = mesh->numMorphTargets;
+        optimized->morphTargets = new MorphTarget[mesh->numMorphTargets];
+        for (unsigned int t = 0; t < mesh->numMorphTargets; t++) {
+            const MorphTarget &target = mesh->morphTargets[t];
+            MorphTarget &copy = optimized->morphTargets[t];
+            copy.nameHash = target.nameHash;
+            copy.positionDeltas = new float[sourceVertices.size() * 3];
+            copy.normalDeltas = target.normalDeltas ? new float[sourceVertices.size() * 3] : 0;
+            for (size_t i = 0; i < sourceVertices.size(); i++) {
+                memcpy(copy.positionDeltas + i * 3, target.positionDeltas + sourceVertices[i] * 3,
+                       3 * sizeof(float));
+                if (copy.normalDeltas) {
+                    memcpy(copy.normalDeltas + i * 3, target.normalDeltas + sourceVertices[i] * 3,
+                           3 * sizeof(float));
+                }
             }
-        } else {
-            // write array of structs
-            out.write((char*) mesh->vertices,
-                      mesh->numVertices * mesh->vertexSize * sizeof(float));
         }
-        // write indices
-        out.write((char*) mesh->indices, mesh->numIndices * sizeof(uint16_t));
     }
+    timer.addOutput(calcMeshBytes(optimized), optimized->numVertices);
+    return optimized;
+}
+
+#ifdef __SSE2__
+// loads x, y, z into the lower three lanes without touching the float behind them
+static inline __m128 loadPosition(const float *position) {
+    const __m128 xy = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*) position);
+    return _mm_movelh_ps(xy, _mm_load_ss(position + 2));
+}
+
+void calcBounds(const Mesh *mesh, ObjectHeader *header) {
+    memset(header->boundsMin, 0, sizeof(header->boundsMin));
+    memset(header->boundsMax, 0, sizeof(header->boundsMax));
+    memset(header->sphereCenter, 0, sizeof(header->sphereCenter));
+    header->sphereRadius = 0.0f;
+    if (!hasPositions(mesh->flags) || mesh->numVertices == 0) {
+        return;
+    }
+    const size_t stride = mesh->vertexSize;
+    const float *positions = mesh->vertices + positionOffset();
+    __m128 low = loadPosition(positions);
+    __m128 high = low;
+    for (size_t i = 1; i < mesh->numVertices; i++) {
+        const __m128 position = loadPosition(positions + i * stride);
+        low = _mm_min_ps(low, position);
+        high = _mm_max_ps(high, position);
+    }
+    const __m128 center = _mm_mul_ps(_mm_add_ps(low, high), _mm_set1_ps(0.5f));
+    __m128 radius = _mm_setzero_ps();
+    for (size_t i = 0; i < mesh->numVertices; i++) {
+        const __m128 d = _mm_sub_ps(loadPosition(positions + i * stride), center);
+        const __m128 squared = _mm_mul_ps(d, d);
+        // x + y + z in the lowest lane, the fourth lane is 0
+        const __m128 sum = _mm_add_ps(squared, _mm_movehl_ps(squared, squared));
+        radius = _mm_max_ss(radius, _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1)));
+    }
+    float values[4];
+    _mm_storeu_ps(values, low);
+    memcpy(header->boundsMin, values, sizeof(header->boundsMin));
+    _mm_storeu_ps(values, high);
+    memcpy(header->boundsMax, values, sizeof(header->boundsMax));
+    _mm_storeu_ps(values, center);
+    memcpy(header->sphereCenter, values, sizeof(header->sphereCenter));
+    header->sphereRadius = sqrtf(_mm_cvtss_f32(radius));
+}
+#else
+void calcBounds(const Mesh *mesh, ObjectHeader *header) {
+    memset(header->boundsMin, 0, sizeof(header->boundsMin));
+    memset(header->boundsMax, 0, sizeof(header->boundsMax));
+    memset(header->sphereCenter, 0, sizeof(header->sphereCenter));
+    header->sphereRadius = 0.0f;
+    if (!hasPositions(mesh->flags) || mesh->numVertices == 0) {
+        return;
+    }
+    const size_t stride = mesh->vertexSize;
+    const float *positions = mesh->vertices + positionOffset();
+    memcpy(header->boundsMin, positions, sizeof(header->boundsMin));
+    memcpy(header->boundsMax, positions, sizeof(header->boundsMax));
+    for (size_t i = 1; i < mesh->numVertices; i++) {
+        for (unsigned int k = 0; k < 3; k++) {
+            const float value = positions[i * stride + k];
+            header->boundsMin[k] = value < header->boundsMin[k] ? value : header->boundsMin[k];
+            header->boundsMax[k] = value > header->boundsMax[k] ? value : header->boundsMax[k];
+        }
+    }
+    float radius = 0.0f;
+    for (unsigned int k = 0; k < 3; k++) {
+        header->sphereCenter[k] = (header->boundsMin[k] + header->boundsMax[k]) * 0.5f;
+    }
+    for (size_t i = 0; i < mesh->numVertices; i++) {
+        float squared = 0.0f;
+        for (unsigned int k = 0; k < 3; k++) {
+            const float d = positions[i * stride + k] - header->sphereCenter[k];
+            squared += d * d;
+        }
+        radius = squared > radius ? squared : radius;
+    }
+    header->sphereRadius = sqrtf(radius);
+}
+#endif
+
+static bool checkSkin(const Mesh *mesh) {
+    if (hasBones(mesh->flags) && (!mesh->bones || !mesh->boneIndices || !mesh->boneWeights)) {
+        std::cerr << "mesh has the bones flag but no skin" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// writes mesh as it is, the indices of shared buffers are relative to the
+// first vertex of their draw range and may address more than 16 bit
+static void writeModel(std::ofstream &out, const Mesh *mesh, bool useStructOfArrays,
+        uint32_t materialIndex) {
+    ObjectHeader *header = createObjectHeader(mesh->flags, mesh->numVertices,
+                                             mesh->numIndices, mesh->numBones,
+                                             mesh->vertexSize, useStructOfArrays);
+    calcBounds(mesh, header);
+    header->materialIndex = materialIndex;
+    writeObjectHeader(out, header);
+    delete header;
+    addStageOutput(STAGE_WRITE, 0, mesh->numVertices);
+
+    // write struct of arrays, transposed in memory and written at once
+    if (useStructOfArrays) {
+        std::vector<float> arrays;
+        transposeVertices(mesh, arrays);
+        out.write((char*) arrays.data(), arrays.size() * sizeof(float));
+    } else {
+        // write array of structs
+        out.write((char*) mesh->vertices,
+                  mesh->numVertices * mesh->vertexSize * sizeof(float));
+    }
+    // write indices
+    out.write((char*) mesh->indices, mesh->numIndices * sizeof(uint16_t));
+    if (hasBones(mesh->flags)) {
+        writeSkin(out, mesh);
+    }
+}
+
+bool writeObject(std::ofstream &out, const Mesh* mesh,
+        bool doOptimize, bool useStructOfArrays, uint32_t materialIndex) {
+    TraceScope trace("writeObject");
+
+    if (!mesh) {
+        std::cerr << "mesh is null" << std::endl;
+        return false;
+    }
+    if (!checkSkin(mesh)) {
+        return false;
+    }
+
+    if (doOptimize) {
+        // meshes that can not be indexed are written as they are
+        Mesh *optimized = createOptimizedMesh(mesh);
+        const bool success = writeObject(out, optimized ? optimized : mesh, false,
+                                         useStructOfArrays, materialIndex);
+        delete optimized;
+        return success;
+    }
+    // larger meshes have to be lists of corners
+    if (mesh->numIndices > 0 && mesh->numVertices > kMaxIndexedVertices) {
+        std::cerr << "mesh has more vertices than 16 bit indices can address: "
+                  << mesh->numVertices << std::endl;
+        return false;
+    }
+    writeModel(out, mesh, useStructOfArrays, materialIndex);
     return true;
 }
 
+static bool writeMorphTargets(std::ofstream &out, const Mesh *mesh) {
+    std::vector<uint8_t> data;
+    BlockHeader header;
+    memset(&header, 0, sizeof(BlockHeader));
+    if (!encodeMorphTargets(mesh->morphTargets, mesh->numMorphTargets, mesh->numVertices,
+                            mesh->quantizeMorphTargets, data, header.flags)) {
+        return false;
+    }
+    header.type = MORPH_TARGETS;
+    header.elementCount = mesh->numMorphTargets;
+    header.dataSize = data.size();
+    out.write((char*) &header, sizeof(BlockHeader));
+    out.write((char*) &data[0], data.size());
+    return true;
+}
+
+static bool writeBvh(std::ofstream &out, const Mesh *mesh) {
+    if (!(mesh->flags & HAS_POSITIONS)) {
+        std::cerr << "a BVH needs positions: " << mesh->name << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> data;
+    // the nodes are aligned relative to the position in the file
+    const size_t dataOffset = (size_t) out.tellp() + sizeof(BlockHeader);
+    // lists of corners have a triangle for every three vertices
+    const bool indexed = mesh->numIndices > 0;
+    if (!buildBvh(mesh->vertices + positionOffset(), mesh->vertexSize, mesh->numVertices,
+                  indexed ? mesh->indices : 0, indexed ? mesh->numIndices : mesh->numVertices,
+                  dataOffset, data)) {
+        return false;
+    }
+    BlockHeader header;
+    memset(&header, 0, sizeof(BlockHeader));
+    header.type = BVH;
+    header.elementCount = ((const BvhHeader*) &data[0])->nodeCount;
+    header.dataSize = data.size();
+    out.write((char*) &header, sizeof(BlockHeader));
+    out.write((char*) &data[0], data.size());
+    return true;
+}
+
+static bool hasMeshBlocks(const Mesh *mesh) {
+    return mesh && (mesh->numMorphTargets > 0 || mesh->storeBvh);
+}
+
+// writes the model, its morph targets and its BVH. The blocks refer to the
+// written vertices, so the mesh is optimized only once for all of them.
+static bool writeMeshObjects(std::ofstream &out, const Mesh *mesh,
+        bool doOptimize, bool useStructOfArrays, uint32_t materialIndex = kNoMaterial) {
+    if (!hasMeshBlocks(mesh)) {
+        return writeObject(out, mesh, doOptimize, useStructOfArrays, materialIndex);
+    }
+    Mesh *optimized = doOptimize ? createOptimizedMesh(mesh) : 0;
+    const Mesh *source = optimized ? optimized : mesh;
+    bool success = writeObject(out, source, false, useStructOfArrays, materialIndex);
+    if (success && source->numMorphTargets > 0) {
+        success = writeMorphTargets(out, source);
+    }
+    if (success && source->storeBvh) {
+        success = writeBvh(out, source);
+    }
+    delete optimized;
+    return success;
+}
+
+// the meshes are the input of the write stage
+static void addWriteInput(StageTimer &timer, const std::vector<Mesh*> &meshes) {
+    for (size_t i = 0; i < meshes.size(); i++) {
+        if (meshes[i]) {
+            timer.addInput(calcMeshBytes(meshes[i]), meshes[i]->numVertices);
+        }
+    }
+}
+
+// morph targets and BVH take an object each
+static size_t countMeshObjects(const Mesh *mesh) {
+    size_t count = 1;
+    if (mesh && mesh->numMorphTargets > 0) {
+        count++;
+    }
+    if (mesh && mesh->storeBvh) {
+        count++;
+    }
+    return count;
+}
+
+static size_t countMeshObjects(const std::vector<Mesh*> &meshes) {
+    size_t count = 0;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        count += countMeshObjects(meshes[i]);
+    }
+    return count;
+}
+
 bool writeFile(const char *path, const std::vector<Mesh*> *meshes,
         bool doOptimize, bool useStructOfArrays) {
-    
+    TraceScope trace("writeFile");
+    StageTimer timer(STAGE_WRITE);
+    addWriteInput(timer, *meshes);
+    const size_t numObjects = countMeshObjects(*meshes);
+    if (numObjects > 255) {
+        std::cerr << "too many objects for one file: " << numObjects << std::endl;
+        return false;
+    }
+    std::ofstream out(path, std::ios::trunc | std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "could not open file: " << path << std::endl;
+        return false;
+    }
+    FileHeader *fileHeader = createFileHeader(numObjects);
+    writeFileHeader(out, fileHeader);
+    delete fileHeader;
+
+    bool success = true;
+    for (size_t i = 0; i < meshes->size() && success; i++) {
+        success = writeMeshObjects(out, meshes->at(i), doOptimize, useStructOfArrays);
+    }
+    out.close();
+    timer.addOutput(fileSize(path), 0);
+    return success && !out.fail();
+}
+
+bool streamModel(const char *path, const char *outPath, bool doOptimize,
+        bool useStructOfArrays, PrepareMeshFunction prepare, void *userData) {
+    TraceScope trace("streamModel");
+    Assimp::Importer importer;
+    if (!importScene(importer, path, modelImporterFlags(false))) {
+        std::cerr << importer.GetErrorString() << std::endl;
+        return false;
+    }
+    // taken from the importer, so every assimp mesh can be freed once converted
+    aiScene *scene = importer.GetOrphanedScene();
+    if (!scene->HasMeshes()) {
+        std::cerr << "scene does not have meshes" << std::endl;
+        delete scene;
+        return false;
+    }
+    std::ofstream out(outPath, std::ios::trunc | std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "could not open file: " << outPath << std::endl;
+        delete scene;
+        return false;
+    }
+    // the object count is patched in after the last object
+    FileHeader *fileHeader = createFileHeader(0);
+    writeFileHeader(out, fileHeader);
+
+    size_t numObjects = 0;
+    bool success = true;
+    for (unsigned int i = 0; i < scene->mNumMeshes && success; i++) {
+        Mesh *mesh = convertAiMesh(scene->mMeshes[i]);
+        delete scene->mMeshes[i];
+        scene->mMeshes[i] = 0;
+        if (!mesh) {
+            std::cerr << "problem converting mesh" << std::endl;
+            continue;
+        }
+        if (prepare) {
+            prepare(mesh, userData);
+        }
+        if (numObjects + countMeshObjects(mesh) > 255) {
+            std::cerr << "too many objects for one file: " << numObjects + countMeshObjects(mesh)
+                      << std::endl;
+            success = false;
+        } else {
+            StageTimer timer(STAGE_WRITE);
+            timer.addInput(calcMeshBytes(mesh), mesh->numVertices);
+            success = writeMeshObjects(out, mesh, doOptimize, useStructOfArrays);
+            numObjects += countMeshObjects(mesh);
+        }
+        delete mesh;
+    }
+    delete scene;
+
+    out.seekp(0);
+    fileHeader->objectCount = numObjects;
+    writeFileHeader(out, fileHeader);
+    delete fileHeader;
+    out.close();
+    addStageOutput(STAGE_WRITE, fileSize(outPath), 0);
+    return success && !out.fail();
+}
+
+bool writeSceneFile(const char *path, const Scene *scene,
+        bool doOptimize, bool useStructOfArrays, float sampleRate, float tolerance) {
+    TraceScope trace("writeSceneFile");
+    StageTimer timer(STAGE_WRITE);
+    addWriteInput(timer, scene->meshes);
+    // the material table, the meshes, one object for the instance table, one
+    // per animation and one per texture
+    const size_t numObjects = (scene->materials.empty() ? 0 : 1) +
+                              countMeshObjects(scene->meshes) +
+                              (scene->instances.empty() ? 0 : 1) + scene->animations.size() +
+                              scene->textures.size();
+    if (numObjects > 255) {
+        std::cerr << "too many objects for one file: " << numObjects << std::endl;
+        return false;
+    }
+    std::vector<std::vector<uint8_t> > clips(scene->animations.size());
+    for (size_t i = 0; i < scene->animations.size(); i++) {
+        if (!compressAnimation(scene->animations[i], clips[i], sampleRate, tolerance)) {
+            return false;
+        }
+    }
+    std::vector<MipChain> mipChains;
+    if (!generateMipChains(scene->textures, scene->mipFilter, mipChains)) {
+        return false;
+    }
+    // the instances refer to meshes, the file to the objects of their models
+    std::vector<uint32_t> modelObjects;
+    size_t objectIndex = scene->materials.empty() ? 0 : 1;
+    for (size_t i = 0; i < scene->meshes.size(); i++) {
+        modelObjects.push_back(objectIndex);
+        objectIndex += countMeshObjects(scene->meshes[i]);
+    }
+    std::vector<Instance> instances(scene->instances);
+    for (size_t i = 0; i < instances.size(); i++) {
+        if (instances[i].objectIndex >= modelObjects.size()) {
+            std::cerr << "instance of a missing mesh: " << instances[i].objectIndex << std::endl;
+            return false;
+        }
+        instances[i].objectIndex = modelObjects[instances[i].objectIndex];
+    }
+    std::ofstream out(path, std::ios::trunc | std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "could not open file: " << path << std::endl;
+        return false;
+    }
+    FileHeader *fileHeader = createFileHeader(numObjects);
+    writeFileHeader(out, fileHeader);
+    delete fileHeader;
+
+    BlockHeader header;
+    memset(&header, 0, sizeof(BlockHeader));
+    // the table comes first, so a reader knows the materials of the models
+    if (!scene->materials.empty()) {
+        std::vector<uint8_t> data;
+        encodeMaterials(scene->materials, scene->textures, data);
+        header.type = MATERIALS;
+        header.elementCount = scene->materials.size();
+        header.dataSize = data.size();
+        out.write((char*) &header, sizeof(BlockHeader));
+        out.write((char*) &data[0], header.dataSize);
+    }
+    for (size_t i = 0; i < scene->meshes.size(); i++) {
+        const Mesh *mesh = scene->meshes[i];
+        const uint32_t materialIndex = mesh && mesh->materialIndex < scene->materials.size() ?
+                                       mesh->materialIndex : kNoMaterial;
+        if (!writeMeshObjects(out, mesh, doOptimize, useStructOfArrays, materialIndex)) {
+            return false;
+        }
+    }
+    if (!instances.empty()) {
+        header.type = INSTANCES;
+        header.elementCount = instances.size();
+        header.dataSize = instances.size() * sizeof(Instance);
+        out.write((char*) &header, sizeof(BlockHeader));
+        out.write((char*) &instances[0], header.dataSize);
+    }
+    for (size_t i = 0; i < clips.size(); i++) {
+        header.type = ANIMATION;
+        header.elementCount = scene->animations[i].tracks.size();
+        header.dataSize = clips[i].size();
+        out.write((char*) &header, sizeof(BlockHeader));
+        out.write((char*) &clips[i][0], header.dataSize);
+    }
+    for (size_t i = 0; i < scene->textures.size(); i++) {
+        std::vector<uint8_t> data;
+        // the levels are aligned relative to the position in the file
+        const size_t dataOffset = (size_t) out.tellp() + sizeof(BlockHeader);
+        if (!encodeTexture(scene->textures[i], mipChains[i], dataOffset, data)) {
+            return false;
+        }
+        header.type = TEXTURE;
+        header.flags = scene->textures[i].flags;
+        header.elementCount = mipChains[i].size();
+        header.dataSize = data.size();
+        out.write((char*) &header, sizeof(BlockHeader));
+        out.write((char*) &data[0], header.dataSize);
+    }
+    out.close();
+    timer.addOutput(fileSize(path), 0);
+    return !out.fail();
+}
+
+static void writeDrawRanges(std::ofstream &out, const std::vector<DrawRange> &ranges) {
+    BlockHeader header;
+    memset(&header, 0, sizeof(BlockHeader));
+    header.type = DRAW_RANGES;
+    header.elementCount = ranges.size();
+    header.dataSize = ranges.size() * (sizeof(DrawRange) + sizeof(DrawCommand));
+    out.write((char*) &header, sizeof(BlockHeader));
+    out.write((char*) &ranges[0], ranges.size() * sizeof(DrawRange));
+    for (size_t i = 0; i < ranges.size(); i++) {
+        DrawCommand command;
+        command.indexCount = ranges[i].indexCount;
+        command.instanceCount = 1;
+        command.firstIndex = ranges[i].firstIndex;
+        command.baseVertex = ranges[i].firstVertex;
+        command.baseInstance = i;
+        out.write((char*) &command, sizeof(DrawCommand));
+    }
+}
+
+// concatenates the vertices and indices of all meshes of a group into one
+// mesh. Indices stay relative to the first vertex of their mesh, the draw
+// ranges supply the base vertex to add when drawing.
+static Mesh* createSharedMesh(const std::vector<const Mesh*> &group,
+        std::vector<DrawRange> &ranges) {
+    const size_t vertexSize = group[0]->vertexSize;
+    const bool hasSkin = hasBones(group[0]->flags);
+    std::vector<float> vertices;
+    std::vector<unsigned short> indices;
+    std::vector<unsigned char> boneIndices;
+    std::vector<float> boneWeights;
+    for (size_t i = 0; i < group.size(); i++) {
+        const Mesh *mesh = group[i];
+        const size_t numInfluences = mesh->numVertices * kMaxBoneInfluences;
+        DrawRange range;
+        range.firstVertex = vertices.size() / vertexSize;
+        range.firstIndex = indices.size();
+        range.vertexCount = mesh->numVertices;
+        range.indexCount = mesh->numIndices;
+        vertices.insert(vertices.end(), mesh->vertices,
+                        mesh->vertices + mesh->numVertices * vertexSize);
+        indices.insert(indices.end(), mesh->indices, mesh->indices + mesh->numIndices);
+        if (hasSkin) {
+            boneIndices.insert(boneIndices.end(), mesh->boneIndices,
+                               mesh->boneIndices + numInfluences);
+            boneWeights.insert(boneWeights.end(), mesh->boneWeights,
+                               mesh->boneWeights + numInfluences);
+        }
+        ranges.push_back(range);
+    }
+
+    Mesh *shared = new Mesh();
+    shared->flags = group[0]->flags;
+    shared->vertexSize = vertexSize;
+    shared->numVertices = vertices.size() / vertexSize;
+    shared->numIndices = indices.size();
+    shared->vertices = new float[vertices.size()];
+    shared->indices = new unsigned short[indices.size()];
+    std::copy(vertices.begin(), vertices.end(), shared->vertices);
+    std::copy(indices.begin(), indices.end(), shared->indices);
+    if (hasSkin) {
+        // skinned meshes are never grouped, the bones belong to the only mesh
+        shared->numBones = group[0]->numBones;
+        shared->bones = new BoneData[shared->numBones];
+        std::copy(group[0]->bones, group[0]->bones + shared->numBones, shared->bones);
+        shared->boneIndices = new unsigned char[boneIndices.size()];
+        shared->boneWeights = new float[boneWeights.size()];
+        std::copy(boneIndices.begin(), boneIndices.end(), shared->boneIndices);
+        std::copy(boneWeights.begin(), boneWeights.end(), shared->boneWeights);
+    }
+    return shared;
+}
+
+// writes a model and its draw ranges per group
+static bool writeSharedGroups(const char *path,
+        const std::vector<std::vector<const Mesh*> > &groups, bool useStructOfArrays) {
+    const size_t numObjects = groups.size() * 2;
+    if (numObjects > 255) {
+        std::cerr << "too many vertex formats for one file: " << groups.size() << std::endl;
+        return false;
+    }
+
     std::ofstream out(path, std::ios::trunc | std::ios::binary);
     if (!out.is_open()) {
         std::cerr << "could not open file: " << path << std::endl;
         return false;
     }
-    FileHeader *fileHeader = createFileHeader(meshes->size());
+    FileHeader *fileHeader = createFileHeader(numObjects);
     writeFileHeader(out, fileHeader);
     delete fileHeader;
 
-    for (int i = 0; i < meshes->size(); i++) {
-        writeObject(out, meshes->at(i), doOptimize, useStructOfArrays);
+    for (size_t i = 0; i < groups.size(); i++) {
+        std::vector<DrawRange> ranges;
+        Mesh *shared = createSharedMesh(groups[i], ranges);
+        writeModel(out, shared, useStructOfArrays, kNoMaterial);
+        delete shared;
+        writeDrawRanges(out, ranges);
+    }
+    out.close();
+    return !out.fail();
+}
+
+bool writeSharedBuffersFile(const char *path, const std::vector<Mesh*> *meshes,
+        bool doOptimize, bool useStructOfArrays) {
+    TraceScope trace("writeSharedBuffersFile");
+    StageTimer timer(STAGE_WRITE);
+    addWriteInput(timer, *meshes);
+    for (size_t i = 0; i < meshes->size(); i++) {
+        const Mesh *mesh = meshes->at(i);
+        if (!mesh) {
+            std::cerr << "mesh is null" << std::endl;
+            return false;
+        }
+        if (!checkSkin(mesh)) {
+            return false;
+        }
+        if (mesh->numMorphTargets > 0) {
+            std::cerr << "morph targets can not be written to shared buffers: " << mesh->name
+                      << std::endl;
+            return false;
+        }
+        // optimizing indexes at most kMaxIndexedVertices of them
+        if (!doOptimize && mesh->numIndices > 0 && mesh->numVertices > kMaxIndexedVertices) {
+            std::cerr << "mesh has more vertices than 16 bit indices can address: "
+                      << mesh->numVertices << std::endl;
+            return false;
+        }
+    }
+    // group the meshes by vertex flags, in the order of their first appearance.
+    // Meshes are optimized first, the ones that can not be indexed stay lists
+    // of corners and never share buffers with indexed meshes.
+    std::vector<Mesh*> optimized(meshes->size(), 0);
+    std::vector<unsigned short> groupFlags;
+    std::vector<bool> groupCorners;
+    std::vector<std::vector<const Mesh*> > groups;
+    for (size_t i = 0; i < meshes->size(); i++) {
+        optimized[i] = doOptimize ? createOptimizedMesh(meshes->at(i)) : 0;
+        const Mesh *mesh = optimized[i] ? optimized[i] : meshes->at(i);
+        const bool corners = mesh->numIndices == 0;
+        size_t group = 0;
+        while (group < groupFlags.size() &&
+               (groupFlags[group] != mesh->flags || groupCorners[group] != corners)) {
+            group++;
+        }
+        // bone indices refer to the bones of their own mesh, so skinned
+        // meshes keep their own buffers
+        if (group == groupFlags.size() || hasBones(mesh->flags)) {
+            group = groupFlags.size();
+            groupFlags.push_back(mesh->flags);
+            groupCorners.push_back(corners);
+            groups.push_back(std::vector<const Mesh*>());
+        }
+        groups[group].push_back(mesh);
+    }
+
+    const bool success = writeSharedGroups(path, groups, useStructOfArrays);
+    for (size_t i = 0; i < optimized.size(); i++) {
+        delete optimized[i];
     }
+    if (success) {
+        timer.addOutput(fileSize(path), 0);
+    }
+    return success;
+}
+
+static void padStream(std::ofstream &out, size_t alignment) {
+    static const char zeros[kPackObjectAlignment] = {0};
+    size_t position = out.tellp();
+    size_t padding = (alignment - position % alignment) % alignment;
+    out.write(zeros, padding);
+}
+
+static bool comparePackEntries(const PackEntry &a, const PackEntry &b) {
+    return a.nameHash < b.nameHash;
+}
+
+bool writePackFile(const char *path, const std::vector<std::string> &names,
+        const std::vector<Mesh*> *meshes,
+        bool doOptimize, bool useStructOfArrays) {
+    TraceScope trace("writePackFile");
+    if (!meshes || names.size() != meshes->size()) {
+        std::cerr << "need exactly one name per mesh" << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < meshes->size(); i++) {
+        if (meshes->at(i) && meshes->at(i)->numMorphTargets > 0) {
+            std::cerr << "morph targets can not be written to a pack: " << names[i] << std::endl;
+            return false;
+        }
+    }
+    StageTimer timer(STAGE_WRITE);
+    addWriteInput(timer, *meshes);
+    std::ofstream out(path, std::ios::trunc | std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "could not open file: " << path << std::endl;
+        return false;
+    }
+    PackHeader header;
+    memset(&header, 0, sizeof(PackHeader));
+    out.write((char*) &header, sizeof(PackHeader));
+
+    std::vector<PackEntry> entries;
+    std::string nameTable;
+    for (size_t i = 0; i < meshes->size(); i++) {
+        padStream(out, kPackObjectAlignment);
+        PackEntry entry;
+        entry.objectOffset = out.tellp();
+        if (!writeObject(out, meshes->at(i), doOptimize, useStructOfArrays)) {
+            return false;
+        }
+        entry.objectSize = (uint64_t) out.tellp() - entry.objectOffset;
+        entry.nameHash = hashName(names[i].c_str(), names[i].size());
+        entry.nameOffset = nameTable.size();
+        entry.nameLength = names[i].size();
+        nameTable.append(names[i]);
+        nameTable.push_back('\0');
+        entries.push_back(entry);
+    }
+    std::stable_sort(entries.begin(), entries.end(), comparePackEntries);
+    for (size_t i = 1; i < entries.size(); i++) {
+        const PackEntry &a = entries[i - 1];
+        const PackEntry &b = entries[i];
+        if (a.nameHash == b.nameHash && a.nameLength == b.nameLength &&
+            nameTable.compare(a.nameOffset, a.nameLength, nameTable, b.nameOffset, b.nameLength) == 0) {
+            std::cerr << "duplicate name in pack: " << &nameTable[a.nameOffset] << std::endl;
+            return false;
+        }
+    }
+
+    // about one entry per bucket keeps the scan after the bucket lookup short
+    uint32_t bucketBits = 0;
+    while ((1u << bucketBits) < entries.size() && bucketBits < 24) {
+        bucketBits++;
+    }
+    const uint32_t bucketCount = 1u << bucketBits;
+    std::vector<uint32_t> buckets(bucketCount + 1, 0);
+    for (uint32_t b = 0, e = 0; b <= bucketCount; b++) {
+        while (e < entries.size() && packBucket(entries[e].nameHash, bucketBits) < b) {
+            e++;
+        }
+        buckets[b] = e;
+    }
+
+    padStream(out, sizeof(uint64_t));
+    header.entryTableOffset = out.tellp();
+    if (!entries.empty()) {
+        out.write((char*) &entries[0], entries.size() * sizeof(PackEntry));
+    }
+    header.bucketTableOffset = out.tellp();
+    out.write((char*) &buckets[0], buckets.size() * sizeof(uint32_t));
+    header.nameTableOffset = out.tellp();
+    header.nameTableSize = nameTable.size();
+    out.write(nameTable.data(), nameTable.size());
+
+    header.magicNumber[0] = kPackMagicNumber[0];
+    header.magicNumber[1] = kPackMagicNumber[1];
+    header.version[0] = kPackFormatVersionMajor;
+    header.version[1] = kPackFormatVersionMinor;
+    header.objectCount = entries.size();
+    header.bucketBits = bucketBits;
+    out.seekp(0);
+    out.write((char*) &header, sizeof(PackHeader));
     out.close();
+    timer.addOutput(fileSize(path), 0);
+    return !out.fail();
 }
 
 int writeFileHeader(std::ofstream &out, const FileHeader *header) {
@@ -498,6 +2014,7 @@ ObjectHeader*  createObjectHeader(
     header->vertexCount = vertexCount;
     header->indexCount = indexCount;
     header->boneCount = boneCount;
+    header->materialIndex = kNoMaterial;
     return header;
 }
 
@@ -18,12 +18,27 @@
 #ifndef RCM_WRITER_H
 #define RCM_WRITER_H
 
+#include "rcm.h"
+#include "rcmanim.h"
+#include "rcmmaterial.h"
+#include "rcmbvh.h"
+#include "rcmmorph.h"
+#include "rcmtexture.h"
+#include <string>
 #include <vector>
 
 struct Mesh {
     ~Mesh() {
         delete [] vertices;
         delete [] indices;
+        delete [] boneIndices;
+        delete [] boneWeights;
+        delete [] bones;
+        for (unsigned int i = 0; i < numMorphTargets; i++) {
+            delete [] morphTargets[i].positionDeltas;
+            delete [] morphTargets[i].normalDeltas;
+        }
+        delete [] morphTargets;
     }
 
     char name[32];
@@ -36,11 +51,112 @@ struct Mesh {
     size_t vertexSize;
     float *vertices;
     unsigned short *indices;
+    // skin, only with HAS_BONES. kMaxBoneInfluences entries per vertex,
+    // weights are sorted from largest to smallest and sum up to 1.
+    unsigned char *boneIndices;
+    float *boneWeights;
+    // numBones entries
+    BoneData *bones;
+    // blend shapes, the deltas are allocated with new[] and owned by the mesh
+    unsigned int numMorphTargets;
+    MorphTarget *morphTargets;
+    // store the deltas with 16 bit instead of floats
+    bool quantizeMorphTargets;
+    // write a BVH over the triangles after the model
+    bool storeBvh;
+    // index into Scene::materials, only written by writeSceneFile()
+    unsigned int materialIndex;
+};
+
+// returns a copy of the mesh in which equal vertices (including their skin
+// and morph target deltas) are stored only once and referenced by index.
+// Returns 0 if there are more distinct vertices than kMaxIndexedVertices.
+Mesh* createOptimizedMesh(const Mesh *mesh);
+
+// fills the bounding box and the bounding sphere of header with the bounds of
+// the positions of the mesh. The sphere is centered on the box.
+void calcBounds(const Mesh *mesh, ObjectHeader *header);
+
+// unique meshes of a model, where they are placed and the animation clips
+// of the model. The object index of an instance is the index of its mesh,
+// writeSceneFile() stores the index of the mesh's model object instead.
+struct Scene {
+    ~Scene() {
+        for (size_t i = 0; i < meshes.size(); i++) {
+            delete meshes[i];
+        }
+    }
+
+    std::vector<Mesh*> meshes;
+    std::vector<Instance> instances;
+    std::vector<Animation> animations;
+    std::vector<Material> materials;
+    // images used by the materials, each is written with its mip chain
+    std::vector<Texture> textures;
+    MipFilter mipFilter;
 };
 
 std::vector<Mesh*>* loadModel(const char *path, bool useAssimpOptimization = false);
 
+// loads a model like loadModel() and adds an instance with the global
+// transform for every use of a mesh in the node hierarchy. With shareMeshes,
+// meshes with identical content are stored only once and only the instances
+// tell where they were used. Animation clips are read as well, and with
+// loadTextures the embedded or referenced images of the materials.
+Scene* loadScene(const char *path, bool useAssimpOptimization = false,
+        bool loadTextures = false, bool shareMeshes = true);
+
+// deletes every mesh whose vertices, indices and material equal those of an
+// earlier mesh, names are ignored. meshMap receives the new index of every original
+// mesh. Returns the number of removed meshes.
+size_t removeDuplicateMeshes(std::vector<Mesh*> &meshes, std::vector<unsigned int> &meshMap);
+
+// orders the meshes by material and then by vertex layout, so a renderer that
+// walks the file changes its state as rarely as possible. The instances are
+// updated to the new mesh indices.
+void sortMeshesByMaterial(Scene *scene);
+
+// writes every mesh as a model, followed by a MORPH_TARGETS object if the
+// mesh has morph targets and a BVH object if storeBvh is set
 bool writeFile(const char *path, const std::vector<Mesh*> *meshes,
         bool doOptimize = true, bool useStructOfArrays = false);
 
+// called with every mesh of streamModel() before it is written, e.g. to set
+// quantizeMorphTargets or storeBvh
+typedef void (*PrepareMeshFunction)(Mesh *mesh, void *userData);
+
+// converts the model at path and writes it to outPath like writeFile() with
+// the meshes of loadModel(), but one mesh at a time: each mesh is converted,
+// optimized and written, then it and its assimp mesh are freed. Besides the
+// imported scene only the largest mesh is held in memory. The object count
+// of the file header is written last.
+bool streamModel(const char *path, const char *outPath,
+        bool doOptimize = true, bool useStructOfArrays = false,
+        PrepareMeshFunction prepare = 0, void *userData = 0);
+
+// merges all meshes with the same vertex flags into one model with shared
+// vertex and index buffers. Every such model is followed by a DRAW_RANGES
+// object with the range and an indirect draw command for each of its meshes,
+// in the order of the meshes. Indices are relative to the range's first vertex.
+// Meshes that stay lists of corners share buffers only with each other.
+// Fails for meshes with morph targets, BVHs are not written.
+bool writeSharedBuffersFile(const char *path, const std::vector<Mesh*> *meshes,
+        bool doOptimize = true, bool useStructOfArrays = false);
+
+// writes the material table (if there are materials), the meshes of the
+// scene (with their morph targets and BVHs like writeFile), an INSTANCES
+// object (if there are instances), one ANIMATION object per clip and one
+// TEXTURE object per texture. The mip chains are generated in parallel.
+bool writeSceneFile(const char *path, const Scene *scene,
+        bool doOptimize = true, bool useStructOfArrays = false,
+        float sampleRate = kDefaultAnimationSampleRate,
+        float tolerance = kDefaultAnimationTolerance);
+
+// writes all meshes into a pack, names[i] is the lookup name of meshes->at(i).
+// Names have to be unique. Fails for meshes with morph targets, BVHs are not
+// written.
+bool writePackFile(const char *path, const std::vector<std::string> &names,
+        const std::vector<Mesh*> *meshes,
+        bool doOptimize = true, bool useStructOfArrays = false);
+
 #endif
@@ -0,0 +1,126 @@
+/* tests/Analyze_test.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include <gtest/gtest.h>
+#include <vector>
+#include "rcmanalyze.h"
+#include "rcmgenerator.h"
+
+// unit square facing +y at the given height, two triangles
+static void addQuad(std::vector<float> &positions, std::vector<uint16_t> &indices, float y) {
+    const uint16_t base = positions.size() / 3;
+    const float corners[] = {0.0f, y, 0.0f,  0.0f, y, 1.0f,  1.0f, y, 1.0f,  1.0f, y, 0.0f};
+    positions.insert(positions.end(), corners, corners + 12);
+    const uint16_t quad[] = {0, 1, 2, 0, 2, 3};
+    for (unsigned int i = 0; i < 6; i++) {
+        indices.push_back(base + quad[i]);
+    }
+}
+
+TEST(AnalyzeTest, vertexCache) {
+    Mesh *grid = generateGrid(10, 10, 0, 1);
+    // rows of 10 vertices fit into the larger caches
+    VertexCacheStats fifo = analyzeVertexCache(grid->indices, grid->numIndices,
+                                               grid->numVertices, VERTEX_CACHE_FIFO, 32);
+    EXPECT_EQ(100u, fifo.transformedVertices);
+    EXPECT_FLOAT_EQ(1.0f, fifo.atvr);
+    EXPECT_FLOAT_EQ(100.0f / 162.0f, fifo.acmr);
+    VertexCacheStats lru = analyzeVertexCache(grid->indices, grid->numIndices,
+                                              grid->numVertices, VERTEX_CACHE_LRU, 32);
+    EXPECT_FLOAT_EQ(1.0f, lru.atvr);
+    // but not into the small ones
+    VertexCacheStats small = analyzeVertexCache(grid->indices, grid->numIndices,
+                                                grid->numVertices, VERTEX_CACHE_FIFO, 4);
+    EXPECT_GT(small.atvr, 1.0f);
+    EXPECT_LE(analyzeVertexCache(grid->indices, grid->numIndices, grid->numVertices,
+                                 VERTEX_CACHE_LRU, 4).acmr, small.acmr);
+    delete grid;
+
+    // corner lists transform every corner
+    VertexCacheStats corners = analyzeVertexCache(0, 30, 30, VERTEX_CACHE_FIFO, 16);
+    EXPECT_FLOAT_EQ(3.0f, corners.acmr);
+    EXPECT_FLOAT_EQ(1.0f, corners.atvr);
+}
+
+TEST(AnalyzeTest, vertexFetch) {
+    // in order, every line is loaded once
+    VertexFetchStats fetch = analyzeVertexFetch(0, 300, 300, 32);
+    EXPECT_EQ(300u * 32u, fetch.fetchedBytes);
+    EXPECT_FLOAT_EQ(1.0f, fetch.overfetch);
+    EXPECT_FLOAT_EQ(1.0f, fetch.efficiency);
+
+    // only every other vertex is used, but whole lines are loaded
+    std::vector<uint16_t> indices;
+    for (uint16_t i = 0; i < 300; i++) {
+        indices.push_back(i * 2);
+    }
+    fetch = analyzeVertexFetch(&indices[0], indices.size(), 600, 32);
+    EXPECT_FLOAT_EQ(2.0f, fetch.overfetch);
+    EXPECT_FLOAT_EQ(0.5f, fetch.efficiency);
+
+    // vertices far apart are loaded again once the cache forgot them
+    indices.clear();
+    for (unsigned int pass = 0; pass < 2; pass++) {
+        for (uint16_t i = 0; i < 3 * kFetchCacheLines; i++) {
+            indices.push_back(i);
+        }
+    }
+    fetch = analyzeVertexFetch(&indices[0], indices.size(), 3 * kFetchCacheLines,
+                               kFetchCacheLineSize);
+    EXPECT_FLOAT_EQ(2.0f, fetch.overfetch);
+}
+
+TEST(AnalyzeTest, overdraw) {
+    std::vector<float> positions;
+    std::vector<uint16_t> indices;
+    addQuad(positions, indices, 0.0f);
+    OverdrawStats single = analyzeOverdraw(&positions[0], 3, positions.size() / 3,
+                                           &indices[0], indices.size());
+    // only visible from above, one pixel per pixel
+    EXPECT_EQ((uint64_t) kOverdrawResolution * kOverdrawResolution, single.coveredPixels);
+    EXPECT_FLOAT_EQ(1.0f, single.overdraw);
+
+    // a second quad above the first one is drawn over it
+    addQuad(positions, indices, 1.0f);
+    OverdrawStats backToFront = analyzeOverdraw(&positions[0], 3, positions.size() / 3,
+                                                &indices[0], indices.size());
+    EXPECT_NEAR(2.0f, backToFront.overdraw, 0.01f);
+
+    // drawn first, it hides the one below
+    std::vector<uint16_t> frontToBack(indices.begin() + 6, indices.end());
+    frontToBack.insert(frontToBack.end(), indices.begin(), indices.begin() + 6);
+    OverdrawStats sorted = analyzeOverdraw(&positions[0], 3, positions.size() / 3,
+                                           &frontToBack[0], frontToBack.size());
+    EXPECT_NEAR(1.0f, sorted.overdraw, 0.01f);
+    EXPECT_EQ(backToFront.coveredPixels, sorted.coveredPixels);
+}
+
+TEST(AnalyzeTest, closedMesh) {
+    // a sphere covers itself in every view, the back is culled
+    Mesh *sphere = generateSphere(16, 32, 0, 1);
+    OverdrawStats stats = analyzeOverdraw(sphere->vertices, sphere->vertexSize,
+                                          sphere->numVertices, sphere->indices,
+                                          sphere->numIndices);
+    EXPECT_GT(stats.coveredPixels, 6u * 40000u);
+    EXPECT_GE(stats.overdraw, 1.0f);
+    EXPECT_LT(stats.overdraw, 1.1f);
+    delete sphere;
+
+    OverdrawStats empty = analyzeOverdraw(0, 3, 0, 0, 0);
+    EXPECT_EQ(0u, empty.coveredPixels);
+    EXPECT_EQ(0.0f, empty.overdraw);
+}
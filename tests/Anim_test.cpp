@@ -0,0 +1,205 @@
+/* tests/Anim_test.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <unistd.h>
+#include <iterator>
+#include "rcmreader.h"
+#include "rcmwriter.h"
+#include "test_mesh.h"
+
+#define TEST_ANIM_FILE "/tmp/123456anim"
+
+// 16 bit steps over the ranges used below plus the fit tolerance
+static const float kVectorError = 0.002f;
+// 15 bit smallest three plus the fit tolerance
+static const float kRotationError = 0.003f;
+
+// one track swinging around the y axis while moving, one constant track
+static Animation createAnimation() {
+    Animation animation;
+    animation.nameHash = hashName("walk", 4);
+    animation.duration = 2.0f;
+    animation.tracks.resize(2);
+    AnimationTrack &moving = animation.tracks[0];
+    moving.nameHash = hashName("hip", 3);
+    for (unsigned int i = 0; i <= 40; i++) {
+        const float time = i * 0.05f;
+        VectorKey translation = {time, {time, sinf(time * 3.0f), 0.5f}};
+        moving.translations.push_back(translation);
+        const float angle = time * 1.5f;
+        RotationKey rotation = {time, {0.0f, sinf(angle * 0.5f), 0.0f, cosf(angle * 0.5f)}};
+        moving.rotations.push_back(rotation);
+    }
+    VectorKey scale = {0.0f, {2.0f, 2.0f, 2.0f}};
+    moving.scales.push_back(scale);
+    AnimationTrack &still = animation.tracks[1];
+    still.nameHash = hashName("head", 4);
+    VectorKey translation = {0.0f, {0.0f, 1.0f, 0.0f}};
+    still.translations.push_back(translation);
+    return animation;
+}
+
+// the source values of the moving track at time
+static void expectedTransform(float time, NodeTransform *transform) {
+    transform->translation[0] = time;
+    transform->translation[1] = sinf(time * 3.0f);
+    transform->translation[2] = 0.5f;
+    const float angle = time * 1.5f;
+    transform->rotation[0] = 0.0f;
+    transform->rotation[1] = sinf(angle * 0.5f);
+    transform->rotation[2] = 0.0f;
+    transform->rotation[3] = cosf(angle * 0.5f);
+}
+
+static void expectRotation(const float *expected, const float *actual) {
+    // q and -q are the same rotation
+    float dot = 0.0f;
+    for (unsigned int i = 0; i < 4; i++) {
+        dot += expected[i] * actual[i];
+    }
+    const float sign = dot < 0.0f ? -1.0f : 1.0f;
+    for (unsigned int i = 0; i < 4; i++) {
+        EXPECT_NEAR(expected[i], sign * actual[i], kRotationError);
+    }
+}
+
+TEST(AnimationTest, compressAndSample) {
+    const Animation animation = createAnimation();
+    std::vector<uint8_t> data;
+    ASSERT_TRUE(compressAnimation(animation, data));
+    AnimationView view;
+    ASSERT_TRUE(openAnimation(&data[0], data.size(), &view));
+    EXPECT_EQ(animation.nameHash, view.header->nameHash);
+    ASSERT_EQ(2u, view.header->trackCount);
+    EXPECT_EQ(hashName("head", 4), view.tracks[1].nameHash);
+    // constant channels keep a single key
+    for (unsigned int c = 0; c < kNumAnimationChannels; c++) {
+        EXPECT_EQ(1u, view.tracks[1].channels[c].keyCount);
+    }
+    EXPECT_EQ(1u, view.tracks[0].channels[SCALE_CHANNEL].keyCount);
+    // the linear translation along x and the rotation need fewer keys than frames
+    EXPECT_LT(view.tracks[0].channels[ROTATION_CHANNEL].keyCount, 61u);
+
+    std::vector<uint32_t> cursors(2 * kNumAnimationChannels, 0);
+    NodeTransform transforms[2];
+    for (unsigned int i = 0; i <= 100; i++) {
+        const float time = i * 0.02f;
+        sampleAnimation(view, time, &cursors[0], transforms);
+        NodeTransform expected;
+        expectedTransform(time, &expected);
+        for (unsigned int k = 0; k < 3; k++) {
+            // in between two frames the resampling error adds to the fit error
+            EXPECT_NEAR(expected.translation[k], transforms[0].translation[k], 0.02f);
+            EXPECT_NEAR(2.0f, transforms[0].scale[k], kVectorError);
+        }
+        expectRotation(expected.rotation, transforms[0].rotation);
+        EXPECT_NEAR(1.0f, transforms[1].translation[1], kVectorError);
+        EXPECT_NEAR(1.0f, transforms[1].rotation[3], kRotationError);
+    }
+}
+
+TEST(AnimationTest, errorAtFramesWithinTolerance) {
+    const Animation animation = createAnimation();
+    std::vector<uint8_t> data;
+    ASSERT_TRUE(compressAnimation(animation, data, 20.0f, 0.001f));
+    AnimationView view;
+    ASSERT_TRUE(openAnimation(&data[0], data.size(), &view));
+    // at the sample points the source keys coincide with the frames
+    std::vector<uint32_t> cursors(2 * kNumAnimationChannels, 0);
+    NodeTransform transforms[2];
+    for (unsigned int i = 0; i <= 40; i++) {
+        const float time = i * 0.05f;
+        sampleAnimation(view, time, &cursors[0], transforms);
+        NodeTransform expected;
+        expectedTransform(time, &expected);
+        for (unsigned int k = 0; k < 3; k++) {
+            EXPECT_NEAR(expected.translation[k], transforms[0].translation[k], kVectorError);
+        }
+        expectRotation(expected.rotation, transforms[0].rotation);
+    }
+}
+
+TEST(AnimationTest, cursorsFollowJumps) {
+    const Animation animation = createAnimation();
+    std::vector<uint8_t> data;
+    ASSERT_TRUE(compressAnimation(animation, data));
+    AnimationView view;
+    ASSERT_TRUE(openAnimation(&data[0], data.size(), &view));
+    std::vector<uint32_t> cursors(2 * kNumAnimationChannels, 0);
+    std::vector<uint32_t> fresh(2 * kNumAnimationChannels, 0);
+    NodeTransform jumped[2];
+    NodeTransform direct[2];
+    const float times[] = {1.9f, 0.1f, 1.2f, 3.0f, -1.0f, 0.7f};
+    for (unsigned int i = 0; i < sizeof(times) / sizeof(times[0]); i++) {
+        sampleAnimation(view, times[i], &cursors[0], jumped);
+        std::fill(fresh.begin(), fresh.end(), 0);
+        sampleAnimation(view, times[i], &fresh[0], direct);
+        EXPECT_EQ(0, memcmp(jumped, direct, sizeof(jumped)));
+    }
+}
+
+TEST(AnimationTest, rejectsBrokenData) {
+    const Animation animation = createAnimation();
+    std::vector<uint8_t> data;
+    ASSERT_TRUE(compressAnimation(animation, data));
+    AnimationView view;
+    EXPECT_FALSE(openAnimation(&data[0], data.size() - 1, &view));
+    CompressedTrack *tracks = (CompressedTrack*) (&data[0] + sizeof(AnimationHeader));
+    tracks[1].channels[SCALE_CHANNEL].firstKey = 1000;
+    EXPECT_FALSE(openAnimation(&data[0], data.size(), &view));
+
+    Animation tooLong;
+    tooLong.nameHash = 0;
+    tooLong.duration = 10000.0f;
+    EXPECT_FALSE(compressAnimation(tooLong, data));
+}
+
+TEST(AnimationTest, writeAndReadScene) {
+    Scene scene;
+    scene.meshes.push_back(createTestMesh(6, 0.0f));
+    scene.animations.push_back(createAnimation());
+    ASSERT_TRUE(writeSceneFile(TEST_ANIM_FILE, &scene, false, false));
+
+    std::ifstream in(TEST_ANIM_FILE, std::ios::binary);
+    std::vector<char> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    unlink(TEST_ANIM_FILE);
+
+    // copy behind one byte so the clip is not aligned in memory
+    std::vector<char> shifted(file.size() + 1);
+    memcpy(&shifted[1], &file[0], file.size());
+    MemoryStream stream(&shifted[1], file.size());
+    FileHeader fileHeader;
+    ObjectHeader objHeader;
+    ASSERT_TRUE(readFileHeader(stream, &fileHeader));
+    // no instances were given, so there is no instance table
+    EXPECT_EQ(2, fileHeader.objectCount);
+    ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+    ASSERT_TRUE(skipObject(stream, &objHeader));
+    ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+    EXPECT_EQ(ANIMATION, objHeader.type);
+    EXPECT_EQ(2u, asBlockHeader(&objHeader)->elementCount);
+    AnimationView view;
+    ASSERT_TRUE(readAnimation(stream, &objHeader, &view));
+    EXPECT_TRUE(view.allocation != 0);
+    EXPECT_EQ(stream.size, stream.position);
+    EXPECT_EQ(hashName("hip", 3), view.tracks[0].nameHash);
+    EXPECT_FLOAT_EQ(2.0f, view.header->duration);
+    delete[] (char*) view.allocation;
+}
@@ -0,0 +1,396 @@
+/* tests/Bvh_test.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iterator>
+#include <math.h>
+#include "rcmgenerator.h"
+#include "rcmreader.h"
+#include "rcmwriter.h"
+
+#define TEST_BVH_FILE "/tmp/123456bvh"
+
+// deterministic random numbers in [0, 1)
+struct Random {
+    uint32_t state;
+    explicit Random(uint32_t seed) : state(seed) {}
+    float next() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0f;
+    }
+};
+
+// small triangles scattered in a 10 units cube
+struct Soup {
+    std::vector<float> positions;
+    std::vector<uint16_t> indices;
+};
+
+static void createSoup(unsigned int numVertices, unsigned int numTriangles, Soup &soup) {
+    Random random(numTriangles);
+    soup.positions.resize(numVertices * 3);
+    for (unsigned int v = 0; v < numVertices; v += 3) {
+        float center[3];
+        for (unsigned int k = 0; k < 3; k++) {
+            center[k] = random.next() * 10.0f;
+        }
+        for (unsigned int c = 0; c < 3 && v + c < numVertices; c++) {
+            for (unsigned int k = 0; k < 3; k++) {
+                soup.positions[(v + c) * 3 + k] = center[k] + random.next() * 0.5f;
+            }
+        }
+    }
+    soup.indices.resize(numTriangles * 3);
+    for (unsigned int t = 0; t < numTriangles; t++) {
+        // mostly triangles of one cluster, some spanning the whole cube
+        const unsigned int cluster = (unsigned int) (random.next() * (numVertices / 3)) * 3;
+        for (unsigned int c = 0; c < 3; c++) {
+            soup.indices[t * 3 + c] = t % 17 == 0 ?
+                    (uint16_t) (random.next() * numVertices) : (uint16_t) (cluster + c);
+        }
+    }
+}
+
+static bool intersectBruteForce(const Soup &soup, const float *origin, const float *direction,
+        BvhHit *hit) {
+    bool found = false;
+    float closest = FLT_MAX;
+    for (size_t t = 0; t < soup.indices.size() / 3; t++) {
+        const float *a = &soup.positions[soup.indices[t * 3] * 3];
+        const float *b = &soup.positions[soup.indices[t * 3 + 1] * 3];
+        const float *c = &soup.positions[soup.indices[t * 3 + 2] * 3];
+        float e1[3], e2[3], s[3];
+        for (unsigned int k = 0; k < 3; k++) {
+            e1[k] = b[k] - a[k];
+            e2[k] = c[k] - a[k];
+            s[k] = origin[k] - a[k];
+        }
+        const float p[3] = {direction[1] * e2[2] - direction[2] * e2[1],
+                            direction[2] * e2[0] - direction[0] * e2[2],
+                            direction[0] * e2[1] - direction[1] * e2[0]};
+        const float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+        if (det == 0.0f) {
+            continue;
+        }
+        const float inv = 1.0f / det;
+        const float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+        if (u < 0.0f || u > 1.0f) {
+            continue;
+        }
+        const float q[3] = {s[1] * e1[2] - s[2] * e1[1],
+                            s[2] * e1[0] - s[0] * e1[2],
+                            s[0] * e1[1] - s[1] * e1[0]};
+        const float v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inv;
+        if (v < 0.0f || u + v > 1.0f) {
+            continue;
+        }
+        const float distance = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+        if (distance >= 0.0f && distance <= closest) {
+            closest = distance;
+            hit->triangle = t;
+            hit->distance = distance;
+            found = true;
+        }
+    }
+    return found;
+}
+
+static void checkRays(const Soup &soup, const BvhView &view, unsigned int numRays) {
+    Random random(7);
+    unsigned int hits = 0;
+    for (unsigned int r = 0; r < numRays; r++) {
+        float origin[3];
+        float direction[3];
+        for (unsigned int k = 0; k < 3; k++) {
+            origin[k] = random.next() * 14.0f - 2.0f;
+            direction[k] = random.next() * 2.0f - 1.0f;
+        }
+        // axis aligned rays take the path for zero direction components
+        if (r % 5 == 0) {
+            direction[0] = 0.0f;
+            direction[1] = -0.0f;
+        }
+        BvhHit expected;
+        BvhHit hit;
+        const bool found = intersectBruteForce(soup, origin, direction, &expected);
+        ASSERT_EQ(found, intersectBvh(view, &soup.positions[0], 3, &soup.indices[0],
+                                      origin, direction, FLT_MAX, &hit));
+        if (found) {
+            // the soup contains duplicates, any of them may be reported
+            for (unsigned int c = 0; c < 3; c++) {
+                EXPECT_EQ(soup.indices[expected.triangle * 3 + c], soup.indices[hit.triangle * 3 + c]);
+            }
+            EXPECT_FLOAT_EQ(expected.distance, hit.distance);
+            hits++;
+        }
+    }
+    EXPECT_GT(hits, numRays / 10);
+}
+
+static void openSoup(const Soup &soup, std::vector<uint8_t> &data, BvhView &view,
+        unsigned int numThreads) {
+    ASSERT_TRUE(buildBvh(&soup.positions[0], 3, soup.positions.size() / 3, &soup.indices[0],
+                         soup.indices.size(), 0, data, numThreads));
+    const BvhHeader *header = (const BvhHeader*) &data[0];
+    ASSERT_TRUE(openBvh(&data[0], data.size(), header->nodeCount, soup.indices.size(), &view));
+}
+
+TEST(BvhTest, raysMatchBruteForce) {
+    Soup soup;
+    createSoup(900, 1500, soup);
+    std::vector<uint8_t> data;
+    BvhView view;
+    openSoup(soup, data, view, 1);
+    EXPECT_EQ(1500u, view.header.triangleCount);
+    EXPECT_EQ(0u, view.header.nodeOffset % kBvhNodeAlignment);
+    checkRays(soup, view, 500);
+
+    // maxDistance cuts off hits behind it
+    const float origin[] = {5.0f, 5.0f, -1.0f};
+    const float direction[] = {0.0f, 0.0f, 1.0f};
+    BvhHit hit;
+    EXPECT_FALSE(intersectBvh(view, &soup.positions[0], 3, &soup.indices[0],
+                              origin, direction, 0.5f, &hit));
+}
+
+TEST(BvhTest, overlapMatchesBruteForce) {
+    Soup soup;
+    createSoup(600, 800, soup);
+    std::vector<uint8_t> data;
+    BvhView view;
+    openSoup(soup, data, view, 2);
+    Random random(3);
+    for (unsigned int q = 0; q < 50; q++) {
+        float boxMin[3];
+        float boxMax[3];
+        for (unsigned int k = 0; k < 3; k++) {
+            boxMin[k] = random.next() * 10.0f;
+            boxMax[k] = boxMin[k] + random.next() * 3.0f;
+        }
+        std::vector<uint32_t> expected;
+        for (uint32_t t = 0; t < 800; t++) {
+            bool overlaps = true;
+            for (unsigned int k = 0; k < 3; k++) {
+                float low = FLT_MAX;
+                float high = -FLT_MAX;
+                for (unsigned int c = 0; c < 3; c++) {
+                    low = std::min(low, soup.positions[soup.indices[t * 3 + c] * 3 + k]);
+                    high = std::max(high, soup.positions[soup.indices[t * 3 + c] * 3 + k]);
+                }
+                overlaps = overlaps && low <= boxMax[k] && high >= boxMin[k];
+            }
+            if (overlaps) {
+                expected.push_back(t);
+            }
+        }
+        std::vector<uint32_t> triangles;
+        overlapBvh(view, &soup.positions[0], 3, &soup.indices[0], boxMin, boxMax, triangles);
+        std::sort(triangles.begin(), triangles.end());
+        EXPECT_EQ(expected, triangles);
+    }
+}
+
+TEST(BvhTest, parallelBuild) {
+    // enough triangles to split the top of the tree into tasks
+    Soup soup;
+    createSoup(60000, 40000, soup);
+    std::vector<uint8_t> data;
+    BvhView view;
+    openSoup(soup, data, view, 4);
+    // every triangle is in exactly one leaf
+    std::vector<uint32_t> triangles(view.triangles, view.triangles + view.header.triangleCount);
+    std::sort(triangles.begin(), triangles.end());
+    for (uint32_t t = 0; t < triangles.size(); t++) {
+        ASSERT_EQ(t, triangles[t]);
+    }
+    for (uint32_t n = 0; n < view.header.nodeCount; n++) {
+        for (unsigned int c = 0; c < 4; c++) {
+            if (isBvhLeaf(view.nodes[n].children[c])) {
+                EXPECT_GE(kBvhMaxLeafTriangles, bvhLeafCount(view.nodes[n].children[c]));
+            }
+        }
+    }
+    checkRays(soup, view, 200);
+}
+
+TEST(BvhTest, rejectsBrokenData) {
+    Soup soup;
+    createSoup(300, 200, soup);
+    std::vector<uint8_t> data;
+    BvhView view;
+    openSoup(soup, data, view, 1);
+    const uint32_t nodeCount = view.header.nodeCount;
+    ASSERT_LT(1u, nodeCount);
+    EXPECT_FALSE(openBvh(&data[0], data.size() - 4, nodeCount, 600, &view));
+    EXPECT_FALSE(openBvh(&data[0], data.size(), nodeCount + 1, 600, &view));
+    EXPECT_FALSE(openBvh(&data[0], data.size(), nodeCount, 603, &view));
+
+    // a child pointing back to the root would loop forever
+    BvhNode *nodes = (BvhNode*) &data[((const BvhHeader*) &data[0])->nodeOffset];
+    unsigned int inner = 0;
+    while (inner < 4 && isBvhLeaf(nodes[0].children[inner])) {
+        inner++;
+    }
+    ASSERT_LT(inner, 4u);
+    const uint32_t child = nodes[0].children[inner];
+    nodes[0].children[inner] = 0;
+    EXPECT_FALSE(openBvh(&data[0], data.size(), nodeCount, 600, &view));
+    nodes[0].children[inner] = child;
+
+    uint32_t *triangles = (uint32_t*) &data[((const BvhHeader*) &data[0])->triangleOffset];
+    triangles[5] = 200;
+    EXPECT_FALSE(openBvh(&data[0], data.size(), nodeCount, 600, &view));
+    triangles[5] = 0;
+
+    const uint16_t badIndices[] = {0, 1, 300};
+    EXPECT_FALSE(buildBvh(&soup.positions[0], 3, 300, badIndices, 3, 0, data));
+}
+
+TEST(BvhTest, writeAndRead) {
+    // a flat 32 x 32 grid in the xz plane
+    const unsigned int size = 32;
+    Mesh *mesh = new Mesh();
+    mesh->flags = HAS_POSITIONS | HAS_NORMALS;
+    mesh->vertexSize = calcVertexSize(mesh->flags);
+    mesh->numVertices = size * size;
+    mesh->vertices = new float[mesh->numVertices * mesh->vertexSize]();
+    for (unsigned int z = 0; z < size; z++) {
+        for (unsigned int x = 0; x < size; x++) {
+            float *vertex = mesh->vertices + (z * size + x) * mesh->vertexSize;
+            vertex[positionOffset()] = x;
+            vertex[positionOffset() + 2] = z;
+            vertex[normalsOffset() + 1] = 1.0f;
+        }
+    }
+    mesh->numIndices = (size - 1) * (size - 1) * 6;
+    mesh->indices = new unsigned short[mesh->numIndices];
+    unsigned short *index = mesh->indices;
+    for (unsigned int z = 0; z + 1 < size; z++) {
+        for (unsigned int x = 0; x + 1 < size; x++) {
+            const unsigned short corner = z * size + x;
+            const unsigned short quad[] = {corner, (unsigned short) (corner + size),
+                                           (unsigned short) (corner + 1),
+                                           (unsigned short) (corner + 1),
+                                           (unsigned short) (corner + size),
+                                           (unsigned short) (corner + size + 1)};
+            index = std::copy(quad, quad + 6, index);
+        }
+    }
+    mesh->storeBvh = true;
+
+    std::vector<Mesh*> meshes(1, mesh);
+    ASSERT_TRUE(writeFile(TEST_BVH_FILE, &meshes, false, false));
+    std::ifstream in(TEST_BVH_FILE, std::ios::binary);
+    std::vector<char> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    unlink(TEST_BVH_FILE);
+
+    MemoryStream stream(&file[0], file.size());
+    FileHeader fileHeader;
+    ObjectHeader model;
+    ObjectHeader objHeader;
+    ASSERT_TRUE(readFileHeader(stream, &fileHeader));
+    EXPECT_EQ(2, fileHeader.objectCount);
+    ASSERT_TRUE(readObjectHeader(stream, &model));
+    const float *positions = (const float*) (stream.data + stream.position) + positionOffset();
+    std::vector<float> vertices(positions - positionOffset(),
+                                positions - positionOffset() + model.vertexCount * mesh->vertexSize);
+    std::vector<uint16_t> indices((const uint16_t*) (stream.data + stream.position +
+                                  vertices.size() * sizeof(float)),
+                                  (const uint16_t*) (stream.data + stream.position +
+                                  vertices.size() * sizeof(float)) + model.indexCount);
+    ASSERT_TRUE(skipObject(stream, &model));
+    ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+    EXPECT_EQ(BVH, objHeader.type);
+    const size_t dataStart = stream.position;
+    BvhView view;
+    ASSERT_TRUE(readBvh(stream, &objHeader, model.indexCount, &view));
+    EXPECT_EQ(stream.size, stream.position);
+    // the nodes start on a cache line of the file
+    EXPECT_EQ(0u, (dataStart + view.header.nodeOffset) % kBvhNodeAlignment);
+
+    const float origin[] = {10.25f, 5.0f, 20.75f};
+    const float direction[] = {0.0f, -1.0f, 0.0f};
+    BvhHit hit;
+    ASSERT_TRUE(intersectBvh(view, &vertices[positionOffset()], mesh->vertexSize, &indices[0],
+                             origin, direction, 100.0f, &hit));
+    EXPECT_FLOAT_EQ(5.0f, hit.distance);
+    // the second triangle of quad (10, 20)
+    EXPECT_EQ((20u * (size - 1) + 10u) * 2u + 1u, hit.triangle);
+    delete[] (char*) view.allocation;
+    delete mesh;
+}
+
+TEST(BvhTest, cornerList) {
+    // too many vertices for 16 bit indices, so every three vertices are a triangle
+    Mesh *mesh = generateGrid(300, 300, 0, 1);
+    ASSERT_NE((Mesh*) 0, mesh);
+    ASSERT_EQ(0u, mesh->numIndices);
+    mesh->storeBvh = true;
+    std::vector<Mesh*> meshes(1, mesh);
+    ASSERT_TRUE(writeFile(TEST_BVH_FILE, &meshes, false, false));
+    std::ifstream in(TEST_BVH_FILE, std::ios::binary);
+    std::vector<char> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    unlink(TEST_BVH_FILE);
+
+    MemoryStream stream(&file[0], file.size());
+    FileHeader fileHeader;
+    ObjectHeader model;
+    ObjectHeader objHeader;
+    ASSERT_TRUE(readFileHeader(stream, &fileHeader));
+    ASSERT_TRUE(readObjectHeader(stream, &model));
+    EXPECT_EQ(0u, model.indexCount);
+    ASSERT_TRUE(skipObject(stream, &model));
+    ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+    EXPECT_EQ(BVH, objHeader.type);
+    BvhView view;
+    ASSERT_TRUE(readBvh(stream, &objHeader, model.vertexCount, &view));
+    EXPECT_EQ(mesh->numVertices / 3, view.header.triangleCount);
+    EXPECT_LT(0u, view.header.nodeCount);
+
+    const float origin[] = {0.1f, 10.0f, 0.2f};
+    const float direction[] = {0.0f, -1.0f, 0.0f};
+    const float *positions = mesh->vertices + positionOffset();
+    BvhHit hit;
+    ASSERT_TRUE(intersectBvh(view, positions, mesh->vertexSize, 0, origin, direction,
+                             100.0f, &hit));
+    // the hit triangle lies under the ray
+    float low[2] = {1e30f, 1e30f};
+    float high[2] = {-1e30f, -1e30f};
+    for (unsigned int c = 0; c < 3; c++) {
+        const float *position = positions + (hit.triangle * 3 + c) * mesh->vertexSize;
+        for (unsigned int k = 0; k < 2; k++) {
+            low[k] = std::min(low[k], position[k * 2]);
+            high[k] = std::max(high[k], position[k * 2]);
+        }
+    }
+    EXPECT_LE(low[0], origin[0]);
+    EXPECT_GE(high[0], origin[0]);
+    EXPECT_LE(low[1], origin[2]);
+    EXPECT_GE(high[1], origin[2]);
+
+    const float boxMin[] = {0.1f, -10.0f, 0.2f};
+    const float boxMax[] = {0.1f, 10.0f, 0.2f};
+    std::vector<uint32_t> triangles;
+    overlapBvh(view, positions, mesh->vertexSize, 0, boxMin, boxMax, triangles);
+    EXPECT_NE(triangles.end(), std::find(triangles.begin(), triangles.end(), hit.triangle));
+    delete[] (char*) view.allocation;
+    delete mesh;
+}
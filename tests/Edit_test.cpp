@@ -0,0 +1,273 @@
+/* tests/Edit_test.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <sstream>
+#include "rcmedit.h"
+#include "rcmbvh.h"
+#include "rcmreader.h"
+#include "rcmtexture.h"
+#include "rcmwriter.h"
+#include "test_mesh.h"
+
+#define TEST_EDIT_FILE_A "/tmp/123456edit_a"
+#define TEST_EDIT_FILE_B "/tmp/123456edit_b"
+#define TEST_EDIT_FILE_OUT "/tmp/123456edit_out"
+#define TEST_EDIT_FILE_EXPECTED "/tmp/123456edit_expected"
+
+class EditTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        first.push_back(createTestMesh(12, 0.0f));
+        first.push_back(createTestMesh(30, 1000.0f));
+        second.push_back(createTestMesh(7, 5000.0f, HAS_POSITIONS));
+        second.push_back(createTestMesh(9, 7000.0f));
+        second.push_back(createTestMesh(3, 9000.0f));
+        writeFile(TEST_EDIT_FILE_A, &first, false, false);
+        writeFile(TEST_EDIT_FILE_B, &second, false, true);
+    }
+
+    virtual void TearDown() {
+        for (size_t i = 0; i < first.size(); i++) {
+            delete first[i];
+        }
+        for (size_t i = 0; i < second.size(); i++) {
+            delete second[i];
+        }
+        unlink(TEST_EDIT_FILE_A);
+        unlink(TEST_EDIT_FILE_B);
+        unlink(TEST_EDIT_FILE_OUT);
+        unlink(TEST_EDIT_FILE_EXPECTED);
+    }
+
+    static std::string readWholeFile(const char *path) {
+        std::ifstream in(path, std::ios::binary);
+        std::stringstream content;
+        content << in.rdbuf();
+        return content.str();
+    }
+
+    // compares the objects of the output file with the given meshes by
+    // reading every object with the regular reader
+    void expectObjects(const std::vector<Mesh*> &meshes) {
+        std::ifstream in(TEST_EDIT_FILE_OUT, std::ios::binary);
+        FileHeader *fileHeader = readFileHeader(in);
+        ASSERT_NE((FileHeader*) 0, fileHeader);
+        ASSERT_EQ(meshes.size(), fileHeader->objectCount);
+        delete fileHeader;
+        for (size_t i = 0; i < meshes.size(); i++) {
+            ObjectHeader *header = readObjectHeader(in);
+            ASSERT_NE((ObjectHeader*) 0, header);
+            EXPECT_EQ(meshes[i]->numVertices, header->vertexCount);
+            EXPECT_EQ(meshes[i]->flags, header->vertexFlags);
+
+            ObjectBuffers buffers;
+            ObjectBufferSizes sizes;
+            calcObjectBufferSizes(header, &sizes);
+            std::vector<char> buffer(sizes.totalSize);
+            ASSERT_TRUE(readObjectInto(in, header, &buffer[0], buffer.size(), &buffers));
+            EXPECT_EQ(meshes[i]->vertices[0], buffers.vertices[POSITION_ARRAY][0]);
+            EXPECT_EQ(meshes[i]->indices[meshes[i]->numIndices - 1],
+                      buffers.indices[header->indexCount - 1]);
+            delete header;
+        }
+    }
+
+    std::vector<Mesh*> first;
+    std::vector<Mesh*> second;
+};
+
+TEST_F(EditTest, listObjects) {
+    std::vector<ObjectLocation> objects;
+    ASSERT_TRUE(listObjects(TEST_EDIT_FILE_B, objects));
+    ASSERT_EQ(3u, objects.size());
+    EXPECT_EQ(sizeof(FileHeader), objects[0].offset);
+    EXPECT_EQ(objects[0].offset + objects[0].size, objects[1].offset);
+    EXPECT_EQ(STRUCT_OF_ARRAYS, objects[1].header.type);
+    EXPECT_EQ(9u, objects[1].header.vertexCount);
+}
+
+TEST_F(EditTest, mergeFiles) {
+    std::vector<std::string> inPaths;
+    inPaths.push_back(TEST_EDIT_FILE_A);
+    inPaths.push_back(TEST_EDIT_FILE_B);
+    ASSERT_TRUE(mergeFiles(inPaths, TEST_EDIT_FILE_OUT));
+
+    std::vector<Mesh*> expected(first);
+    expected.insert(expected.end(), second.begin(), second.end());
+    expectObjects(expected);
+}
+
+TEST_F(EditTest, extractObjects) {
+    std::vector<unsigned int> indices;
+    indices.push_back(2);
+    indices.push_back(0);
+    ASSERT_TRUE(extractObjects(TEST_EDIT_FILE_B, indices, TEST_EDIT_FILE_OUT));
+
+    std::vector<Mesh*> expected;
+    expected.push_back(second[2]);
+    expected.push_back(second[0]);
+    expectObjects(expected);
+}
+
+TEST_F(EditTest, dropObjects) {
+    std::vector<unsigned int> indices(1, 1);
+    ASSERT_TRUE(dropObjects(TEST_EDIT_FILE_B, indices, TEST_EDIT_FILE_OUT));
+
+    std::vector<Mesh*> expected;
+    expected.push_back(second[0]);
+    expected.push_back(second[2]);
+    expectObjects(expected);
+}
+
+TEST_F(EditTest, transcodeMatchesWriter) {
+    // the chunk size is far below the size of a single object, so every
+    // object is converted in many pieces
+    ASSERT_TRUE(transcodeFile(TEST_EDIT_FILE_A, TEST_EDIT_FILE_OUT, STRUCT_OF_ARRAYS, 100));
+    writeFile(TEST_EDIT_FILE_EXPECTED, &first, false, true);
+    EXPECT_EQ(readWholeFile(TEST_EDIT_FILE_EXPECTED), readWholeFile(TEST_EDIT_FILE_OUT));
+
+    ASSERT_TRUE(transcodeFile(TEST_EDIT_FILE_B, TEST_EDIT_FILE_OUT, ARRAY_OF_STRUCTS, 100));
+    writeFile(TEST_EDIT_FILE_EXPECTED, &second, false, false);
+    EXPECT_EQ(readWholeFile(TEST_EDIT_FILE_EXPECTED), readWholeFile(TEST_EDIT_FILE_OUT));
+
+    // same layout only copies
+    ASSERT_TRUE(transcodeFile(TEST_EDIT_FILE_B, TEST_EDIT_FILE_OUT, STRUCT_OF_ARRAYS));
+    EXPECT_EQ(readWholeFile(TEST_EDIT_FILE_B), readWholeFile(TEST_EDIT_FILE_OUT));
+}
+
+TEST_F(EditTest, errors) {
+    std::vector<unsigned int> indices(1, 5);
+    EXPECT_FALSE(extractObjects(TEST_EDIT_FILE_A, indices, TEST_EDIT_FILE_OUT));
+    EXPECT_FALSE(transcodeFile(TEST_EDIT_FILE_A, TEST_EDIT_FILE_A, STRUCT_OF_ARRAYS));
+    std::vector<unsigned int> valid(1, 0);
+    EXPECT_FALSE(dropObjects(TEST_EDIT_FILE_A, valid, TEST_EDIT_FILE_A));
+    std::vector<ObjectLocation> objects;
+    ASSERT_TRUE(listObjects(TEST_EDIT_FILE_A, objects));
+    EXPECT_EQ(first.size(), objects.size());
+
+    // 100 objects from three copies exceed the limit of a single file
+    std::vector<Mesh*> many;
+    for (unsigned int i = 0; i < 100; i++) {
+        many.push_back(createTestMesh(3, i * 100.0f));
+    }
+    writeFile(TEST_EDIT_FILE_A, &many, false, false);
+    for (size_t i = 0; i < many.size(); i++) {
+        delete many[i];
+    }
+    std::vector<std::string> inPaths(3, TEST_EDIT_FILE_A);
+    EXPECT_FALSE(mergeFiles(inPaths, TEST_EDIT_FILE_OUT));
+    inPaths.pop_back();
+    EXPECT_TRUE(mergeFiles(inPaths, TEST_EDIT_FILE_OUT));
+}
+
+TEST_F(EditTest, modelBlocksFollowTheirModel) {
+    // model 0, model 1 and the BVH of model 1
+    first[1]->storeBvh = true;
+    writeFile(TEST_EDIT_FILE_A, &first, false, false);
+    std::vector<unsigned int> indices(1, 1);
+    ASSERT_TRUE(extractObjects(TEST_EDIT_FILE_A, indices, TEST_EDIT_FILE_OUT));
+    std::vector<ObjectLocation> objects;
+    ASSERT_TRUE(listObjects(TEST_EDIT_FILE_OUT, objects));
+    ASSERT_EQ(2u, objects.size());
+    EXPECT_EQ(30u, objects[0].header.vertexCount);
+    EXPECT_EQ(BVH, objects[1].header.type);
+
+    ASSERT_TRUE(dropObjects(TEST_EDIT_FILE_A, indices, TEST_EDIT_FILE_OUT));
+    std::vector<Mesh*> expected(1, first[0]);
+    expectObjects(expected);
+
+    // the BVH can not be taken away from its model
+    std::vector<unsigned int> block(1, 2);
+    EXPECT_FALSE(extractObjects(TEST_EDIT_FILE_A, block, TEST_EDIT_FILE_OUT));
+    EXPECT_FALSE(dropObjects(TEST_EDIT_FILE_A, block, TEST_EDIT_FILE_OUT));
+}
+
+TEST_F(EditTest, referencesAreNotEdited) {
+    // the instances refer to the models by their index
+    Scene scene;
+    scene.meshes.push_back(createTestMesh(3, 0.0f));
+    scene.instances.resize(1);
+    memset(&scene.instances[0], 0, sizeof(Instance));
+    ASSERT_TRUE(writeSceneFile(TEST_EDIT_FILE_A, &scene, false, false));
+    std::vector<unsigned int> indices(1, 0);
+    EXPECT_FALSE(extractObjects(TEST_EDIT_FILE_A, indices, TEST_EDIT_FILE_OUT));
+    EXPECT_FALSE(dropObjects(TEST_EDIT_FILE_A, indices, TEST_EDIT_FILE_OUT));
+    std::vector<std::string> inPaths;
+    inPaths.push_back(TEST_EDIT_FILE_B);
+    inPaths.push_back(TEST_EDIT_FILE_A);
+    EXPECT_FALSE(mergeFiles(inPaths, TEST_EDIT_FILE_OUT));
+}
+
+TEST_F(EditTest, placedDataStaysAligned) {
+    // a model with a BVH and a texture, their data is aligned in the file
+    Scene scene;
+    scene.meshes.push_back(createTestMesh(30, 0.0f));
+    scene.meshes[0]->storeBvh = true;
+    scene.textures.resize(1);
+    Texture &texture = scene.textures[0];
+    texture.nameHash = 1;
+    texture.width = 33;
+    texture.height = 17;
+    texture.flags = 0;
+    texture.pixels.resize(texture.width * texture.height * 4);
+    for (size_t i = 0; i < texture.pixels.size(); i++) {
+        texture.pixels[i] = (uint8_t) (i * 7);
+    }
+    ASSERT_TRUE(writeSceneFile(TEST_EDIT_FILE_EXPECTED, &scene, false, false));
+
+    // moved behind the objects of another file
+    std::vector<std::string> inPaths;
+    inPaths.push_back(TEST_EDIT_FILE_A);
+    inPaths.push_back(TEST_EDIT_FILE_EXPECTED);
+    ASSERT_TRUE(mergeFiles(inPaths, TEST_EDIT_FILE_OUT));
+    const std::string file = readWholeFile(TEST_EDIT_FILE_OUT);
+    MemoryStream stream(file.data(), file.size());
+    FileHeader fileHeader;
+    ASSERT_TRUE(readFileHeader(stream, &fileHeader));
+    ASSERT_EQ(5, fileHeader.objectCount);
+    ObjectHeader model;
+    ObjectHeader objHeader;
+    for (unsigned int i = 0; i < 3; i++) {
+        ASSERT_TRUE(readObjectHeader(stream, &model));
+        ASSERT_TRUE(skipObject(stream, &model));
+    }
+    ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+    ASSERT_EQ(BVH, objHeader.type);
+    size_t dataStart = stream.position;
+    BvhView bvh;
+    ASSERT_TRUE(readBvh(stream, &objHeader, model.indexCount, &bvh));
+    EXPECT_EQ(0u, (dataStart + bvh.header.nodeOffset) % kBvhNodeAlignment);
+    delete[] (char*) bvh.allocation;
+
+    ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+    ASSERT_EQ(TEXTURE, objHeader.type);
+    dataStart = stream.position;
+    TextureView view;
+    ASSERT_TRUE(readTexture(stream, &objHeader, &view));
+    for (uint32_t l = 0; l < view.header.levelCount; l++) {
+        EXPECT_EQ(0u, (dataStart + view.levels[l].offset) % kTextureLevelAlignment);
+    }
+    const TextureLevel &level = view.levels[0];
+    for (uint32_t y = 0; y < level.height; y++) {
+        EXPECT_EQ(0, memcmp(&texture.pixels[y * texture.width * 4],
+                            view.data + level.offset + y * level.rowPitch, texture.width * 4));
+    }
+    EXPECT_EQ(stream.size, stream.position);
+}
+
@@ -0,0 +1,144 @@
+/* tests/Generator_test.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <unistd.h>
+#include "rcmgenerator.h"
+#include "rcmreader.h"
+
+#define TEST_GENERATOR_FILE "/tmp/123456generator"
+
+static const unsigned short kAllAttributes = HAS_NORMALS | HAS_UV0 | HAS_UV1 | HAS_COLOR0 |
+                                             HAS_TAN_AND_BITAN | HAS_BONES;
+
+static float length(const float *v) {
+    return sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+}
+
+TEST(GeneratorTest, grid) {
+    Mesh *mesh = generateGrid(10, 5, HAS_NORMALS | HAS_UV0, 1);
+    ASSERT_TRUE(mesh != 0);
+    EXPECT_EQ(HAS_POSITIONS | HAS_NORMALS | HAS_UV0, mesh->flags);
+    EXPECT_EQ(calcVertexSize(mesh->flags), mesh->vertexSize);
+    EXPECT_EQ(50u, mesh->numVertices);
+    EXPECT_EQ(9u * 4u * 6u, mesh->numIndices);
+    for (unsigned int i = 0; i < mesh->numIndices; i++) {
+        ASSERT_LT(mesh->indices[i], mesh->numVertices);
+    }
+    for (unsigned int i = 0; i < mesh->numIndices; i += 3) {
+        // every triangle faces up
+        const float *a = mesh->vertices + mesh->indices[i] * mesh->vertexSize;
+        const float *b = mesh->vertices + mesh->indices[i + 1] * mesh->vertexSize;
+        const float *c = mesh->vertices + mesh->indices[i + 2] * mesh->vertexSize;
+        const float ab[] = {b[0] - a[0], b[2] - a[2]};
+        const float ac[] = {c[0] - a[0], c[2] - a[2]};
+        EXPECT_GT(ab[1] * ac[0] - ab[0] * ac[1], 0.0f);
+    }
+    const float *last = mesh->vertices + 49 * mesh->vertexSize;
+    EXPECT_FLOAT_EQ(0.5f, last[0]);
+    EXPECT_FLOAT_EQ(0.5f, last[2]);
+    EXPECT_NEAR(1.0f, length(last + normalsOffset()), 1e-5f);
+    EXPECT_FLOAT_EQ(1.0f, last[texCoords0Offset(mesh->flags)]);
+    delete mesh;
+
+    EXPECT_EQ(0, generateGrid(1, 5, 0, 1));
+}
+
+TEST(GeneratorTest, sphere) {
+    Mesh *mesh = generateSphere(6, 12, kAllAttributes, 3);
+    ASSERT_TRUE(mesh != 0);
+    EXPECT_EQ(6u * 13u, mesh->numVertices);
+    // the triangles of zero area at the poles are left out
+    EXPECT_EQ((2u * 12u * 5u - 2u * 12u) * 3u, mesh->numIndices);
+    EXPECT_EQ(kGeneratedBones, mesh->numBones);
+    for (unsigned int i = 0; i < mesh->numVertices; i++) {
+        const float *vertex = mesh->vertices + i * mesh->vertexSize;
+        EXPECT_NEAR(1.0f, length(vertex), 1e-5f);
+        EXPECT_NEAR(1.0f, length(vertex + tanOffset(mesh->flags)), 1e-5f);
+        const float *weights = mesh->boneWeights + i * kMaxBoneInfluences;
+        EXPECT_NEAR(1.0f, weights[0] + weights[1] + weights[2] + weights[3], 1e-5f);
+        EXPECT_GE(weights[0], weights[1]);
+        EXPECT_GE(weights[2], weights[3]);
+        for (unsigned int k = 0; k < kMaxBoneInfluences; k++) {
+            EXPECT_LT(mesh->boneIndices[i * kMaxBoneInfluences + k], kGeneratedBones);
+        }
+    }
+    for (unsigned int i = 0; i < mesh->numIndices; i += 3) {
+        const float *a = mesh->vertices + mesh->indices[i] * mesh->vertexSize;
+        const float *b = mesh->vertices + mesh->indices[i + 1] * mesh->vertexSize;
+        const float *c = mesh->vertices + mesh->indices[i + 2] * mesh->vertexSize;
+        float normal[3];
+        const float ab[] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+        const float ac[] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+        normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+        normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+        normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+        // no degenerate triangles and all of them face outwards
+        ASSERT_GT(length(normal), 0.0f);
+        EXPECT_GT(normal[0] * a[0] + normal[1] * a[1] + normal[2] * a[2], 0.0f);
+    }
+    delete mesh;
+}
+
+TEST(GeneratorTest, scanMergesCorners) {
+    Mesh *mesh = generateScan(20, 20, 0.01f, HAS_NORMALS | HAS_COLOR0, 5);
+    ASSERT_TRUE(mesh != 0);
+    EXPECT_EQ(0u, mesh->numIndices);
+    EXPECT_EQ(19u * 19u * 6u, mesh->numVertices);
+    Mesh *optimized = createOptimizedMesh(mesh);
+    ASSERT_TRUE(optimized != 0);
+    // the corners of a vertex are exactly equal
+    EXPECT_EQ(400u, optimized->numVertices);
+    EXPECT_EQ(mesh->numVertices, optimized->numIndices);
+    delete optimized;
+
+    // the same seed gives the same mesh, another one a different mesh
+    Mesh *same = generateScan(20, 20, 0.01f, HAS_NORMALS | HAS_COLOR0, 5);
+    Mesh *other = generateScan(20, 20, 0.01f, HAS_NORMALS | HAS_COLOR0, 6);
+    const size_t size = mesh->numVertices * mesh->vertexSize * sizeof(float);
+    EXPECT_EQ(0, memcmp(mesh->vertices, same->vertices, size));
+    EXPECT_NE(0, memcmp(mesh->vertices, other->vertices, size));
+    delete other;
+    delete same;
+    delete mesh;
+}
+
+TEST(GeneratorTest, largeMeshesAreCorners) {
+    Mesh *mesh = generateMesh(GENERATE_GRID, 100000, HAS_NORMALS, 1);
+    ASSERT_TRUE(mesh != 0);
+    EXPECT_EQ(0u, mesh->numIndices);
+    EXPECT_GT(mesh->numVertices, kMaxIndexedVertices);
+    // too many distinct vertices for the indices
+    EXPECT_EQ(0, createOptimizedMesh(mesh));
+
+    // written as it is even if optimization was requested
+    std::vector<Mesh*> meshes(1, mesh);
+    ASSERT_TRUE(writeFile(TEST_GENERATOR_FILE, &meshes, true, false));
+    std::ifstream in(TEST_GENERATOR_FILE, std::ios::binary);
+    FileHeader *fileHeader = readFileHeader(in);
+    ObjectHeader *objHeader = readObjectHeader(in);
+    EXPECT_EQ(mesh->numVertices, objHeader->vertexCount);
+    EXPECT_EQ(0u, objHeader->indexCount);
+    EXPECT_FLOAT_EQ(-0.5f, objHeader->boundsMin[0]);
+    EXPECT_FLOAT_EQ(0.5f, objHeader->boundsMax[2]);
+    delete objHeader;
+    delete fileHeader;
+    in.close();
+    unlink(TEST_GENERATOR_FILE);
+    delete mesh;
+}
@@ -0,0 +1,172 @@
+/* tests/Loader_test.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <errno.h>
+#include "rcmloader.h"
+#include "rcmwriter.h"
+#include "test_mesh.h"
+
+#define TEST_LOADER_FILE "/tmp/123456loader"
+#define TEST_LOADER_FILE_INVALID "/tmp/123456does_not_exist"
+
+static int gCallbackCount = 0;
+
+static void countCallback(const LoadRequest &request, const LoadResult &result) {
+    if (result.status == 0) {
+        gCallbackCount++;
+    }
+}
+
+class LoaderTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        meshes.push_back(createTestMesh(12, 0.0f));
+        meshes.push_back(createTestMesh(300, 1000.0f));
+        meshes.push_back(createTestMesh(7, 5000.0f));
+        writeFile(TEST_LOADER_FILE, &meshes, false, false);
+    }
+
+    virtual void TearDown() {
+        for (size_t i = 0; i < meshes.size(); i++) {
+            delete meshes[i];
+        }
+        unlink(TEST_LOADER_FILE);
+    }
+
+    void expectMeshData(const Mesh *mesh, const LoadResult &result) {
+        ASSERT_EQ(0, result.status);
+        ASSERT_NE((void*) 0, result.data);
+        EXPECT_EQ(mesh->numVertices, result.header.vertexCount);
+        EXPECT_EQ(mesh->numIndices, result.header.indexCount);
+        EXPECT_EQ(mesh->flags, result.header.vertexFlags);
+
+        const size_t vertexBytes = mesh->numVertices * mesh->vertexSize * sizeof(float);
+        EXPECT_EQ(vertexBytes + mesh->numIndices * sizeof(unsigned short), result.size);
+        EXPECT_EQ(0, memcmp(mesh->vertices, result.data, vertexBytes));
+        EXPECT_EQ(0, memcmp(mesh->indices, (char*) result.data + vertexBytes,
+                            mesh->numIndices * sizeof(unsigned short)));
+    }
+
+    std::vector<Mesh*> meshes;
+};
+
+TEST_F(LoaderTest, loadWithThreadPool) {
+    AsyncLoader loader(8, 2, false);
+    EXPECT_FALSE(loader.usesIoUring());
+
+    std::vector<std::future<LoadResult> > futures;
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        LoadRequest request;
+        request.path = TEST_LOADER_FILE;
+        request.objectIndex = i;
+        futures.push_back(loader.add(request));
+    }
+    loader.run();
+
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        LoadResult result = futures[i].get();
+        expectMeshData(meshes[i], result);
+        delete[] (char*) result.data;
+    }
+}
+
+TEST_F(LoaderTest, loadWithDefaultBackend) {
+    AsyncLoader loader;
+    LoadRequest request;
+    request.path = TEST_LOADER_FILE;
+    request.objectIndex = 2;
+    std::future<LoadResult> future = loader.add(request);
+    loader.run();
+
+    LoadResult result = future.get();
+    expectMeshData(meshes[2], result);
+    delete[] (char*) result.data;
+}
+
+TEST_F(LoaderTest, loadIntoCallerBuffer) {
+    AsyncLoader loader(4, 1, false);
+    std::vector<char> buffer(64 * 1024);
+
+    gCallbackCount = 0;
+    LoadRequest request;
+    request.path = TEST_LOADER_FILE;
+    request.objectIndex = 1;
+    request.buffer = &buffer[0];
+    request.bufferSize = buffer.size();
+    request.callback = countCallback;
+    std::future<LoadResult> future = loader.add(request);
+    loader.run();
+
+    LoadResult result = future.get();
+    EXPECT_EQ(1, gCallbackCount);
+    EXPECT_EQ((void*) &buffer[0], result.data);
+    expectMeshData(meshes[1], result);
+}
+
+TEST_F(LoaderTest, loadErrors) {
+    AsyncLoader loader(4, 1, false);
+    char smallBuffer[16];
+
+    LoadRequest missingFile;
+    missingFile.path = TEST_LOADER_FILE_INVALID;
+    LoadRequest missingObject;
+    missingObject.path = TEST_LOADER_FILE;
+    missingObject.objectIndex = 3;
+    LoadRequest bufferTooSmall;
+    bufferTooSmall.path = TEST_LOADER_FILE;
+    bufferTooSmall.buffer = smallBuffer;
+    bufferTooSmall.bufferSize = sizeof(smallBuffer);
+
+    std::future<LoadResult> a = loader.add(missingFile);
+    std::future<LoadResult> b = loader.add(missingObject);
+    std::future<LoadResult> c = loader.add(bufferTooSmall);
+    loader.run();
+
+    EXPECT_EQ(-ENOENT, a.get().status);
+    EXPECT_EQ(-ERANGE, b.get().status);
+    LoadResult result = c.get();
+    EXPECT_EQ(-ENOBUFS, result.status);
+    EXPECT_EQ((void*) 0, result.data);
+}
+
+static void* allocateBuffer(size_t size, size_t alignment, void *userData) {
+    return new char[size];
+}
+
+static void releaseBuffer(void *data, void *userData) {
+    delete[] (char*) data;
+    (*(int*) userData)++;
+}
+
+TEST_F(LoaderTest, releaseAllocationOnError) {
+    // the data of the last object is cut off after it was allocated
+    ASSERT_EQ(0, truncate(TEST_LOADER_FILE, sizeof(FileHeader) + 3 * sizeof(ObjectHeader)));
+    int released = 0;
+    ReaderAllocator allocator = { allocateBuffer, &released, releaseBuffer };
+    AsyncLoader loader(4, 1, false);
+    LoadRequest request;
+    request.path = TEST_LOADER_FILE;
+    request.allocator = &allocator;
+    std::future<LoadResult> future = loader.add(request);
+    loader.run();
+    LoadResult result = future.get();
+    EXPECT_EQ(-EIO, result.status);
+    EXPECT_EQ((void*) 0, result.data);
+    EXPECT_EQ(1, released);
+}
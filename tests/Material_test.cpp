@@ -0,0 +1,233 @@
+/* tests/Material_test.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <iterator>
+#include "internal/rcm_internal.h"
+#include "rcmreader.h"
+#include "test_mesh.h"
+
+#define TEST_MATERIAL_FILE "/tmp/123456material"
+
+static void createMaterial(const char *name, float red, Material &material) {
+    material.nameHash = hashName(name, strlen(name));
+    const float diffuse[] = {red, 0.5f, 0.25f, 1.0f};
+    memcpy(material.diffuse, diffuse, sizeof(diffuse));
+    memset(material.specular, 0, sizeof(material.specular));
+    memset(material.emissive, 0, sizeof(material.emissive));
+    material.shininess = 16.0f;
+    material.flags = 0;
+}
+
+TEST(MaterialTest, encodeAndOpen) {
+    std::vector<Material> materials(2);
+    createMaterial("wood", 0.8f, materials[0]);
+    createMaterial("metal", 0.2f, materials[1]);
+    materials[0].texturePaths[DIFFUSE_TEXTURE] = "wood.png";
+    materials[0].texturePaths[NORMAL_TEXTURE] = "normal.png";
+    materials[1].texturePaths[NORMAL_TEXTURE] = "normal.png";
+    materials[1].flags = MATERIAL_TWO_SIDED;
+    // only the normal map is embedded
+    std::vector<Texture> textures(1);
+    textures[0].nameHash = hashName("normal.png", 10);
+
+    std::vector<uint8_t> data;
+    encodeMaterials(materials, textures, data);
+    // both materials share the path of the normal map
+    EXPECT_EQ(2 * sizeof(MaterialEntry) + 9 + 11, data.size());
+    MaterialsView view;
+    ASSERT_TRUE(openMaterials(&data[0], data.size(), 2, &view));
+    ASSERT_EQ(2u, view.materialCount);
+    const MaterialEntry &wood = view.materials[0];
+    EXPECT_EQ(materials[0].nameHash, wood.nameHash);
+    EXPECT_FLOAT_EQ(0.8f, wood.diffuse[0]);
+    EXPECT_FLOAT_EQ(16.0f, wood.shininess);
+    EXPECT_STREQ("wood.png", materialTexturePath(view, wood, DIFFUSE_TEXTURE));
+    EXPECT_EQ(kNoTexture, wood.textures[DIFFUSE_TEXTURE].texture);
+    EXPECT_EQ(0u, wood.textures[NORMAL_TEXTURE].texture);
+    EXPECT_EQ(0, materialTexturePath(view, wood, SPECULAR_TEXTURE));
+    const MaterialEntry &metal = view.materials[1];
+    EXPECT_EQ(MATERIAL_TWO_SIDED, metal.flags);
+    EXPECT_EQ(wood.textures[NORMAL_TEXTURE].path, metal.textures[NORMAL_TEXTURE].path);
+    EXPECT_STREQ("normal.png", materialTexturePath(view, metal, NORMAL_TEXTURE));
+}
+
+TEST(MaterialTest, rejectsCorruptData) {
+    std::vector<Material> materials(1);
+    createMaterial("wood", 0.8f, materials[0]);
+    materials[0].texturePaths[DIFFUSE_TEXTURE] = "wood.png";
+    std::vector<uint8_t> data;
+    encodeMaterials(materials, std::vector<Texture>(), data);
+    MaterialsView view;
+    EXPECT_FALSE(openMaterials(&data[0], sizeof(MaterialEntry) - 1, 1, &view));
+    EXPECT_FALSE(openMaterials(&data[0], data.size(), 2, &view));
+    // the name table lost its terminator
+    EXPECT_FALSE(openMaterials(&data[0], data.size() - 1, 1, &view));
+    // the path points behind the name table
+    ((MaterialEntry*) &data[0])->textures[DIFFUSE_TEXTURE].path = 100;
+    EXPECT_FALSE(openMaterials(&data[0], data.size(), 1, &view));
+}
+
+TEST(MaterialTest, sortByMaterial) {
+    Scene scene;
+    scene.meshes.push_back(createTestMesh(3, 0.0f));
+    scene.meshes.push_back(createTestMesh(3, 1.0f, HAS_POSITIONS));
+    scene.meshes.push_back(createTestMesh(3, 2.0f));
+    scene.meshes.push_back(createTestMesh(3, 3.0f, HAS_POSITIONS));
+    scene.meshes[0]->materialIndex = 1;
+    scene.meshes[1]->materialIndex = 1;
+    scene.meshes[2]->materialIndex = 0;
+    scene.meshes[3]->materialIndex = 1;
+    Mesh *original[] = {scene.meshes[0], scene.meshes[1], scene.meshes[2], scene.meshes[3]};
+    scene.instances.resize(4);
+    for (unsigned int i = 0; i < 4; i++) {
+        scene.instances[i].objectIndex = i;
+    }
+    sortMeshesByMaterial(&scene);
+    // material 0, then the meshes of material 1 with positions only in their
+    // original order, then the mesh with normals and uvs
+    EXPECT_EQ(original[2], scene.meshes[0]);
+    EXPECT_EQ(original[1], scene.meshes[1]);
+    EXPECT_EQ(original[3], scene.meshes[2]);
+    EXPECT_EQ(original[0], scene.meshes[3]);
+    for (unsigned int i = 0; i < 4; i++) {
+        EXPECT_EQ(original[i], scene.meshes[scene.instances[i].objectIndex]);
+    }
+}
+
+TEST(MaterialTest, equalMeshesWithOtherMaterialsAreKept) {
+    std::vector<Mesh*> meshes;
+    meshes.push_back(createTestMesh(4, 0.0f));
+    meshes.push_back(createTestMesh(4, 0.0f));
+    meshes[1]->materialIndex = 1;
+    std::vector<unsigned int> meshMap;
+    EXPECT_EQ(0u, removeDuplicateMeshes(meshes, meshMap));
+    EXPECT_EQ(2u, meshes.size());
+    delete meshes[0];
+    delete meshes[1];
+}
+
+TEST(MaterialTest, writeAndRead) {
+    Scene scene;
+    scene.meshes.push_back(createTestMesh(3, 0.0f));
+    scene.meshes.push_back(createTestMesh(3, 1.0f));
+    scene.meshes[0]->materialIndex = 1;
+    // out of range, written without material
+    scene.meshes[1]->materialIndex = 7;
+    scene.materials.resize(2);
+    createMaterial("wood", 0.8f, scene.materials[0]);
+    createMaterial("metal", 0.2f, scene.materials[1]);
+    scene.materials[1].texturePaths[SPECULAR_TEXTURE] = "metal.png";
+    ASSERT_TRUE(writeSceneFile(TEST_MATERIAL_FILE, &scene, false, false));
+    std::ifstream in(TEST_MATERIAL_FILE, std::ios::binary);
+    std::vector<char> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+
+    MemoryStream stream(&file[0], file.size());
+    FileHeader fileHeader;
+    ObjectHeader objHeader;
+    ASSERT_TRUE(readFileHeader(stream, &fileHeader));
+    EXPECT_EQ(3, fileHeader.objectCount);
+    // the table comes before the models
+    ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+    EXPECT_EQ(MATERIALS, objHeader.type);
+    MaterialsView view;
+    ASSERT_TRUE(readMaterials(stream, &objHeader, &view));
+    ASSERT_EQ(2u, view.materialCount);
+    EXPECT_EQ(scene.materials[1].nameHash, view.materials[1].nameHash);
+    EXPECT_STREQ("metal.png", materialTexturePath(view, view.materials[1], SPECULAR_TEXTURE));
+    delete[] (char*) view.allocation;
+    ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+    EXPECT_EQ(1u, objHeader.materialIndex);
+    ASSERT_TRUE(skipObject(stream, &objHeader));
+    ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+    EXPECT_EQ(kNoMaterial, objHeader.materialIndex);
+    ASSERT_TRUE(skipObject(stream, &objHeader));
+    EXPECT_EQ(stream.size, stream.position);
+
+    // the same through a file stream
+    std::ifstream fileStream(TEST_MATERIAL_FILE, std::ios::binary);
+    FileHeader *header = readFileHeader(fileStream);
+    ObjectHeader *object = readObjectHeader(fileStream);
+    ASSERT_TRUE(readMaterials(fileStream, object, &view));
+    EXPECT_FLOAT_EQ(0.8f, view.materials[0].diffuse[0]);
+    delete[] (char*) view.allocation;
+    delete object;
+    delete header;
+    fileStream.close();
+
+    // without materials the models have none
+    scene.materials.clear();
+    ASSERT_TRUE(writeSceneFile(TEST_MATERIAL_FILE, &scene, false, false));
+    fileStream.open(TEST_MATERIAL_FILE, std::ios::binary);
+    header = readFileHeader(fileStream);
+    EXPECT_EQ(2, header->objectCount);
+    object = readObjectHeader(fileStream);
+    EXPECT_EQ(kNoMaterial, object->materialIndex);
+    delete object;
+    delete header;
+    fileStream.close();
+    unlink(TEST_MATERIAL_FILE);
+}
+
+TEST(MaterialTest, instancesReferToModelObjects) {
+    // the material table and the BVH of the first mesh come before the second
+    Scene scene;
+    scene.meshes.push_back(createTestMesh(3, 0.0f));
+    scene.meshes.push_back(createTestMesh(3, 1.0f));
+    scene.meshes[0]->storeBvh = true;
+    scene.materials.resize(1);
+    createMaterial("wood", 0.8f, scene.materials[0]);
+    const uint32_t meshIndices[] = {1, 0, 1};
+    scene.instances.resize(3);
+    for (unsigned int i = 0; i < 3; i++) {
+        memset(&scene.instances[i], 0, sizeof(Instance));
+        scene.instances[i].objectIndex = meshIndices[i];
+    }
+    ASSERT_TRUE(writeSceneFile(TEST_MATERIAL_FILE, &scene, false, false));
+    std::ifstream in(TEST_MATERIAL_FILE, std::ios::binary);
+    std::vector<char> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    unlink(TEST_MATERIAL_FILE);
+
+    MemoryStream stream(&file[0], file.size());
+    FileHeader fileHeader;
+    ASSERT_TRUE(readFileHeader(stream, &fileHeader));
+    ASSERT_EQ(5, fileHeader.objectCount);
+    std::vector<uint32_t> types;
+    ObjectHeader objHeader;
+    for (unsigned int i = 0; i < 4; i++) {
+        ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+        types.push_back(objHeader.type);
+        ASSERT_TRUE(skipObject(stream, &objHeader));
+    }
+    ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+    Instance instances[3];
+    ASSERT_TRUE(readInstances(stream, &objHeader, instances));
+    EXPECT_EQ(3u, instances[0].objectIndex);
+    EXPECT_EQ(1u, instances[1].objectIndex);
+    EXPECT_EQ(3u, instances[2].objectIndex);
+    EXPECT_EQ((uint32_t) MATERIALS, types[0]);
+    EXPECT_EQ((uint32_t) ARRAY_OF_STRUCTS, types[instances[1].objectIndex]);
+    EXPECT_EQ((uint32_t) BVH, types[2]);
+    EXPECT_EQ((uint32_t) ARRAY_OF_STRUCTS, types[instances[0].objectIndex]);
+
+    // an instance of a mesh that does not exist
+    scene.instances[1].objectIndex = 2;
+    EXPECT_FALSE(writeSceneFile(TEST_MATERIAL_FILE, &scene, false, false));
+}
@@ -0,0 +1,188 @@
+/* tests/Morph_test.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <iterator>
+#include "rcmreader.h"
+#include "rcmwriter.h"
+#include "test_mesh.h"
+
+#define TEST_MORPH_FILE "/tmp/123456morph"
+
+// adds a target that moves every vertex in moved by (vertex index + 1) * 0.1
+// along y, with normal deltas if withNormals
+static void addTarget(Mesh *mesh, const std::vector<unsigned int> &moved, bool withNormals) {
+    MorphTarget *targets = new MorphTarget[mesh->numMorphTargets + 1];
+    std::copy(mesh->morphTargets, mesh->morphTargets + mesh->numMorphTargets, targets);
+    delete[] mesh->morphTargets;
+    mesh->morphTargets = targets;
+    MorphTarget &target = targets[mesh->numMorphTargets++];
+    target.nameHash = mesh->numMorphTargets;
+    target.positionDeltas = new float[mesh->numVertices * 3]();
+    target.normalDeltas = withNormals ? new float[mesh->numVertices * 3]() : 0;
+    for (size_t i = 0; i < moved.size(); i++) {
+        target.positionDeltas[moved[i] * 3 + 1] = (moved[i] + 1) * 0.1f;
+        if (withNormals) {
+            target.normalDeltas[moved[i] * 3] = -0.05f;
+        }
+    }
+}
+
+static std::vector<unsigned int> vertexList(unsigned int first, unsigned int count,
+        unsigned int step) {
+    std::vector<unsigned int> list;
+    for (unsigned int i = 0; i < count; i++) {
+        list.push_back(first + i * step);
+    }
+    return list;
+}
+
+// applies the targets of mesh to a copy of its vertices and compares the
+// result with the deltas computed in floats
+static void checkApply(Mesh *mesh, const float *weights, float tolerance) {
+    std::vector<uint8_t> data;
+    uint16_t flags = 0;
+    ASSERT_TRUE(encodeMorphTargets(mesh->morphTargets, mesh->numMorphTargets, mesh->numVertices,
+                                   mesh->quantizeMorphTargets, data, flags));
+    MorphTargetsView view;
+    ASSERT_TRUE(openMorphTargets(&data[0], data.size(), flags, mesh->numMorphTargets,
+                                 mesh->numVertices, &view));
+
+    std::vector<float> vertices(mesh->vertices,
+                                mesh->vertices + mesh->numVertices * mesh->vertexSize);
+    applyMorphTargets(view, weights, &vertices[positionOffset()], &vertices[normalsOffset()],
+                      mesh->vertexSize);
+    for (unsigned int v = 0; v < mesh->numVertices; v++) {
+        for (unsigned int k = 0; k < 3; k++) {
+            float position = mesh->vertices[v * mesh->vertexSize + positionOffset() + k];
+            float normal = mesh->vertices[v * mesh->vertexSize + normalsOffset() + k];
+            for (unsigned int t = 0; t < mesh->numMorphTargets; t++) {
+                const MorphTarget &target = mesh->morphTargets[t];
+                position += weights[t] * target.positionDeltas[v * 3 + k];
+                if (target.normalDeltas) {
+                    normal += weights[t] * target.normalDeltas[v * 3 + k];
+                }
+            }
+            EXPECT_NEAR(position, vertices[v * mesh->vertexSize + positionOffset() + k], tolerance);
+            EXPECT_NEAR(normal, vertices[v * mesh->vertexSize + normalsOffset() + k], tolerance);
+        }
+    }
+    // the texture coordinates are left alone
+    EXPECT_EQ(mesh->vertices[texCoords0Offset(mesh->flags)], vertices[texCoords0Offset(mesh->flags)]);
+}
+
+TEST(MorphTest, storesOnlyMovedVertices) {
+    Mesh *mesh = createTestMesh(10, 0.0f);
+    addTarget(mesh, vertexList(2, 2, 5), false);
+    addTarget(mesh, vertexList(5, 1, 1), true);
+    std::vector<uint8_t> data;
+    uint16_t flags = 0;
+    ASSERT_TRUE(encodeMorphTargets(mesh->morphTargets, 2, 10, false, data, flags));
+    EXPECT_EQ(MORPH_NORMALS, flags);
+    MorphTargetsView view;
+    ASSERT_TRUE(openMorphTargets(&data[0], data.size(), flags, 2, 10, &view));
+    EXPECT_EQ(3u, view.deltaCount);
+    EXPECT_EQ(2u, view.targets[0].deltaCount);
+    EXPECT_EQ(2u, view.vertexIndices[0]);
+    EXPECT_EQ(7u, view.vertexIndices[1]);
+    EXPECT_EQ(5u, view.vertexIndices[2]);
+    EXPECT_EQ(2u, view.targets[1].nameHash);
+    // the first target does not change the normals, its normal deltas are 0
+    const float *deltas = (const float*) view.deltas;
+    EXPECT_FLOAT_EQ(0.8f, deltas[6 + 1]);
+    EXPECT_FLOAT_EQ(0.0f, deltas[6 + 3]);
+    EXPECT_FLOAT_EQ(-0.05f, deltas[12 + 3]);
+    // vertex indices have to exist in the base mesh
+    EXPECT_FALSE(openMorphTargets(&data[0], data.size(), flags, 2, 7, &view));
+    EXPECT_FALSE(openMorphTargets(&data[0], data.size() - 4, flags, 2, 10, &view));
+    delete mesh;
+}
+
+TEST(MorphTest, applyFloatDeltas) {
+    Mesh *mesh = createTestMesh(40, 0.0f);
+    // 11 moved vertices exercise whole blocks and the rest
+    addTarget(mesh, vertexList(1, 11, 3), true);
+    addTarget(mesh, vertexList(0, 6, 2), false);
+    addTarget(mesh, vertexList(39, 1, 1), true);
+    const float weights[] = {0.5f, 2.0f, 0.0f};
+    checkApply(mesh, weights, 1e-4f);
+    delete mesh;
+}
+
+TEST(MorphTest, applyQuantizedDeltas) {
+    Mesh *mesh = createTestMesh(40, 0.0f);
+    mesh->quantizeMorphTargets = true;
+    addTarget(mesh, vertexList(1, 11, 3), true);
+    addTarget(mesh, vertexList(0, 6, 2), false);
+    const float weights[] = {0.75f, -1.0f};
+    // the largest delta is 3.2, one step is 3.2 / 32767
+    checkApply(mesh, weights, 2e-4f);
+    delete mesh;
+}
+
+TEST(MorphTest, optimizeKeepsMovedVertices) {
+    // vertices 0 and 2 as well as 1 and 3 are equal, but only vertex 2 moves
+    Mesh *mesh = createTestMesh(4, 0.0f, HAS_POSITIONS);
+    const float positions[] = {0, 0, 0, 1, 1, 1, 0, 0, 0, 1, 1, 1};
+    memcpy(mesh->vertices, positions, sizeof(positions));
+    delete[] mesh->indices;
+    const unsigned short indices[] = {0, 1, 2, 2, 1, 3};
+    mesh->indices = new unsigned short[6];
+    memcpy(mesh->indices, indices, sizeof(indices));
+    mesh->numIndices = 6;
+    addTarget(mesh, vertexList(2, 1, 1), false);
+
+    std::vector<Mesh*> meshes(1, mesh);
+    ASSERT_TRUE(writeFile(TEST_MORPH_FILE, &meshes, true, false));
+    std::ifstream in(TEST_MORPH_FILE, std::ios::binary);
+    std::vector<char> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    unlink(TEST_MORPH_FILE);
+
+    MemoryStream stream(&file[0], file.size());
+    FileHeader fileHeader;
+    ObjectHeader model;
+    ObjectHeader objHeader;
+    ASSERT_TRUE(readFileHeader(stream, &fileHeader));
+    EXPECT_EQ(2, fileHeader.objectCount);
+    ASSERT_TRUE(readObjectHeader(stream, &model));
+    EXPECT_EQ(3u, model.vertexCount);
+    ASSERT_TRUE(skipObject(stream, &model));
+    ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+    EXPECT_EQ(MORPH_TARGETS, objHeader.type);
+    MorphTargetsView view;
+    ASSERT_TRUE(readMorphTargets(stream, &objHeader, model.vertexCount, &view));
+    EXPECT_EQ(stream.size, stream.position);
+    ASSERT_EQ(1u, view.deltaCount);
+    EXPECT_EQ(2u, view.vertexIndices[0]);
+    EXPECT_FLOAT_EQ(0.3f, ((const float*) view.deltas)[1]);
+    delete[] (char*) view.allocation;
+    delete mesh;
+}
+
+TEST(MorphTest, noSharedBuffersOrPacks) {
+    // neither of them has a place for the morph targets of a mesh
+    Mesh *mesh = createTestMesh(10, 0.0f);
+    addTarget(mesh, vertexList(2, 1, 1), false);
+    std::vector<Mesh*> meshes(1, mesh);
+    EXPECT_FALSE(writeSharedBuffersFile(TEST_MORPH_FILE, &meshes, true, false));
+    std::vector<std::string> names(1, "morph");
+    EXPECT_FALSE(writePackFile(TEST_MORPH_FILE, names, &meshes, true, false));
+    unlink(TEST_MORPH_FILE);
+    delete mesh;
+}
@@ -0,0 +1,129 @@
+/* tests/Pack_test.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <unistd.h>
+#include "rcmpack.h"
+#include "rcmwriter.h"
+#include "test_mesh.h"
+
+#define TEST_PACK_FILE "/tmp/123456pack"
+
+class PackTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        for (unsigned int i = 0; i < 1000; i++) {
+            std::stringstream name;
+            name << "level/mesh_" << i;
+            names.push_back(name.str());
+            meshes.push_back(createTestMesh(3 + i % 17, i * 100.0f));
+        }
+    }
+
+    virtual void TearDown() {
+        for (size_t i = 0; i < meshes.size(); i++) {
+            delete meshes[i];
+        }
+        unlink(TEST_PACK_FILE);
+    }
+
+    std::vector<std::string> names;
+    std::vector<Mesh*> meshes;
+};
+
+TEST_F(PackTest, findAllObjects) {
+    ASSERT_TRUE(writePackFile(TEST_PACK_FILE, names, &meshes, false, false));
+    Pack *pack = openPack(TEST_PACK_FILE);
+    ASSERT_NE((Pack*) 0, pack);
+    EXPECT_EQ(meshes.size(), pack->header->objectCount);
+
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const PackEntry *entry = findPackEntry(pack, names[i].c_str());
+        ASSERT_NE((const PackEntry*) 0, entry);
+        EXPECT_EQ(names[i], packEntryName(pack, entry));
+        EXPECT_EQ(0, entry->objectOffset % kPackObjectAlignment);
+
+        ObjectHeader header;
+        ObjectView view;
+        ASSERT_TRUE(readPackObject(pack, entry, &header, &view));
+        // objects are aligned in the pack, so the data is used in place
+        EXPECT_EQ((void*) 0, view.allocation);
+        Mesh *mesh = meshes[i];
+        ASSERT_EQ(mesh->numVertices, header.vertexCount);
+        EXPECT_EQ(0, memcmp(mesh->vertices, view.vertices[POSITION_ARRAY],
+                            mesh->numVertices * mesh->vertexSize * sizeof(float)));
+        EXPECT_EQ(0, memcmp(mesh->indices, view.indices,
+                            mesh->numIndices * sizeof(unsigned short)));
+    }
+    EXPECT_EQ((const PackEntry*) 0, findPackEntry(pack, "level/mesh_1000"));
+    EXPECT_EQ((const PackEntry*) 0, findPackEntry(pack, ""));
+    closePack(pack);
+}
+
+TEST_F(PackTest, emptyPack) {
+    std::vector<std::string> noNames;
+    std::vector<Mesh*> noMeshes;
+    ASSERT_TRUE(writePackFile(TEST_PACK_FILE, noNames, &noMeshes));
+    Pack *pack = openPack(TEST_PACK_FILE);
+    ASSERT_NE((Pack*) 0, pack);
+    EXPECT_EQ(0, pack->header->objectCount);
+    EXPECT_EQ((const PackEntry*) 0, findPackEntry(pack, "level/mesh_0"));
+    closePack(pack);
+}
+
+TEST_F(PackTest, duplicateNames) {
+    names[10] = names[20];
+    EXPECT_FALSE(writePackFile(TEST_PACK_FILE, names, &meshes));
+}
+
+TEST_F(PackTest, corruptPack) {
+    ASSERT_TRUE(writePackFile(TEST_PACK_FILE, names, &meshes, false, false));
+    std::ifstream in(TEST_PACK_FILE, std::ios::binary);
+    std::vector<uint64_t> memory(1024 * 1024);
+    in.read((char*) &memory[0], memory.size() * sizeof(uint64_t));
+    const size_t size = in.gcount();
+    in.close();
+
+    Pack *pack = openPack(&memory[0], size);
+    ASSERT_NE((Pack*) 0, pack);
+    // an entry whose object is not a model is not read as one
+    const PackEntry *entry = findPackEntry(pack, names[0].c_str());
+    ASSERT_NE((const PackEntry*) 0, entry);
+    ObjectHeader *object = (ObjectHeader*) ((char*) &memory[0] + entry->objectOffset);
+    const uint8_t type = object->type;
+    object->type = MORPH_TARGETS;
+    ObjectHeader objHeader;
+    ObjectView view;
+    EXPECT_FALSE(readPackObject(pack, entry, &objHeader, &view));
+    object->type = type;
+    closePack(pack);
+
+    EXPECT_EQ((Pack*) 0, openPack(&memory[0], size / 2));
+
+    PackHeader *header = (PackHeader*) &memory[0];
+    header->objectCount += 1;
+    EXPECT_EQ((Pack*) 0, openPack(&memory[0], size));
+    header->objectCount -= 1;
+    // larger than any shift of the bucket count
+    const uint32_t bucketBits = header->bucketBits;
+    header->bucketBits = 200;
+    EXPECT_EQ((Pack*) 0, openPack(&memory[0], size));
+    header->bucketBits = bucketBits;
+    header->magicNumber[0] = 0;
+    EXPECT_EQ((Pack*) 0, openPack(&memory[0], size));
+}
@@ -17,8 +17,10 @@
 
 #include <gtest/gtest.h>
 #include <assimp/Importer.hpp>
+#include <math.h>
 #include "rcmreader.h"
 #include "internal/rcm_internal.h"
+#include "test_mesh.h"
 
 #define TEST_MODEL "suzanne.obj"
 #define TEST_MODEL_INVALID "does_not_exist"
@@ -275,3 +277,460 @@ TEST_F(ReaderTest, readUnoptimizedStructOfArrays) {
     unlink(TEST_ARRAYS_DATA_FILE);
 }
 
+
+struct TestArena {
+    char *memory;
+    size_t size;
+    size_t used;
+    int allocations;
+};
+
+static void* arenaAllocate(size_t size, size_t alignment, void *userData) {
+    TestArena *arena = (TestArena*) userData;
+    size_t offset = (arena->used + alignment - 1) & ~(alignment - 1);
+    if (offset + size > arena->size) {
+        return 0;
+    }
+    arena->used = offset + size;
+    arena->allocations++;
+    return arena->memory + offset;
+}
+
+TEST(ReaderBuffersTest, calcObjectBufferSizes) {
+    const unsigned short flags = HAS_POSITIONS | HAS_NORMALS | HAS_UV0 | HAS_COLOR0;
+    ObjectHeader *header = createObjectHeader(flags, 3, 5, 0, calcVertexSize(flags), false);
+    ObjectBufferSizes sizes;
+    calcObjectBufferSizes(header, &sizes);
+    EXPECT_EQ(3 * calcVertexSize(flags) * sizeof(float), sizes.arraySize[POSITION_ARRAY]);
+    EXPECT_EQ(0, sizes.arraySize[NORMALS_ARRAY]);
+    EXPECT_EQ(0, sizes.indexOffset % kObjectBufferAlignment);
+    EXPECT_EQ(5 * sizeof(unsigned short), sizes.indexSize);
+    EXPECT_EQ(sizes.indexOffset + sizes.indexSize, sizes.totalSize);
+    delete header;
+
+    header = createObjectHeader(flags, 3, 5, 0, calcVertexSize(flags), true);
+    calcObjectBufferSizes(header, &sizes);
+    EXPECT_EQ(3 * kPositionSize * sizeof(float), sizes.arraySize[POSITION_ARRAY]);
+    EXPECT_EQ(3 * kNormalsSize * sizeof(float), sizes.arraySize[NORMALS_ARRAY]);
+    EXPECT_EQ(3 * kTextureSize * sizeof(float), sizes.arraySize[UV0_ARRAY]);
+    EXPECT_EQ(0, sizes.arraySize[UV1_ARRAY]);
+    EXPECT_EQ(3 * kColorSize * sizeof(float), sizes.arraySize[COLOR0_ARRAY]);
+    EXPECT_EQ(0, sizes.arraySize[TANGENT_ARRAY]);
+    for (int i = 0; i < kNumVertexArrays; i++) {
+        EXPECT_EQ(0, sizes.arrayOffset[i] % kObjectBufferAlignment);
+    }
+    EXPECT_EQ(sizes.indexOffset + sizes.indexSize, sizes.totalSize);
+    delete header;
+}
+
+TEST(ReaderBuffersTest, readObjectIntoStructOfArrays) {
+    const unsigned short flags = HAS_POSITIONS | HAS_NORMALS | HAS_UV0 | HAS_TAN_AND_BITAN;
+    std::vector<Mesh*> meshes;
+    meshes.push_back(createTestMesh(31, 0.0f, flags));
+    writeFile(TEST_ARRAYS_DATA_FILE, &meshes, false, true);
+
+    std::ifstream in(TEST_ARRAYS_DATA_FILE, std::ios::binary);
+    FileHeader *fileHeader = readFileHeader(in);
+    ObjectHeader *objHeader = readObjectHeader(in);
+    ASSERT_EQ(STRUCT_OF_ARRAYS, objHeader->type);
+
+    ObjectBufferSizes sizes;
+    calcObjectBufferSizes(objHeader, &sizes);
+    std::vector<float> memory(sizes.totalSize / sizeof(float) + 1);
+    ObjectBuffers buffers;
+    ASSERT_FALSE(readObjectInto(in, objHeader, &memory[0], sizes.totalSize - 1, &buffers));
+    ASSERT_TRUE(readObjectInto(in, objHeader, &memory[0], sizes.totalSize, &buffers));
+    in.close();
+    unlink(TEST_ARRAYS_DATA_FILE);
+
+    Mesh *mesh = meshes[0];
+    ASSERT_NE((float*) 0, buffers.vertices[TANGENT_ARRAY]);
+    EXPECT_EQ((float*) 0, buffers.vertices[UV1_ARRAY]);
+    for (unsigned int i = 0; i < mesh->numVertices; i++) {
+        const float *vertex = mesh->vertices + i * mesh->vertexSize;
+        for (int k = 0; k < kPositionSize; k++) {
+            EXPECT_EQ(vertex[k], buffers.vertices[POSITION_ARRAY][i * kPositionSize + k]);
+        }
+        for (int k = 0; k < kNormalsSize; k++) {
+            EXPECT_EQ(vertex[normalsOffset() + k],
+                      buffers.vertices[NORMALS_ARRAY][i * kNormalsSize + k]);
+        }
+        for (int k = 0; k < kBitanSize; k++) {
+            EXPECT_EQ(vertex[bitanOffset(flags) + k],
+                      buffers.vertices[BITANGENT_ARRAY][i * kBitanSize + k]);
+        }
+    }
+    for (unsigned int i = 0; i < mesh->numIndices; i++) {
+        EXPECT_EQ(mesh->indices[i], buffers.indices[i]);
+    }
+    delete mesh;
+}
+
+TEST(ReaderBuffersTest, readObjectWithAllocator) {
+    std::vector<Mesh*> meshes;
+    meshes.push_back(createTestMesh(17, 0.0f));
+    meshes.push_back(createTestMesh(40, 100.0f));
+    writeFile(TEST_STRUCTS_DATA_FILE, &meshes, false, false);
+
+    std::vector<char> memory(16 * 1024);
+    TestArena arena = { &memory[0], memory.size(), 0, 0 };
+    ReaderAllocator allocator = { arenaAllocate, &arena, 0 };
+
+    std::ifstream in(TEST_STRUCTS_DATA_FILE, std::ios::binary);
+    FileHeader *fileHeader = readFileHeader(in);
+    for (size_t n = 0; n < meshes.size(); n++) {
+        ObjectHeader *objHeader = readObjectHeader(in);
+        ObjectBuffers buffers;
+        ASSERT_TRUE(readObject(in, objHeader, allocator, &buffers));
+        EXPECT_EQ(n + 1, arena.allocations);
+
+        Mesh *mesh = meshes[n];
+        EXPECT_EQ(0, memcmp(mesh->vertices, buffers.vertices[POSITION_ARRAY],
+                            mesh->numVertices * mesh->vertexSize * sizeof(float)));
+        EXPECT_EQ(0, memcmp(mesh->indices, buffers.indices,
+                            mesh->numIndices * sizeof(unsigned short)));
+        delete objHeader;
+        delete mesh;
+    }
+    in.close();
+    unlink(TEST_STRUCTS_DATA_FILE);
+}
+
+static std::vector<char> readWholeFile(const char *path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<char>((std::istreambuf_iterator<char>(in)),
+                             std::istreambuf_iterator<char>());
+}
+
+TEST(MemoryReaderTest, readObjectViews) {
+    std::vector<Mesh*> meshes;
+    meshes.push_back(createTestMesh(9, 0.0f));
+    meshes.push_back(createTestMesh(21, 500.0f));
+    writeFile(TEST_STRUCTS_DATA_FILE, &meshes, false, false);
+    std::vector<char> file = readWholeFile(TEST_STRUCTS_DATA_FILE);
+    unlink(TEST_STRUCTS_DATA_FILE);
+
+    // place the file such that the first object's data is float aligned
+    const size_t dataOffset = sizeof(FileHeader) + sizeof(ObjectHeader);
+    const size_t shift = (sizeof(float) - dataOffset % sizeof(float)) % sizeof(float);
+    std::vector<float> memory(file.size() / sizeof(float) + 2);
+    char *base = (char*) &memory[0] + shift;
+    memcpy(base, &file[0], file.size());
+
+    MemoryStream in(base, file.size());
+    FileHeader fileHeader;
+    ASSERT_TRUE(readFileHeader(in, &fileHeader));
+    EXPECT_EQ(2, fileHeader.objectCount);
+
+    for (size_t n = 0; n < meshes.size(); n++) {
+        ObjectHeader objHeader;
+        ASSERT_TRUE(readObjectHeader(in, &objHeader));
+        ObjectView view;
+        ASSERT_TRUE(readObjectView(in, &objHeader, &view));
+        Mesh *mesh = meshes[n];
+        EXPECT_EQ(0, memcmp(mesh->vertices, view.vertices[POSITION_ARRAY],
+                            mesh->numVertices * mesh->vertexSize * sizeof(float)));
+        EXPECT_EQ(0, memcmp(mesh->indices, view.indices,
+                            mesh->numIndices * sizeof(unsigned short)));
+        if (n == 0) {
+            // data is referenced in place
+            EXPECT_EQ((void*) 0, view.allocation);
+            EXPECT_EQ((const void*) (base + dataOffset), (const void*) view.vertices[POSITION_ARRAY]);
+        }
+        delete[] (char*) view.allocation;
+        delete mesh;
+    }
+    EXPECT_EQ(file.size(), in.position);
+}
+
+TEST(MemoryReaderTest, readObjectViewCopiesUnaligned) {
+    std::vector<Mesh*> meshes;
+    meshes.push_back(createTestMesh(5, 0.0f, HAS_POSITIONS | HAS_COLOR0));
+    writeFile(TEST_ARRAYS_DATA_FILE, &meshes, false, true);
+    std::vector<char> file = readWholeFile(TEST_ARRAYS_DATA_FILE);
+    unlink(TEST_ARRAYS_DATA_FILE);
+
+    const size_t dataOffset = sizeof(FileHeader) + sizeof(ObjectHeader);
+    const size_t shift = (sizeof(float) - dataOffset % sizeof(float)) % sizeof(float) + 1;
+    std::vector<float> memory(file.size() / sizeof(float) + 2);
+    char *base = (char*) &memory[0] + shift;
+    memcpy(base, &file[0], file.size());
+
+    MemoryStream in(base, file.size());
+    FileHeader fileHeader;
+    ObjectHeader objHeader;
+    ObjectView view;
+    ASSERT_TRUE(readFileHeader(in, &fileHeader));
+    ASSERT_TRUE(readObjectHeader(in, &objHeader));
+    ASSERT_TRUE(readObjectView(in, &objHeader, &view));
+    ASSERT_NE((void*) 0, view.allocation);
+    EXPECT_EQ((const float*) 0, view.vertices[NORMALS_ARRAY]);
+
+    Mesh *mesh = meshes[0];
+    for (unsigned int i = 0; i < mesh->numVertices; i++) {
+        for (int k = 0; k < kColorSize; k++) {
+            EXPECT_EQ(mesh->vertices[i * mesh->vertexSize + color0Offset(mesh->flags) + k],
+                      view.vertices[COLOR0_ARRAY][i * kColorSize + k]);
+        }
+    }
+    delete[] (char*) view.allocation;
+    delete mesh;
+}
+
+TEST(MemoryReaderTest, truncatedData) {
+    std::vector<Mesh*> meshes;
+    meshes.push_back(createTestMesh(9, 0.0f));
+    writeFile(TEST_STRUCTS_DATA_FILE, &meshes, false, false);
+    std::vector<char> file = readWholeFile(TEST_STRUCTS_DATA_FILE);
+    unlink(TEST_STRUCTS_DATA_FILE);
+    delete meshes[0];
+
+    FileHeader fileHeader;
+    ObjectHeader objHeader;
+    MemoryStream tooSmall(&file[0], sizeof(FileHeader) - 1);
+    EXPECT_FALSE(readFileHeader(tooSmall, &fileHeader));
+
+    MemoryStream noObject(&file[0], sizeof(FileHeader) + sizeof(ObjectHeader) - 1);
+    ASSERT_TRUE(readFileHeader(noObject, &fileHeader));
+    EXPECT_FALSE(readObjectHeader(noObject, &objHeader));
+    EXPECT_EQ(sizeof(FileHeader), noObject.position);
+
+    MemoryStream noData(&file[0], file.size() - 1);
+    ASSERT_TRUE(readFileHeader(noData, &fileHeader));
+    EXPECT_FALSE(readObjectHeader(noData, &objHeader));
+
+    file[3] = kFileFormatVersionMinor - 1;
+    MemoryStream oldVersion(&file[0], file.size());
+    EXPECT_FALSE(readFileHeader(oldVersion, &fileHeader));
+
+    file[0] = 0;
+    MemoryStream badMagic(&file[0], file.size());
+    EXPECT_FALSE(readFileHeader(badMagic, &fileHeader));
+}
+
+TEST(MemoryReaderTest, blocksAreNoModels) {
+    // a morph target block whose element count would claim 12000 bytes of
+    // positions when read as a vertex count
+    uint64_t data[(sizeof(BlockHeader) + 8) / sizeof(uint64_t)];
+    memset(data, 0, sizeof(data));
+    BlockHeader *block = (BlockHeader*) data;
+    block->type = MORPH_TARGETS;
+    block->flags = HAS_POSITIONS;
+    block->elementCount = 1000;
+    block->dataSize = 8;
+    MemoryStream in(data, sizeof(data));
+    ObjectHeader objHeader;
+    ASSERT_TRUE(readObjectHeader(in, &objHeader));
+    ObjectView view;
+    EXPECT_FALSE(readObjectView(in, &objHeader, &view));
+    char buffer[16];
+    ObjectBuffers buffers;
+    EXPECT_FALSE(readObjectInto(in, &objHeader, buffer, sizeof(buffer), &buffers));
+    EXPECT_EQ(sizeof(BlockHeader), in.position);
+}
+
+TEST(MemoryReaderTest, boundsInHeader) {
+    std::vector<Mesh*> meshes;
+    meshes.push_back(createTestMesh(5, 10.0f, HAS_POSITIONS | HAS_UV0));
+    writeFile(TEST_STRUCTS_DATA_FILE, &meshes, false, true);
+    std::vector<char> file = readWholeFile(TEST_STRUCTS_DATA_FILE);
+    unlink(TEST_STRUCTS_DATA_FILE);
+    delete meshes[0];
+
+    // positions of vertex i are 10 + 5 * i + (0, 1, 2)
+    MemoryStream in(&file[0], file.size());
+    FileHeader fileHeader;
+    ObjectHeader objHeader;
+    ASSERT_TRUE(readFileHeader(in, &fileHeader));
+    ASSERT_TRUE(readObjectHeader(in, &objHeader));
+    for (unsigned int k = 0; k < 3; k++) {
+        EXPECT_EQ(10.0f + k, objHeader.boundsMin[k]);
+        EXPECT_EQ(30.0f + k, objHeader.boundsMax[k]);
+        EXPECT_EQ(20.0f + k, objHeader.sphereCenter[k]);
+    }
+    EXPECT_FLOAT_EQ(sqrtf(300.0f), objHeader.sphereRadius);
+}
+
+TEST(SharedBuffersTest, readDrawRanges) {
+    std::vector<Mesh*> meshes;
+    meshes.push_back(createTestMesh(12, 0.0f));
+    meshes.push_back(createTestMesh(5, 100.0f, HAS_POSITIONS));
+    meshes.push_back(createTestMesh(30, 1000.0f));
+    ASSERT_TRUE(writeSharedBuffersFile(TEST_STRUCTS_DATA_FILE, &meshes, true, true));
+    std::vector<char> file = readWholeFile(TEST_STRUCTS_DATA_FILE);
+    unlink(TEST_STRUCTS_DATA_FILE);
+
+    MemoryStream in(&file[0], file.size());
+    FileHeader fileHeader;
+    ASSERT_TRUE(readFileHeader(in, &fileHeader));
+    EXPECT_EQ(4, fileHeader.objectCount);
+
+    // meshes 0 and 2 share the first model
+    ObjectHeader objHeader;
+    ObjectView view;
+    ASSERT_TRUE(readObjectHeader(in, &objHeader));
+    EXPECT_EQ(STRUCT_OF_ARRAYS, objHeader.type);
+    EXPECT_EQ(42u, objHeader.vertexCount);
+    EXPECT_EQ(42u, objHeader.indexCount);
+    ASSERT_TRUE(readObjectView(in, &objHeader, &view));
+    EXPECT_EQ(meshes[2]->vertices[0], view.vertices[POSITION_ARRAY][12 * kPositionSize]);
+    EXPECT_EQ(0, view.indices[12]);
+
+    ASSERT_TRUE(readObjectHeader(in, &objHeader));
+    ASSERT_EQ(DRAW_RANGES, objHeader.type);
+    ASSERT_EQ(2u, asBlockHeader(&objHeader)->elementCount);
+    DrawRange ranges[2];
+    DrawCommand commands[2];
+    ASSERT_TRUE(readDrawRanges(in, &objHeader, ranges, commands));
+    EXPECT_EQ(0u, ranges[0].firstVertex);
+    EXPECT_EQ(12u, ranges[0].vertexCount);
+    EXPECT_EQ(12u, ranges[1].firstVertex);
+    EXPECT_EQ(30u, ranges[1].vertexCount);
+    EXPECT_EQ(12u, ranges[1].firstIndex);
+    EXPECT_EQ(30u, ranges[1].indexCount);
+    EXPECT_EQ(30u, commands[1].indexCount);
+    EXPECT_EQ(1u, commands[1].instanceCount);
+    EXPECT_EQ(12u, commands[1].firstIndex);
+    EXPECT_EQ(12, commands[1].baseVertex);
+    EXPECT_EQ(1u, commands[1].baseInstance);
+
+    // the second model holds mesh 1 alone, its draw ranges can be skipped
+    ASSERT_TRUE(readObjectHeader(in, &objHeader));
+    EXPECT_EQ(5u, objHeader.vertexCount);
+    ASSERT_TRUE(skipObject(in, &objHeader));
+    ASSERT_TRUE(readObjectHeader(in, &objHeader));
+    ASSERT_TRUE(skipObject(in, &objHeader));
+    EXPECT_EQ(file.size(), in.position);
+
+    delete[] (char*) view.allocation;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        delete meshes[i];
+    }
+}
+
+TEST(SceneTest, removeDuplicatesAndReadInstances) {
+    Scene scene;
+    scene.meshes.push_back(createTestMesh(12, 0.0f));
+    scene.meshes.push_back(createTestMesh(12, 0.0f));
+    scene.meshes.push_back(createTestMesh(12, 1.0f));
+    scene.meshes.push_back(createTestMesh(12, 0.0f, HAS_POSITIONS));
+    scene.meshes.push_back(createTestMesh(12, 0.0f));
+    strcpy(scene.meshes[1]->name, "copy");
+
+    std::vector<unsigned int> meshMap;
+    EXPECT_EQ(2u, removeDuplicateMeshes(scene.meshes, meshMap));
+    ASSERT_EQ(3u, scene.meshes.size());
+    ASSERT_EQ(5u, meshMap.size());
+    EXPECT_EQ(0u, meshMap[0]);
+    EXPECT_EQ(0u, meshMap[1]);
+    EXPECT_EQ(1u, meshMap[2]);
+    EXPECT_EQ(2u, meshMap[3]);
+    EXPECT_EQ(0u, meshMap[4]);
+
+    for (unsigned int i = 0; i < meshMap.size(); i++) {
+        Instance instance;
+        memset(&instance, 0, sizeof(Instance));
+        instance.objectIndex = meshMap[i];
+        instance.transform[0] = instance.transform[5] = instance.transform[10] = 1.0f;
+        instance.transform[15] = 1.0f;
+        instance.transform[12] = (float) i;
+        scene.instances.push_back(instance);
+    }
+    ASSERT_TRUE(writeSceneFile(TEST_STRUCTS_DATA_FILE, &scene, true, false));
+    std::vector<char> file = readWholeFile(TEST_STRUCTS_DATA_FILE);
+    unlink(TEST_STRUCTS_DATA_FILE);
+
+    MemoryStream in(&file[0], file.size());
+    FileHeader fileHeader;
+    ObjectHeader objHeader;
+    ASSERT_TRUE(readFileHeader(in, &fileHeader));
+    ASSERT_EQ(4, fileHeader.objectCount);
+    for (unsigned int i = 0; i < 3; i++) {
+        ASSERT_TRUE(readObjectHeader(in, &objHeader));
+        ASSERT_TRUE(skipObject(in, &objHeader));
+    }
+    ASSERT_TRUE(readObjectHeader(in, &objHeader));
+    ASSERT_EQ(INSTANCES, objHeader.type);
+    ASSERT_EQ(5u, asBlockHeader(&objHeader)->elementCount);
+    Instance instances[5];
+    ASSERT_TRUE(readInstances(in, &objHeader, instances));
+    EXPECT_EQ(2u, instances[3].objectIndex);
+    EXPECT_EQ(0u, instances[4].objectIndex);
+    EXPECT_EQ(4.0f, instances[4].transform[12]);
+    EXPECT_EQ(file.size(), in.position);
+}
+
+// four corners of positions with a skin where corners 0 and 3 are equal and
+// corner 1 only differs in its weights
+static Mesh* createSkinnedMesh(bool wideWeights) {
+    Mesh *mesh = createTestMesh(4, 0.0f, HAS_POSITIONS | HAS_BONES);
+    if (wideWeights) {
+        mesh->flags |= USES_16BIT_WEIGHTS;
+    }
+    memcpy(&mesh->vertices[9], &mesh->vertices[0], 3 * sizeof(float));
+    memcpy(&mesh->vertices[3], &mesh->vertices[0], 3 * sizeof(float));
+    mesh->numBones = 2;
+    mesh->bones = new BoneData[2];
+    memset(mesh->bones, 0, 2 * sizeof(BoneData));
+    mesh->bones[0].nameHash = hashName("root", 4);
+    mesh->bones[1].nameHash = hashName("arm", 3);
+    mesh->bones[1].inverseBindMatrix[15] = 1.0f;
+    const unsigned char boneIndices[] = {0, 1, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0};
+    const float boneWeights[] = {0.7f, 0.3f, 0, 0, 0.6f, 0.4f, 0, 0,
+                                 1.0f, 0, 0, 0, 0.7f, 0.3f, 0, 0};
+    mesh->boneIndices = new unsigned char[16];
+    mesh->boneWeights = new float[16];
+    memcpy(mesh->boneIndices, boneIndices, sizeof(boneIndices));
+    memcpy(mesh->boneWeights, boneWeights, sizeof(boneWeights));
+    return mesh;
+}
+
+TEST(SkinTest, writeAndReadSkin) {
+    std::vector<Mesh*> meshes;
+    meshes.push_back(createSkinnedMesh(false));
+    meshes.push_back(createSkinnedMesh(true));
+    ASSERT_TRUE(writeFile(TEST_STRUCTS_DATA_FILE, &meshes, true, true));
+    std::vector<char> file = readWholeFile(TEST_STRUCTS_DATA_FILE);
+    unlink(TEST_STRUCTS_DATA_FILE);
+
+    MemoryStream in(&file[0], file.size());
+    FileHeader fileHeader;
+    ASSERT_TRUE(readFileHeader(in, &fileHeader));
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        ObjectHeader objHeader;
+        ObjectView view;
+        ASSERT_TRUE(readObjectHeader(in, &objHeader));
+        EXPECT_EQ(3u, objHeader.vertexCount);
+        EXPECT_EQ(4u, objHeader.indexCount);
+        EXPECT_EQ(2u, objHeader.boneCount);
+        ASSERT_TRUE(readObjectView(in, &objHeader, &view));
+        EXPECT_EQ(0, view.indices[3]);
+
+        BoneData bone;
+        memcpy(&bone, (const uint8_t*) view.bones + sizeof(BoneData), sizeof(BoneData));
+        EXPECT_EQ(hashName("arm", 3), bone.nameHash);
+        EXPECT_EQ(1.0f, bone.inverseBindMatrix[15]);
+        EXPECT_EQ(1, view.boneIndices[1]);
+        EXPECT_EQ(1, view.boneIndices[8]);
+
+        // weights add up exactly after rounding
+        if (uses16BitWeights(objHeader.vertexFlags)) {
+            uint16_t weights[12];
+            memcpy(weights, view.boneWeights, sizeof(weights));
+            EXPECT_EQ(45874, weights[0]);
+            EXPECT_EQ(0xffff, weights[0] + weights[1]);
+            EXPECT_EQ(0xffff, weights[4] + weights[5]);
+            EXPECT_EQ(0xffff, weights[8]);
+        } else {
+            EXPECT_EQ(178, view.boneWeights[0]);
+            EXPECT_EQ(0xff, view.boneWeights[0] + view.boneWeights[1]);
+            EXPECT_EQ(0xff, view.boneWeights[4] + view.boneWeights[5]);
+            EXPECT_EQ(0xff, view.boneWeights[8]);
+        }
+        delete[] (char*) view.allocation;
+    }
+    EXPECT_EQ(file.size(), in.position);
+    for (size_t i = 0; i < meshes.size(); i++) {
+        delete meshes[i];
+    }
+}
@@ -0,0 +1,138 @@
+/* tests/Stats_test.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "rcmgenerator.h"
+#include "rcmstats.h"
+
+#define TEST_STATS_FILE "/tmp/123456stats"
+
+static uint64_t sAllocations = 0;
+
+// one allocation between any two calls
+static uint64_t countAllocations() {
+    return sAllocations++;
+}
+
+static uint64_t fileSize(const char *path) {
+    struct stat info;
+    return stat(path, &info) == 0 ? info.st_size : 0;
+}
+
+TEST(StatsTest, nothingIsCollectedByDefault) {
+    ConvertStats stats;
+    Mesh *mesh = generateScan(10, 10, 0.01f, HAS_NORMALS, 1);
+    Mesh *optimized = createOptimizedMesh(mesh);
+    EXPECT_EQ(0u, stats.stages[STAGE_DEDUP].calls);
+
+    collectConvertStats(&stats);
+    collectConvertStats(0);
+    delete optimized;
+    optimized = createOptimizedMesh(mesh);
+    EXPECT_EQ(0u, stats.stages[STAGE_DEDUP].calls);
+    delete optimized;
+    delete mesh;
+}
+
+TEST(StatsTest, dedupCountsVertices) {
+    ConvertStats stats;
+    Mesh *mesh = generateScan(20, 20, 0.01f, HAS_NORMALS | HAS_UV0, 2);
+    collectConvertStats(&stats);
+    Mesh *optimized = createOptimizedMesh(mesh);
+    collectConvertStats(0);
+    ASSERT_TRUE(optimized != 0);
+
+    const StageStats &dedup = stats.stages[STAGE_DEDUP];
+    EXPECT_EQ(1u, dedup.calls);
+    EXPECT_EQ(19u * 19u * 6u, dedup.verticesIn);
+    EXPECT_EQ(400u, dedup.verticesOut);
+    EXPECT_EQ(mesh->numVertices * mesh->vertexSize * sizeof(float), dedup.bytesIn);
+    EXPECT_EQ(optimized->numVertices * optimized->vertexSize * sizeof(float) +
+              optimized->numIndices * sizeof(unsigned short), dedup.bytesOut);
+    EXPECT_GE(dedup.wallSeconds, 0.0);
+    EXPECT_GT(dedup.peakRssBytes, 0u);
+    // no counter given
+    EXPECT_EQ(0u, dedup.allocations);
+    delete optimized;
+    delete mesh;
+}
+
+TEST(StatsTest, writeExcludesNestedStages) {
+    ConvertStats stats;
+    stats.countAllocations = countAllocations;
+    Mesh *mesh = generateGrid(16, 16, HAS_NORMALS | HAS_COLOR0, 3);
+    std::vector<Mesh*> meshes(1, mesh);
+    sAllocations = 100;
+    collectConvertStats(&stats);
+    ASSERT_TRUE(writeFile(TEST_STATS_FILE, &meshes, true, true));
+    collectConvertStats(0);
+
+    const StageStats &write = stats.stages[STAGE_WRITE];
+    const StageStats &dedup = stats.stages[STAGE_DEDUP];
+    const StageStats &layout = stats.stages[STAGE_LAYOUT];
+    EXPECT_EQ(1u, write.calls);
+    EXPECT_EQ(1u, dedup.calls);
+    EXPECT_EQ(1u, layout.calls);
+    EXPECT_EQ(0u, stats.stages[STAGE_IMPORT].calls);
+    EXPECT_EQ(256u, write.verticesIn);
+    EXPECT_EQ(256u, write.verticesOut);
+    EXPECT_EQ(fileSize(TEST_STATS_FILE), write.bytesOut);
+    EXPECT_EQ(256u * mesh->vertexSize * sizeof(float), layout.bytesOut);
+    // the write stage sees five allocations, two of them in the nested stages
+    EXPECT_EQ(1u, dedup.allocations);
+    EXPECT_EQ(1u, layout.allocations);
+    EXPECT_EQ(3u, write.allocations);
+
+    // array of structs does not convert the layout
+    collectConvertStats(&stats);
+    ASSERT_TRUE(writeFile(TEST_STATS_FILE, &meshes, false, false));
+    collectConvertStats(0);
+    EXPECT_EQ(2u, write.calls);
+    EXPECT_EQ(1u, layout.calls);
+    unlink(TEST_STATS_FILE);
+    delete mesh;
+}
+
+TEST(StatsTest, printJson) {
+    ConvertStats stats;
+    stats.stages[STAGE_DEDUP].calls = 2;
+    stats.stages[STAGE_DEDUP].verticesIn = 600;
+    stats.stages[STAGE_DEDUP].verticesOut = 150;
+    stats.stages[STAGE_WRITE].bytesOut = 4096;
+    stats.stages[STAGE_WRITE].peakRssBytes = 1 << 20;
+    std::stringstream json;
+    printConvertStatsJson(json, stats, "in \"a\".obj", "out\\a.rcm");
+    const std::string text = json.str();
+    EXPECT_NE(std::string::npos, text.find("\"input\": \"in \\\"a\\\".obj\""));
+    EXPECT_NE(std::string::npos, text.find("\"output\": \"out\\\\a.rcm\""));
+    EXPECT_NE(std::string::npos, text.find("\"allocations_counted\": false"));
+    EXPECT_NE(std::string::npos, text.find("{\"stage\": \"dedup\", \"calls\": 2,"));
+    EXPECT_NE(std::string::npos, text.find("\"vertices_in\": 600, \"vertices_out\": 150"));
+    EXPECT_NE(std::string::npos, text.find("\"peak_rss_bytes\": 1048576}\n}"));
+    for (unsigned int i = 0; i < kNumConvertStages; i++) {
+        const std::string entry = std::string("\"stage\": \"") + stageName((ConvertStage) i);
+        EXPECT_NE(std::string::npos, text.find(entry));
+    }
+
+    std::stringstream table;
+    printConvertStats(table, stats);
+    EXPECT_NE(std::string::npos, table.str().find("dedup"));
+    EXPECT_NE(std::string::npos, table.str().find("total"));
+}
@@ -0,0 +1,241 @@
+/* tests/Texture_test.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <iterator>
+#include "internal/rcm_internal.h"
+#include "rcmreader.h"
+#include "test_mesh.h"
+
+#define TEST_TEXTURE_FILE "/tmp/123456texture"
+
+static void createTexture(uint32_t width, uint32_t height, uint16_t flags, Texture &texture) {
+    texture.nameHash = hashName("texture.png", 11);
+    texture.width = width;
+    texture.height = height;
+    texture.flags = flags;
+    texture.pixels.resize(width * height * 4);
+    for (size_t i = 0; i < texture.pixels.size(); i++) {
+        texture.pixels[i] = (uint8_t) (i * 7);
+    }
+}
+
+static void fill(Texture &texture, uint32_t x, uint32_t y, uint8_t r, uint8_t g, uint8_t b,
+        uint8_t a) {
+    uint8_t *texel = &texture.pixels[(y * texture.width + x) * 4];
+    texel[0] = r;
+    texel[1] = g;
+    texel[2] = b;
+    texel[3] = a;
+}
+
+TEST(TextureTest, layoutForUpload) {
+    Texture texture;
+    createTexture(5, 3, 0, texture);
+    MipChain levels;
+    ASSERT_TRUE(generateMipChain(texture, MIP_FILTER_BOX, levels));
+    ASSERT_EQ(3u, levels.size());
+    EXPECT_EQ(2u * 1u * 4u, levels[1].size());
+    EXPECT_EQ(4u, levels[2].size());
+
+    // the data starts somewhere in the file, the levels start on 512 bytes
+    const size_t dataOffset = 70;
+    std::vector<uint8_t> data;
+    ASSERT_TRUE(encodeTexture(texture, levels, dataOffset, data));
+    TextureView view;
+    ASSERT_TRUE(openTexture(&data[0], data.size(), texture.flags, 3, &view));
+    EXPECT_EQ(5u, view.header.width);
+    EXPECT_EQ(texture.nameHash, view.header.nameHash);
+    for (uint32_t i = 0; i < 3; i++) {
+        EXPECT_EQ(0u, (dataOffset + view.levels[i].offset) % kTextureLevelAlignment);
+        EXPECT_EQ(kTextureRowAlignment, view.levels[i].rowPitch);
+    }
+    EXPECT_EQ(2u, view.levels[1].width);
+    EXPECT_EQ(1u, view.levels[1].height);
+    for (uint32_t y = 0; y < 3; y++) {
+        EXPECT_EQ(0, memcmp(&texture.pixels[y * 5 * 4],
+                            view.data + view.levels[0].offset + y * view.levels[0].rowPitch, 5 * 4));
+    }
+
+    EXPECT_FALSE(openTexture(&data[0], data.size(), 0, 2, &view));
+    EXPECT_FALSE(openTexture(&data[0], data.size() - 1, 0, 3, &view));
+    levels.pop_back();
+    EXPECT_FALSE(encodeTexture(texture, levels, 0, data));
+    texture.pixels.pop_back();
+    EXPECT_FALSE(generateMipChain(texture, MIP_FILTER_BOX, levels));
+}
+
+TEST(TextureTest, boxFilterAverages) {
+    Texture texture;
+    createTexture(4, 2, 0, texture);
+    for (uint32_t y = 0; y < 2; y++) {
+        fill(texture, 0, y, 0, 0, 0, 0);
+        fill(texture, 1, y, 100, 200, 40, 255);
+        fill(texture, 2, y, 255, 255, 255, 255);
+        fill(texture, 3, y, 255, 255, 255, 255);
+    }
+    MipChain levels;
+    ASSERT_TRUE(generateMipChain(texture, MIP_FILTER_BOX, levels));
+    ASSERT_EQ(3u, levels.size());
+    const uint8_t first[] = {50, 100, 20, 128, 255, 255, 255, 255};
+    EXPECT_EQ(std::vector<uint8_t>(first, first + 8), levels[1]);
+    EXPECT_EQ(153, levels[2][0]);
+    EXPECT_EQ(191, levels[2][3]);
+
+    // odd sizes: the texel in the middle counts half for both sides
+    Texture odd;
+    createTexture(3, 1, 0, odd);
+    fill(odd, 0, 0, 0, 0, 0, 0);
+    fill(odd, 1, 0, 90, 90, 90, 90);
+    fill(odd, 2, 0, 0, 0, 0, 0);
+    ASSERT_TRUE(generateMipChain(odd, MIP_FILTER_BOX, levels));
+    ASSERT_EQ(2u, levels.size());
+    EXPECT_EQ(30, levels[1][0]);
+}
+
+TEST(TextureTest, colorsAreFilteredInLinearSpace) {
+    Texture texture;
+    createTexture(2, 1, TEXTURE_SRGB, texture);
+    fill(texture, 0, 0, 0, 0, 0, 0);
+    fill(texture, 1, 0, 255, 255, 255, 255);
+    MipChain levels;
+    ASSERT_TRUE(generateMipChain(texture, MIP_FILTER_BOX, levels));
+    // linear 0.5 is 188 in sRGB, alpha stays linear
+    EXPECT_EQ(188, levels[1][0]);
+    EXPECT_EQ(188, levels[1][2]);
+    EXPECT_EQ(128, levels[1][3]);
+}
+
+TEST(TextureTest, normalMapsStayNormalized) {
+    Texture texture;
+    createTexture(2, 2, TEXTURE_NORMAL_MAP, texture);
+    for (uint32_t y = 0; y < 2; y++) {
+        // +x and +y
+        fill(texture, 0, y, 255, 128, 128, 255);
+        fill(texture, 1, y, 128, 255, 128, 255);
+    }
+    MipChain levels;
+    ASSERT_TRUE(generateMipChain(texture, MIP_FILTER_BOX, levels));
+    // (0.707, 0.707, 0)
+    EXPECT_NEAR(218, levels[1][0], 1);
+    EXPECT_NEAR(218, levels[1][1], 1);
+    EXPECT_NEAR(128, levels[1][2], 1);
+}
+
+TEST(TextureTest, kaiserKeepsFlatAreas) {
+    Texture texture;
+    createTexture(64, 16, TEXTURE_SRGB, texture);
+    for (uint32_t y = 0; y < 16; y++) {
+        for (uint32_t x = 0; x < 64; x++) {
+            fill(texture, x, y, 30, 140, 250, 77);
+        }
+    }
+    MipChain levels;
+    ASSERT_TRUE(generateMipChain(texture, MIP_FILTER_KAISER, levels));
+    ASSERT_EQ(7u, levels.size());
+    for (size_t l = 1; l < levels.size(); l++) {
+        for (size_t i = 0; i < levels[l].size(); i += 4) {
+            EXPECT_NEAR(30, levels[l][i], 1);
+            EXPECT_NEAR(140, levels[l][i + 1], 1);
+            EXPECT_NEAR(250, levels[l][i + 2], 1);
+            EXPECT_NEAR(77, levels[l][i + 3], 1);
+        }
+    }
+}
+
+TEST(TextureTest, convertAiTexture) {
+    aiTexture aitexture;
+    aitexture.mWidth = 2;
+    aitexture.mHeight = 1;
+    aitexture.pcData = new aiTexel[2];
+    const aiTexel texels[] = {{1, 2, 3, 4}, {5, 6, 7, 8}};
+    memcpy(aitexture.pcData, texels, sizeof(texels));
+    Texture texture;
+    ASSERT_TRUE(convertAiTexture(&aitexture, texture));
+    EXPECT_EQ(2u, texture.width);
+    const uint8_t rgba[] = {3, 2, 1, 4, 7, 6, 5, 8};
+    EXPECT_EQ(std::vector<uint8_t>(rgba, rgba + 8), texture.pixels);
+
+    // compressed data of an unknown format
+    aitexture.mWidth = 8;
+    aitexture.mHeight = 0;
+    delete[] aitexture.pcData;
+    aitexture.pcData = new aiTexel[2]();
+    EXPECT_FALSE(convertAiTexture(&aitexture, texture));
+}
+
+TEST(TextureTest, writeAndRead) {
+    Scene scene;
+    scene.meshes.push_back(createTestMesh(3, 0.0f));
+    scene.textures.resize(3);
+    createTexture(33, 17, TEXTURE_SRGB, scene.textures[0]);
+    createTexture(8, 8, TEXTURE_NORMAL_MAP, scene.textures[1]);
+    createTexture(1, 1, 0, scene.textures[2]);
+    scene.mipFilter = MIP_FILTER_KAISER;
+    ASSERT_TRUE(writeSceneFile(TEST_TEXTURE_FILE, &scene, false, false));
+    std::ifstream in(TEST_TEXTURE_FILE, std::ios::binary);
+    std::vector<char> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+
+    MemoryStream stream(&file[0], file.size());
+    FileHeader fileHeader;
+    ObjectHeader objHeader;
+    ASSERT_TRUE(readFileHeader(stream, &fileHeader));
+    EXPECT_EQ(4, fileHeader.objectCount);
+    ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+    ASSERT_TRUE(skipObject(stream, &objHeader));
+    for (size_t t = 0; t < scene.textures.size(); t++) {
+        ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+        EXPECT_EQ(TEXTURE, objHeader.type);
+        const size_t dataStart = stream.position;
+        TextureView view;
+        ASSERT_TRUE(readTexture(stream, &objHeader, &view));
+        EXPECT_EQ(scene.textures[t].flags, view.flags);
+        // the mip chains built in parallel equal the ones built one by one
+        MipChain levels;
+        ASSERT_TRUE(generateMipChain(scene.textures[t], MIP_FILTER_KAISER, levels));
+        ASSERT_EQ(levels.size(), view.header.levelCount);
+        for (uint32_t l = 0; l < view.header.levelCount; l++) {
+            const TextureLevel &level = view.levels[l];
+            EXPECT_EQ(0u, (dataStart + level.offset) % kTextureLevelAlignment);
+            for (uint32_t y = 0; y < level.height; y++) {
+                EXPECT_EQ(0, memcmp(&levels[l][y * level.width * 4],
+                                    view.data + level.offset + y * level.rowPitch,
+                                    level.width * 4));
+            }
+        }
+    }
+    EXPECT_EQ(stream.size, stream.position);
+
+    // the same through a file stream
+    std::ifstream fileStream(TEST_TEXTURE_FILE, std::ios::binary);
+    FileHeader *header = readFileHeader(fileStream);
+    ObjectHeader *object = readObjectHeader(fileStream);
+    fileStream.seekg(calcObjectDataSize(object), std::ios::cur);
+    delete object;
+    object = readObjectHeader(fileStream);
+    TextureView view;
+    ASSERT_TRUE(readTexture(fileStream, object, &view));
+    EXPECT_EQ(33u, view.header.width);
+    EXPECT_EQ(6u, view.header.levelCount);
+    delete[] (char*) view.allocation;
+    delete object;
+    delete header;
+    fileStream.close();
+    unlink(TEST_TEXTURE_FILE);
+}
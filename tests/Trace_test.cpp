@@ -0,0 +1,111 @@
+/* tests/Trace_test.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include <gtest/gtest.h>
+#include <set>
+#include <sstream>
+#include <unistd.h>
+#include "rcmgenerator.h"
+#include "rcmtrace.h"
+
+#define TEST_TRACE_FILE "/tmp/123456trace"
+
+static size_t countOccurrences(const std::string &text, const std::string &pattern) {
+    size_t count = 0;
+    for (size_t i = text.find(pattern); i != std::string::npos; i = text.find(pattern, i + 1)) {
+        count++;
+    }
+    return count;
+}
+
+static std::string traceText() {
+    std::stringstream out;
+    writeTrace(out);
+    return out.str();
+}
+
+static Texture createTexture(uint32_t size) {
+    Texture texture;
+    texture.nameHash = 0;
+    texture.width = size;
+    texture.height = size;
+    texture.flags = 0;
+    texture.pixels.assign(size * size * 4, 128);
+    return texture;
+}
+
+TEST(TraceTest, recordsOnlyWhileTracing) {
+    Mesh *mesh = generateGrid(4, 4, HAS_NORMALS, 1);
+    delete createOptimizedMesh(mesh);
+    startTrace();
+    EXPECT_TRUE(isTracing());
+    delete createOptimizedMesh(mesh);
+    stopTrace();
+    EXPECT_FALSE(isTracing());
+    delete createOptimizedMesh(mesh);
+    delete mesh;
+
+    const std::string text = traceText();
+    EXPECT_EQ(0u, text.find("{\"displayTimeUnit\": \"ms\", \"traceEvents\": ["));
+    EXPECT_EQ(1u, countOccurrences(text, "\"name\": \"createOptimizedMesh\""));
+    EXPECT_NE(std::string::npos, text.find("\"ph\": \"X\""));
+
+    // a new trace drops the old events
+    startTrace();
+    stopTrace();
+    EXPECT_EQ(0u, countOccurrences(traceText(), "\"name\""));
+}
+
+TEST(TraceTest, nestedCallsAndThreads) {
+    Mesh *mesh = generateGrid(8, 8, HAS_NORMALS, 2);
+    std::vector<Mesh*> meshes(1, mesh);
+    std::vector<Texture> textures;
+    for (unsigned int i = 0; i < 4; i++) {
+        textures.push_back(createTexture(64));
+    }
+    startTrace();
+    ASSERT_TRUE(writeFile(TEST_TRACE_FILE, &meshes, true, true));
+    std::vector<MipChain> chains;
+    ASSERT_TRUE(generateMipChains(textures, MIP_FILTER_BOX, chains, 2));
+    stopTrace();
+    unlink(TEST_TRACE_FILE);
+    delete mesh;
+
+    const std::string text = traceText();
+    EXPECT_EQ(1u, countOccurrences(text, "\"name\": \"writeFile\""));
+    EXPECT_EQ(2u, countOccurrences(text, "\"name\": \"writeObject\""));
+    EXPECT_EQ(1u, countOccurrences(text, "\"name\": \"transposeVertices\""));
+    EXPECT_EQ(4u, countOccurrences(text, "\"name\": \"generateMipChain\""));
+
+    // the mip chains were generated on the pool threads
+    std::set<std::string> threads;
+    for (size_t i = text.find("\"tid\": "); i != std::string::npos; i = text.find("\"tid\": ", i + 1)) {
+        threads.insert(text.substr(i, text.find(',', i) - i));
+    }
+    EXPECT_GE(threads.size(), 2u);
+}
+
+TEST(TraceTest, keepsTheLatestEvents) {
+    Mesh *mesh = generateGrid(2, 2, 0, 3);
+    startTrace();
+    for (size_t i = 0; i < kTraceBufferEvents + 10; i++) {
+        delete createOptimizedMesh(mesh);
+    }
+    stopTrace();
+    delete mesh;
+    EXPECT_EQ(kTraceBufferEvents, countOccurrences(traceText(), "\"name\": \"createOptimizedMesh\""));
+}
@@ -0,0 +1,252 @@
+/* tests/Weld_test.cpp
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <iterator>
+#include <math.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "internal/rcm_internal.h"
+#include "rcmgenerator.h"
+#include "rcmweld.h"
+#include "test_mesh.h"
+
+#define TEST_WELD_CORNER_FILE "/tmp/123456weldcorners"
+#define TEST_WELD_VERTEX_FILE "/tmp/123456weldvertices"
+#define TEST_WELD_INDEX_FILE "/tmp/123456weldindices"
+#define TEST_WELD_TEMP_DIR "/tmp"
+
+template<typename T>
+static std::vector<T> readArray(const char *path) {
+    std::ifstream in(path, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::vector<T> values(bytes.size() / sizeof(T));
+    memcpy(values.data(), bytes.data(), values.size() * sizeof(T));
+    return values;
+}
+
+static void writeCorners(const Mesh *mesh) {
+    std::ofstream out(TEST_WELD_CORNER_FILE, std::ios::trunc | std::ios::binary);
+    out.write((char*) mesh->vertices, mesh->numVertices * mesh->vertexSize * sizeof(float));
+}
+
+class WeldTest : public ::testing::Test {
+protected:
+    virtual void TearDown() {
+        unlink(TEST_WELD_CORNER_FILE);
+        unlink(TEST_WELD_VERTEX_FILE);
+        unlink(TEST_WELD_INDEX_FILE);
+    }
+
+    // welds the corners of mesh and compares the result with the one of
+    // optimizeArrayOfStructs()
+    void expectSameAsInMemory(const Mesh *mesh, size_t memoryBudget, unsigned int numThreads) {
+        std::vector<unsigned short> expectedIndices;
+        std::vector<Vertex<float> > expectedVertices;
+        ASSERT_TRUE(optimizeArrayOfStructs(mesh->vertices, mesh->vertexSize, mesh->numVertices,
+                                           expectedIndices, expectedVertices));
+        writeCorners(mesh);
+        uint64_t numVertices = 0;
+        ASSERT_TRUE(weldFile(TEST_WELD_CORNER_FILE, mesh->vertexSize, TEST_WELD_VERTEX_FILE,
+                             TEST_WELD_INDEX_FILE, TEST_WELD_TEMP_DIR, memoryBudget,
+                             numThreads, &numVertices));
+        EXPECT_EQ(expectedVertices.size(), numVertices);
+
+        const std::vector<float> vertices = readArray<float>(TEST_WELD_VERTEX_FILE);
+        ASSERT_EQ(expectedVertices.size() * mesh->vertexSize, vertices.size());
+        for (size_t i = 0; i < expectedVertices.size(); i++) {
+            ASSERT_EQ(0, memcmp(expectedVertices[i].array, &vertices[i * mesh->vertexSize],
+                                mesh->vertexSize * sizeof(float)));
+        }
+        const std::vector<uint32_t> indices = readArray<uint32_t>(TEST_WELD_INDEX_FILE);
+        ASSERT_EQ(expectedIndices.size(), indices.size());
+        for (size_t i = 0; i < indices.size(); i++) {
+            ASSERT_EQ(expectedIndices[i], indices[i]);
+        }
+    }
+};
+
+TEST_F(WeldTest, singlePartition) {
+    Mesh *scan = generateScan(20, 20, 0.01f, HAS_NORMALS, 1);
+    expectSameAsInMemory(scan, 64 * 1024 * 1024, 1);
+    delete scan;
+}
+
+TEST_F(WeldTest, manyPartitions) {
+    // the small budget spreads the corners over many partitions
+    Mesh *scan = generateScan(80, 80, 0.01f, HAS_NORMALS | HAS_UV0, 2);
+    expectSameAsInMemory(scan, kMinWeldMemory, 1);
+    expectSameAsInMemory(scan, 4 * kMinWeldMemory, 4);
+    delete scan;
+}
+
+TEST_F(WeldTest, openFileLimit) {
+    // about 50 partitions for the smallest budget, three files each
+    Mesh *scan = generateScan(80, 80, 0.01f, HAS_NORMALS | HAS_UV0, 2);
+    struct rlimit limit;
+    ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &limit));
+    struct rlimit lowered = limit;
+    lowered.rlim_cur = 64;
+    ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &lowered));
+    writeCorners(scan);
+    const bool tooManyFiles = weldFile(TEST_WELD_CORNER_FILE, scan->vertexSize,
+                                       TEST_WELD_VERTEX_FILE, TEST_WELD_INDEX_FILE,
+                                       TEST_WELD_TEMP_DIR, kMinWeldMemory, 1);
+    // a larger budget needs fewer partitions
+    expectSameAsInMemory(scan, 4 * kMinWeldMemory, 1);
+    ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &limit));
+    EXPECT_FALSE(tooManyFiles);
+    delete scan;
+}
+
+TEST_F(WeldTest, invalidInput) {
+    EXPECT_FALSE(weldFile("does_not_exist", 3, TEST_WELD_VERTEX_FILE, TEST_WELD_INDEX_FILE,
+                          TEST_WELD_TEMP_DIR, kMinWeldMemory));
+
+    // no whole number of vertices
+    std::ofstream out(TEST_WELD_CORNER_FILE, std::ios::trunc | std::ios::binary);
+    const float values[] = {1.0f, 2.0f, 3.0f, 4.0f};
+    out.write((char*) values, sizeof(values));
+    out.close();
+    EXPECT_FALSE(weldFile(TEST_WELD_CORNER_FILE, 3, TEST_WELD_VERTEX_FILE, TEST_WELD_INDEX_FILE,
+                          TEST_WELD_TEMP_DIR, kMinWeldMemory));
+    EXPECT_FALSE(weldFile(TEST_WELD_CORNER_FILE, 2, TEST_WELD_VERTEX_FILE, TEST_WELD_INDEX_FILE,
+                          TEST_WELD_TEMP_DIR, kMinWeldMemory - 1));
+    EXPECT_TRUE(weldFile(TEST_WELD_CORNER_FILE, 2, TEST_WELD_VERTEX_FILE, TEST_WELD_INDEX_FILE,
+                         TEST_WELD_TEMP_DIR, kMinWeldMemory));
+    EXPECT_EQ(2u, readArray<uint32_t>(TEST_WELD_INDEX_FILE).size());
+
+    // an empty file gives empty results
+    out.open(TEST_WELD_CORNER_FILE, std::ios::trunc | std::ios::binary);
+    out.close();
+    uint64_t numVertices = 1;
+    EXPECT_TRUE(weldFile(TEST_WELD_CORNER_FILE, 3, TEST_WELD_VERTEX_FILE, TEST_WELD_INDEX_FILE,
+                         TEST_WELD_TEMP_DIR, kMinWeldMemory, 0, &numVertices));
+    EXPECT_EQ(0u, numVertices);
+    EXPECT_TRUE(readArray<uint32_t>(TEST_WELD_INDEX_FILE).empty());
+}
+
+// moves every corner of a scan by up to noise, as if exporters wrote the
+// shared vertices with different rounding
+static void addNoise(Mesh *mesh, float noise) {
+    uint32_t state = 7;
+    for (unsigned int i = 0; i < mesh->numVertices * mesh->vertexSize; i++) {
+        state = state * 1664525u + 1013904223u;
+        mesh->vertices[i] += noise * ((state >> 8) / 16777216.0f * 2.0f - 1.0f);
+    }
+}
+
+static unsigned int countOptimizedVertices(const Mesh *mesh) {
+    Mesh *optimized = createOptimizedMesh(mesh);
+    const unsigned int count = optimized->numVertices;
+    delete optimized;
+    return count;
+}
+
+TEST(ToleranceWeldTest, mergesNoise) {
+    const WeldTolerance tolerance = {1e-4f, 1.0f, 1e-4f};
+    Mesh *scan = generateScan(30, 30, 0.01f, HAS_NORMALS | HAS_UV0, 3);
+    EXPECT_EQ(900u, countOptimizedVertices(scan));
+    addNoise(scan, 1e-6f);
+    EXPECT_EQ(scan->numVertices, countOptimizedVertices(scan));
+
+    Mesh *copy = generateScan(30, 30, 0.01f, HAS_NORMALS | HAS_UV0, 3);
+    addNoise(copy, 1e-6f);
+    const size_t merged = weldVertices(scan, tolerance, 1);
+    EXPECT_EQ(scan->numVertices - 900u, merged);
+    EXPECT_EQ(900u, countOptimizedVertices(scan));
+
+    // the result does not depend on the threads
+    EXPECT_EQ(merged, weldVertices(copy, tolerance, 4));
+    EXPECT_EQ(0, memcmp(scan->vertices, copy->vertices,
+                        scan->numVertices * scan->vertexSize * sizeof(float)));
+    delete scan;
+    delete copy;
+}
+
+TEST(ToleranceWeldTest, keepsVerticesApart) {
+    const WeldTolerance tolerance = {0.01f, 10.0f, 0.01f};
+    Mesh *mesh = createTestMesh(6, 0.0f, HAS_POSITIONS | HAS_NORMALS | HAS_UV0 | HAS_COLOR0);
+    const float vertices[6][12] = {
+        {0, 0, 0,      0, 1, 0,     0, 0,      1, 1, 1, 1},
+        // within every tolerance of the first
+        {0.005f, 0, 0, 0.1f, 1, 0,  0.005f, 0, 1, 1, 1, 1},
+        // too far
+        {0.02f, 0, 0,  0, 1, 0,     0, 0,      1, 1, 1, 1},
+        // normal turned by 45 degrees
+        {0, 0, 0,      1, 1, 0,     0, 0,      1, 1, 1, 1},
+        // other uv
+        {0, 0, 0,      0, 1, 0,     0.5f, 0,   1, 1, 1, 1},
+        // other color
+        {0, 0, 0,      0, 1, 0,     0, 0,      1, 0, 1, 1},
+    };
+    memcpy(mesh->vertices, vertices, sizeof(vertices));
+    EXPECT_EQ(1u, weldVertices(mesh, tolerance));
+    EXPECT_EQ(0, memcmp(mesh->vertices, mesh->vertices + 12, 12 * sizeof(float)));
+    EXPECT_EQ(0.02f, mesh->vertices[2 * 12]);
+    EXPECT_EQ(5u, countOptimizedVertices(mesh));
+
+    // without tolerances only equal vertices are merged
+    const WeldTolerance exact = {0.0f, 0.0f, 0.0f};
+    memcpy(mesh->vertices, vertices, sizeof(vertices));
+    memcpy(mesh->vertices + 12, vertices[0], 12 * sizeof(float));
+    EXPECT_EQ(1u, weldVertices(mesh, exact));
+    delete mesh;
+}
+
+TEST(ToleranceWeldTest, chainsDoNotGrow) {
+    // every vertex is within tolerance of its neighbors, but a vertex only
+    // becomes a copy of one that kept its own values
+    const WeldTolerance tolerance = {1.5f, 180.0f, 0.0f};
+    Mesh *mesh = createTestMesh(5, 0.0f, HAS_POSITIONS);
+    for (unsigned int i = 0; i < 15; i++) {
+        mesh->vertices[i] = i % 3 == 0 ? (float) (i / 3) : 0.0f;
+    }
+    EXPECT_EQ(2u, weldVertices(mesh, tolerance));
+    const float expected[] = {0, 0, 0,  0, 0, 0,  2, 0, 0,  2, 0, 0,  4, 0, 0};
+    EXPECT_EQ(0, memcmp(expected, mesh->vertices, sizeof(expected)));
+    delete mesh;
+}
+
+TEST(ToleranceWeldTest, denseCells) {
+    // every vertex is within tolerance of every earlier one, the search of a
+    // vertex stops at the first one
+    const WeldTolerance tolerance = {1.0f, 180.0f, 1.0f};
+    Mesh *mesh = createTestMesh(50000, 0.0f, HAS_POSITIONS);
+    for (unsigned int i = 0; i < mesh->numVertices * 3; i++) {
+        mesh->vertices[i] = (i % 3) * 1e-3f + (i / 3) * 1e-8f;
+    }
+    EXPECT_EQ(mesh->numVertices - 1, weldVertices(mesh, tolerance, 2));
+    EXPECT_EQ(1u, countOptimizedVertices(mesh));
+    delete mesh;
+}
+
+TEST(ToleranceWeldTest, nonFinitePositions) {
+    const WeldTolerance tolerance = {1e-30f, 180.0f, 0.0f};
+    Mesh *mesh = createTestMesh(8, 0.0f, HAS_POSITIONS);
+    const float inf = INFINITY;
+    const float positions[8][3] = {
+        {NAN, 0, 0}, {inf, -inf, 0}, {3e38f, -3e38f, 1}, {0, 0, 0},
+        {NAN, 0, 0}, {inf, -inf, 0}, {3e38f, -3e38f, 1}, {0, 0, 1e-31f},
+    };
+    memcpy(mesh->vertices, positions, sizeof(positions));
+    // the same bits are merged, the last vertex is within tolerance
+    EXPECT_EQ(4u, weldVertices(mesh, tolerance));
+    EXPECT_EQ(0, memcmp(mesh->vertices, mesh->vertices + 12, 12 * sizeof(float)));
+    delete mesh;
+}
@@ -19,6 +19,13 @@
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include "internal/rcm_internal.h"
+#include "rcmgenerator.h"
+#include "rcmreader.h"
+#include "test_mesh.h"
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <sstream>
 #include <unistd.h>
 
 #define TEST_MODEL "suzanne.obj"
@@ -27,6 +34,10 @@
 #define TEST_OBJECT_HEADER_FILE "/tmp/123456oh"
 #define TEST_ARRAYS_DATA_FILE "/tmp/123456arrays"
 #define TEST_STRUCTS_DATA_FILE "/tmp/123456structs"
+#define TEST_STREAM_MODEL_FILE "/tmp/123456stream.obj"
+#define TEST_STREAM_FILE "/tmp/123456stream"
+#define TEST_STREAM_REFERENCE_FILE "/tmp/123456streamref"
+#define TEST_LARGE_MESH_FILE "/tmp/123456large"
 
 
 class WriterTest : public ::testing::Test {
@@ -414,3 +425,433 @@ TEST_F(WriterTest, writeStructOfArraysData) {
 
 // TODO: write code to check unoptimized write cases
 
+
+TEST(SkinTest, convertAiBones) {
+    aiMesh *aimesh = new aiMesh();
+    aimesh->mNumVertices = 3;
+    aimesh->mVertices = new aiVector3D[3];
+    aimesh->mNumFaces = 1;
+    aimesh->mFaces = new aiFace[1];
+    aimesh->mFaces[0].mNumIndices = 3;
+    aimesh->mFaces[0].mIndices = new unsigned int[3];
+    for (unsigned int i = 0; i < 3; i++) {
+        aimesh->mVertices[i].x = aimesh->mVertices[i].y = aimesh->mVertices[i].z = (float) i;
+        aimesh->mFaces[0].mIndices[i] = i;
+    }
+    // vertex 0 is influenced by all six bones, vertex 1 by bone 5 only and
+    // vertex 2 by none
+    const float weights[] = {0.05f, 0.3f, 0.1f, 0.2f, 0.25f, 0.1f};
+    aimesh->mNumBones = 6;
+    aimesh->mBones = new aiBone*[6];
+    for (unsigned int b = 0; b < 6; b++) {
+        aiBone *bone = new aiBone();
+        bone->mName.Set(b == 5 ? "hand" : "bone");
+        bone->mNumWeights = b == 5 ? 2 : 1;
+        bone->mWeights = new aiVertexWeight[bone->mNumWeights];
+        bone->mWeights[0].mVertexId = 0;
+        bone->mWeights[0].mWeight = weights[b];
+        if (b == 5) {
+            bone->mWeights[1].mVertexId = 1;
+            bone->mWeights[1].mWeight = 0.5f;
+            bone->mOffsetMatrix.a4 = 2.0f;
+        }
+        aimesh->mBones[b] = bone;
+    }
+
+    Mesh *mesh = convertAiMesh(aimesh);
+    ASSERT_NE((Mesh*) 0, mesh);
+    EXPECT_TRUE(hasBones(mesh->flags));
+    EXPECT_EQ(3u, mesh->vertexSize);
+    ASSERT_EQ(6u, mesh->numBones);
+    EXPECT_EQ(hashName("hand", 4), mesh->bones[5].nameHash);
+    // translation ends up in the last column
+    EXPECT_EQ(2.0f, mesh->bones[5].inverseBindMatrix[12]);
+
+    // the four largest influences, sorted and normalized
+    EXPECT_EQ(1, mesh->boneIndices[0]);
+    EXPECT_EQ(4, mesh->boneIndices[1]);
+    EXPECT_EQ(3, mesh->boneIndices[2]);
+    EXPECT_FLOAT_EQ(0.3f / 0.85f, mesh->boneWeights[0]);
+    EXPECT_FLOAT_EQ(0.25f / 0.85f, mesh->boneWeights[1]);
+    EXPECT_FLOAT_EQ(0.2f / 0.85f, mesh->boneWeights[2]);
+    EXPECT_FLOAT_EQ(0.1f / 0.85f, mesh->boneWeights[3]);
+
+    EXPECT_EQ(5, mesh->boneIndices[4]);
+    EXPECT_FLOAT_EQ(1.0f, mesh->boneWeights[4]);
+    EXPECT_FLOAT_EQ(0.0f, mesh->boneWeights[5]);
+    EXPECT_EQ(0, mesh->boneIndices[8]);
+    EXPECT_FLOAT_EQ(1.0f, mesh->boneWeights[8]);
+
+    delete mesh;
+    delete aimesh;
+}
+
+TEST(MorphTest, convertAiAnimMeshes) {
+    aiMesh *aimesh = new aiMesh();
+    aimesh->mNumVertices = 3;
+    aimesh->mVertices = new aiVector3D[3];
+    aimesh->mNumFaces = 1;
+    aimesh->mFaces = new aiFace[1];
+    aimesh->mFaces[0].mNumIndices = 3;
+    aimesh->mFaces[0].mIndices = new unsigned int[3];
+    for (unsigned int i = 0; i < 3; i++) {
+        aimesh->mVertices[i].x = aimesh->mVertices[i].y = aimesh->mVertices[i].z = (float) i;
+        aimesh->mFaces[0].mIndices[i] = i;
+    }
+    // the first target raises vertex 1, the second one has the wrong size
+    aimesh->mNumAnimMeshes = 2;
+    aimesh->mAnimMeshes = new aiAnimMesh*[2];
+    for (unsigned int t = 0; t < 2; t++) {
+        aiAnimMesh *animMesh = new aiAnimMesh();
+        animMesh->mName.Set(t == 0 ? "smile" : "broken");
+        animMesh->mNumVertices = t == 0 ? 3 : 2;
+        animMesh->mVertices = new aiVector3D[animMesh->mNumVertices];
+        for (unsigned int i = 0; i < animMesh->mNumVertices; i++) {
+            animMesh->mVertices[i] = aimesh->mVertices[i];
+        }
+        aimesh->mAnimMeshes[t] = animMesh;
+    }
+    aimesh->mAnimMeshes[0]->mVertices[1].y += 0.5f;
+
+    Mesh *mesh = convertAiMesh(aimesh);
+    ASSERT_NE((Mesh*) 0, mesh);
+    ASSERT_EQ(1u, mesh->numMorphTargets);
+    const MorphTarget &target = mesh->morphTargets[0];
+    EXPECT_EQ(hashName("smile", 5), target.nameHash);
+    EXPECT_EQ((float*) 0, target.normalDeltas);
+    for (unsigned int i = 0; i < 9; i++) {
+        EXPECT_FLOAT_EQ(i == 4 ? 0.5f : 0.0f, target.positionDeltas[i]);
+    }
+    delete mesh;
+    delete aimesh;
+}
+
+TEST(BoundsTest, calcBounds) {
+    // positions only, so the last position ends the vertex buffer
+    Mesh *mesh = createTestMesh(4, 0.0f, HAS_POSITIONS);
+    const float positions[] = {1, -2, 3, -4, 5, 0, 2, 2, 2, 0, 0, -1};
+    memcpy(mesh->vertices, positions, sizeof(positions));
+    ObjectHeader header;
+    memset(&header, 0xff, sizeof(header));
+    calcBounds(mesh, &header);
+    EXPECT_EQ(-4.0f, header.boundsMin[0]);
+    EXPECT_EQ(-2.0f, header.boundsMin[1]);
+    EXPECT_EQ(-1.0f, header.boundsMin[2]);
+    EXPECT_EQ(2.0f, header.boundsMax[0]);
+    EXPECT_EQ(5.0f, header.boundsMax[1]);
+    EXPECT_EQ(3.0f, header.boundsMax[2]);
+    EXPECT_EQ(-1.0f, header.sphereCenter[0]);
+    EXPECT_EQ(1.5f, header.sphereCenter[1]);
+    EXPECT_EQ(1.0f, header.sphereCenter[2]);
+    // (-4, 5, 0) is the farthest from the center
+    EXPECT_FLOAT_EQ(sqrtf(9.0f + 12.25f + 1.0f), header.sphereRadius);
+
+    mesh->flags = HAS_NORMALS;
+    calcBounds(mesh, &header);
+    EXPECT_EQ(0.0f, header.boundsMax[0]);
+    EXPECT_EQ(0.0f, header.sphereRadius);
+    delete mesh;
+}
+
+TEST(WriteErrorTest, failedMeshFailsFile) {
+    std::vector<Mesh*> meshes;
+    meshes.push_back(createTestMesh(3, 0.0f));
+    // a skin flag without skin data can not be written
+    meshes.push_back(createTestMesh(3, 10.0f, HAS_POSITIONS | HAS_BONES));
+    EXPECT_FALSE(writeFile(TEST_STRUCTS_DATA_FILE, &meshes, false, false));
+    EXPECT_FALSE(writeSharedBuffersFile(TEST_STRUCTS_DATA_FILE, &meshes, false, false));
+    Scene scene;
+    scene.meshes = meshes;
+    EXPECT_FALSE(writeSceneFile(TEST_STRUCTS_DATA_FILE, &scene, false, false));
+    unlink(TEST_STRUCTS_DATA_FILE);
+}
+
+TEST(WriteErrorTest, tooManyObjects) {
+    // a model and a BVH each, the object count of the file header would wrap
+    std::vector<Mesh*> meshes;
+    for (unsigned int i = 0; i < 128; i++) {
+        meshes.push_back(createTestMesh(3, i * 100.0f));
+        meshes.back()->storeBvh = true;
+    }
+    EXPECT_FALSE(writeFile(TEST_STRUCTS_DATA_FILE, &meshes, false, false));
+    delete meshes.back();
+    meshes.pop_back();
+    EXPECT_TRUE(writeFile(TEST_STRUCTS_DATA_FILE, &meshes, false, false));
+    for (size_t i = 0; i < meshes.size(); i++) {
+        delete meshes[i];
+    }
+    unlink(TEST_STRUCTS_DATA_FILE);
+}
+
+static std::string readFileContent(const char *path) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+static void storeBvh(Mesh *mesh, void *calls) {
+    mesh->storeBvh = true;
+    (*(unsigned int*) calls)++;
+}
+
+TEST(StreamTest, streamModel) {
+    // a quad and a triangle, each its own mesh
+    std::ofstream model(TEST_STREAM_MODEL_FILE);
+    model << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 0 0 1\nv 1 0 1\nv 0 1 1\n";
+    model << "o quad\nf 1 2 3 4\no triangle\nf 5 6 7\n";
+    model.close();
+
+    for (unsigned int arrays = 0; arrays < 2; arrays++) {
+        std::vector<Mesh*> *meshes = loadModel(TEST_STREAM_MODEL_FILE);
+        ASSERT_TRUE(meshes != 0);
+        ASSERT_EQ(2u, meshes->size());
+        ASSERT_TRUE(writeFile(TEST_STREAM_REFERENCE_FILE, meshes, true, arrays == 1));
+        for (size_t i = 0; i < meshes->size(); i++) {
+            delete meshes->at(i);
+        }
+        delete meshes;
+        ASSERT_TRUE(streamModel(TEST_STREAM_MODEL_FILE, TEST_STREAM_FILE, true, arrays == 1));
+        EXPECT_EQ(readFileContent(TEST_STREAM_REFERENCE_FILE), readFileContent(TEST_STREAM_FILE));
+    }
+
+    // the object count includes the BVHs added on the way
+    unsigned int calls = 0;
+    ASSERT_TRUE(streamModel(TEST_STREAM_MODEL_FILE, TEST_STREAM_FILE, true, false,
+                            storeBvh, &calls));
+    EXPECT_EQ(2u, calls);
+    const std::string file = readFileContent(TEST_STREAM_FILE);
+    MemoryStream stream(file.data(), file.size());
+    FileHeader fileHeader;
+    ASSERT_TRUE(readFileHeader(stream, &fileHeader));
+    EXPECT_EQ(4, fileHeader.objectCount);
+    ObjectHeader objHeader;
+    for (unsigned int i = 0; i < 4; i++) {
+        ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+        EXPECT_EQ(i % 2 == 0 ? ARRAY_OF_STRUCTS : BVH, objHeader.type);
+        ASSERT_TRUE(skipObject(stream, &objHeader));
+    }
+    EXPECT_EQ(file.size(), stream.position);
+
+    EXPECT_FALSE(streamModel(TEST_MODEL_INVALID, TEST_STREAM_FILE));
+    unlink(TEST_STREAM_MODEL_FILE);
+    unlink(TEST_STREAM_FILE);
+    unlink(TEST_STREAM_REFERENCE_FILE);
+}
+
+// meshes large enough to be converted, transposed and merged on several
+// threads give the same result as a single thread
+
+// 200000 vertices whose faces run backwards through them, skinned and with
+// one morph target, to see that the 32 bit face indices of assimp survive
+static aiMesh* createLargeAiMesh() {
+    const unsigned int numVertices = 200000;
+    aiMesh *aimesh = new aiMesh();
+    aimesh->mNumVertices = numVertices;
+    aimesh->mVertices = new aiVector3D[numVertices];
+    aimesh->mNormals = new aiVector3D[numVertices];
+    aimesh->mNumFaces = numVertices / 3;
+    aimesh->mFaces = new aiFace[aimesh->mNumFaces];
+    for (unsigned int i = 0; i < numVertices; i++) {
+        aimesh->mVertices[i] = aiVector3D((float) i, 1.0f, -(float) i);
+        aimesh->mNormals[i] = aiVector3D(0.0f, (float) i, 0.0f);
+    }
+    for (unsigned int f = 0; f < aimesh->mNumFaces; f++) {
+        aimesh->mFaces[f].mNumIndices = 3;
+        aimesh->mFaces[f].mIndices = new unsigned int[3];
+        for (unsigned int k = 0; k < 3; k++) {
+            aimesh->mFaces[f].mIndices[k] = numVertices - 1 - (f * 3 + k);
+        }
+    }
+    // the bone moves the first vertex only, the target raises the last one
+    aimesh->mNumBones = 2;
+    aimesh->mBones = new aiBone*[2];
+    for (unsigned int b = 0; b < 2; b++) {
+        aiBone *bone = new aiBone();
+        bone->mName.Set(b == 0 ? "root" : "tip");
+        bone->mNumWeights = b;
+        bone->mWeights = new aiVertexWeight[1];
+        bone->mWeights[0].mVertexId = 0;
+        bone->mWeights[0].mWeight = 1.0f;
+        aimesh->mBones[b] = bone;
+    }
+    aimesh->mNumAnimMeshes = 1;
+    aimesh->mAnimMeshes = new aiAnimMesh*[1];
+    aiAnimMesh *animMesh = new aiAnimMesh();
+    animMesh->mName.Set("raise");
+    animMesh->mNumVertices = numVertices;
+    animMesh->mVertices = new aiVector3D[numVertices];
+    std::copy(aimesh->mVertices, aimesh->mVertices + numVertices, animMesh->mVertices);
+    animMesh->mVertices[numVertices - 1].y += 0.5f;
+    aimesh->mAnimMeshes[0] = animMesh;
+    return aimesh;
+}
+
+TEST(LargeMeshTest, convertAiMesh) {
+    aiMesh *aimesh = createLargeAiMesh();
+    const unsigned int numCorners = aimesh->mNumFaces * 3;
+    Mesh *mesh = convertAiMesh(aimesh);
+    ASSERT_NE((Mesh*) 0, mesh);
+    ASSERT_EQ(6u, mesh->vertexSize);
+    // too many vertices for 16 bit indices, so a list of corners
+    ASSERT_EQ(0u, mesh->numIndices);
+    ASSERT_EQ(numCorners, mesh->numVertices);
+    ASSERT_EQ(1u, mesh->numMorphTargets);
+    for (unsigned int i = 0; i < numCorners; i++) {
+        const unsigned int v = aimesh->mNumVertices - 1 - i;
+        const float expected[] = {(float) v, 1.0f, -(float) v, 0.0f, (float) v, 0.0f};
+        ASSERT_EQ(0, memcmp(expected, mesh->vertices + i * 6, sizeof(expected)));
+        ASSERT_EQ(v == 0 ? 1 : 0, mesh->boneIndices[i * kMaxBoneInfluences]);
+        ASSERT_EQ(1.0f, mesh->boneWeights[i * kMaxBoneInfluences]);
+        ASSERT_EQ(i == 0 ? 0.5f : 0.0f, mesh->morphTargets[0].positionDeltas[i * 3 + 1]);
+    }
+    delete mesh;
+    delete aimesh;
+}
+
+TEST(LargeMeshTest, writeCorners) {
+    aiMesh *aimesh = createLargeAiMesh();
+    std::vector<Mesh*> meshes(1, convertAiMesh(aimesh));
+    ASSERT_NE((Mesh*) 0, meshes[0]);
+    // every vertex is distinct, so optimizing can not index the corners.
+    // That is expected and no error.
+    std::stringstream errors;
+    std::streambuf *cerrBuffer = std::cerr.rdbuf(errors.rdbuf());
+    const bool written = writeFile(TEST_LARGE_MESH_FILE, &meshes, true, true);
+    std::cerr.rdbuf(cerrBuffer);
+    ASSERT_TRUE(written);
+    EXPECT_EQ("", errors.str());
+    const std::string file = readFileContent(TEST_LARGE_MESH_FILE);
+    unlink(TEST_LARGE_MESH_FILE);
+
+    MemoryStream stream(file.data(), file.size());
+    FileHeader fileHeader;
+    ASSERT_TRUE(readFileHeader(stream, &fileHeader));
+    ObjectHeader objHeader;
+    ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+    EXPECT_EQ(0u, objHeader.indexCount);
+    ASSERT_EQ(aimesh->mNumFaces * 3, objHeader.vertexCount);
+    ObjectView view;
+    ASSERT_TRUE(readObjectView(stream, &objHeader, &view));
+    for (unsigned int i = 0; i < objHeader.vertexCount; i++) {
+        const aiVector3D &expected = aimesh->mVertices[aimesh->mNumVertices - 1 - i];
+        const float *position = view.vertices[POSITION_ARRAY] + i * 3;
+        ASSERT_EQ(expected.x, position[0]);
+        ASSERT_EQ(expected.y, position[1]);
+        ASSERT_EQ(expected.z, position[2]);
+    }
+    delete[] (char*) view.allocation;
+    delete meshes[0];
+    delete aimesh;
+}
+
+TEST(LargeMeshTest, createOptimizedMesh) {
+    // 62500 vertices shared by six corners each
+    Mesh *scan = generateScan(250, 250, 0.01f, HAS_NORMALS | HAS_UV0, 5);
+    Mesh *optimized = createOptimizedMesh(scan);
+    ASSERT_NE((Mesh*) 0, optimized);
+    EXPECT_EQ(250u * 250u, optimized->numVertices);
+    ASSERT_EQ(scan->numVertices, optimized->numIndices);
+    const size_t vertexSize = scan->vertexSize;
+    unsigned int nextIndex = 0;
+    for (unsigned int i = 0; i < optimized->numIndices; i++) {
+        const unsigned int index = optimized->indices[i];
+        // numbered in the order of the first corner, like the map did
+        ASSERT_LE(index, nextIndex);
+        if (index == nextIndex) {
+            nextIndex++;
+        }
+        ASSERT_EQ(0, memcmp(scan->vertices + i * vertexSize,
+                            optimized->vertices + index * vertexSize,
+                            vertexSize * sizeof(float)));
+    }
+    delete optimized;
+
+    // the same vertices from optimizeArrayOfStructs()
+    std::vector<unsigned short> indices;
+    std::vector<Vertex<float> > vertices;
+    ASSERT_TRUE(optimizeArrayOfStructs(scan->vertices, vertexSize, scan->numVertices,
+                                       indices, vertices));
+    EXPECT_EQ(250u * 250u, vertices.size());
+    ASSERT_EQ(scan->numVertices, indices.size());
+    for (unsigned int i = 0; i < indices.size(); i++) {
+        ASSERT_EQ(0, memcmp(scan->vertices + i * vertexSize, vertices[indices[i]].array,
+                            vertexSize * sizeof(float)));
+    }
+    delete scan;
+
+    // one vertex too many for 16 bit indices
+    Mesh *tooLarge = generateScan(257, 256, 0.01f, 0, 5);
+    EXPECT_EQ((Mesh*) 0, createOptimizedMesh(tooLarge));
+    indices.clear();
+    vertices.clear();
+    EXPECT_FALSE(optimizeArrayOfStructs(tooLarge->vertices, tooLarge->vertexSize,
+                                        tooLarge->numVertices, indices, vertices));
+    delete tooLarge;
+}
+
+TEST(LargeMeshTest, writeTooLargeMeshes) {
+    // a list of corners that can not be indexed and a small indexed mesh with
+    // the same vertex flags
+    std::vector<Mesh*> meshes;
+    meshes.push_back(generateScan(257, 256, 0.01f, 0, 5));
+    meshes.push_back(createTestMesh(12, 0.0f, meshes[0]->flags));
+    ASSERT_TRUE(writeSharedBuffersFile(TEST_LARGE_MESH_FILE, &meshes, true, false));
+    const std::string file = readFileContent(TEST_LARGE_MESH_FILE);
+    MemoryStream stream(file.data(), file.size());
+    FileHeader fileHeader;
+    ASSERT_TRUE(readFileHeader(stream, &fileHeader));
+    // the corners keep buffers of their own
+    EXPECT_EQ(4, fileHeader.objectCount);
+    ObjectHeader objHeader;
+    ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+    EXPECT_EQ(meshes[0]->numVertices, objHeader.vertexCount);
+    EXPECT_EQ(0u, objHeader.indexCount);
+    ASSERT_TRUE(skipObject(stream, &objHeader));
+    ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+    ASSERT_TRUE(skipObject(stream, &objHeader));
+    ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+    EXPECT_EQ(12u, objHeader.indexCount);
+
+    // indices can not address every vertex of an indexed mesh that large
+    Mesh *mesh = meshes[0];
+    mesh->numIndices = 3;
+    mesh->indices = new unsigned short[3];
+    for (unsigned short i = 0; i < 3; i++) {
+        mesh->indices[i] = i;
+    }
+    std::vector<Mesh*> large(1, mesh);
+    EXPECT_FALSE(writeFile(TEST_LARGE_MESH_FILE, &large, false, false));
+    EXPECT_FALSE(writeSharedBuffersFile(TEST_LARGE_MESH_FILE, &large, false, false));
+    unlink(TEST_LARGE_MESH_FILE);
+    delete meshes[0];
+    delete meshes[1];
+}
+
+TEST(LargeMeshTest, writeStructOfArrays) {
+    Mesh *scan = generateScan(200, 200, 0.01f, HAS_NORMALS | HAS_UV0, 5);
+    std::vector<Mesh*> meshes(1, scan);
+    ASSERT_TRUE(writeFile(TEST_LARGE_MESH_FILE, &meshes, false, true));
+    const std::string file = readFileContent(TEST_LARGE_MESH_FILE);
+    unlink(TEST_LARGE_MESH_FILE);
+
+    MemoryStream stream(file.data(), file.size());
+    FileHeader fileHeader;
+    ASSERT_TRUE(readFileHeader(stream, &fileHeader));
+    ObjectHeader objHeader;
+    ASSERT_TRUE(readObjectHeader(stream, &objHeader));
+    ObjectView view;
+    ASSERT_TRUE(readObjectView(stream, &objHeader, &view));
+    const unsigned int arrays[] = {POSITION_ARRAY, NORMALS_ARRAY, UV0_ARRAY};
+    const unsigned int sizes[] = {3, 3, 2};
+    for (unsigned int i = 0; i < scan->numVertices; i++) {
+        const float *vertex = scan->vertices + i * scan->vertexSize;
+        for (unsigned int a = 0; a < 3; a++) {
+            ASSERT_EQ(0, memcmp(vertex, view.vertices[arrays[a]] + i * sizes[a],
+                                sizes[a] * sizeof(float)));
+            vertex += sizes[a];
+        }
+    }
+    delete[] (char*) view.allocation;
+    delete scan;
+}
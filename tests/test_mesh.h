@@ -0,0 +1,44 @@
+/* tests/test_mesh.h
+ *
+ * Copyright 2014,2015 Andreas Seuss
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * */
+
+#ifndef TEST_MESH_H
+#define TEST_MESH_H
+
+#include "rcm.h"
+#include "rcmwriter.h"
+
+// creates an unindexed mesh with distinct vertices, so no vertex gets merged
+// when optimizing. Every float gets a unique value starting at seed.
+inline Mesh* createTestMesh(unsigned int numVertices, float seed,
+        unsigned short flags = HAS_POSITIONS | HAS_NORMALS | HAS_UV0) {
+    Mesh *mesh = new Mesh();
+    mesh->flags = flags;
+    mesh->vertexSize = calcVertexSize(mesh->flags);
+    mesh->numVertices = numVertices;
+    mesh->numIndices = numVertices;
+    mesh->vertices = new float[numVertices * mesh->vertexSize];
+    mesh->indices = new unsigned short[numVertices];
+    for (unsigned int i = 0; i < numVertices * mesh->vertexSize; i++) {
+        mesh->vertices[i] = seed + i;
+    }
+    for (unsigned int i = 0; i < numVertices; i++) {
+        mesh->indices[i] = i;
+    }
+    return mesh;
+}
+
+#endif // TEST_MESH_H